@@ -0,0 +1,303 @@
+#include "bench_harness.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include "hal.h"
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#else
+#include <pthread.h>
+#endif
+
+struct BenchCase {
+  const char* name;
+  BenchFn fn;
+  BenchFn setup;
+  void* ctx;
+};
+
+static BenchCase cases[BENCH_MAX_CASES];
+static int caseCount = 0;
+
+// ============================================================================
+// ALLOCATION COUNTING (-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free)
+// ============================================================================
+//
+// Only objects linked with the wrap flags are counted (the firmware sources,
+// ArduinoJson); allocations inside prebuilt core libraries are not.
+
+static volatile bool allocCounting = false;
+static volatile uint32_t allocCount = 0;
+static volatile uint32_t allocBytes = 0;
+
+#ifdef ARDUINO
+static TaskHandle_t benchTask = NULL;
+static bool onBenchStack() {
+  return xTaskGetCurrentTaskHandle() == benchTask;
+}
+#else
+static pthread_t benchThread;
+static bool onBenchStack() {
+  return pthread_equal(pthread_self(), benchThread) != 0;
+}
+#endif
+
+static inline void countAlloc(size_t size) {
+  if (allocCounting && onBenchStack()) {
+    allocCount++;
+    allocBytes += size;
+  }
+}
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+  countAlloc(size);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  countAlloc(count * size);
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  countAlloc(size);
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+  __real_free(ptr);
+}
+}
+
+// new/delete go through the wrapped malloc so String and `new` are counted too
+void* operator new(size_t size) {
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
+
+// ============================================================================
+// MEASUREMENT (runs on the benchmark stack)
+// ============================================================================
+
+struct BenchJob {
+  const BenchCase* benchCase;
+  BenchResult* result;
+};
+
+static uint32_t runIterations(const BenchCase& c, uint32_t iterations) {
+  uint32_t start = halCycleCount();
+  for (uint32_t i = 0; i < iterations; i++) {
+    c.fn(c.ctx);
+  }
+  return halCycleCount() - start;
+}
+
+static int compareFloat(const void* a, const void* b) {
+  float fa = *(const float*)a;
+  float fb = *(const float*)b;
+  return (fa > fb) - (fa < fb);
+}
+
+static void measure(BenchJob* job) {
+  const BenchCase& c = *job->benchCase;
+  BenchResult& r = *job->result;
+
+  if (c.setup) {
+    c.setup(c.ctx);
+  }
+
+  // Scale up until one repetition takes at least BENCH_MIN_TIME_MS
+  uint32_t minCycles = (uint32_t)BENCH_MIN_TIME_MS * 1000 * halCpuFrequencyMhz();
+  uint32_t iterations = 1;
+  while (true) {
+    uint32_t cycles = runIterations(c, iterations);
+    if (cycles >= minCycles || iterations >= (1u << 24)) break;
+    uint32_t next = cycles > 0 ? (uint32_t)((uint64_t)iterations * minCycles * 12 / 10 / cycles) : iterations * 10;
+    if (next <= iterations) next = iterations * 2;
+    if (next > iterations * 10) next = iterations * 10;
+    iterations = next;
+  }
+
+  float perOp[BENCH_REPETITIONS];
+  allocCount = 0;
+  allocBytes = 0;
+  allocCounting = true;
+  for (int rep = 0; rep < BENCH_REPETITIONS; rep++) {
+    perOp[rep] = (float)runIterations(c, iterations) / iterations;
+  }
+  allocCounting = false;
+
+  float sum = 0.0f;
+  for (int rep = 0; rep < BENCH_REPETITIONS; rep++) {
+    sum += perOp[rep];
+  }
+  float mean = sum / BENCH_REPETITIONS;
+  float variance = 0.0f;
+  for (int rep = 0; rep < BENCH_REPETITIONS; rep++) {
+    variance += (perOp[rep] - mean) * (perOp[rep] - mean);
+  }
+  qsort(perOp, BENCH_REPETITIONS, sizeof(float), compareFloat);
+
+  uint32_t ops = iterations * BENCH_REPETITIONS;
+  r.name = c.name;
+  r.iterations = iterations;
+  r.meanCycles = mean;
+  r.medianCycles = perOp[BENCH_REPETITIONS / 2];
+  r.stddevCycles = sqrtf(variance / (BENCH_REPETITIONS - 1));
+  r.minCycles = perOp[0];
+  r.allocsPerOp = (float)allocCount / ops;
+  r.allocBytesPerOp = (float)allocBytes / ops;
+}
+
+// ============================================================================
+// BENCHMARK STACK
+// ============================================================================
+
+#ifdef ARDUINO
+static SemaphoreHandle_t benchDone = NULL;
+
+static void benchTaskMain(void* arg) {
+  measure((BenchJob*)arg);
+  xSemaphoreGive(benchDone);
+  vTaskSuspend(NULL);
+}
+
+// Peak stack use in bytes (ESP-IDF reports the high-water mark in bytes)
+static uint32_t runOnBenchStack(BenchJob* job) {
+  if (benchDone == NULL) {
+    benchDone = xSemaphoreCreateBinary();
+  }
+  xTaskCreatePinnedToCore(benchTaskMain, "bench", BENCH_STACK_BYTES, job, 1, &benchTask, 1);
+  xSemaphoreTake(benchDone, portMAX_DELAY);
+  uint32_t used = BENCH_STACK_BYTES - uxTaskGetStackHighWaterMark(benchTask);
+  vTaskDelete(benchTask);
+  benchTask = NULL;
+  return used;
+}
+#else
+#define STACK_PAINT 0xA5
+
+static void* benchThreadMain(void* arg) {
+  measure((BenchJob*)arg);
+  return NULL;
+}
+
+// Peak stack use in bytes: the stack is painted and scanned from its low end
+static uint32_t runOnBenchStack(BenchJob* job) {
+  uint8_t* stack = (uint8_t*)malloc(BENCH_STACK_BYTES);
+  memset(stack, STACK_PAINT, BENCH_STACK_BYTES);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, stack, BENCH_STACK_BYTES);
+  // benchThread is written before the thread can allocate anything counted
+  pthread_create(&benchThread, &attr, benchThreadMain, job);
+  pthread_join(benchThread, NULL);
+  pthread_attr_destroy(&attr);
+
+  uint32_t untouched = 0;
+  while (untouched < BENCH_STACK_BYTES && stack[untouched] == STACK_PAINT) {
+    untouched++;
+  }
+  free(stack);
+  return BENCH_STACK_BYTES - untouched;
+}
+#endif
+
+static void emptyBench(void* ctx) {
+  benchDoNotOptimize(ctx);
+}
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+void benchRegister(const char* name, BenchFn fn, BenchFn setup, void* ctx) {
+  if (caseCount >= BENCH_MAX_CASES) {
+    fprintf(stderr, "bench: too many cases, dropping %s\n", name);
+    return;
+  }
+  cases[caseCount].name = name;
+  cases[caseCount].fn = fn;
+  cases[caseCount].setup = setup;
+  cases[caseCount].ctx = ctx;
+  caseCount++;
+}
+
+int benchRunAll(const char* filter, BenchResult* results, int maxResults) {
+  // Stack used by the harness itself, subtracted from every case
+  BenchCase empty = {"empty", emptyBench, NULL, NULL};
+  BenchResult emptyResult;
+  BenchJob emptyJob = {&empty, &emptyResult};
+  uint32_t baselineStack = runOnBenchStack(&emptyJob);
+
+  int count = 0;
+  for (int i = 0; i < caseCount && count < maxResults; i++) {
+    if (filter && !strstr(cases[i].name, filter)) continue;
+
+    BenchJob job = {&cases[i], &results[count]};
+    uint32_t stack = runOnBenchStack(&job);
+    results[count].stackBytes = stack > baselineStack ? stack - baselineStack : 0;
+    count++;
+  }
+  return count;
+}
+
+void benchPrintTable(const BenchResult* results, int count) {
+  float mhz = (float)halCpuFrequencyMhz();
+  printf("%-26s %10s %10s %10s %8s %10s %8s %9s %7s\n", "benchmark", "iters", "mean_cyc", "median_cyc",
+         "stddev%", "median_ns", "allocs", "alloc_B", "stack_B");
+  for (int i = 0; i < count; i++) {
+    const BenchResult& r = results[i];
+    float stddevPct = r.meanCycles > 0 ? r.stddevCycles * 100.0f / r.meanCycles : 0.0f;
+    printf("%-26s %10u %10.0f %10.0f %8.1f %10.0f %8.2f %9.1f %7u\n", r.name, (unsigned)r.iterations, r.meanCycles,
+           r.medianCycles, stddevPct, r.medianCycles * 1000.0f / mhz, r.allocsPerOp, r.allocBytesPerOp,
+           (unsigned)r.stackBytes);
+  }
+}
+
+void benchPrintCsv(const BenchResult* results, int count, void (*writeLine)(const char* line, void* ctx), void* ctx) {
+  char line[160];
+  writeLine("name,mean_cycles,median_cycles,stddev_cycles,allocs_per_op,alloc_bytes_per_op,stack_bytes", ctx);
+  for (int i = 0; i < count; i++) {
+    const BenchResult& r = results[i];
+    snprintf(line, sizeof(line), "%s,%.1f,%.1f,%.1f,%.3f,%.1f,%u", r.name, r.meanCycles, r.medianCycles,
+             r.stddevCycles, r.allocsPerOp, r.allocBytesPerOp, (unsigned)r.stackBytes);
+    writeLine(line, ctx);
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// MICRO-BENCHMARK HARNESS (host + ESP32)
+// ============================================================================
+//
+// Each case runs on its own stack (pthread with a painted stack on the host,
+// a FreeRTOS task on target). The iteration count is scaled until one
+// repetition takes BENCH_MIN_TIME_MS, then BENCH_REPETITIONS repetitions are
+// timed with halCycleCount() and summarised as mean/median/stddev/min.
+// malloc/calloc/realloc are wrapped at link time (-Wl,--wrap=...) so heap
+// allocations made by the benchmark thread are counted per operation.
+
+#ifdef ARDUINO
+#define BENCH_MIN_TIME_MS 200
+#define BENCH_STACK_BYTES 16384
+#else
+#define BENCH_MIN_TIME_MS 50
+#define BENCH_STACK_BYTES (256 * 1024)
+#endif
+#define BENCH_REPETITIONS 5
+#define BENCH_MAX_CASES 24
+
+typedef void (*BenchFn)(void* ctx);
+
+struct BenchResult {
+  const char* name;
+  uint32_t iterations;         // Per repetition
+  float meanCycles;            // Per operation
+  float medianCycles;
+  float stddevCycles;
+  float minCycles;
+  float allocsPerOp;
+  float allocBytesPerOp;
+  uint32_t stackBytes;         // Peak stack above the harness baseline
+};
+
+// setup runs once on the benchmark stack before timing (may be NULL)
+void benchRegister(const char* name, BenchFn fn, BenchFn setup, void* ctx);
+
+// Runs every registered case whose name contains filter (NULL = all)
+int benchRunAll(const char* filter, BenchResult* results, int maxResults);
+
+void benchPrintTable(const BenchResult* results, int count);
+// One "name,mean_cycles,median_cycles,stddev_cycles,allocs_per_op,alloc_bytes_per_op,stack_bytes" line per case
+void benchPrintCsv(const BenchResult* results, int count, void (*writeLine)(const char* line, void* ctx), void* ctx);
+
+// Keeps the optimiser from discarding a result
+static inline void benchDoNotOptimize(const void* value) {
+  __asm__ volatile("" : : "r"(value) : "memory");
+}
+
+#endif
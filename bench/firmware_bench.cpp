@@ -0,0 +1,505 @@
+// Firmware micro-benchmarks: cycles, heap allocations and stack per operation
+// on the hot paths (command parsing, profile tick, telemetry encoding,
+// pressure mapping, zero-cross ISR).
+//
+//   pio run -e bench && .pio/build/bench/program [options]
+//   pio run -e bench_esp32 -t upload && pio device monitor    (table + CSV on Serial)
+//
+//   --filter TEXT        only cases whose name contains TEXT
+//   --csv FILE           write results as CSV
+//   --baseline FILE      compare median cycles against an earlier --csv file
+//   --tolerance PCT      allowed slowdown before a case counts as a regression (default 15)
+//   --stress SECONDS     host only: hammer the triac control word and stats from
+//                        concurrent threads instead of running the cases
+//
+// Exit code 1 when a case regressed against the baseline, or when a case on
+// the control-tick / telemetry path allocated from the heap (host only), or
+// when the stress run saw a torn control word or stats snapshot.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ArduinoJson.h>
+
+#include "bench_harness.h"
+#include "calibration.h"
+#include "commands.h"
+#include "config.h"
+#include "hal.h"
+#include "messaging.h"
+#include "profile_engine.h"
+#include "profiles.h"
+#include "telemetry.h"
+#include "triac.h"
+
+#ifndef ARDUINO
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "hal_native.h"
+#endif
+
+// 10-segment profile, the largest a stored profile can hold
+static const char STORE_PROFILE_JSON[] =
+    "{\"command\":\"store_profile\",\"id\":9,\"profile\":{\"name\":\"bench_ten_seg\",\"segments\":["
+    "{\"startTime\":0,\"endTime\":25,\"startPressure\":2,\"endPressure\":2},"
+    "{\"startTime\":25,\"endTime\":50,\"startPressure\":2,\"endPressure\":9},"
+    "{\"startTime\":50,\"endTime\":75,\"startPressure\":9,\"endPressure\":9},"
+    "{\"startTime\":75,\"endTime\":100,\"startPressure\":9,\"endPressure\":8.5},"
+    "{\"startTime\":100,\"endTime\":125,\"startPressure\":8.5,\"endPressure\":8},"
+    "{\"startTime\":125,\"endTime\":150,\"startPressure\":8,\"endPressure\":7.5},"
+    "{\"startTime\":150,\"endTime\":175,\"startPressure\":7.5,\"endPressure\":7},"
+    "{\"startTime\":175,\"endTime\":200,\"startPressure\":7,\"endPressure\":6.5},"
+    "{\"startTime\":200,\"endTime\":225,\"startPressure\":6.5,\"endPressure\":6},"
+    "{\"startTime\":225,\"endTime\":250,\"startPressure\":6,\"endPressure\":6}]}}";
+
+static const char GET_STATUS_JSON[] = "{\"command\":\"get_status\"}";
+
+// Measured steady-state pressures of a typical vibratory pump, 0-100% in 5% steps
+static const float BENCH_CALIBRATION[CALIBRATION_POINTS] = {
+    0.0f, 0.2f, 0.5f, 0.9f, 1.4f, 2.0f, 2.7f, 3.4f, 4.1f, 4.9f, 5.6f,
+    6.3f, 7.0f, 7.6f, 8.2f, 8.8f, 9.3f, 9.8f, 10.3f, 10.7f, 11.0f};
+
+// ============================================================================
+// CASES
+// ============================================================================
+
+static void benchParseStoreProfile(void* ctx) {
+  DynamicJsonDocument doc(1024);
+  DeserializationError error = deserializeJson(doc, STORE_PROFILE_JSON);
+  benchDoNotOptimize(&error);
+}
+
+static void benchHandleStoreProfile(void* ctx) {
+  // Emptied first, so the store is never skipped as unchanged
+  storedProfiles[9].segmentCount = 0;
+  handleCommand(STORE_PROFILE_JSON);
+}
+
+// The same profile again: hashed and skipped, no NVS write
+static void benchHandleStoreProfileUnchanged(void* ctx) {
+  handleCommand(STORE_PROFILE_JSON);
+}
+
+static void benchHandleGetStatus(void* ctx) {
+  handleCommand(GET_STATUS_JSON);
+}
+
+// What the control tick builds per telemetry frame once a client is connected
+static void benchEncodeTelemetryFrame(void* ctx) {
+  static uint32_t t = 0;
+  t += 10;
+  TelemetrySample sample;
+  sample.timeMs = t;
+  sample.pressure = 8.7f;
+  sample.target = 9.0f;
+  sample.flow = 2.1f;
+  sample.dimLevel = 62;
+  sample.segment = 1;
+  sample.flowSegment = false;
+  sample.dryRun = false;
+  uint8_t frame[TELEMETRY_FRAME_LENGTH];
+  size_t length = encodeTelemetryFrame(sample, frame);
+  benchDoNotOptimize(frame);
+  benchDoNotOptimize(&length);
+}
+
+// Encode, queue and notify one frame: the whole per-tick transmit path
+static void benchTelemetrySend(void* ctx) {
+  static uint32_t t = 0;
+  t += 10;
+  TelemetrySample sample;
+  sample.timeMs = t;
+  sample.pressure = 8.7f;
+  sample.target = 9.0f;
+  sample.flow = 2.1f;
+  sample.dimLevel = 62;
+  sample.segment = 1;
+  sample.flowSegment = false;
+  sample.dryRun = false;
+  uint8_t frame[TELEMETRY_FRAME_LENGTH];
+  size_t length = encodeTelemetryFrame(sample, frame);
+  sendTelemetryFrame(frame, length);
+  pumpTransmitQueue();
+}
+
+static void startBenchProfile(void* ctx) {
+  DynamicJsonDocument doc(2048);
+  deserializeJson(doc, STORE_PROFILE_JSON);
+  startProfile(doc["profile"]);
+}
+
+static void benchExecuteProfileTick(void* ctx) {
+  if (!isRunning) {
+    startBenchProfile(ctx);
+  }
+  executeProfile();
+}
+
+static void benchPressureToDimLevel(void* ctx) {
+  static float pressure = 0.0f;
+  pressure += 0.37f;
+  if (pressure > 12.0f) pressure -= 12.0f;
+  int level = pressureToDimLevel(pressure);
+  benchDoNotOptimize(&level);
+}
+
+static void benchCalibrationFit(void* ctx) {
+  static CalibrationModel model;
+  float levels[CALIBRATION_POINTS];
+  bool valid[CALIBRATION_POINTS];
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    levels[i] = indexToDimLevel(i);
+    valid[i] = true;
+  }
+  model.fit(levels, BENCH_CALIBRATION, valid, CALIBRATION_POINTS);
+  benchDoNotOptimize(&model);
+}
+
+static void startIsrBench(void* ctx) {
+  setDimLevel(50);
+}
+
+static void benchZeroCrossIsr(void* ctx) {
+  zeroCrossISR();
+}
+
+// Gate timer for the benchmarks: armed by the ISR, never drives the pin
+static void benchTimerCallback(void* arg) {
+}
+
+static void writeCsvLine(const char* line, void* ctx) {
+  if (ctx) {
+    fprintf((FILE*)ctx, "%s\n", line);
+  } else {
+    printf("%s\n", line);
+  }
+}
+
+// ============================================================================
+// SETUP
+// ============================================================================
+
+// Firmware state without the triac drive: no ZC interrupt, the gate pin is
+// never touched and settings go to a separate storage namespace
+static void benchInit() {
+  halConsoleSetEnabled(false);
+  halStorageBegin("bench");
+  pulseTimerHandle = halTimerCreate("bench_pulse", benchTimerCallback, NULL);
+  initFiringPatterns();
+  initSubscriptions();
+  zcEnabled = false;
+
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    dimLevelToPressure[i] = BENCH_CALIBRATION[i];
+  }
+  isCalibrated = true;
+  rebuildCalibrationCurve();
+
+  benchRegister("parse_store_profile", benchParseStoreProfile, NULL, NULL);
+#ifndef ARDUINO
+  // Saves to NVS every call: host only to spare the flash
+  benchRegister("handle_store_profile", benchHandleStoreProfile, NULL, NULL);
+#endif
+  benchRegister("handle_store_unchanged", benchHandleStoreProfileUnchanged, NULL, NULL);
+  benchRegister("handle_get_status", benchHandleGetStatus, NULL, NULL);
+  benchRegister("encode_telemetry_frame", benchEncodeTelemetryFrame, NULL, NULL);
+  benchRegister("telemetry_send", benchTelemetrySend, NULL, NULL);
+  benchRegister("execute_profile_tick", benchExecuteProfileTick, startBenchProfile, NULL);
+  benchRegister("pressure_to_dim_level", benchPressureToDimLevel, NULL, NULL);
+  benchRegister("calibration_fit", benchCalibrationFit, NULL, NULL);
+  benchRegister("zero_cross_isr", benchZeroCrossIsr, startIsrBench, NULL);
+}
+
+static void benchFinish() {
+  stopProfile();
+  setDimLevel(0);
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+static BenchResult results[BENCH_MAX_CASES];
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  benchInit();
+
+  // The bench task runs on core 1 while this task waits for it
+  printf("\nModspresso benchmarks @ %u MHz (no BLE client: sendResponse skips serialization)\n",
+         (unsigned)halCpuFrequencyMhz());
+  int count = benchRunAll(NULL, results, BENCH_MAX_CASES);
+  benchFinish();
+
+  benchPrintTable(results, count);
+  printf("\n");
+  benchPrintCsv(results, count, writeCsvLine, NULL);
+}
+
+void loop() {
+  delay(1000);
+}
+
+#else
+
+// ============================================================================
+// BASELINE COMPARISON (host)
+// ============================================================================
+
+static int compareBaseline(const char* path, const BenchResult* results, int count, float tolerancePct) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "cannot open baseline %s\n", path);
+    return -1;
+  }
+
+  int regressions = 0;
+  char line[256];
+  printf("\n%-26s %12s %12s %8s\n", "benchmark", "base_median", "median", "delta%");
+  while (fgets(line, sizeof(line), f)) {
+    char name[64];
+    float mean, median;
+    if (sscanf(line, "%63[^,],%f,%f", name, &mean, &median) != 3) continue;  // Header
+
+    for (int i = 0; i < count; i++) {
+      if (strcmp(results[i].name, name) != 0) continue;
+      float delta = median > 0 ? (results[i].medianCycles - median) * 100.0f / median : 0.0f;
+      bool regressed = delta > tolerancePct;
+      printf("%-26s %12.0f %12.0f %+8.1f%s\n", name, median, results[i].medianCycles, delta,
+             regressed ? "  REGRESSION" : "");
+      if (regressed) regressions++;
+    }
+  }
+  fclose(f);
+  return regressions;
+}
+
+// Cases that run every control tick or telemetry frame: must not touch the heap
+static const char* const ZERO_ALLOC_CASES[] = {"execute_profile_tick", "encode_telemetry_frame", "telemetry_send"};
+
+static int checkZeroAlloc(const BenchResult* results, int count) {
+  int failures = 0;
+  for (int i = 0; i < count; i++) {
+    for (size_t z = 0; z < sizeof(ZERO_ALLOC_CASES) / sizeof(ZERO_ALLOC_CASES[0]); z++) {
+      if (strcmp(results[i].name, ZERO_ALLOC_CASES[z]) != 0 || results[i].allocsPerOp == 0.0f) continue;
+      fprintf(stderr, "%s: %.3f heap allocations per op (expected none)\n", results[i].name,
+              results[i].allocsPerOp);
+      failures++;
+    }
+  }
+  return failures;
+}
+
+static void discardNotification(HalChannel channel, const uint8_t* data, size_t len, void* ctx) {
+}
+
+// ============================================================================
+// TRIAC STRESS (host)
+// ============================================================================
+
+// Writers publish levels while one thread plays the ZC interrupt, one polls
+// the stats and one trips, standing in for the loop, the ISR, the
+// status/telemetry readers and the supervisor on the two cores. Writers go through publishTriacDuty() at 1-100:
+// setTriacLevel() also writes dimmerLevel and logs, which only the loop does,
+// and level 0 stops the gate timer, which the host HAL does not share between
+// threads.
+#define STRESS_WRITERS 3
+
+static std::atomic<bool> stressRunning(false);
+static std::atomic<uint32_t> stressFailures(0);
+
+static void stressFail(const char* what) {
+  if (stressFailures.fetch_add(1) < 10) {
+    fprintf(stderr, "stress: %s\n", what);
+  }
+}
+
+static void stressWriter(unsigned seed) {
+  while (stressRunning.load()) {
+    seed = seed * 1103515245u + 12345u;
+    publishTriacDuty(1 + (int)((seed >> 16) % 100));
+    std::this_thread::yield();
+  }
+}
+
+// The generation wraps at 16 bits, so it is checked for consistency with its
+// payload rather than for order
+static void stressIsr() {
+  TriacControl last = readTriacControl();
+  while (stressRunning.load()) {
+    zeroCrossISR();
+    TriacControl control = readTriacControl();
+    if ((control.mode == DIM_ON) != (control.duty > 0) || control.duty > 100) {
+      stressFail("control word mode and duty disagree");
+    }
+    if (control.forcedOff && control.mode == DIM_ON) {
+      stressFail("duty published over a forced-off word");
+    }
+    if (control.generation == last.generation && (control.mode != last.mode || control.duty != last.duty)) {
+      stressFail("one control generation carried two settings");
+    }
+    last = control;
+  }
+}
+
+// Plays the supervisor: trips while the writers publish, and the word must
+// stay off until the trip is released
+static void stressTripper(uint64_t* trips) {
+  while (stressRunning.load()) {
+    forceTriacOff();
+    for (int i = 0; i < 100; i++) {
+      std::this_thread::yield();
+      if (readTriacControl().mode != DIM_OFF) {
+        stressFail("a writer turned the triac on during a trip");
+        break;
+      }
+    }
+    releaseTriacForcedOff();
+    (*trips)++;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+}
+
+static void stressReader(uint64_t* snapshots) {
+  TriacStats previous;
+  readTriacStats(&previous);
+  while (stressRunning.load()) {
+    TriacStats stats;
+    readTriacStats(&stats);
+    if (stats.firedCount > stats.zcCount) {
+      stressFail("stats snapshot fired more than it crossed");
+    }
+    if (stats.zcCount < previous.zcCount || stats.firedCount < previous.firedCount) {
+      stressFail("stats counters went backwards");
+    }
+    if (stats.zcCount == previous.zcCount && stats.lastZcUs != previous.lastZcUs) {
+      stressFail("stats snapshot mixes two updates");
+    }
+    previous = stats;
+    (*snapshots)++;
+  }
+}
+
+// A settled level must fire exactly its share of a pattern window, split
+// evenly between the two polarities
+static bool stressCheckPattern(int level) {
+  setTriacLevel(level);
+  uint32_t fired[2] = {0, 0};
+  for (int i = 0; i < FIRING_PATTERN_HALF_CYCLES; i++) {
+    uint32_t before = triacFiredCount();
+    zeroCrossISR();
+    fired[i & 1] += triacFiredCount() - before;
+  }
+  uint32_t share = (uint32_t)level * FIRING_PATTERN_HALF_CYCLES / 200;
+  if (fired[0] != share || fired[1] != share) {
+    fprintf(stderr, "stress: level %d fired %u + %u of %d half-cycles\n", level, (unsigned)fired[0],
+            (unsigned)fired[1], FIRING_PATTERN_HALF_CYCLES);
+    return false;
+  }
+  return true;
+}
+
+static int runTriacStress(float seconds) {
+  if (std::thread::hardware_concurrency() < 2) {
+    printf("triac stress: single CPU, threads only interleave at preemption (weak coverage)\n");
+  }
+  TriacStats start;
+  readTriacStats(&start);
+  uint64_t snapshots = 0;
+  uint64_t trips = 0;
+
+  stressRunning.store(true);
+  std::thread isr(stressIsr);
+  std::thread reader(stressReader, &snapshots);
+  std::thread tripper(stressTripper, &trips);
+  std::thread writers[STRESS_WRITERS];
+  for (int i = 0; i < STRESS_WRITERS; i++) {
+    writers[i] = std::thread(stressWriter, 17u + (unsigned)i * 7919u);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds((long)(seconds * 1000.0f)));
+  stressRunning.store(false);
+  for (int i = 0; i < STRESS_WRITERS; i++) {
+    writers[i].join();
+  }
+  isr.join();
+  reader.join();
+  tripper.join();
+
+  TriacStats end;
+  readTriacStats(&end);
+  printf("triac stress: %lu ZC, %lu fired, %u control generations, %llu stats snapshots, %llu trips, %u failures\n",
+         (unsigned long)(end.zcCount - start.zcCount), (unsigned long)(end.firedCount - start.firedCount),
+         (unsigned)readTriacControl().generation, (unsigned long long)snapshots, (unsigned long long)trips,
+         (unsigned)stressFailures.load());
+
+  bool patternsOk = stressCheckPattern(100) && stressCheckPattern(50) && stressCheckPattern(7);
+  setTriacLevel(0);
+  return (stressFailures.load() == 0 && patternsOk) ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  const char* filter = NULL;
+  const char* csvPath = NULL;
+  const char* baselinePath = NULL;
+  float tolerancePct = 15.0f;
+  float stressSeconds = 0.0f;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+      csvPath = argv[++i];
+    } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baselinePath = argv[++i];
+    } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      tolerancePct = (float)atof(argv[++i]);
+    } else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc) {
+      stressSeconds = (float)atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--filter TEXT] [--csv FILE] [--baseline FILE] [--tolerance PCT] [--stress SECONDS]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  // Connected client whose notifications are dropped: the full send path runs
+  halNativeOnTransport(discardNotification, NULL);
+  benchInit();
+
+  if (stressSeconds > 0.0f) {
+    return runTriacStress(stressSeconds);
+  }
+
+  static BenchResult results[BENCH_MAX_CASES];
+  int count = benchRunAll(filter, results, BENCH_MAX_CASES);
+  benchFinish();
+  benchPrintTable(results, count);
+
+  if (csvPath) {
+    FILE* csv = fopen(csvPath, "w");
+    if (!csv) {
+      fprintf(stderr, "cannot open %s\n", csvPath);
+      return 1;
+    }
+    benchPrintCsv(results, count, writeCsvLine, csv);
+    fclose(csv);
+  }
+
+  if (checkZeroAlloc(results, count) != 0) {
+    return 1;
+  }
+
+  if (baselinePath) {
+    int regressions = compareBaseline(baselinePath, results, count, tolerancePct);
+    if (regressions != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#endif
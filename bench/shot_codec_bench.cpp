@@ -0,0 +1,138 @@
+// Shot codec benchmark (host)
+//
+// Encodes a synthetic 30 s / 100 Hz shot, verifies the round trip and reports
+// compression ratio and encode/decode cost per sample.
+//
+//   g++ -O2 -Iinclude src/shot_codec.cpp bench/shot_codec_bench.cpp -o shot_codec_bench
+//   ./shot_codec_bench
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "shot_codec.h"
+
+#define SHOT_SECONDS 30
+#define SAMPLE_RATE_HZ 100
+#define ITERATIONS 200
+
+static uint32_t rngState = 0x12345678;
+
+static uint32_t xorshift() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+static float noise(float amplitude) {
+  return ((xorshift() & 0xFFFF) / 32767.5f - 1.0f) * amplitude;
+}
+
+// Preinfusion, ramp, hold, decline - the shape of a typical stored profile
+static float profileTarget(float t) {
+  if (t < 8.0f) return 2.0f;
+  if (t < 12.0f) return 2.0f + (t - 8.0f) / 4.0f * 7.0f;
+  if (t < 25.0f) return 9.0f;
+  return 9.0f - (t - 25.0f) / 5.0f * 3.0f;
+}
+
+static void generateShot(std::vector<ShotSample>& shot) {
+  float pressure = 0.0f;
+  uint32_t fired = 0;
+  uint32_t timeMs = 0;
+  float firedFraction = 0.0f;
+
+  while (timeMs <= SHOT_SECONDS * 1000) {
+    float t = timeMs / 1000.0f;
+    float target = profileTarget(t);
+    pressure += (target - pressure) * 0.05f;  // Pump lag
+    int dim = (int)(target / 12.0f * 100.0f + 0.5f);
+    firedFraction += dim / 100.0f;
+    while (firedFraction >= 1.0f) {
+      fired++;
+      firedFraction -= 1.0f;
+    }
+
+    ShotSample s;
+    s.timeMs = timeMs;
+    s.targetPressure = target;
+    s.pressure = pressure + noise(0.03f);
+    s.dimLevel = (uint8_t)dim;
+    s.firedCount = fired;
+    shot.push_back(s);
+
+    // loop() runs every ~10 ms with occasional jitter from BLE work
+    timeMs += 1000 / SAMPLE_RATE_HZ + ((xorshift() % 16) == 0 ? 1 : 0);
+  }
+}
+
+static void appendSink(const uint8_t* data, size_t len, void* ctx) {
+  std::vector<uint8_t>* out = (std::vector<uint8_t>*)ctx;
+  out->insert(out->end(), data, data + len);
+}
+
+int main() {
+  std::vector<ShotSample> shot;
+  generateShot(shot);
+
+  std::vector<uint8_t> encoded;
+  encoded.reserve(shot.size() * SHOT_RAW_SAMPLE_SIZE);
+
+  ShotEncoder encoder;
+  auto encStart = std::chrono::steady_clock::now();
+  for (int iter = 0; iter < ITERATIONS; iter++) {
+    encoded.clear();
+    encoder.begin(appendSink, &encoded);
+    for (size_t i = 0; i < shot.size(); i++) {
+      encoder.add(shot[i]);
+    }
+    encoder.finish();
+  }
+  auto encEnd = std::chrono::steady_clock::now();
+
+  ShotDecoder decoder;
+  ShotSample decoded;
+  size_t decodedCount = 0;
+  auto decStart = std::chrono::steady_clock::now();
+  for (int iter = 0; iter < ITERATIONS; iter++) {
+    decoder.begin(encoded.data(), encoded.size());
+    decodedCount = 0;
+    while (decoder.next(decoded)) {
+      decodedCount++;
+    }
+  }
+  auto decEnd = std::chrono::steady_clock::now();
+
+  // Round-trip check (within quantization)
+  float maxPressureError = 0.0f;
+  int mismatches = 0;
+  decoder.begin(encoded.data(), encoded.size());
+  for (size_t i = 0; i < shot.size() && decoder.next(decoded); i++) {
+    const ShotSample& s = shot[i];
+    if (decoded.timeMs != s.timeMs || decoded.dimLevel != s.dimLevel || decoded.firedCount != s.firedCount) {
+      mismatches++;
+    }
+    maxPressureError = fmaxf(maxPressureError, fabsf(decoded.pressure - s.pressure));
+    maxPressureError = fmaxf(maxPressureError, fabsf(decoded.targetPressure - s.targetPressure));
+  }
+
+  size_t rawBytes = shot.size() * SHOT_RAW_SAMPLE_SIZE;
+  double encNs = std::chrono::duration<double, std::nano>(encEnd - encStart).count() / ITERATIONS / shot.size();
+  double decNs = std::chrono::duration<double, std::nano>(decEnd - decStart).count() / ITERATIONS / shot.size();
+
+  printf("Shot codec benchmark (%d s @ %d Hz, %d channels)\n", SHOT_SECONDS, SAMPLE_RATE_HZ, SHOT_CHANNELS);
+  printf("  samples:          %zu\n", shot.size());
+  printf("  raw bytes:        %zu\n", rawBytes);
+  printf("  encoded bytes:    %zu (%.2f bytes/sample)\n", encoded.size(), (double)encoded.size() / shot.size());
+  printf("  compression:      %.1fx\n", (double)rawBytes / encoded.size());
+  printf("  encode:           %.1f ns/sample\n", encNs);
+  printf("  decode:           %.1f ns/sample\n", decNs);
+  printf("  max quant error:  %.4f bar\n", maxPressureError);
+
+  bool ok = decodedCount == shot.size() && mismatches == 0 && maxPressureError <= 0.5f / SHOT_PRESSURE_QUANT + 1e-4f;
+  printf("  round trip:       %s\n", ok ? "OK" : "FAILED");
+  return ok ? 0 : 1;
+}
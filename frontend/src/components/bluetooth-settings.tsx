@@ -312,9 +312,21 @@ export const BluetoothSettings: React.FC<BluetoothSettingsProps> = ({
             <span className="text-gray-500">4fafc201-1fb5-459e-8fcc-c5c9c331914b</span>
           </div>
           <div className="flex items-center justify-between">
-            <span>Characteristic:</span>
+            <span>Kommando:</span>
+            <span className="text-gray-500">beb5483e-36e1-4688-b7f5-ea07361b26a9</span>
+          </div>
+          <div className="flex items-center justify-between">
+            <span>Svar:</span>
             <span className="text-gray-500">beb5483e-36e1-4688-b7f5-ea07361b26a8</span>
           </div>
+          <div className="flex items-center justify-between">
+            <span>Telemetri:</span>
+            <span className="text-gray-500">beb5483e-36e1-4688-b7f5-ea07361b26aa</span>
+          </div>
+          <div className="flex items-center justify-between">
+            <span>Logg:</span>
+            <span className="text-gray-500">beb5483e-36e1-4688-b7f5-ea07361b26ab</span>
+          </div>
         </div>
       </div>
 
@@ -89,7 +89,16 @@ declare global {
 
 // ESP32 BLE Service and Characteristic UUIDs
 const ESP32_SERVICE_UUID = '4fafc201-1fb5-459e-8fcc-c5c9c331914b';
-const ESP32_CHARACTERISTIC_UUID = 'beb5483e-36e1-4688-b7f5-ea07361b26a8';
+const ESP32_COMMAND_UUID = 'beb5483e-36e1-4688-b7f5-ea07361b26a9';   // write: JSON commands
+const ESP32_RESPONSE_UUID = 'beb5483e-36e1-4688-b7f5-ea07361b26a8';  // notify: JSON responses/status
+const ESP32_TELEMETRY_UUID = 'beb5483e-36e1-4688-b7f5-ea07361b26aa'; // notify: binary telemetry frames
+const ESP32_LOG_UUID = 'beb5483e-36e1-4688-b7f5-ea07361b26ab';       // notify: serial_log
+
+// Binary telemetry frame (little-endian, see QUICK_DEBUG.md)
+const TELEMETRY_FRAME_TYPE = 0x01;
+const TELEMETRY_FRAME_LENGTH = 16;
+const TELEMETRY_FLAG_FLOW = 0x01;
+const TELEMETRY_FLAG_DRY_RUN = 0x02;
 
 interface ESP32Status {
   current_pressure: number;
@@ -109,9 +118,31 @@ export interface LiveBrewData {
   time: number;
   current_pressure: number;
   target_pressure: number;
+  flow?: number;
+  target_flow?: number;
+  dim_level?: number;
+  dry_run?: boolean;
   timestamp: number;
 }
 
+const decodeTelemetryFrame = (value: DataView): LiveBrewData | null => {
+  if (value.byteLength < TELEMETRY_FRAME_LENGTH || value.getUint8(0) !== TELEMETRY_FRAME_TYPE) {
+    return null;
+  }
+  const flowTarget = (value.getUint8(1) & TELEMETRY_FLAG_FLOW) !== 0;
+  const target = value.getUint16(10, true) / 100;
+  return {
+    time: value.getUint32(4, true) / 1000,
+    current_pressure: value.getUint16(8, true) / 100,
+    target_pressure: flowTarget ? 0 : target,
+    flow: value.getUint16(12, true) / 100,
+    target_flow: flowTarget ? target : undefined,
+    dim_level: value.getUint8(14),
+    dry_run: (value.getUint8(1) & TELEMETRY_FLAG_DRY_RUN) !== 0,
+    timestamp: Date.now()
+  };
+};
+
 interface DeviceInfo {
   id: string;
   name: string;
@@ -140,6 +171,7 @@ export const useWebBluetooth = () => {
   const serverRef = useRef<BluetoothRemoteGATTServer | null>(null);
   const serviceRef = useRef<BluetoothRemoteGATTService | null>(null);
   const characteristicRef = useRef<BluetoothRemoteGATTCharacteristic | null>(null);
+  const statusSeqRef = useRef<number | null>(null);
 
   // Check if Web Bluetooth is supported
   useEffect(() => {
@@ -217,23 +249,13 @@ export const useWebBluetooth = () => {
       const service = await server.getPrimaryService(ESP32_SERVICE_UUID);
       serviceRef.current = service;
 
-      // Get the characteristic
-      const characteristic = await service.getCharacteristic(ESP32_CHARACTERISTIC_UUID);
+      // Commands are written to their own characteristic
+      const characteristic = await service.getCharacteristic(ESP32_COMMAND_UUID);
       characteristicRef.current = characteristic;
+      statusSeqRef.current = null;
 
-      // Set up notifications
-      console.log('Starting BLE notifications...');
-      try {
-        await characteristic.startNotifications();
-        console.log('BLE notifications started successfully');
-      } catch (err) {
-        console.error('Failed to start notifications:', err);
-        throw err;
-      }
-      
-      console.log('Setting up characteristicvaluechanged event listener...');
-      characteristic.addEventListener('characteristicvaluechanged', (event) => {
-        console.log('characteristicvaluechanged event received!'); // Debug
+      // Responses and logs are JSON, telemetry is binary
+      const handleJsonNotification = (event: Event) => {
         const value = (event.target as unknown as BluetoothRemoteGATTCharacteristic).value;
         if (value) {
           const decoder = new TextDecoder();
@@ -246,22 +268,41 @@ export const useWebBluetooth = () => {
             console.log('📨 data.type:', data.type, 'data.status:', data.status); // Debug logging
             
             if (data.type === 'status_update') {
-              // Extract only the status fields (exclude 'type')
-              const statusData: ESP32Status = {
-                current_pressure: data.current_pressure ?? 0,
-                is_running: data.is_running ?? false,
-                current_segment: data.current_segment ?? 0,
-                total_segments: data.total_segments ?? 0,
-                uptime: data.uptime ?? 0,
-                is_calibrated: data.is_calibrated ?? false,
-                profile_count: data.profile_count,
-                default_profile1: data.default_profile1,
-                default_profile2: data.default_profile2,
-                default_profile1_name: data.default_profile1_name,
-                default_profile2_name: data.default_profile2_name
-              };
-              console.log('Setting status:', statusData); // Debug logging
-              setStatus(statusData);
+              // Snapshots ("full") replace the status, deltas carry only changed fields.
+              // A gap in "seq" means a delta was lost: ask for a snapshot.
+              const lastSeq = statusSeqRef.current;
+              statusSeqRef.current = data.seq ?? null;
+              if (!data.full && lastSeq !== null && data.seq !== lastSeq + 1) {
+                console.warn('Status sequence gap, requesting snapshot:', lastSeq, '->', data.seq);
+                characteristic.writeValue(new TextEncoder().encode(JSON.stringify({ command: 'get_status' })))
+                  .catch(err => console.error('Failed to request status snapshot:', err));
+                return;
+              }
+              setStatus(prev => {
+                const base: ESP32Status = data.full || !prev ? {
+                  current_pressure: 0,
+                  is_running: false,
+                  current_segment: 0,
+                  total_segments: 0,
+                  uptime: 0,
+                  is_calibrated: false
+                } : prev;
+                const statusData: ESP32Status = {
+                  current_pressure: data.current_pressure ?? base.current_pressure,
+                  is_running: data.is_running ?? base.is_running,
+                  current_segment: data.current_segment ?? base.current_segment,
+                  total_segments: data.total_segments ?? base.total_segments,
+                  uptime: data.uptime ?? base.uptime,
+                  is_calibrated: data.is_calibrated ?? base.is_calibrated,
+                  profile_count: data.profile_count ?? base.profile_count,
+                  default_profile1: data.default_profile1 ?? base.default_profile1,
+                  default_profile2: data.default_profile2 ?? base.default_profile2,
+                  default_profile1_name: data.default_profile1_name ?? base.default_profile1_name,
+                  default_profile2_name: data.default_profile2_name ?? base.default_profile2_name
+                };
+                console.log('Setting status:', statusData); // Debug logging
+                return statusData;
+              });
             } else if (data.type === 'serial_log') {
               console.log('Received serial_log message:', data); // Debug logging
               // Add log entry to serial logs (keep last 500 entries)
@@ -274,19 +315,6 @@ export const useWebBluetooth = () => {
                 console.log('Updated serialLogs, new count:', newLogs.length); // Debug logging
                 return newLogs.slice(-500); // Keep last 500 entries
               });
-            } else if (data.type === 'pressure_update') {
-              // Handle live brew data updates
-              const brewData: LiveBrewData = {
-                time: data.current_time ?? 0,
-                current_pressure: data.current_pressure ?? 0,
-                target_pressure: data.target_pressure ?? 0,
-                timestamp: Date.now()
-              };
-              setLiveBrewData(prev => {
-                const newData = [...prev, brewData];
-                // Keep last 1000 data points (about 16 minutes at 1 update/second)
-                return newData.slice(-1000);
-              });
             } else if (data.status === 'profile_started') {
               // Profile started - store the profile name and ID for tracking
               // This is the authoritative source for which profile is currently running
@@ -312,7 +340,39 @@ export const useWebBluetooth = () => {
         } else {
           console.log('No value in characteristicvaluechanged event'); // Debug logging
         }
-      });
+      };
+
+      const handleTelemetryNotification = (event: Event) => {
+        const value = (event.target as unknown as BluetoothRemoteGATTCharacteristic).value;
+        const brewData = value ? decodeTelemetryFrame(value) : null;
+        if (!brewData) {
+          return;
+        }
+        setLiveBrewData(prev => {
+          const newData = [...prev, brewData];
+          // Keep last 1000 data points
+          return newData.slice(-1000);
+        });
+      };
+
+      // Set up notifications
+      console.log('Starting BLE notifications...');
+      const notifyChannels: Array<[string, (event: Event) => void]> = [
+        [ESP32_RESPONSE_UUID, handleJsonNotification],
+        [ESP32_LOG_UUID, handleJsonNotification],
+        [ESP32_TELEMETRY_UUID, handleTelemetryNotification]
+      ];
+      try {
+        for (const [uuid, listener] of notifyChannels) {
+          const notifyCharacteristic = await service.getCharacteristic(uuid);
+          notifyCharacteristic.addEventListener('characteristicvaluechanged', listener);
+          await notifyCharacteristic.startNotifications();
+        }
+        console.log('BLE notifications started successfully');
+      } catch (err) {
+        console.error('Failed to start notifications:', err);
+        throw err;
+      }
 
       // Listen for disconnection
       bluetoothDevice.addEventListener('gattserverdisconnected', () => {
@@ -0,0 +1,12 @@
+#ifndef APP_H
+#define APP_H
+
+// Firmware entry points shared by the ESP32 sketch (main.cpp) and the
+// native host build (main_native.cpp)
+void appSetup();
+void appLoop();
+
+// One command line typed on the console (Serial Monitor / stdin)
+void appHandleConsoleLine(const char* line);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <ArduinoJson.h>
+
+#include "calibration_model.h"
+#include "config.h"
+
+// Calibration data - stores pressure for each dim level (0-100 in steps of 5)
+// Index 0 = 0%, Index 1 = 5%, Index 2 = 10%, ..., Index 20 = 100%
+extern float dimLevelToPressure[CALIBRATION_POINTS];
+extern bool isCalibrated;
+
+// Monotone fit of dimLevelToPressure (rebuilt on load/save), used for targeting
+extern CalibrationModel calibrationCurve;
+
+// Pressure sensor calibration: bar = (volts - pressureOffset) * pressureScale
+extern float pressureOffset;
+extern float pressureScale;
+
+// Automatic sweep (needs the transducer): each 5% step is held until the
+// last CAL_WINDOW_SAMPLES readings are steady, then their mean is recorded
+#define CAL_SAMPLE_INTERVAL_MS 50
+#define CAL_WINDOW_SAMPLES 20        // 1 s window
+#define CAL_MIN_SETTLE_MS 1500       // Ignore the first part of every step
+#define CAL_STEP_TIMEOUT_MS 15000    // Record the window mean anyway
+#define CAL_SETTLE_STDDEV_BAR 0.05f  // Noise/ripple limit over the window
+#define CAL_SETTLE_DRIFT_BAR 0.02f   // Mean change between window halves
+
+extern bool calibrationRunning;
+
+// Steady-pressure detector over the last CAL_WINDOW_SAMPLES readings
+class SettleDetector {
+ public:
+  SettleDetector() { reset(); }
+  void reset() { count_ = 0; head_ = 0; }
+  // Adds a reading; once the window is full *mean is its average and the
+  // result says whether spread and drift are below the limits
+  bool add(float pressure, float* mean);
+  bool full() const { return count_ == CAL_WINDOW_SAMPLES; }
+
+ private:
+  float window_[CAL_WINDOW_SAMPLES];  // Ring of the latest readings
+  int count_;
+  int head_;
+};
+
+// Helper: Convert dim level (0-100) to calibration array index
+inline int dimLevelToIndex(int dimLevel) {
+  return clampInt(dimLevel / 5, 0, CALIBRATION_POINTS - 1);
+}
+
+// Helper: Convert calibration array index to dim level
+inline int indexToDimLevel(int index) {
+  return index * 5;
+}
+
+float getCurrentPressure();
+int pressureToDimLevel(float pressure);
+void startCalibration(bool automatic);
+void stopCalibration(const char* reason);
+void calibrationTick();  // From loop() while calibrationRunning
+void setCalibrationPoint(int step, float pressure);
+void setCalibrationData(JsonObject calibration);
+void sendCalibrationStatus();
+void rebuildCalibrationCurve();  // After changing dimLevelToPressure (save/load do it)
+void saveCalibrationData();
+void loadCalibrationData();
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef CALIBRATION_MODEL_H
+#define CALIBRATION_MODEL_H
+
+#include <stdint.h>
+
+// ============================================================================
+// CALIBRATION MODEL - monotone dim level -> pressure curve
+// ============================================================================
+//
+// The measured 5% grid is fitted in three passes:
+//   1. Outlier rejection: the point furthest from the straight line through
+//      its kept neighbours is dropped while it is off by more than
+//      max(CAL_OUTLIER_MIN_BAR, 3 robust sigma), up to CAL_MAX_OUTLIERS times.
+//   2. Isotonic regression (pool adjacent violators): the least-squares
+//      non-decreasing sequence through the kept points.
+//   3. Monotone piecewise-cubic Hermite (PCHIP, Fritsch-Carlson slopes)
+//      through the isotonic values; it never overshoots between points.
+// The inverse (pressure -> level) is tabulated every CAL_INVERSE_STEP_BAR so
+// pressureToDimLevel() is one table interpolation.
+
+#define CAL_MODEL_MAX_POINTS 21
+#define CAL_OUTLIER_MIN_BAR 1.0f
+#define CAL_MAX_OUTLIERS 5
+#define CAL_INVERSE_MAX_BAR 12.0f
+#define CAL_INVERSE_STEP_BAR 0.1f
+#define CAL_INVERSE_POINTS 121          // 0-12 bar
+
+struct CalibrationFitQuality {
+  uint8_t usedPoints;                   // Points the curve was fitted through
+  uint8_t outliers;                     // Points rejected in pass 1
+  uint32_t outlierMask;                 // Bit i = grid point i rejected
+  uint8_t pooledPoints;                 // Points moved by the isotonic pass
+  float rmsResidualBar;                 // Measured vs. fitted over the used points
+  float maxResidualBar;
+};
+
+class CalibrationModel {
+ public:
+  CalibrationModel();
+
+  // pressures[i] is the reading at levels[i] (ascending, 0-100).
+  // Points with valid[i] == false are ignored. Returns false with < 2 points.
+  bool fit(const float* levels, const float* pressures, const bool* valid, int count);
+  bool isValid() const { return knotCount_ >= 2; }
+
+  float pressureAt(float level) const;
+  // Smallest level whose fitted pressure reaches the target (0-100)
+  float levelFor(float pressure) const;
+
+  const CalibrationFitQuality& quality() const { return quality_; }
+  float maxPressure() const { return knotCount_ > 0 ? y_[knotCount_ - 1] : 0.0f; }
+
+ private:
+  float solveLevel(float pressure) const;
+
+  int knotCount_;
+  float x_[CAL_MODEL_MAX_POINTS];       // Level
+  float y_[CAL_MODEL_MAX_POINTS];       // Fitted pressure
+  float m_[CAL_MODEL_MAX_POINTS];       // Slope (bar per %)
+  float inverse_[CAL_INVERSE_POINTS];   // Level per CAL_INVERSE_STEP_BAR
+  CalibrationFitQuality quality_;
+};
+
+#endif
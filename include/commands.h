@@ -0,0 +1,21 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#define COMMAND_DOC_BYTES 1024        // Parse document for one command
+#define BATCH_MAX_COMMANDS 16
+
+// Parses and dispatches one JSON command (BLE write or Serial line), or a
+// batch: a JSON array of commands applied in order as one transaction. The
+// stored profiles and button defaults it changes are written to NVS once at
+// the end; the first failing command rolls those back and skips the rest.
+// A batch holds only those writes and reads: one with any other command is
+// refused before anything runs. Acks of the batched commands are folded
+// into one batch_done response with per-batch timing; data responses
+// ("type") are sent as usual.
+// Commands run one at a time under halCommandLock().
+// From BLE or Serial (MESSAGE_CLIENT_BLE)
+void handleCommand(const char* command);
+// From one client (MESSAGE_CLIENT_*): subscribe and get_status apply to it
+void handleClientCommand(int client, const char* command);
+
+#endif
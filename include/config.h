@@ -0,0 +1,53 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Pin definitions
+#define ZERO_CROSS_PIN 33   // GPIO33 (D33) for zero-cross detection (RobotDyn Mod-Dimmer-5A-1L)
+#define DIMMER_PIN 25       // GPIO25 (D25) for AC dimmer control (gate pin - PWM output)
+#define LED_PIN 2           // GPIO2 for status LED (built-in LED)
+#define BUTTON_1_PIN 18     // GPIO18 (D18) for hardware button 1 (Program 1) - DISABLED in manual-dimmer-control
+#define BUTTON_2_PIN 19     // GPIO19 (D19) for hardware button 2 (Program 2) - DISABLED in manual-dimmer-control
+#define RELAY_1_PIN 22      // GPIO22 (D22) relay output - DISABLED in manual-dimmer-control
+#define RELAY_2_PIN 23      // GPIO23 (D23) relay output - DISABLED in manual-dimmer-control
+#define USE_HARDWARE_BUTTONS 0  // Set to 1 to re-enable D18/D19
+#define USE_RELAYS 0            // Set to 1 to re-enable D22/D23
+
+// Pressure transducer (0.5-4.5V, 0-12 bar) on GPIO34 through a 10k/20k divider
+#define PRESSURE_SENSOR_PIN 34
+#ifndef USE_PRESSURE_SENSOR
+#define USE_PRESSURE_SENSOR 0   // Set to 1 when the transducer is fitted
+#endif
+#define PRESSURE_SENSOR_OFFSET_V 0.333f   // Output at 0 bar (after divider)
+#define PRESSURE_SENSOR_BAR_PER_V 4.5f    // 12 bar over 0.333-3.0V
+
+// ============================================================================
+// TRIAC DRIVE CONFIGURATION - PSM (Pulse-Skip Modulation)
+// ============================================================================
+
+// Debug mode
+#define DIM_DEBUG 1
+
+// PSM Configuration
+#define PSM_WINDOW_MS 100           // 100ms window (10 half-cycles at 50Hz)
+#define PHASE_DELAY_FULL_US 200     // 200µs delay for full conduction
+#define PULSE_WIDTH_US 300          // 300µs trigger pulse width
+
+// AC frequency
+#define AC_FREQ_HZ 50
+
+// Profile storage
+#define MAX_PROFILES 10
+#define MAX_SEGMENTS 10
+
+// Calibration - 0, 5, 10, 15, ..., 100 (21 values)
+#define CALIBRATION_POINTS 21
+
+static inline int clampInt(int value, int low, int high) {
+  return value < low ? low : (value > high ? high : value);
+}
+
+static inline float clampFloat(float value, float low, float high) {
+  return value < low ? low : (value > high ? high : value);
+}
+
+#endif
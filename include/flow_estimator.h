@@ -0,0 +1,53 @@
+#ifndef FLOW_ESTIMATOR_H
+#define FLOW_ESTIMATOR_H
+
+#include <stdint.h>
+
+// ============================================================================
+// FLOW ESTIMATOR - pump flow from fired half-cycles
+// ============================================================================
+//
+// A vibratory pump moves a roughly fixed volume per stroke, reduced linearly
+// by the back pressure it works against:
+//   V(p) = strokeMl * (1 - p / deadheadBar)
+// Its diode only lets it stroke on one polarity, so with PSM spreading the
+// fired half-cycles over both polarities a fired half-cycle is worth V(p)/2.
+// The estimate integrates triacFiredCount() deltas times V/2 at the measured
+// back pressure (the calibration curve stands in without a transducer).
+// Flow segments invert the same model for the dim level and trim the rest
+// with a slow integral on the estimated flow.
+
+#define FLOW_STROKE_ML 0.14f            // Default displacement per stroke at 0 bar
+#define FLOW_DEADHEAD_BAR 15.0f         // Default pressure where a stroke delivers nothing
+#define FLOW_FILTER_TAU_S 0.3f          // Low-pass on the reported flow
+#define FLOW_TRIM_KI 8.0f               // % level per ml/s per second
+#define FLOW_TRIM_LIMIT 20.0f           // Max trim (% level)
+#define FLOW_PRESSURE_LIMIT_BAR 11.0f   // Flow segments back off above this
+#define FLOW_MAX_ML_S 12.7f             // Compact format limit (0.1 ml/s in 7 bits)
+
+struct FlowModel {
+  float strokeMl;
+  float deadheadBar;
+};
+
+extern FlowModel flowModel;
+extern float estimatedFlow;             // ml/s, filtered
+extern float estimatedVolume;           // ml since resetFlowEstimator()
+
+void loadFlowModel();
+void setFlowModel(float strokeMl, float deadheadBar);
+void sendFlowModel();
+
+// Volume one fired half-cycle delivers against the given pressure (ml)
+float halfCycleDisplacementMl(float backPressureBar);
+
+// Call resetFlowEstimator() when a run starts, then updateFlowEstimator()
+// once per control tick
+void resetFlowEstimator();
+void updateFlowEstimator();
+
+// Dim level that delivers targetFlow (ml/s) at the current back pressure;
+// without closedLoop the model alone (no trim on the estimate)
+int flowToDimLevel(float targetFlow, bool closedLoop = true);
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// HARDWARE ABSTRACTION LAYER
+// ============================================================================
+//
+// Everything the control core needs from the board. hal_esp32.cpp maps these
+// onto Arduino/esp_timer/Preferences/SPIFFS/BLE; hal_native.cpp backs them
+// with in-memory state so the core builds and runs on Linux (see
+// hal_native.h for the simulation hooks).
+
+// Clock
+uint32_t halMillis();
+uint32_t halMicros();
+uint64_t halMicros64();             // Since boot, does not wrap (esp_timer)
+void halDelay(uint32_t ms);
+void halDelayMicroseconds(uint32_t us);
+uint32_t halCycleCount();           // CPU cycle counter (ns on host)
+uint32_t halCpuFrequencyMhz();      // Cycle counter rate (1000 on host)
+
+// GPIO
+enum HalPinMode {
+  HAL_PIN_INPUT = 0,
+  HAL_PIN_OUTPUT = 1,
+  HAL_PIN_INPUT_PULLUP = 2
+};
+
+typedef void (*HalIsrFn)();
+
+void halPinMode(uint8_t pin, HalPinMode mode);
+void halDigitalWrite(uint8_t pin, bool high);
+bool halDigitalRead(uint8_t pin);
+void halAttachRisingInterrupt(uint8_t pin, HalIsrFn isr);
+void halDetachInterrupt(uint8_t pin);
+
+// Analog input (pressure sensor)
+uint32_t halAnalogReadMilliVolts(uint8_t pin);
+
+// Direct PWM output (PWM test mode only)
+void halPwmBegin(uint8_t pin, uint32_t freqHz, uint8_t resolutionBits);
+void halPwmWrite(uint32_t duty);
+void halPwmEnd(uint8_t pin);
+
+// One-shot microsecond timers
+typedef struct HalTimer* HalTimerHandle;
+typedef void (*HalTimerFn)(void* arg);
+
+HalTimerHandle halTimerCreate(const char* name, HalTimerFn callback, void* arg);
+void halTimerStartOnce(HalTimerHandle timer, uint32_t delayUs);
+void halTimerStop(HalTimerHandle timer);
+
+// Periodic task above loop() priority and below the esp_timer task, so gate
+// pulses are never delayed by it (FreeRTOS task on target, a re-armed timer
+// between loop() passes on host)
+typedef void (*HalTaskFn)(void* arg);
+
+bool halTaskCreatePeriodic(const char* name, HalTaskFn fn, void* arg, uint32_t periodMs);
+// The calling task (tells the transport's task from loop())
+uintptr_t halCurrentTask();
+
+// Hardware watchdog: halWatchdogBegin() subscribes the calling task, which
+// must then call halWatchdogFeed() within timeoutMs or the board resets
+void halWatchdogBegin(uint32_t timeoutMs);
+void halWatchdogFeed();
+bool halResetByWatchdog();          // The previous boot ended in a watchdog reset
+
+// Key-value storage (NVS namespace)
+bool halStorageBegin(const char* ns);
+uint8_t halStorageGetU8(const char* key, uint8_t defaultValue);
+void halStoragePutU8(const char* key, uint8_t value);
+uint32_t halStorageGetU32(const char* key, uint32_t defaultValue);
+void halStoragePutU32(const char* key, uint32_t value);
+size_t halStorageGetBytes(const char* key, void* data, size_t len);
+void halStoragePutBytes(const char* key, const void* data, size_t len);
+size_t halStorageBytesLength(const char* key);
+bool halStorageIsKey(const char* key);
+void halStorageRemove(const char* key);
+
+// File storage (recorded shots)
+bool halFileBegin();
+bool halFileWrite(const char* path, const uint8_t* data, size_t len, bool append);
+size_t halFileRead(const char* path, uint32_t offset, uint8_t* data, size_t len);
+int32_t halFileSize(const char* path);  // -1 if the file does not exist
+
+// Transport to the client (BLE on target). Commands arrive on their own
+// characteristic; each outgoing stream notifies on its own channel.
+typedef void (*HalReceiveFn)(const char* data);
+
+enum HalChannel {
+  HAL_CHANNEL_RESPONSE = 0,  // JSON responses and status
+  HAL_CHANNEL_TELEMETRY,     // Binary telemetry frames
+  HAL_CHANNEL_LOG,           // JSON serial_log lines
+  HAL_CHANNEL_COUNT
+};
+
+void halTransportBegin(const char* deviceName, HalReceiveFn onReceive);
+bool halTransportConnected();
+void halTransportRestartAdvertising();
+void halTransportNotify(HalChannel channel, const uint8_t* data, size_t len);
+// Commands run on the transport's task; guards state it shares with loop()
+// (keep it to a few copies, not ISR-safe)
+void halTransportLock();
+void halTransportUnlock();
+// Commands arrive on the transport's task and from loop() (WebSocket,
+// console): one at a time under this lock (a mutex, may block)
+void halCommandLock();
+void halCommandUnlock();
+
+// TCP sockets (lwIP over WiFi on target, BSD sockets on host). Everything
+// is non-blocking; a socket is its descriptor, -1 = none.
+int halTcpListen(uint16_t port);
+int halTcpAccept(int listener);
+int halTcpRead(int socket, uint8_t* buffer, size_t len);       // Bytes, 0 = nothing yet, -1 = closed
+int halTcpWrite(int socket, const uint8_t* data, size_t len);  // Bytes taken, 0 = full, -1 = closed
+void halTcpClose(int socket);
+
+// Memory (0 on host: not tracked)
+uint32_t halFreeHeap();
+uint32_t halLargestFreeBlock();
+uint32_t halStackHighWaterMark();   // Unused stack of the calling task, bytes
+
+// CRC-32 (IEEE, as zlib's crc32()): start at 0, pass the previous result to
+// continue over more data (ROM routine on target)
+uint32_t halCrc32(uint32_t crc, const uint8_t* data, size_t len);
+
+// Debug console (Serial on target)
+void halConsolePrintln(const char* line);
+void halConsoleSetEnabled(bool enabled);  // Mute for benchmarks/simulation
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef HAL_NATIVE_H
+#define HAL_NATIVE_H
+
+// Host-only hooks into the native HAL (simulator, benchmarks, host main).
+#ifndef ARDUINO
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hal.h"
+
+typedef void (*HalNativeTransportFn)(HalChannel channel, const uint8_t* data, size_t len, void* ctx);
+typedef void (*HalNativePinFn)(uint8_t pin, bool high, void* ctx);
+typedef void (*HalNativeIdleFn)(uint64_t untilUs, void* ctx);
+
+// Clock: wall clock by default; manual mode freezes time until advanced
+void halNativeUseManualClock(bool manual);
+void halNativeSetTimeUs(uint64_t us);
+uint64_t halNativeTimeUs();
+// Called instead of jumping the manual clock when firmware blocks in
+// halDelay(); the hook must run the simulation up to untilUs
+void halNativeOnIdle(HalNativeIdleFn fn, void* ctx);
+
+// Fires the interrupt attached to pin (if any), as the edge would on target
+void halNativeTriggerInterrupt(uint8_t pin);
+// Runs timer callbacks whose deadline has passed; returns how many fired
+int halNativeRunDueTimers();
+// Earliest pending timer deadline, or UINT64_MAX when none is armed
+uint64_t halNativeNextTimerUs();
+// Periodic tasks keep their schedule but skip their body (a hung task)
+void halNativeSuspendTasks(bool suspended);
+// The watchdog was started and not fed within its timeout (target: reset)
+bool halNativeWatchdogExpired();
+
+void halNativeSetPinInput(uint8_t pin, bool high);
+void halNativeOnPinWrite(HalNativePinFn fn, void* ctx);
+void halNativeSetAnalogMilliVolts(uint8_t pin, uint32_t mv);
+
+// Transport: connected by default, notifications go to stdout (telemetry
+// frames as "telemetry <hex>")
+void halNativeSetConnected(bool connected);
+void halNativeOnTransport(HalNativeTransportFn fn, void* ctx);
+
+// Drops all stored keys and files
+void halNativeResetStorage();
+
+#endif
+
+#endif
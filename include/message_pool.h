@@ -0,0 +1,55 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+// ============================================================================
+// MESSAGE POOL - fixed blocks for the JSON documents
+// ============================================================================
+//
+// A message document takes its whole capacity in one allocation when it is
+// built and returns it when it goes out of scope. MessageDocument takes it
+// from blocks reserved at link time instead of the heap: the smallest free
+// block that fits, the heap only when every fitting block is in use (counted
+// as a fallback so the pool can be resized). Nothing the firmware does per
+// message or per tick touches the heap, so a long uptime can't fragment it.
+// Documents are built from the loop and from the BLE task, so the block
+// bitmaps are taken under the transport lock.
+
+#define MESSAGE_POOL_SMALL_BYTES 256    // Most responses
+#define MESSAGE_POOL_SMALL_COUNT 8
+#define MESSAGE_POOL_MEDIUM_BYTES 512
+#define MESSAGE_POOL_MEDIUM_COUNT 4
+#define MESSAGE_POOL_LARGE_BYTES 1536   // Command parsing, calibration, perf stats
+#define MESSAGE_POOL_LARGE_COUNT 3
+#define MESSAGE_POOL_CLASSES 3
+
+struct MessagePoolStats {
+  uint8_t inUse[MESSAGE_POOL_CLASSES];
+  uint8_t highWater[MESSAGE_POOL_CLASSES];
+  uint32_t allocations;                 // From the pool
+  uint32_t fallbacks;                   // Went to the heap (pool exhausted or too large)
+};
+
+extern MessagePoolStats messagePoolStats;
+
+// ArduinoJson allocator over the pool
+struct MessagePoolAllocator {
+  void* allocate(size_t size);
+  void deallocate(void* pointer);
+  void* reallocate(void* pointer, size_t newSize);
+};
+
+typedef BasicJsonDocument<MessagePoolAllocator> MessageDocument;
+
+// Capacity that always holds the parse of json: a slot per value (each one
+// follows a ',' or an opening bracket) plus room to copy every string
+size_t messageDocBytesFor(const char* json, size_t length);
+
+// {"small":[inUse,highWater,blocks],...,"allocs":n,"fallbacks":n}
+void addMessagePoolStats(JsonObject pool);
+
+#endif
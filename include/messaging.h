@@ -0,0 +1,96 @@
+#ifndef MESSAGING_H
+#define MESSAGING_H
+
+#include <ArduinoJson.h>
+
+#include "message_pool.h"
+#include "subscriptions.h"
+#include "ws_server.h"
+
+// Longest JSON message sent in one notification (a 512-byte ATT value at the
+// 517-byte MTU). Responses are serialized straight into a buffer of this size;
+// one that does not fit is not sent (cut JSON is no use to a client), so list
+// responses that can grow go out through PagedResponse.
+#define MAX_MESSAGE_LENGTH 500
+#define PAGE_DOC_BYTES 1024             // Document of one page (<= MAX_MESSAGE_LENGTH of JSON)
+
+// Outgoing priority: responses are notified immediately on the response
+// channel. Telemetry frames wait in a single latest-wins slot and log lines
+// in a small FIFO (oldest dropped when full); pumpTransmitQueue() sends up
+// to TX_NOTIFY_BUDGET of them per loop pass, telemetry first. A burst of
+// either can therefore never sit in front of a command ack. WebSocket
+// clients get every message through their own queues.
+#define TX_LOG_SLOTS 8                  // Queued serial_log lines
+#define TX_NOTIFY_BUDGET 2              // Queued notifications per loop pass
+
+extern uint32_t txTelemetryDropped;     // Frames replaced before they went out
+extern uint32_t txLogDropped;           // Log lines dropped from a full queue
+
+// Serial/stdout only
+void consolePrintf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+// Console AND serial_log notification to the client
+void logPrintf(const char* level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// BLE client or an open WebSocket client (ws_server.h)
+bool clientConnected();
+
+// Per-client sends (status deltas): the BLE client, then each WebSocket slot
+#define MESSAGE_CLIENT_BLE 0
+#define MESSAGE_CLIENT_WS 1
+#define MESSAGE_CLIENT_COUNT (MESSAGE_CLIENT_WS + WS_MAX_CLIENTS)
+#define MESSAGE_CLIENTS_ALL ((uint8_t)((1u << MESSAGE_CLIENT_COUNT) - 1))  // Bit per client
+
+bool messageClientConnected(int client);
+// JSON on the response channel of one client; false if it was not sent
+bool sendJsonTo(int client, const char* json, size_t length);
+
+void sendResponse(JsonDocument& doc);
+// While set, responses with a "status" (command acks) that the calling task
+// sends go to the hook instead of the clients; "type" messages (data) and
+// other tasks' responses are still sent. NULL to clear.
+typedef void (*ResponseHook)(JsonDocument& doc);
+void setResponseHook(ResponseHook hook);
+// Console always; client only if the logs topic takes the level
+void sendLogMessage(const char* message, const char* level = "info");
+// Console always; client only if the topic is due (periodic log lines)
+void sendTopicLog(SubscriptionTopic topic, const char* message, const char* level);
+
+// A list response in pages that each fit one notification. The members set
+// on header() are repeated on every page and the list is split between them;
+// when there is more than one page each carries "page" (from 0) and the last
+// one also "done":true. Set the header first, then per item fill item() and
+// add() it (add(key) for a list that is an object), then finish(). itemBytes
+// sizes item() for lists of larger items.
+class PagedResponse {
+ public:
+  explicit PagedResponse(const char* listKey, bool keyed = false,
+                         size_t itemBytes = MESSAGE_POOL_SMALL_BYTES);
+
+  JsonObject header() { return header_.as<JsonObject>(); }
+  JsonVariant item();
+  void add(const char* key = NULL);
+  void finish();
+
+ private:
+  void startPage();
+  void flushPage(bool last);
+
+  const char* listKey_;
+  bool keyed_;
+  MessageDocument header_;
+  MessageDocument item_;
+  MessageDocument page_;
+  bool pageStarted_;
+  int pageIndex_;
+  int pageItems_;
+  size_t pageBytes_;                    // Serialized length of page_ so far
+};
+
+// Queue a binary telemetry frame for the clients in the mask (topicDue());
+// on BLE it replaces one not yet sent
+void sendTelemetryFrame(const uint8_t* frame, size_t len, uint8_t clients = MESSAGE_CLIENTS_ALL);
+// Call once per loop pass; resetTransmitQueue() on disconnect
+void pumpTransmitQueue();
+void resetTransmitQueue();
+
+#endif
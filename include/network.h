@@ -0,0 +1,14 @@
+#ifndef NETWORK_H
+#define NETWORK_H
+
+// WiFi and OTA configuration
+extern char wifiSSID[64];      // WiFi SSID (set via BLE command)
+extern char wifiPassword[64];  // WiFi password (set via BLE command)
+extern bool wifiConfigured;
+extern bool wifiConnected;
+
+void setWiFiCredentials(const char* ssid, const char* password);
+void setupWiFi();
+void performOTAUpdate(const char* firmwareUrl);
+
+#endif
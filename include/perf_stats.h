@@ -0,0 +1,113 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "hal.h"
+
+#ifdef ARDUINO
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#endif
+
+// ============================================================================
+// RUNTIME PERFORMANCE COUNTERS
+// ============================================================================
+//
+// Always-on instrumentation read with {"command":"get_perf_stats"}. A section
+// costs two cycle-counter reads and a few adds; a histogram sample one
+// count-leading-zeros. The ISR, gate timer and control tick counters each
+// have one writer and are read unsynchronised (a value may be one sample
+// stale). Commands (BLE task and loop) and sends (any task) are recorded with
+// perfEndShared(), under the transport lock. Build with -DPERF_STATS=0 to
+// compile everything out.
+
+#ifndef PERF_STATS
+#define PERF_STATS 1
+#endif
+
+enum PerfSection {
+  PERF_ZC_ISR = 0,        // zeroCrossISR
+  PERF_PULSE_TIMER,       // pulseTimerCallback (includes the gate pulse)
+  PERF_CONTROL_TICK,      // executeProfile from the main loop
+  PERF_COMMAND,           // handleCommand (parse, dispatch, responses), shared
+  PERF_TRANSPORT_SEND,    // halTransportNotify (BLE notify, any channel), shared
+  PERF_SECTION_COUNT
+};
+
+enum PerfHistogramId {
+  PERF_HIST_LOOP_PERIOD = 0,  // Time between appLoop() calls
+  PERF_HIST_ISR_LATENCY,      // Gate timer deadline -> callback running
+  PERF_HIST_ZC_TO_GATE,       // Zero-cross ISR -> gate pin high
+  PERF_HISTOGRAM_COUNT
+};
+
+// log2 buckets in µs: bucket 0 = 0 µs, bucket i = [2^(i-1), 2^i) µs, last = open-ended
+#define PERF_HISTOGRAM_BUCKETS 16
+
+struct PerfCounter {
+  uint32_t count;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+};
+
+struct PerfHistogram {
+  uint32_t buckets[PERF_HISTOGRAM_BUCKETS];
+  uint32_t maxUs;
+};
+
+extern PerfCounter perfCounters[PERF_SECTION_COUNT];
+extern PerfHistogram perfHistograms[PERF_HISTOGRAM_COUNT];
+
+// Start of a timed section: pass the result to perfEnd()
+static inline uint32_t IRAM_ATTR perfBegin() {
+#if PERF_STATS
+  return halCycleCount();
+#else
+  return 0;
+#endif
+}
+
+static inline void IRAM_ATTR perfEnd(PerfSection section, uint32_t startCycles) {
+#if PERF_STATS
+  uint32_t cycles = halCycleCount() - startCycles;
+  PerfCounter& c = perfCounters[section];
+  c.count++;
+  c.totalCycles += cycles;
+  if (cycles > c.maxCycles) c.maxCycles = cycles;
+#endif
+}
+
+// Same, for a section timed from more than one task (not from an ISR)
+static inline void perfEndShared(PerfSection section, uint32_t startCycles) {
+#if PERF_STATS
+  uint32_t cycles = halCycleCount() - startCycles;
+  halTransportLock();
+  PerfCounter& c = perfCounters[section];
+  c.count++;
+  c.totalCycles += cycles;
+  if (cycles > c.maxCycles) c.maxCycles = cycles;
+  halTransportUnlock();
+#endif
+}
+
+static inline void IRAM_ATTR perfRecordUs(PerfHistogramId id, uint32_t us) {
+#if PERF_STATS
+  PerfHistogram& h = perfHistograms[id];
+  int bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+  if (bucket >= PERF_HISTOGRAM_BUCKETS) bucket = PERF_HISTOGRAM_BUCKETS - 1;
+  h.buckets[bucket]++;
+  if (us > h.maxUs) h.maxUs = us;
+#endif
+}
+
+// Called at the top of appLoop(): loop period + once-a-second memory sample
+void perfLoopTick();
+// Stack left on the task handling commands (sampled by get_perf_stats)
+void perfSampleCommandStack();
+void resetPerfStats();
+void sendPerfStats();
+
+#endif
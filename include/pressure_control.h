@@ -0,0 +1,81 @@
+#ifndef PRESSURE_CONTROL_H
+#define PRESSURE_CONTROL_H
+
+#include <stdint.h>
+
+// ============================================================================
+// PRESSURE CONTROLLER - scheduled PID trim with relay autotune
+// ============================================================================
+//
+// The feedforward level (calibration curve + pump dynamics) is corrected by
+// a PID on the transducer reading. Gains come from a relay-feedback autotune
+// (Astrom-Hagglund): around each band setpoint the level is switched
+// between bias +/- amplitude with a small hysteresis; the limit cycle's
+// amplitude a and period Tu give the ultimate gain Ku = 4d / (pi sqrt(a^2 - eps^2)).
+// The bias starts at the calibrated level and follows the mean output of
+// lopsided cycles (biased relay), so a poor calibration still closes a cycle.
+// Tyreus-Luyben rules turn (Ku, Tu) into gains, which are interpolated by
+// target pressure at runtime. After tuning, a closed-loop step between the
+// lowest and highest band measures rise time, overshoot and settling time.
+
+#define PID_MAX_BANDS 4
+#define PID_DEFAULT_BANDS 3             // 3, 6 and 9 bar
+#define PID_RELAY_AMPLITUDE 15          // Dim level swing (%) around the bias
+#define PID_RELAY_HYSTERESIS_BAR 0.1f
+#define PID_RELAY_WARMUP_CYCLES 2       // Limit cycles ignored while it forms
+#define PID_RELAY_CYCLES 4              // Limit cycles averaged
+#define PID_RELAY_TIMEOUT_MS 40000      // Per band
+#define PID_RELAY_DWELL_MAX_MS 4000     // Longer on one side: re-bias by half the amplitude
+#define PID_RELAY_MAX_ASYMMETRY 0.3f    // (high - low) / (high + low) dwell above this: re-bias
+#define PID_RELAY_MAX_OVER_BAR 3.0f     // Abort above setpoint + this
+#define PID_AUTOTUNE_MAX_SETPOINT_BAR 10.0f
+#define PID_MIN_TARGET_BAR 1.0f         // Below this the feedforward runs alone
+#define PID_INTEGRAL_LIMIT 30.0f        // Max integral contribution (% level)
+#define PID_INTEGRAL_ZONE_BAR 1.0f      // Integrate only this close to target
+#define PID_DERIVATIVE_TAU_S 0.1f       // Low-pass on the derivative term
+#define PID_STEP_HOLD_MS 4000           // Step test: settle at the low setpoint
+#define PID_STEP_RECORD_MS 6000         // Step test: observe the step
+#define PID_SETTLE_BAND_BAR 0.2f
+
+struct PidBand {
+  float setpointBar;
+  float ultimateGain;                   // Ku, % level per bar
+  float ultimatePeriodMs;               // Tu
+  float kp;                             // % per bar
+  float ki;                             // % per bar-second
+  float kd;                             // % second per bar
+};
+
+struct PidSchedule {
+  uint8_t bandCount;
+  PidBand bands[PID_MAX_BANDS];         // Ascending setpoints
+};
+
+struct StepMetrics {
+  float fromBar;
+  float toBar;
+  float riseTimeMs;                     // 10% -> 90% of the step
+  float overshootPct;
+  float settlingTimeMs;                 // Last exit from +/- PID_SETTLE_BAND_BAR
+};
+
+extern PidSchedule pidSchedule;
+extern bool pidScheduleValid;
+extern bool pressureControlEnabled;
+extern bool autotuneRunning;
+extern StepMetrics lastStepMetrics;
+
+void loadPressureControl();
+void setPressureControlEnabled(bool enabled);
+void sendPressureControlStatus();
+
+// Closed loop: call resetPressureControl() when a run starts, then once per
+// tick with the feedforward level; returns the level to apply
+void resetPressureControl();
+int pressureControlUpdate(float targetBar, float measuredBar, float feedforwardLevel);
+
+void startAutotune(const float* setpoints, int count, int amplitude);
+void stopAutotune(const char* reason);
+void autotuneTick();                    // From loop() while autotuneRunning
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef PROFILE_CLOCK_H
+#define PROFILE_CLOCK_H
+
+#include <stdint.h>
+
+// ============================================================================
+// PROFILE CLOCK - time base of profile execution
+// ============================================================================
+//
+// Profile timing, shot samples, telemetry frames and log timestamps read this
+// clock rather than halMillis(). It counts 64-bit microseconds from
+// halMicros64(), so it neither wraps nor loses resolution over a long
+// uptime. It follows real time except during a dry run, when it runs
+// `speed` times faster: the profile plays out at that speed with the triac
+// held off and the client gets the computed target/dim trace. Ending the dry
+// run puts the clock back on real time.
+
+#define PROFILE_CLOCK_MAX_SPEED 50      // A 40 s profile in under a second
+
+// Microseconds since boot on the profile clock
+uint64_t profileMicros();
+// Same in milliseconds, truncated to 32 bits (timestamps)
+uint32_t profileMillis();
+uint8_t profileClockSpeed();
+// 1 = real time (jumps back to halMillis())
+void setProfileClockSpeed(uint8_t speed);
+
+#endif
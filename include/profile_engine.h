@@ -0,0 +1,52 @@
+#ifndef PROFILE_ENGINE_H
+#define PROFILE_ENGINE_H
+
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+// Runtime segment table, filled once when a profile starts so the control
+// tick never touches JSON (stored profiles hold 10 segments). Times are in
+// ms and values in thousandths, so the target at any time is an exact
+// integer interpolation.
+#define PROFILE_MAX_SEGMENTS 32
+#define PROFILE_VALUE_SCALE 1000        // Segment values: 0.001 bar or ml/s
+
+struct RuntimeSegment {
+  uint32_t startMs;
+  uint32_t endMs;
+  int32_t startValue;  // bar, or ml/s for flow segments (PROFILE_VALUE_SCALE)
+  int32_t endValue;
+  bool flow;
+};
+
+// Profile execution variables
+extern bool isRunning;
+extern int64_t startTimeUs;          // Profile clock at 0 s into the profile (may be < 0 after resume_at)
+extern int currentSegment;
+extern int totalSegments;
+extern float currentTargetPressure;  // Last commanded pressure (bar), 0 when idle
+extern float currentTargetFlow;      // Last commanded flow (ml/s), 0 outside flow segments
+extern bool dryRunActive;            // Profile plays on the fast clock, triac held off
+
+// Power-up safety: Prevents auto-start if switch is ON at boot
+extern bool powerUpSafetyActive;
+
+// atSeconds > 0 starts partway in (resume_at, e.g. after a brownout)
+void startProfile(JsonObject profile, float atSeconds = 0.0f);
+void stopProfile();
+void executeProfile();
+// Moves the running profile to a time on its timeline (false when idle)
+bool seekProfile(float seconds);
+// Time into the running profile on the profile clock
+uint32_t profileElapsedMs();
+// The next profile start is a dry run at `speed`x (profile_clock.h): open
+// loop, triac inhibited, no relays or shot recording. Ends with the profile.
+void beginDryRun(uint8_t speed);
+void endDryRun();
+void startDefaultProfile(int button);
+void startProfileById(uint8_t profileId, float atSeconds = 0.0f);
+void initHardwareButtons();
+void checkHardwareButtons();
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef PROFILE_UPLOAD_H
+#define PROFILE_UPLOAD_H
+
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+// ============================================================================
+// PROFILE UPLOAD - chunked, resumable transfer of profile sets
+// ============================================================================
+//
+// A profile set that does not fit in one command write goes up in chunks:
+//   upload_begin   {"size":N,"crc":C}                   -> upload_ready + offset
+//   upload_chunk   {"offset":O,"data":"<base64>","crc":c} -> upload_ack + offset
+//   upload_commit                                       -> upload_done
+//   upload_abort
+// The object is newline-separated records {"id":3,"profile":{...}} ("p" also
+// works), i.e. store_profile commands without the "command". Every chunk
+// carries the CRC-32 of its decoded bytes and begin the CRC-32 of the whole
+// object, checked again at commit. The staged bytes survive a disconnect: an
+// upload_begin with the same size and crc answers with the offset reached
+// and the client goes on from there. Chunks must arrive in order; one from
+// the wrong offset is refused with the expected offset (a repeat of one
+// already taken is acked). Commit checks every record before storing any,
+// then writes NVS once; a record that still fails to store rolls back the
+// others and answers upload_error "store failed".
+
+#define UPLOAD_MAX_BYTES 8192         // Ten 10-segment profiles with full field names are ~7.3 KB
+#define UPLOAD_CHUNK_MAX_BYTES 300    // Decoded bytes per chunk: 400 chars base64, one 512-byte write
+
+void handleUploadBegin(JsonObject doc);
+void handleUploadChunk(JsonObject doc);
+void handleUploadCommit();
+void handleUploadAbort();
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef PROFILES_H
+#define PROFILES_H
+
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+#include "config.h"
+
+// Compact profile structure. Pressures are in 0.1 bar; a segment with
+// COMPACT_FLOW_FLAG set in startPressure is a flow segment and both values
+// are in 0.1 ml/s (0-12.7).
+#define COMPACT_FLOW_FLAG 0x80
+
+struct CompactSegment {
+  uint8_t startTime;
+  uint8_t endTime;
+  uint8_t startPressure;
+  uint8_t endPressure;
+};
+
+struct CompactProfile {
+  uint8_t id;
+  char name[16];
+  uint8_t segmentCount;
+  CompactSegment segments[MAX_SEGMENTS];
+  uint8_t totalDuration;
+  uint8_t checksum;
+};
+
+// Profile storage (10 profiles)
+extern CompactProfile storedProfiles[MAX_PROFILES];
+extern uint8_t profileCount;
+
+// Default profiles for hardware buttons (0-9, 255 = none)
+extern uint8_t defaultProfile1;  // Profile ID for button 1
+extern uint8_t defaultProfile2;  // Profile ID for button 2
+
+uint8_t calculateChecksum(CompactProfile& profile);
+// Hash reported by get_profile_hashes, for a client to compare with its own
+// copy of the profile before sending store_profile. It is the CRC-32 (zlib /
+// IEEE 802.3, reflected, init and final xor 0xFFFFFFFF) of the stored form,
+// so a client reproduces the firmware's quantization and hashes these bytes:
+//   1 byte       id (slot 0-9)
+//   16 bytes     name: the first 15 bytes of the UTF-8 name, zero padded
+//   1 byte       segment count (the first MAX_SEGMENTS segments are kept)
+//   4 bytes      per kept segment, in order:
+//                  startTime, endTime: seconds as given (0-255)
+//                  pressure segment: trunc(bar * 10) for start and end
+//                  flow segment: COMPACT_FLOW_FLAG | round(ml/s * 10) for
+//                  start, round(ml/s * 10) for end (end defaults to start),
+//                  ml/s clamped to 0-12.7 first
+//   1 byte       total duration: the largest endTime
+// Unused segment slots and the checksum are not hashed. Worked example in
+// QUICK_DEBUG.md ("Profile sync (hashes)").
+uint32_t profileHash(const CompactProfile& profile);
+bool profileSlotUsed(uint8_t id);
+// A profile identical to the stored one (same hash) is left alone: no NVS
+// write. persist = false leaves the NVS write to the caller (saveProfiles())
+bool storeProfile(uint8_t id, JsonObject profileData, bool persist = true);
+void clearAllProfiles();
+bool setDefaultProfile(int button, uint8_t profileId);
+void sendProfileStatus();
+void sendProfileHashes();
+void saveProfiles();
+void loadProfiles();
+void saveDefaultProfiles();
+void loadDefaultProfiles();
+
+// Batched commands: between begin and commit the save functions only mark
+// what changed, commit writes it to NVS once; rollback restores the profiles
+// and button defaults as they were at begin, without touching NVS
+void beginProfileTransaction();
+void commitProfileTransaction();
+void rollbackProfileTransaction();
+bool profileTransactionOpen();
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PUMP_DYNAMICS_H
+#define PUMP_DYNAMICS_H
+
+#include <stdint.h>
+
+// ============================================================================
+// PUMP DYNAMICS - first-order-plus-dead-time model and feedforward
+// ============================================================================
+//
+// A step from one dim level to another is fitted with Smith's two-point
+// method: with t28/t63 the times the pressure covers 28.3%/63.2% of the
+// step, tau = 1.5 (t63 - t28) and the dead time theta = t63 - tau.
+// During a profile the target is then evaluated ahead of time so the
+// pressure arrives on schedule:
+//   p_cmd(t) = r(t + theta) + tau * dr/dt(t + theta)
+// and p_cmd is mapped to a dim level through the static calibration curve.
+
+#define PUMP_ID_SAMPLE_MS 20
+#define PUMP_ID_MAX_SAMPLES 500         // 10 s of step response
+#define PUMP_ID_FROM_LEVEL 40           // Default pre-step level (%)
+#define PUMP_ID_TO_LEVEL 80             // Default step level (%)
+#define PUMP_ID_MIN_STEP_BAR 0.5f       // Smaller responses are rejected
+#define PUMP_FF_SLOPE_WINDOW_S 0.1f     // Finite difference for dr/dt
+#define PUMP_FF_MAX_LOOKAHEAD_MS 3000   // Sanity limit on theta and tau
+
+struct PumpDynamics {
+  float gainBarPerPct;                  // Steady-state gain around the step
+  float tauMs;
+  float deadTimeMs;
+};
+
+extern PumpDynamics pumpDynamics;
+extern bool pumpDynamicsValid;
+extern bool feedforwardEnabled;
+extern bool pumpIdentificationRunning;
+
+void loadPumpDynamics();
+void startPumpIdentification(int fromLevel, int toLevel);
+void stopPumpIdentification(const char* reason);
+void pumpIdentificationTick();          // From loop() while running
+void sendPumpDynamics();
+void setFeedforwardEnabled(bool enabled);
+
+// Feedforward pressure command; targetAt(seconds) evaluates the profile
+float feedforwardPressure(float seconds, float (*targetAt)(float seconds));
+
+#endif
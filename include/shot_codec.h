@@ -0,0 +1,110 @@
+#ifndef SHOT_CODEC_H
+#define SHOT_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// SHOT CODEC - streaming compressor for recorded shots
+// ============================================================================
+//
+// A shot is a stream of samples with five channels. Every channel is first
+// quantized to the resolution the hardware can actually deliver, then coded
+// as a zigzag varint of either its first difference (noisy channels) or its
+// second difference (timestamps, ramps and counters, which are near-linear).
+//
+// Stream layout:
+//   header (8 bytes): 'S' 'H' version channels orderMask pressureQuant(u16 LE) reserved
+//   record:           tag [varint per flagged channel]
+//
+// Tag byte:
+//   0x00-0x1F  bit n set = channel n has a non-zero residual, varints follow
+//   0x80-0xFF  run of (tag & 0x7F) + 1 samples whose residuals are all zero
+//
+// Quantized values are plain integers, so an XOR float coder would only add
+// noise bits; integer residuals of a steady shot are 0 and cost nothing.
+
+#define SHOT_CODEC_VERSION 1
+#define SHOT_CHANNELS 5
+#define SHOT_HEADER_SIZE 8
+
+// Quantization steps (matched to sensor/actuator resolution)
+#define SHOT_PRESSURE_QUANT 100     // 0.01 bar steps (12-bit ADC over 0-12 bar ~ 0.003 bar)
+#define SHOT_MAX_RUN 128            // Longest run a single tag byte can describe
+
+#ifndef SHOT_ENCODER_BUFFER
+#define SHOT_ENCODER_BUFFER 256     // Bytes buffered before handing off to the sink
+#endif
+
+// Channel indices
+enum ShotChannel {
+  SHOT_CH_TIME = 0,         // ms since shot start (delta-of-delta)
+  SHOT_CH_TARGET = 1,       // target pressure (delta-of-delta, profiles are linear ramps)
+  SHOT_CH_PRESSURE = 2,     // measured pressure (delta, sensor noise)
+  SHOT_CH_DIM = 3,          // dim level % (delta, step changes)
+  SHOT_CH_FIRED = 4         // cumulative fired half-cycles (delta-of-delta, constant rate)
+};
+
+struct ShotSample {
+  uint32_t timeMs;          // ms since shot start
+  float targetPressure;     // bar
+  float pressure;           // bar (measured)
+  uint8_t dimLevel;         // 0-100 %
+  uint32_t firedCount;      // half-cycles fired since shot start
+};
+
+// Receives encoded bytes (header first). Called whenever the internal buffer
+// fills up and once more from finish().
+typedef void (*ShotSinkFn)(const uint8_t* data, size_t len, void* ctx);
+
+class ShotEncoder {
+ public:
+  void begin(ShotSinkFn sink, void* ctx);
+  void add(const ShotSample& sample);
+  void finish();
+
+  uint32_t sampleCount() const { return samples; }
+  uint32_t bytesWritten() const { return written + bufferLen; }
+
+ private:
+  void flushRun();
+  void putByte(uint8_t b);
+  void putVarint(uint32_t v);
+  void flush();
+
+  ShotSinkFn sinkFn;
+  void* sinkCtx;
+  uint8_t buffer[SHOT_ENCODER_BUFFER];
+  size_t bufferLen;
+  uint32_t written;
+  uint32_t samples;
+  uint16_t zeroRun;
+  int32_t prev[SHOT_CHANNELS];
+  int32_t prevDelta[SHOT_CHANNELS];
+};
+
+// Decodes a complete stream held in memory (flash file or downloaded chunks).
+class ShotDecoder {
+ public:
+  // Returns false if the header is missing or from an unknown version
+  bool begin(const uint8_t* data, size_t len);
+  // Returns false at end of stream or on a truncated record
+  bool next(ShotSample& out);
+
+ private:
+  bool getVarint(uint32_t& v);
+
+  const uint8_t* data;
+  size_t len;
+  size_t pos;
+  uint8_t orderMask;
+  uint16_t pressureQuant;
+  uint16_t pendingRun;
+  int32_t prev[SHOT_CHANNELS];
+  int32_t prevDelta[SHOT_CHANNELS];
+};
+
+// Size of the uncompressed representation (timestamp + four 32-bit channels)
+#define SHOT_RAW_SAMPLE_SIZE 20
+
+#endif
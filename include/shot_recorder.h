@@ -0,0 +1,24 @@
+#ifndef SHOT_RECORDER_H
+#define SHOT_RECORDER_H
+
+#include <stdint.h>
+
+// Shot recording (compressed with shot_codec, stored in flash files)
+#define SHOT_SAMPLE_INTERVAL_MS 10  // 100 Hz
+#define SHOT_SLOTS 8                // Ring of most recent shots kept in flash
+#define SHOT_CHUNK_BYTES 240        // Raw bytes per BLE chunk (320 chars base64)
+#define SHOT_WRITE_BUFFER 512       // RAM per flash write buffer (two of them)
+
+extern bool shotRecording;
+extern uint32_t shotSeq;            // Id of the next shot (persisted in NVS)
+
+void loadShotIndex();
+void beginShotRecording();
+void recordShotSample(float targetPressure);
+void finishShotRecording();
+void sendShotList();
+void sendShotData(uint32_t shotId, uint32_t offset);
+void shotTransferTick();            // From loop(): next chunk of a get_shot
+void shotRecorderTick();            // From loop(): writes recorded blocks to flash
+
+#endif
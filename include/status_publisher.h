@@ -0,0 +1,29 @@
+#ifndef STATUS_PUBLISHER_H
+#define STATUS_PUBLISHER_H
+
+#include <stdint.h>
+
+// ============================================================================
+// STATUS PUBLISHER - status_update as per-client deltas
+// ============================================================================
+//
+// Every client (BLE and each WebSocket slot) keeps the last status it was
+// sent. sendStatusUpdate() compares the current state against it and sends
+// only the fields that changed, or nothing at all, so an idle connection is
+// quiet. Each message carries "seq", +1 per status message to that client,
+// and "full":true when it is a complete snapshot. A client that sees a gap
+// asks get_status and gets a snapshot; a new connection, a subscribe that
+// touches the status topic and a message the transport had to drop also
+// restart the client from one. Uptime is only in snapshots; pressure is
+// only re-sent once it moved by STATUS_PRESSURE_DEADBAND_BAR.
+
+#define STATUS_PRESSURE_DEADBAND_BAR 0.1f
+#define STATUS_DOC_SIZE 512             // Snapshot with both profile names
+
+// Changes to the connected clients in the mask (bit per MESSAGE_CLIENT_*,
+// default all; snapshots where one is due)
+void sendStatusUpdate(uint8_t clients = 0xFF);
+// Next update to this client (MESSAGE_CLIENT_*) is a snapshot
+void resetStatusClient(int client);
+
+#endif
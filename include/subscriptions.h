@@ -0,0 +1,64 @@
+#ifndef SUBSCRIPTIONS_H
+#define SUBSCRIPTIONS_H
+
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+// ============================================================================
+// SUBSCRIPTIONS - which unsolicited streams the client receives
+// ============================================================================
+//
+// Command responses always go out. The periodic streams are topics, and
+// every client (MESSAGE_CLIENT_*: BLE and each WebSocket slot) subscribes on
+// its own, so a slow BLE link's limits never thin out a WebSocket client's
+// full-rate stream. The producer asks topicDue() before building the
+// message and gets the clients it is due for; with none, the stream costs
+// neither serialization nor airtime. Each topic keeps only every
+// `decimate`-th event and at most `rate` per second for that client. A new
+// connection starts with the defaults (everything, as before).
+
+enum SubscriptionTopic {
+  TOPIC_TELEMETRY = 0,  // Binary telemetry frames, every control tick while brewing
+  TOPIC_LOGS,           // serial_log at or above the subscribed level
+  TOPIC_STATUS,         // status_update (1 Hz)
+  TOPIC_TRIAC_STATS,    // [PSM STATS] lines (1 Hz)
+  TOPIC_COUNT
+};
+
+enum LogLevel {
+  LOG_DEBUG = 0,
+  LOG_INFO,
+  LOG_WARN,
+  LOG_ERROR
+};
+
+struct TopicSubscription {
+  bool enabled;
+  uint16_t minIntervalMs;  // From the rate limit, 0 = unlimited
+  uint8_t decimation;      // Keep every Nth event (1 = all)
+  uint8_t minLevel;        // TOPIC_LOGS only (LogLevel)
+  uint8_t skipCount;       // Events dropped since the last kept one
+  unsigned long lastSent;
+  uint32_t sent;
+  uint32_t suppressed;
+};
+
+// Every client on the defaults, counters cleared (once at boot)
+void initSubscriptions();
+// Defaults for one client (new connection or "reset":true); keeps its counters
+void resetSubscriptions(int client);
+
+// Connected clients an event on the topic is due for now, one bit per
+// MESSAGE_CLIENT_* (0 = build nothing); counts it for each of them
+uint8_t topicDue(SubscriptionTopic topic);
+// TOPIC_LOGS with each client's level filter applied first
+uint8_t logDue(const char* level);
+
+// {"telemetry":{"rate":10,"decimate":2},"logs":{"level":"warn"},"status":false,...}
+// for the client that sent it: true = defaults, false = off, an object
+// changes only the given fields
+void applySubscriptions(int client, JsonObject topics);
+void sendSubscriptions(int client);
+
+#endif
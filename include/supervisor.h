@@ -0,0 +1,72 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdint.h>
+
+// ============================================================================
+// SAFETY SUPERVISOR - independent limits on the triac drive
+// ============================================================================
+//
+// A periodic task above loop() priority checks the drive every
+// SUPERVISOR_PERIOD_MS and is the only feeder of the hardware watchdog, so a
+// hung supervisor resets the board. While the triac is on it trips on:
+//   - loop_stall          loop() has not run for SUPERVISOR_LOOP_STALL_MS
+//   - brew_duration       a profile ran past its timeline (plus grace) or
+//                         past SUPERVISOR_MAX_BREW_MS
+//   - zc_timeout          no zero-cross for SUPERVISOR_ZC_TIMEOUT_MS
+//   - fired_without_zc    a gate pulse that no zero-cross armed
+//   - over_pressure       above SUPERVISOR_MAX_PRESSURE_BAR (transducer only)
+// A trip clears the control word from the task itself (forceTriacOff): the
+// next crossing fires nothing and an already armed pulse is dropped, so the
+// triac is off within the half-cycle. setTriacLevel() holds it at 0 until
+// loop() has stopped the run, recorded the trip and sent safety_trip.
+
+#define SUPERVISOR_PERIOD_MS 5
+#define SUPERVISOR_WATCHDOG_MS 5000           // Hardware reset when the task stops feeding
+#define SUPERVISOR_LOOP_STALL_MS 2000         // Above the 1 s connection greeting in loop()
+#define SUPERVISOR_MAX_BREW_MS 120000UL
+#define SUPERVISOR_BREW_GRACE_MS 2000         // Past the timeline end before brew_duration
+#define SUPERVISOR_ZC_TIMEOUT_MS 30           // Three half-cycles at 50 Hz
+#define SUPERVISOR_MAX_PRESSURE_BAR 12.5f     // Above the OPV, below the transducer's end
+#define SUPERVISOR_PRESSURE_HOLD_MS 100       // Continuous, so noise spikes do not trip
+#define SUPERVISOR_TRIP_LOG 8                 // Trips kept in RAM
+
+enum SafetyTripReason {
+  TRIP_NONE = 0,
+  TRIP_WATCHDOG,          // Recorded at boot after a watchdog reset
+  TRIP_LOOP_STALL,
+  TRIP_BREW_DURATION,
+  TRIP_ZC_TIMEOUT,
+  TRIP_FIRED_WITHOUT_ZC,
+  TRIP_OVER_PRESSURE,
+  TRIP_REASON_COUNT
+};
+
+struct SafetyTrip {
+  uint8_t reason;         // SafetyTripReason
+  uint32_t atMs;          // halMillis() when the supervisor tripped
+  float value;            // What tripped: ms, pulses or bar
+};
+
+extern SafetyTrip safetyTrips[SUPERVISOR_TRIP_LOG];  // Ring, newest at (safetyTripCount - 1)
+extern uint32_t safetyTripCount;                     // Since first boot (NVS)
+
+// Starts the supervisor task; records a watchdog reset of the previous boot
+void initSupervisor();
+// From loop(): heartbeat, and the stop/record/report half of a pending trip
+void supervisorLoopTick();
+// One supervisor pass (the task body; the native HAL runs it from a timer)
+void supervisorCheck();
+
+// A run that drives the triac: expectedMs is what is left of its timeline
+void supervisorBrewStarted(uint32_t expectedMs);
+void supervisorBrewStopped();
+
+// Tripped and not yet handled by loop(): the triac stays off
+bool supervisorTripped();
+SafetyTripReason supervisorPendingTrip();
+const char* safetyTripName(uint8_t reason);
+
+void sendSafetyStatus();
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// TELEMETRY - fixed-size binary frames for the telemetry characteristic
+// ============================================================================
+//
+// One frame per control tick while brewing, replacing the JSON
+// pressure_update (~130 bytes) with 16 bytes that fit a default-MTU
+// notification. Little-endian:
+//   0  u8   type (TELEMETRY_FRAME_TYPE)
+//   1  u8   flags (TELEMETRY_FLAG_*)
+//   2  u16  sequence, +1 per frame (gaps = frames dropped on the way)
+//   4  u32  run time (ms)
+//   8  u16  pressure (0.01 bar)
+//   10 u16  target: pressure (0.01 bar), or flow (0.01 ml/s) in flow segments
+//   12 u16  estimated flow (0.01 ml/s)
+//   14 u8   dim level (%)
+//   15 u8   segment index
+
+#define TELEMETRY_FRAME_TYPE 0x01
+#define TELEMETRY_FRAME_LENGTH 16
+#define TELEMETRY_FLAG_FLOW 0x01        // Target is a flow
+#define TELEMETRY_FLAG_DRY_RUN 0x02     // Dry run: computed trace, triac held off
+
+struct TelemetrySample {
+  uint32_t timeMs;
+  float pressure;      // bar
+  float target;        // bar, or ml/s when flowSegment
+  float flow;          // ml/s
+  uint8_t dimLevel;
+  uint8_t segment;
+  bool flowSegment;
+  bool dryRun;
+};
+
+// Writes TELEMETRY_FRAME_LENGTH bytes and advances the sequence
+size_t encodeTelemetryFrame(const TelemetrySample& sample, uint8_t* frame);
+
+#endif
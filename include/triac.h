@@ -0,0 +1,129 @@
+#ifndef TRIAC_H
+#define TRIAC_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "hal.h"
+
+#ifdef ARDUINO
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#define DRAM_ATTR
+#endif
+
+// Triac drive state
+enum DimmerMode {
+  DIM_OFF = 0,
+  DIM_ON = 1
+};
+
+// ============================================================================
+// CONTROL WORD AND STATS - what the loop and the ISR share
+// ============================================================================
+//
+// setTriacLevel() publishes mode and duty as one packed 32-bit word with a
+// single atomic store, the generation bumped by compare-and-swap so that
+// the loop and the command task can both write. The ISR loads the word once
+// per zero-cross, so a torn mode/duty pair is impossible, and looks the
+// decision up in the duty's firing pattern (below).
+//
+// forceTriacOff() also sets a forced-off bit that only
+// releaseTriacForcedOff() clears: while it is set every publish keeps the
+// word off, checked inside the CAS retry, so a duty computed before a trip can
+// never land after it.
+//
+// The ISR-side counters go the other way through a seqlock: the ISR makes
+// the sequence odd, updates the block, makes it even again. A reader copies
+// the block and retries until it saw the same even sequence before and
+// after, so zc/fired counts and the interval always come from one edge.
+
+#define TRIAC_CONTROL_DUTY_MASK 0x000000FFu
+#define TRIAC_CONTROL_ON 0x00000100u
+#define TRIAC_CONTROL_FORCED_OFF 0x00000200u
+#define TRIAC_CONTROL_GENERATION_SHIFT 16
+
+struct TriacControl {
+  DimmerMode mode;
+  uint8_t duty;          // 0-100% of half-cycles fired
+  bool forcedOff;        // Safety trip not yet released
+  uint16_t generation;   // +1 per publish
+};
+
+struct TriacStats {
+  uint32_t zcCount;
+  uint32_t firedCount;
+  uint32_t zcIntervalUs;  // Last edge to edge
+  uint32_t lastZcUs;      // halMicros() at the last edge
+};
+
+// Last published control (loop side)
+TriacControl readTriacControl();
+// Consistent copy of the ISR counters
+void readTriacStats(TriacStats* stats);
+// Single fields: one aligned word, no retry needed
+uint32_t triacFiredCount();
+uint32_t triacZcIntervalUs();
+
+// ============================================================================
+// FIRING PATTERNS - which half-cycles a duty level fires
+// ============================================================================
+//
+// One 200-bit mask per duty level covers 100 mains cycles; bit i is the
+// i-th half-cycle, so even and odd bits are opposite polarities. Each
+// polarity fires `duty` of its 100 half-cycles, spread evenly, with the odd
+// sequence half a step behind the even one: every level is DC-free (a
+// Bresenham sequence at 50% fires one polarity only) and the gaps are as
+// short as the duty allows. The ISR walks the window continuously and only
+// switches masks on a duty change, so there is no restart glitch.
+
+#define FIRING_PATTERN_HALF_CYCLES 200
+#define FIRING_PATTERN_WORDS ((FIRING_PATTERN_HALF_CYCLES + 31) / 32)
+
+// Fills the tables (initTriacDrive(); benchmarks call it directly)
+void initFiringPatterns();
+
+extern int dimmerLevel;
+
+// PWM test mode (bypasses zero-cross, direct LEDC PWM)
+extern std::atomic<bool> pwmTestMode;
+
+// Gate pulses, +1 by the timer after the ISR counted the fire; read before
+// the stats so a snapshot never holds a pulse without its fire
+extern std::atomic<uint32_t> pulseCount;
+extern unsigned long offModeStartTime;
+extern std::atomic<bool> zcEnabled;
+
+// Software control mode (bypasses hardware switch safety)
+extern bool swControlEnabled;
+
+// Timer handle
+extern HalTimerHandle pulseTimerHandle;
+
+void IRAM_ATTR zeroCrossISR();
+void IRAM_ATTR pulseTimerCallback(void* arg);
+void initTriacDrive();
+void setTriacLevel(int level);
+// Publish path of setTriacLevel() for duty 1-100: CAS only, no logging and no
+// dimmerLevel, so any task may call it; false if already published or forced off
+bool publishTriacDuty(int duty);
+void setDimLevel(int level);
+// Safety supervisor: clears the control word from any task, no logging, and
+// holds it off until loop() has handled the trip and releases it
+void forceTriacOff();
+void releaseTriacForcedOff();
+void setPwmTestMode(bool enable);
+void setZeroCrossEnabled(bool enabled);
+void printTriacStats();
+
+// Sanity test: OFF, 50%, 100%, OFF, one phase per SANITY_PHASE_MS, stepped
+// from loop() so the supervisor's heartbeat keeps running
+#define SANITY_PHASE_MS 2000
+extern bool sanityTestRunning;
+void startSanityTest();
+void sanityTestTick();  // From loop() while sanityTestRunning
+void stopSanityTest(const char* reason);
+
+#endif
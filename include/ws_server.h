@@ -0,0 +1,42 @@
+#ifndef WS_SERVER_H
+#define WS_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// WS SERVER - HTTP + WebSocket access while WiFi is up
+// ============================================================================
+//
+// BLE notifications top out at a few kB/s; over WiFi the same streams go to
+// WebSocket clients at full rate. A client connects to ws://<ip>/ws, sends
+// JSON commands as text frames (anything handleCommand() takes) and gets
+// responses, status and logs as text frames and telemetry as binary frames
+// (the 16-byte layout in telemetry.h). Responses go to every client, BLE
+// included; the streams follow each client's own subscriptions
+// (subscriptions.h), so a WebSocket client keeps full-rate telemetry
+// whatever the BLE client asked for. Each client has its own send queue and a message that does
+// not fit is dropped for that client instead of waiting on a slow socket.
+// A plain GET returns a short JSON description. wsServerTick() runs it from
+// the loop whenever wifiConnected is set (host build: --ws PORT).
+
+#define WS_SERVER_PORT 80               // Default listening port
+#define WS_MAX_CLIENTS 2
+#define WS_RX_BUFFER 4096               // Largest HTTP request or client frame
+#define WS_TX_QUEUE_BYTES 4096          // Per-client send queue
+#define WS_HANDSHAKE_TIMEOUT_MS 5000    // Request/close must complete within this
+#define WS_LISTEN_RETRY_MS 5000         // Between failed listen attempts
+
+extern uint16_t wsServerPort;
+
+// Listen/accept/read/flush; call once per loop pass
+void wsServerTick();
+int wsServerClientCount();
+bool wsServerClientOpen(int slot);
+// Queue a message for every open client (text = JSON, binary = telemetry)
+void wsServerBroadcast(bool binary, const uint8_t* data, size_t len);
+// Queue for one slot; false when it is not open or the queue is full
+bool wsServerSend(int slot, bool binary, const uint8_t* data, size_t len);
+void sendWsServerStatus();
+
+#endif
@@ -0,0 +1,83 @@
+#include "mains_model.h"
+
+MainsModel::MainsModel(const MainsConfig& config)
+    : config_(config),
+      random_(config.seed),
+      halfPeriodUs_((uint32_t)(500000.0f / config.freqHz + 0.5f)),
+      nextCrossingUs_(0),
+      nextPositive_(true),
+      pendingCount_(0),
+      crossings_(0),
+      glitches_(0) {
+  // Jitter beyond half a half-cycle would reorder crossings
+  if (config_.detectorOffsetUs + config_.jitterUs > halfPeriodUs_ / 2) {
+    config_.jitterUs = config_.detectorOffsetUs < halfPeriodUs_ / 2 ? halfPeriodUs_ / 2 - config_.detectorOffsetUs : 0;
+  }
+  reset(0);
+}
+
+void MainsModel::reset(uint64_t startUs) {
+  random_ = SimRandom(config_.seed);
+  nextCrossingUs_ = startUs + halfPeriodUs_;
+  nextPositive_ = true;
+  pendingCount_ = 0;
+  crossings_ = 0;
+  glitches_ = 0;
+  scheduleEdges(nextCrossingUs_);
+}
+
+uint64_t MainsModel::nextEventUs() const {
+  if (pendingCount_ > 0 && pending_[0].timeUs < nextCrossingUs_) {
+    return pending_[0].timeUs;
+  }
+  return nextCrossingUs_;
+}
+
+MainsEvent MainsModel::pop() {
+  if (pendingCount_ > 0 && pending_[0].timeUs < nextCrossingUs_) {
+    MainsEvent event = pending_[0];
+    for (int i = 1; i < pendingCount_; i++) {
+      pending_[i - 1] = pending_[i];
+    }
+    pendingCount_--;
+    return event;
+  }
+
+  MainsEvent event;
+  event.type = MAINS_ZERO_CROSS;
+  event.timeUs = nextCrossingUs_;
+  event.positiveHalf = nextPositive_;
+  crossings_++;
+
+  nextPositive_ = !nextPositive_;
+  nextCrossingUs_ += halfPeriodUs_;
+  scheduleEdges(nextCrossingUs_);
+  return event;
+}
+
+// Called one half-cycle ahead: detector edge for the crossing at crossingUs
+// and an optional glitch inside the half-cycle leading up to it
+void MainsModel::scheduleEdges(uint64_t crossingUs) {
+  int64_t jitter = config_.jitterUs > 0 ? (int64_t)(random_.symmetric() * config_.jitterUs) : 0;
+  push(MAINS_DETECTOR_EDGE, crossingUs + config_.detectorOffsetUs + jitter);
+
+  float glitchProbability = config_.glitchesPerSecond / (2.0f * config_.freqHz);
+  if (glitchProbability > 0.0f && random_.uniform() < glitchProbability) {
+    uint64_t offset = (uint64_t)((0.05f + 0.9f * random_.uniform()) * halfPeriodUs_);
+    push(MAINS_GLITCH, crossingUs - halfPeriodUs_ + offset);
+    glitches_++;
+  }
+}
+
+void MainsModel::push(MainsEventType type, uint64_t timeUs) {
+  if (pendingCount_ >= MAX_PENDING) return;
+
+  int i = pendingCount_++;
+  while (i > 0 && pending_[i - 1].timeUs > timeUs) {
+    pending_[i] = pending_[i - 1];
+    i--;
+  }
+  pending_[i].type = type;
+  pending_[i].timeUs = timeUs;
+  pending_[i].positiveHalf = false;
+}
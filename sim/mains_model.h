@@ -0,0 +1,84 @@
+#ifndef MAINS_MODEL_H
+#define MAINS_MODEL_H
+
+#include <stdint.h>
+
+// ============================================================================
+// MAINS / ZERO-CROSS DETECTOR MODEL
+// ============================================================================
+//
+// True zero crossings are strictly periodic. The detector output the ISR sees
+// is each true crossing shifted by a fixed offset plus uniform jitter, with
+// optional spurious edges (noise glitches) inside the half-cycle.
+
+struct MainsConfig {
+  float freqHz;
+  uint32_t detectorOffsetUs;  // Detector edge delay after the true crossing
+  uint32_t jitterUs;          // Uniform +/- jitter on every detector edge
+  float glitchesPerSecond;    // Spurious detector edges (mean rate)
+  uint32_t seed;
+
+  MainsConfig() : freqHz(50.0f), detectorOffsetUs(0), jitterUs(0), glitchesPerSecond(0.0f), seed(1) {}
+};
+
+enum MainsEventType {
+  MAINS_ZERO_CROSS = 0,   // True crossing: triac commutates, polarity flips
+  MAINS_DETECTOR_EDGE,    // Detector edge for a real crossing
+  MAINS_GLITCH            // Spurious detector edge
+};
+
+struct MainsEvent {
+  MainsEventType type;
+  uint64_t timeUs;
+  bool positiveHalf;      // Polarity of the half-cycle starting at a crossing
+};
+
+// Deterministic xorshift32 (same sequence on every host)
+class SimRandom {
+ public:
+  explicit SimRandom(uint32_t seed) : state_(seed ? seed : 1) {}
+  uint32_t next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+  // Uniform in [0, 1)
+  float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+  // Uniform in [-1, 1)
+  float symmetric() { return uniform() * 2.0f - 1.0f; }
+
+ private:
+  uint32_t state_;
+};
+
+class MainsModel {
+ public:
+  explicit MainsModel(const MainsConfig& config);
+
+  void reset(uint64_t startUs);
+  uint64_t nextEventUs() const;
+  MainsEvent pop();
+
+  uint32_t halfPeriodUs() const { return halfPeriodUs_; }
+  uint32_t zeroCrossCount() const { return crossings_; }
+  uint32_t glitchCount() const { return glitches_; }
+
+ private:
+  void scheduleEdges(uint64_t crossingUs);
+  void push(MainsEventType type, uint64_t timeUs);
+
+  static const int MAX_PENDING = 8;
+
+  MainsConfig config_;
+  SimRandom random_;
+  uint32_t halfPeriodUs_;
+  uint64_t nextCrossingUs_;
+  bool nextPositive_;
+  MainsEvent pending_[MAX_PENDING];  // Detector edges, sorted by time
+  int pendingCount_;
+  uint32_t crossings_;
+  uint32_t glitches_;
+};
+
+#endif
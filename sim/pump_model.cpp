@@ -0,0 +1,88 @@
+#include "pump_model.h"
+
+#define PUMP_STEP_US 1000  // Max integration step (explicit Euler)
+
+PumpModel::PumpModel(const PumpConfig& config) : config_(config), random_(config.seed) {
+  reset(0);
+}
+
+void PumpModel::reset(uint64_t nowUs) {
+  random_ = SimRandom(config_.seed);
+  timeUs_ = nowUs;
+  conducting_ = false;
+  positiveHalf_ = true;
+  stroked_ = false;
+  gateUntilUs_ = 0;
+  pressureBar_ = 0.0f;
+  filledMl_ = 0.0f;
+  resistance_ = config_.puckResistance;
+  sensorLagBar_ = 0.0f;
+  cupVolumeMl_ = 0.0f;
+  pumpedVolumeMl_ = 0.0f;
+  strokes_ = 0;
+}
+
+void PumpModel::advance(uint64_t untilUs) {
+  while (timeUs_ < untilUs) {
+    uint64_t stepUs = untilUs - timeUs_;
+    if (stepUs > PUMP_STEP_US) stepUs = PUMP_STEP_US;
+    step(stepUs * 1e-6f);
+    timeUs_ += stepUs;
+  }
+}
+
+void PumpModel::step(float dtS) {
+  // Pump: twice the mean flow while stroking (only one polarity strokes)
+  float pumpFlow = 0.0f;
+  if (conducting_ && positiveHalf_) {
+    float headroom = 1.0f - pressureBar_ / config_.maxPressureBar;
+    pumpFlow = headroom > 0.0f ? 2.0f * config_.maxFlowMlPerS * headroom : 0.0f;
+  }
+  pumpedVolumeMl_ += pumpFlow * dtS;
+
+  if (filledMl_ < config_.headspaceMl) {
+    // Filling the basket: water goes into headspace, pressure barely rises
+    filledMl_ += pumpFlow * dtS;
+    pressureBar_ = 0.5f * (filledMl_ < config_.headspaceMl ? filledMl_ / config_.headspaceMl : 1.0f);
+  } else {
+    float puckFlow = pressureBar_ / resistance_;
+    float opvFlow = pressureBar_ > config_.opvPressureBar ? (pressureBar_ - config_.opvPressureBar) / config_.opvResistance : 0.0f;
+    pressureBar_ += (pumpFlow - puckFlow - opvFlow) * dtS / config_.complianceMlPerBar;
+    if (pressureBar_ < 0.0f) pressureBar_ = 0.0f;
+    cupVolumeMl_ += puckFlow * dtS;
+    if (puckFlow > 0.0f) {
+      resistance_ *= 1.0f - config_.puckErosionPerS * dtS;
+    }
+  }
+
+  // Transducer lag
+  float alpha = config_.sensorTauMs > 0.0f ? dtS * 1000.0f / (config_.sensorTauMs + dtS * 1000.0f) : 1.0f;
+  sensorLagBar_ += (pressureBar_ - sensorLagBar_) * alpha;
+}
+
+void PumpModel::gate(uint64_t nowUs, uint32_t widthUs) {
+  advance(nowUs);
+  conducting_ = true;
+  gateUntilUs_ = nowUs + widthUs;
+  if (positiveHalf_ && !stroked_) {
+    stroked_ = true;
+    strokes_++;
+  }
+}
+
+void PumpModel::zeroCross(uint64_t nowUs, bool positiveHalf) {
+  advance(nowUs);
+  positiveHalf_ = positiveHalf;
+  stroked_ = false;
+  // Triac commutates at the crossing; a gate pulse spanning it re-latches
+  conducting_ = nowUs < gateUntilUs_;
+  if (conducting_ && positiveHalf_) {
+    stroked_ = true;
+    strokes_++;
+  }
+}
+
+float PumpModel::sensorBar() {
+  float reading = sensorLagBar_ + random_.symmetric() * config_.sensorNoiseBar;
+  return reading > 0.0f ? reading : 0.0f;
+}
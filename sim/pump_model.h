@@ -0,0 +1,89 @@
+#ifndef PUMP_MODEL_H
+#define PUMP_MODEL_H
+
+#include <stdint.h>
+
+#include "mains_model.h"
+
+// ============================================================================
+// VIBRATORY PUMP + PUCK HYDRAULIC MODEL
+// ============================================================================
+//
+// The pump has an internal diode, so it only strokes on positive half-cycles
+// while the triac conducts. Stroke flow falls linearly with back pressure.
+// Water first fills the basket headspace (little pressure), then the group
+// behaves as a compliance discharging through the puck (laminar resistance
+// that slowly erodes during the shot) and the OPV above its set point.
+// The transducer is a first-order lag with additive noise.
+
+struct PumpConfig {
+  float maxFlowMlPerS;        // Mean flow at 0 bar, every positive half-cycle
+  float maxPressureBar;       // Dead-head pressure (flow reaches zero)
+  float complianceMlPerBar;   // Group/boiler compliance once the basket is full
+  float headspaceMl;          // Basket headspace to fill before the puck loads
+  float puckResistance;       // bar per ml/s at the start of the shot
+  float puckErosionPerS;      // Fractional resistance loss per second of flow
+  float opvPressureBar;       // Over-pressure valve opening pressure
+  float opvResistance;        // bar per ml/s once the OPV is open
+  float sensorTauMs;          // Transducer lag
+  float sensorNoiseBar;       // Uniform +/- noise on each reading
+  uint32_t seed;
+
+  PumpConfig()
+      : maxFlowMlPerS(7.0f),
+        maxPressureBar(15.0f),
+        complianceMlPerBar(0.6f),
+        headspaceMl(6.0f),
+        puckResistance(4.5f),
+        puckErosionPerS(0.01f),
+        opvPressureBar(12.0f),
+        opvResistance(0.3f),
+        sensorTauMs(20.0f),
+        sensorNoiseBar(0.02f),
+        seed(7) {}
+};
+
+class PumpModel {
+ public:
+  explicit PumpModel(const PumpConfig& config);
+
+  // New dry puck, no pressure
+  void reset(uint64_t nowUs);
+
+  // Integrates the hydraulics up to untilUs
+  void advance(uint64_t untilUs);
+
+  // Triac gate pulse [nowUs, nowUs + widthUs); latches until the next crossing
+  void gate(uint64_t nowUs, uint32_t widthUs);
+  // True mains zero crossing: triac turns off unless the gate is still held
+  void zeroCross(uint64_t nowUs, bool positiveHalf);
+
+  float pressureBar() const { return pressureBar_; }
+  float sensorBar();          // Lagged + noisy reading (advances noise sequence)
+  float cupVolumeMl() const { return cupVolumeMl_; }
+  float pumpedVolumeMl() const { return pumpedVolumeMl_; }
+  uint32_t strokeCount() const { return strokes_; }
+
+  // Parameters may be changed between runs (takes effect at once)
+  PumpConfig& config() { return config_; }
+
+ private:
+  void step(float dtS);
+
+  PumpConfig config_;
+  SimRandom random_;
+  uint64_t timeUs_;
+  bool conducting_;
+  bool positiveHalf_;
+  bool stroked_;              // Current half-cycle already counted as a stroke
+  uint64_t gateUntilUs_;
+  float pressureBar_;
+  float filledMl_;
+  float resistance_;
+  float sensorLagBar_;
+  float cupVolumeMl_;
+  float pumpedVolumeMl_;
+  uint32_t strokes_;
+};
+
+#endif
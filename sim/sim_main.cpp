@@ -0,0 +1,270 @@
+// Pressure-tracking simulator: runs the firmware against the mains and pump
+// models and prints tracking figures per profile and mains scenario.
+//
+//   pio run -e sim && .pio/build/sim/program [options]
+//
+//   --uncalibrated     skip the calibration sweep (linear fallback mapping)
+//   --auto-cal         calibrate with the on-device sweep (start_calibration)
+//   --identify         run identify_pump after calibrating (enables feedforward)
+//   --autotune         run autotune_pressure after calibrating (enables PID trim)
+//   --seed N           seed for jitter, glitches and sensor noise
+//   --trace FILE       CSV of every run at 10 ms (run,t_ms,target,pressure,sensor,dim)
+//   --safety           run the supervisor trip cases instead (clean 50 Hz); exit 1 when
+//                      a case does not trip as expected or the gate fires a half-cycle
+//                      after the trip, or a seek back trips before its run ends
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pressure_control.h"
+#include "pump_dynamics.h"
+#include "simulator.h"
+#include "supervisor.h"
+#include "triac.h"
+
+struct SimProfile {
+  const char* name;
+  const char* setup;   // Optional command sent first (e.g. store_profile)
+  const char* json;
+  uint32_t maxMs;
+};
+
+struct SimScenario {
+  const char* name;
+  float freqHz;
+  uint32_t jitterUs;
+  float glitchesPerSecond;
+};
+
+static const SimProfile PROFILES[] = {
+  {"flat_9bar", NULL,
+   "{\"command\":\"start_profile\",\"profile\":{\"name\":\"flat_9bar\",\"segments\":["
+   "{\"startTime\":0,\"endTime\":25,\"startPressure\":9,\"endPressure\":9}]}}",
+   30000},
+  {"ramp_decline", NULL,
+   "{\"command\":\"start_profile\",\"profile\":{\"name\":\"ramp_decline\",\"segments\":["
+   "{\"startTime\":0,\"endTime\":6,\"startPressure\":2,\"endPressure\":2},"
+   "{\"startTime\":6,\"endTime\":10,\"startPressure\":2,\"endPressure\":9},"
+   "{\"startTime\":10,\"endTime\":22,\"startPressure\":9,\"endPressure\":9},"
+   "{\"startTime\":22,\"endTime\":30,\"startPressure\":9,\"endPressure\":6}]}}",
+   35000},
+  {"steps", NULL,
+   "{\"command\":\"start_profile\",\"profile\":{\"name\":\"steps\",\"segments\":["
+   "{\"startTime\":0,\"endTime\":8,\"startPressure\":4,\"endPressure\":4},"
+   "{\"startTime\":8,\"endTime\":16,\"startPressure\":8,\"endPressure\":8},"
+   "{\"startTime\":16,\"endTime\":24,\"startPressure\":5,\"endPressure\":5}]}}",
+   30000},
+  {"flow_2mls", NULL,
+   "{\"command\":\"start_profile\",\"profile\":{\"name\":\"flow_2mls\",\"segments\":["
+   "{\"startTime\":0,\"endTime\":4,\"startFlow\":4,\"endFlow\":4},"
+   "{\"startTime\":4,\"endTime\":28,\"startFlow\":2,\"endFlow\":2}]}}",
+   32000},
+  // Pressure preinfusion, then a flow ramp; stored in the compact format
+  {"flow_stored",
+   "{\"cmd\":\"\",\"id\":9,\"p\":{\"n\":\"flow_stored\",\"s\":["
+   "{\"st\":0,\"et\":6,\"sp\":3,\"ep\":3},"
+   "{\"st\":6,\"et\":26,\"sf\":1.5,\"ef\":3}]}}",
+   "{\"command\":\"start_profile_by_id\",\"profile_id\":9}",
+   30000},
+};
+
+static const SimScenario SCENARIOS[] = {
+  {"clean_50Hz", 50.0f, 20, 0.0f},
+  {"noisy_50Hz", 50.0f, 300, 5.0f},
+  {"clean_60Hz", 60.0f, 20, 0.0f},
+};
+
+struct SimSafetyCase {
+  const char* name;
+  SimFault fault;
+  uint8_t expected;     // SafetyTripReason; TRIP_NONE = watchdog expiry for the hang, no trip otherwise
+  bool manual;          // json is a set_dim_level under SW control, not a profile
+  const char* json;
+  uint32_t settleMs;    // Brewing before the fault
+  uint32_t maxMs;       // Fault to recorded trip
+};
+
+#define SAFETY_LONG_BREW                                                                          \
+  "{\"command\":\"start_profile\",\"profile\":{\"name\":\"long_9bar\",\"segments\":["               \
+  "{\"startTime\":0,\"endTime\":200,\"startPressure\":9,\"endPressure\":9}]}}"
+#define SAFETY_SHORT_BREW                                                                         \
+  "{\"command\":\"start_profile\",\"profile\":{\"name\":\"short_9bar\",\"segments\":["              \
+  "{\"startTime\":0,\"endTime\":10,\"startPressure\":9,\"endPressure\":9}]}}"
+#define SAFETY_FULL_POWER "{\"command\":\"set_dim_level\",\"level\":100}"
+
+static const SimSafetyCase SAFETY_CASES[] = {
+  {"brew_duration", SIM_FAULT_LONG_BREW, TRIP_BREW_DURATION, false, SAFETY_LONG_BREW, 3000, 130000},
+  {"zc_loss", SIM_FAULT_ZC_LOSS, TRIP_ZC_TIMEOUT, false, SAFETY_LONG_BREW, 3000, 1000},
+  {"spurious_gate", SIM_FAULT_SPURIOUS_GATE, TRIP_FIRED_WITHOUT_ZC, false, SAFETY_LONG_BREW, 3000, 1000},
+  // The profile controller would hold its target: manual full power
+  {"over_pressure", SIM_FAULT_OVER_PRESSURE, TRIP_OVER_PRESSURE, true, SAFETY_FULL_POWER, 0, 30000},
+  {"loop_stall", SIM_FAULT_LOOP_STALL, TRIP_LOOP_STALL, false, SAFETY_LONG_BREW, 3000, 5000},
+  {"supervisor_hang", SIM_FAULT_SUPERVISOR_HANG, TRIP_NONE, false, SAFETY_LONG_BREW, 3000, 0},
+  // Seek back at 8 s: the limit re-arms, the run ends 10 s later untripped
+  {"seek_back", SIM_FAULT_SEEK_BACK, TRIP_NONE, false, SAFETY_SHORT_BREW, 8000, 15000},
+};
+
+#define COUNT_OF(a) (sizeof(a) / sizeof((a)[0]))
+
+// Every trip path of the supervisor against a healthy 50 Hz machine
+static int runSafetyCases(uint32_t seed) {
+  SimConfig config;
+  config.mains.jitterUs = 20;
+  config.mains.seed = seed;
+  config.pump.seed = seed + 1;
+  Simulator sim(config);
+  sim.boot();
+  sim.calibrate(4000);
+
+  float halfCycleMs = 500.0f / config.mains.freqHz;
+  int failures = 0;
+  printf("%-16s %-17s %-17s %9s %11s %8s %s\n", "case", "expected", "tripped", "trip_ms", "gate_after", "stopped",
+         "result");
+  for (size_t i = 0; i < COUNT_OF(SAFETY_CASES); i++) {
+    const SimSafetyCase& c = SAFETY_CASES[i];
+    if (c.manual) sim.command("{\"command\":\"set_sw_control\",\"enable\":true}");
+    SimTripResult r = sim.runFault(c.fault, c.json, c.settleMs, c.maxMs);
+    if (c.manual) sim.command("{\"command\":\"set_sw_control\",\"enable\":false}");
+    bool hang = c.fault == SIM_FAULT_SUPERVISOR_HANG;
+    bool pass;
+    if (hang) {
+      pass = r.watchdogExpired && r.reason == TRIP_NONE;
+    } else if (c.expected == TRIP_NONE) {
+      pass = r.reason == TRIP_NONE && r.stopped;
+    } else {
+      pass = r.reason == c.expected && r.stopped && r.lastGateAfterTripMs <= halfCycleMs && dimmerLevel == 0;
+    }
+    if (!pass) failures++;
+    printf("%-16s %-17s %-17s %9.1f %11.2f %8s %s\n", c.name,
+           hang ? "watchdog_expiry" : safetyTripName(c.expected),
+           hang ? (r.watchdogExpired ? "watchdog_expiry" : "-") : safetyTripName(r.reason),
+           r.faultToTripMs, r.lastGateAfterTripMs, r.stopped ? "yes" : "no", pass ? "PASS" : "FAIL");
+  }
+  return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  bool calibrated = true;
+  bool autoCal = false;
+  bool identify = false;
+  bool tune = false;
+  bool safety = false;
+  uint32_t seed = 1;
+  const char* tracePath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--uncalibrated") == 0) {
+      calibrated = false;
+    } else if (strcmp(argv[i], "--auto-cal") == 0) {
+      autoCal = true;
+    } else if (strcmp(argv[i], "--identify") == 0) {
+      identify = true;
+    } else if (strcmp(argv[i], "--autotune") == 0) {
+      tune = true;
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else if (strcmp(argv[i], "--safety") == 0) {
+      safety = true;
+    } else {
+      fprintf(stderr, "usage: %s [--uncalibrated] [--auto-cal] [--identify] [--autotune] [--seed N] [--trace FILE] [--safety]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if (safety) {
+    return runSafetyCases(seed);
+  }
+
+  FILE* trace = NULL;
+  if (tracePath) {
+    trace = fopen(tracePath, "w");
+    if (!trace) {
+      fprintf(stderr, "cannot open %s\n", tracePath);
+      return 1;
+    }
+    fprintf(trace, "run,t_ms,target_bar,pressure_bar,sensor_bar,dim_level\n");
+  }
+
+  printf("%-13s %-13s %7s %8s %8s %8s %8s %8s %8s %7s %6s %6s %6s %7s\n", "scenario", "profile", "run_s", "rms_bar",
+         "over_bar", "under_bar", "ripple", "flow_rms", "est_err%", "cup_ml", "edges", "fired", "stroke", "wall_ms");
+
+  // The firmware is booted once; each scenario attaches its own simulator
+  // and recalibrates (60 Hz changes the steady-state pressures)
+  static char labels[COUNT_OF(SCENARIOS)][COUNT_OF(PROFILES)][40];
+  bool booted = false;
+  for (size_t s = 0; s < COUNT_OF(SCENARIOS); s++) {
+    SimConfig config;
+    config.mains.freqHz = SCENARIOS[s].freqHz;
+    config.mains.jitterUs = SCENARIOS[s].jitterUs;
+    config.mains.glitchesPerSecond = SCENARIOS[s].glitchesPerSecond;
+    config.mains.seed = seed;
+    config.pump.seed = seed + 1;
+
+    Simulator sim(config);
+    if (!booted) {
+      sim.boot();
+      booted = true;
+    } else {
+      sim.attach();
+    }
+    if (calibrated && autoCal) {
+      uint32_t ms = sim.autoCalibrate(600000);
+      printf("# %s: on-device calibration %s in %.1f s\n", SCENARIOS[s].name, ms ? "finished" : "timed out",
+             ms / 1000.0f);
+    } else if (calibrated) {
+      sim.calibrate(4000);
+    }
+    sim.sendFlowModel();
+    if (identify) {
+      uint32_t ms = sim.identifyPump(60000);
+      printf("# %s: pump identification %s in %.1f s (tau %.0f ms, dead time %.0f ms)\n", SCENARIOS[s].name,
+             ms ? "finished" : "timed out", ms / 1000.0f, pumpDynamics.tauMs, pumpDynamics.deadTimeMs);
+    }
+    if (tune) {
+      uint32_t ms = sim.autotune(300000);
+      printf("# %s: autotune %s in %.1f s\n", SCENARIOS[s].name, ms ? "finished" : "failed", ms / 1000.0f);
+      for (int b = 0; ms && b < pidSchedule.bandCount; b++) {
+        const PidBand& band = pidSchedule.bands[b];
+        printf("#   %.1f bar: Ku %.2f %%/bar, Tu %.0f ms -> Kp %.2f Ki %.2f Kd %.2f\n", band.setpointBar,
+               band.ultimateGain, band.ultimatePeriodMs, band.kp, band.ki, band.kd);
+      }
+      if (ms) {
+        printf("#   step %.1f -> %.1f bar: rise %.0f ms, overshoot %.1f%%, settling %.0f ms\n", lastStepMetrics.fromBar,
+               lastStepMetrics.toBar, lastStepMetrics.riseTimeMs, lastStepMetrics.overshootPct,
+               lastStepMetrics.settlingTimeMs);
+      }
+    }
+
+    for (size_t p = 0; p < COUNT_OF(PROFILES); p++) {
+      snprintf(labels[s][p], sizeof(labels[s][p]), "%s/%s", SCENARIOS[s].name, PROFILES[p].name);
+      sim.setTrace(trace, labels[s][p]);
+
+      if (PROFILES[p].setup) {
+        sim.command(PROFILES[p].setup);
+      }
+      SimResult r = sim.runProfile(PROFILES[p].json, PROFILES[p].maxMs);
+      char flowRms[16] = "-";
+      if (r.flowRmsErrorMlS >= 0.0f) {
+        snprintf(flowRms, sizeof(flowRms), "%.3f", r.flowRmsErrorMlS);
+      }
+      printf("%-13s %-13s %7.2f %8.3f %8.3f %8.3f %8.3f %8s %8.1f %7.1f %6u %6u %6u %7.1f\n", SCENARIOS[s].name,
+             PROFILES[p].name, r.durationS, r.rmsErrorBar, r.maxOvershootBar, r.maxUndershootBar, r.rippleBar,
+             flowRms, r.flowEstimateErrorPct, r.cupVolumeMl, r.detectorEdges, r.fired, r.strokes, r.wallMs);
+
+      // Let the group depressurise between shots
+      sim.runFor(2000);
+    }
+  }
+
+  if (safetyTripCount > 0) {
+    printf("# %u safety trips during the runs (see --safety)\n", (unsigned)safetyTripCount);
+  }
+
+  if (trace) {
+    fclose(trace);
+  }
+  return 0;
+}
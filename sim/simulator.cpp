@@ -0,0 +1,418 @@
+#include "simulator.h"
+
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+#include "app.h"
+#include "calibration.h"
+#include "commands.h"
+#include "config.h"
+#include "flow_estimator.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "pressure_control.h"
+#include "profile_engine.h"
+#include "pump_dynamics.h"
+#include "supervisor.h"
+#include "triac.h"
+
+#define SIM_SAMPLE_US 10000       // Metrics/trace resolution
+#define SIM_UNDERSHOOT_GRACE_US 2000000  // Basket fill is not tracking error
+
+Simulator::Simulator(const SimConfig& config)
+    : config_(config),
+      mains_(config.mains),
+      pump_(config.pump),
+      nowUs_(0),
+      nextLoopUs_(0),
+      nextSampleUs_(0),
+      inLoop_(false),
+      detectorEnabled_(true),
+      loopStalled_(false),
+      lastGateUs_(0),
+      collecting_(false),
+      runStartUs_(0),
+      errorSquaredSum_(0.0),
+      errorSamples_(0),
+      maxOvershoot_(0.0f),
+      maxUndershoot_(0.0f),
+      flowErrorSquaredSum_(0.0),
+      flowSamples_(0),
+      flowWindowCount_(0),
+      rippleCount_(0),
+      rippleSquaredSum_(0.0),
+      rippleSamples_(0),
+      trace_(NULL),
+      traceLabel_("") {
+}
+
+// Firmware state is global: boot() once per process, attach() further
+// simulators (other mains/pump configs) to the already running firmware
+void Simulator::boot() {
+  halNativeResetStorage();
+  halNativeUseManualClock(true);
+  halNativeSetTimeUs(0);
+  attach();
+  appSetup();
+  nextLoopUs_ = halNativeTimeUs();
+  nextSampleUs_ = nextLoopUs_;
+
+  // Let the connection greeting in loop() go out
+  runFor(2000);
+}
+
+void Simulator::attach() {
+  halNativeOnPinWrite(onPinWrite, this);
+  halNativeOnIdle(onIdle, this);
+  halNativeOnTransport(onTransport, this);
+  halNativeSetConnected(true);
+  halConsoleSetEnabled(false);
+
+  nowUs_ = halNativeTimeUs();
+  mains_.reset(nowUs_);
+  pump_.reset(nowUs_);
+  nextLoopUs_ = nowUs_;
+  nextSampleUs_ = nowUs_;
+}
+
+void Simulator::command(const char* json) {
+  handleCommand(json);
+}
+
+void Simulator::runFor(uint32_t ms) {
+  runUntil(nowUs_ + (uint64_t)ms * 1000);
+}
+
+void Simulator::runUntil(uint64_t untilUs) {
+  while (true) {
+    uint64_t mainsUs = mains_.nextEventUs();
+    uint64_t timerUs = halNativeNextTimerUs();
+    uint64_t next = untilUs;
+    if (mainsUs < next) next = mainsUs;
+    if (timerUs < next) next = timerUs;
+    if (!inLoop_ && nextLoopUs_ < next) next = nextLoopUs_;
+    if (nextSampleUs_ < next) next = nextSampleUs_;
+
+    pump_.advance(next);
+    nowUs_ = next;
+    halNativeSetTimeUs(next);
+
+    if (mainsUs == next) {
+      MainsEvent event = mains_.pop();
+      if (event.type == MAINS_ZERO_CROSS) {
+        pump_.zeroCross(next, event.positiveHalf);
+      } else if (detectorEnabled_) {
+        halNativeTriggerInterrupt(ZERO_CROSS_PIN);
+      }
+    } else if (timerUs == next) {
+      halNativeRunDueTimers();
+    } else if (nextSampleUs_ == next) {
+      sample();
+      nextSampleUs_ += SIM_SAMPLE_US;
+    } else if (!inLoop_ && nextLoopUs_ == next && loopStalled_) {
+      nextLoopUs_ = nowUs_ + (uint64_t)config_.loopIntervalMs * 1000;
+    } else if (!inLoop_ && nextLoopUs_ == next) {
+      float sensorVolts = pump_.sensorBar() / PRESSURE_SENSOR_BAR_PER_V + PRESSURE_SENSOR_OFFSET_V;
+      halNativeSetAnalogMilliVolts(PRESSURE_SENSOR_PIN, (uint32_t)(sensorVolts * 1000.0f));
+
+      inLoop_ = true;
+      appLoop();
+      inLoop_ = false;
+      // loop() may have blocked in delay(); the idle hook advanced time
+      nowUs_ = halNativeTimeUs();
+      nextLoopUs_ = nowUs_ + (uint64_t)config_.loopIntervalMs * 1000;
+    } else {
+      break;
+    }
+  }
+}
+
+void Simulator::sample() {
+  if (!collecting_ || !isRunning) return;
+
+  float pressure = pump_.pressureBar();
+  if (nowUs_ - runStartUs_ >= SIM_UNDERSHOOT_GRACE_US) {
+    // Ripple: the middle sample against the window mean, so ramps cancel
+    rippleWindow_[rippleCount_ % SIM_RIPPLE_WINDOW] = pressure;
+    rippleCount_++;
+    if (rippleCount_ >= SIM_RIPPLE_WINDOW) {
+      float sum = 0.0f;
+      for (int i = 0; i < SIM_RIPPLE_WINDOW; i++) sum += rippleWindow_[i];
+      float middle = rippleWindow_[(rippleCount_ - 1 - SIM_RIPPLE_WINDOW / 2) % SIM_RIPPLE_WINDOW];
+      float deviation = middle - sum / SIM_RIPPLE_WINDOW;
+      rippleSquaredSum_ += (double)deviation * deviation;
+      rippleSamples_++;
+    }
+  }
+
+  if (currentTargetFlow > 0.0f) {
+    // Flow segment: mean pump flow over the window against the mean target
+    int slot = flowWindowCount_ % SIM_FLOW_WINDOW;
+    float oldest = flowWindowVolume_[slot];
+    flowWindowVolume_[slot] = pump_.pumpedVolumeMl();
+    flowWindowTarget_[slot] = currentTargetFlow;
+    flowWindowCount_++;
+    if (flowWindowCount_ > SIM_FLOW_WINDOW) {
+      float targetSum = 0.0f;
+      for (int i = 0; i < SIM_FLOW_WINDOW; i++) targetSum += flowWindowTarget_[i];
+      float flow = (pump_.pumpedVolumeMl() - oldest) / (SIM_FLOW_WINDOW * SIM_SAMPLE_US / 1e6f);
+      float flowError = flow - targetSum / SIM_FLOW_WINDOW;
+      flowErrorSquaredSum_ += (double)flowError * flowError;
+      flowSamples_++;
+    }
+  } else {
+    flowWindowCount_ = 0;
+    float error = pressure - currentTargetPressure;
+    errorSquaredSum_ += (double)error * error;
+    errorSamples_++;
+    if (error > maxOvershoot_) maxOvershoot_ = error;
+    if (nowUs_ - runStartUs_ >= SIM_UNDERSHOOT_GRACE_US && -error > maxUndershoot_) {
+      maxUndershoot_ = -error;
+    }
+  }
+
+  if (trace_) {
+    fprintf(trace_, "%s,%.0f,%.3f,%.3f,%.3f,%d\n", traceLabel_, (nowUs_ - runStartUs_) / 1000.0,
+            currentTargetPressure, pressure, pump_.sensorBar(), dimmerLevel);
+  }
+}
+
+SimResult Simulator::runProfile(const char* profileJson, uint32_t maxMs) {
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+  pump_.reset(nowUs_);  // Fresh puck
+  uint32_t edgesBefore = mains_.zeroCrossCount();
+  uint32_t glitchesBefore = mains_.glitchCount();
+  unsigned long firedBefore = triacFiredCount();
+
+  collecting_ = true;
+  runStartUs_ = nowUs_;
+  errorSquaredSum_ = 0.0;
+  errorSamples_ = 0;
+  maxOvershoot_ = 0.0f;
+  maxUndershoot_ = 0.0f;
+  flowErrorSquaredSum_ = 0.0;
+  flowSamples_ = 0;
+  flowWindowCount_ = 0;
+  rippleCount_ = 0;
+  rippleSquaredSum_ = 0.0;
+  rippleSamples_ = 0;
+
+  command(profileJson);
+  while (isRunning && nowUs_ - runStartUs_ < (uint64_t)maxMs * 1000) {
+    runFor(config_.loopIntervalMs);
+  }
+  if (isRunning) {
+    command("{\"command\":\"stop_profile\"}");
+  }
+  collecting_ = false;
+
+  SimResult result;
+  result.durationS = (nowUs_ - runStartUs_) / 1e6f;
+  result.rmsErrorBar = errorSamples_ > 0 ? (float)sqrt(errorSquaredSum_ / errorSamples_) : 0.0f;
+  result.maxOvershootBar = maxOvershoot_;
+  result.maxUndershootBar = maxUndershoot_;
+  result.finalPressureBar = pump_.pressureBar();
+  result.cupVolumeMl = pump_.cupVolumeMl();
+  result.flowRmsErrorMlS = flowSamples_ > 0 ? (float)sqrt(flowErrorSquaredSum_ / flowSamples_) : -1.0f;
+  result.rippleBar = rippleSamples_ > 0 ? (float)sqrt(rippleSquaredSum_ / rippleSamples_) : 0.0f;
+  float pumped = pump_.pumpedVolumeMl();
+  result.flowEstimateErrorPct = pumped > 0.0f ? 100.0f * (estimatedVolume - pumped) / pumped : 0.0f;
+  // One detector edge per crossing plus every glitch
+  result.glitches = mains_.glitchCount() - glitchesBefore;
+  result.detectorEdges = mains_.zeroCrossCount() - edgesBefore + result.glitches;
+  result.fired = triacFiredCount() - firedBefore;
+  result.strokes = pump_.strokeCount();
+  result.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+  return result;
+}
+
+void Simulator::calibrate(uint32_t settleMs) {
+  char json[512];
+  int length = snprintf(json, sizeof(json), "{\"command\":\"set_calibration_data\",\"calibration\":{\"0\":0");
+
+  command("{\"command\":\"set_sw_control\",\"enable\":true}");
+  for (int level = 5; level <= 100; level += 5) {
+    char levelCommand[64];
+    snprintf(levelCommand, sizeof(levelCommand), "{\"command\":\"set_dim_level\",\"level\":%d}", level);
+
+    pump_.reset(nowUs_);
+    command(levelCommand);
+    runFor(settleMs);
+
+    // Average the last 500 ms like a user reading the gauge
+    float sum = 0.0f;
+    for (int i = 0; i < 10; i++) {
+      runFor(50);
+      sum += pump_.pressureBar();
+    }
+    length += snprintf(json + length, sizeof(json) - length, ",\"%d\":%.2f", level, sum / 10.0f);
+
+    command("{\"command\":\"set_dim_level\",\"level\":0}");
+  }
+  command("{\"command\":\"set_sw_control\",\"enable\":false}");
+
+  snprintf(json + length, sizeof(json) - length, "}}");
+  command(json);
+  pump_.reset(nowUs_);
+}
+
+void Simulator::sendFlowModel() {
+  // A stroke is one positive half-cycle at the model's doubled stroking flow
+  float strokeMl = config_.pump.maxFlowMlPerS / config_.mains.freqHz;
+  char json[128];
+  snprintf(json, sizeof(json), "{\"command\":\"set_flow_model\",\"stroke_ml\":%.4f,\"deadhead_bar\":%.1f}", strokeMl,
+           config_.pump.maxPressureBar);
+  command(json);
+}
+
+uint32_t Simulator::autoCalibrate(uint32_t maxMs) {
+  // The sweep runs against a fixed restriction: a puck eroding for minutes
+  // would make every step read lower than the last
+  float erosion = pump_.config().puckErosionPerS;
+  pump_.config().puckErosionPerS = 0.0f;
+  pump_.reset(nowUs_);
+  uint64_t startUs = nowUs_;
+  command("{\"command\":\"start_calibration\",\"auto\":true}");
+  while (calibrationRunning && nowUs_ - startUs < (uint64_t)maxMs * 1000) {
+    runFor(config_.loopIntervalMs);
+  }
+  bool finished = !calibrationRunning;
+  if (!finished) {
+    command("{\"command\":\"stop_calibration\"}");
+  }
+  pump_.config().puckErosionPerS = erosion;
+  pump_.reset(nowUs_);
+  return finished ? (uint32_t)((nowUs_ - startUs) / 1000) : 0;
+}
+
+uint32_t Simulator::identifyPump(uint32_t maxMs) {
+  float erosion = pump_.config().puckErosionPerS;
+  pump_.config().puckErosionPerS = 0.0f;
+  pump_.reset(nowUs_);
+  uint64_t startUs = nowUs_;
+  command("{\"command\":\"identify_pump\"}");
+  while (pumpIdentificationRunning && nowUs_ - startUs < (uint64_t)maxMs * 1000) {
+    runFor(config_.loopIntervalMs);
+  }
+  bool finished = !pumpIdentificationRunning;
+  if (!finished) {
+    command("{\"command\":\"stop_profile\"}");
+  }
+  pump_.config().puckErosionPerS = erosion;
+  pump_.reset(nowUs_);
+  return finished ? (uint32_t)((nowUs_ - startUs) / 1000) : 0;
+}
+
+uint32_t Simulator::autotune(uint32_t maxMs) {
+  float erosion = pump_.config().puckErosionPerS;
+  pump_.config().puckErosionPerS = 0.0f;
+  pump_.reset(nowUs_);
+  uint64_t startUs = nowUs_;
+  pidScheduleValid = false;  // Only this run's schedule counts
+  command("{\"command\":\"autotune_pressure\"}");
+  while (autotuneRunning && nowUs_ - startUs < (uint64_t)maxMs * 1000) {
+    runFor(config_.loopIntervalMs);
+  }
+  bool finished = !autotuneRunning && pidScheduleValid;
+  if (autotuneRunning) {
+    command("{\"command\":\"stop_profile\"}");
+  }
+  pump_.config().puckErosionPerS = erosion;
+  pump_.reset(nowUs_);
+  return finished ? (uint32_t)((nowUs_ - startUs) / 1000) : 0;
+}
+
+SimTripResult Simulator::runFault(SimFault fault, const char* profileJson, uint32_t settleMs, uint32_t maxMs) {
+  PumpConfig healthy = pump_.config();
+  if (fault == SIM_FAULT_OVER_PRESSURE) {
+    // Blocked basket (takes a fresh puck) and a stuck OPV: the pump heads
+    // for its dead-head pressure
+    pump_.config().opvPressureBar = 2.0f * healthy.maxPressureBar;
+    pump_.config().puckResistance = 100.0f * healthy.puckResistance;
+  }
+  uint32_t tripsBefore = safetyTripCount;
+  pump_.reset(nowUs_);
+  command(profileJson);
+  runFor(settleMs);
+
+  SimTripResult result;
+  result.reason = TRIP_NONE;
+  result.faultToTripMs = 0.0f;
+  result.lastGateAfterTripMs = 0.0f;
+  result.stopped = false;
+  result.watchdogExpired = false;
+  uint64_t faultUs = nowUs_;
+
+  switch (fault) {
+    case SIM_FAULT_LONG_BREW:
+    case SIM_FAULT_OVER_PRESSURE:
+      faultUs -= (uint64_t)settleMs * 1000;  // Faulty from the start
+      break;
+    case SIM_FAULT_ZC_LOSS:
+      detectorEnabled_ = false;
+      break;
+    case SIM_FAULT_SPURIOUS_GATE:
+      pulseTimerCallback(NULL);
+      break;
+    case SIM_FAULT_LOOP_STALL:
+      loopStalled_ = true;
+      break;
+    case SIM_FAULT_SUPERVISOR_HANG:
+      halNativeSuspendTasks(true);
+      break;
+    case SIM_FAULT_SEEK_BACK:
+      command("{\"command\":\"seek\",\"time\":0}");
+      break;
+  }
+
+  if (fault == SIM_FAULT_SUPERVISOR_HANG) {
+    runFor(SUPERVISOR_WATCHDOG_MS + 100);
+    result.watchdogExpired = halNativeWatchdogExpired();
+    halNativeSuspendTasks(false);
+  } else {
+    while (safetyTripCount == tripsBefore && nowUs_ - faultUs < (uint64_t)maxMs * 1000) {
+      // A stalled loop resumes once the supervisor has acted
+      if (loopStalled_ && supervisorTripped()) loopStalled_ = false;
+      runFor(1);
+    }
+    result.stopped = !isRunning;
+  }
+
+  if (safetyTripCount != tripsBefore) {
+    const SafetyTrip& trip = safetyTrips[(safetyTripCount - 1) % SUPERVISOR_TRIP_LOG];
+    uint64_t tripUs = (uint64_t)trip.atMs * 1000;
+    result.reason = trip.reason;
+    result.faultToTripMs = tripUs > faultUs ? (tripUs - faultUs) / 1000.0f : 0.0f;
+    result.stopped = !isRunning;
+    runFor(100);
+    result.lastGateAfterTripMs = ((double)lastGateUs_ - (double)tripUs) / 1000.0;
+  }
+  if (isRunning) {
+    command("{\"command\":\"stop_profile\"}");
+  }
+
+  detectorEnabled_ = true;
+  loopStalled_ = false;
+  pump_.config() = healthy;
+  runFor(2000);
+  pump_.reset(nowUs_);
+  return result;
+}
+
+void Simulator::onPinWrite(uint8_t pin, bool high, void* ctx) {
+  Simulator* sim = (Simulator*)ctx;
+  if (pin == DIMMER_PIN && high) {
+    sim->pump_.gate(sim->nowUs_, PULSE_WIDTH_US);
+    sim->lastGateUs_ = sim->nowUs_;
+  }
+}
+
+void Simulator::onIdle(uint64_t untilUs, void* ctx) {
+  ((Simulator*)ctx)->runUntil(untilUs);
+}
+
+void Simulator::onTransport(HalChannel channel, const uint8_t* data, size_t len, void* ctx) {
+  // Notifications are not needed for the metrics
+}
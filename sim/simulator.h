@@ -0,0 +1,145 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hal.h"
+#include "mains_model.h"
+#include "pump_model.h"
+
+// ============================================================================
+// DISCRETE-EVENT SIMULATOR
+// ============================================================================
+//
+// Runs the unmodified firmware (appSetup/appLoop, zeroCrossISR,
+// pulseTimerCallback) on the native HAL with a manual clock. Time jumps from
+// event to event: mains crossings and detector edges, esp_timer deadlines,
+// main loop ticks and 10 ms metric samples. Identical configs give identical
+// results on every run.
+
+#define SIM_FLOW_WINDOW 50          // Samples (0.5 s) the true flow is averaged over
+#define SIM_RIPPLE_WINDOW 25        // Samples (250 ms) of the centred mean ripple is taken against
+
+struct SimConfig {
+  MainsConfig mains;
+  PumpConfig pump;
+  uint32_t loopIntervalMs;    // delay() at the end of loop()
+
+  SimConfig() : loopIntervalMs(10) {}
+};
+
+struct SimResult {
+  float durationS;            // Simulated run time until the profile stopped
+  float rmsErrorBar;          // Model pressure vs. commanded target (pressure segments)
+  float maxOvershootBar;      // Largest excursion above target
+  float maxUndershootBar;     // Largest excursion below target (after 2 s)
+  float finalPressureBar;
+  float cupVolumeMl;
+  float flowRmsErrorMlS;      // True pump flow (0.5 s window) vs. target, flow segments; -1 without
+  float flowEstimateErrorPct; // Firmware's estimated volume vs. true pumped volume
+  float rippleBar;            // RMS of pressure minus its centred 250 ms mean (after 2 s)
+  uint32_t detectorEdges;     // ISR invocations (real + glitch edges)
+  uint32_t glitches;
+  uint32_t fired;             // Half-cycles the firmware fired
+  uint32_t strokes;           // Positive half-cycles that actually pumped (fired / 2 when balanced)
+  double wallMs;              // Host time spent (not deterministic)
+};
+
+// Faults for the safety supervisor, injected while a profile runs
+enum SimFault {
+  SIM_FAULT_LONG_BREW = 0,    // Profile longer than the brew limit
+  SIM_FAULT_ZC_LOSS,          // Detector output goes quiet, mains keeps crossing
+  SIM_FAULT_SPURIOUS_GATE,    // A gate pulse no crossing armed
+  SIM_FAULT_OVER_PRESSURE,    // OPV stuck shut and a blocked basket at full power
+  SIM_FAULT_LOOP_STALL,       // loop() stops running
+  SIM_FAULT_SUPERVISOR_HANG,  // Supervisor task stops feeding the watchdog
+  SIM_FAULT_SEEK_BACK         // Not a fault: seek to 0 late in the run, which must finish untripped
+};
+
+struct SimTripResult {
+  uint8_t reason;             // SafetyTripReason recorded, TRIP_NONE without a trip
+  float faultToTripMs;        // Fault injected -> supervisor tripped
+  float lastGateAfterTripMs;  // Latest gate pulse after the trip, <= 0 when none
+  bool stopped;               // loop() stopped the profile
+  bool watchdogExpired;       // SIM_FAULT_SUPERVISOR_HANG only
+};
+
+class Simulator {
+ public:
+  explicit Simulator(const SimConfig& config);
+
+  // Boots the firmware on a fresh native HAL (storage wiped)
+  void boot();
+  // Takes over a firmware already booted by another simulator
+  void attach();
+  // Feeds one JSON command through handleCommand()
+  void command(const char* json);
+  // Advances simulated time, running ISRs, timers and loop()
+  void runFor(uint32_t ms);
+  // Runs a start_profile command to completion (or maxMs)
+  SimResult runProfile(const char* profileJson, uint32_t maxMs);
+  // Steady-state pressure per 5% level, sent as set_calibration_data
+  void calibrate(uint32_t settleMs);
+  // Per-stroke displacement and dead-head pressure of the pump model, sent
+  // as set_flow_model (what a pump datasheet gives)
+  void sendFlowModel();
+  // On-device sweep (start_calibration); returns its duration in ms, 0 on timeout
+  uint32_t autoCalibrate(uint32_t maxMs);
+  // identify_pump step test; returns its duration in ms, 0 on timeout
+  uint32_t identifyPump(uint32_t maxMs);
+  // autotune_pressure relay test and step check; returns its duration in ms, 0 on failure
+  uint32_t autotune(uint32_t maxMs);
+  // Starts profileJson, injects the fault after settleMs and waits up to
+  // maxMs for the supervisor to trip and loop() to record it
+  SimTripResult runFault(SimFault fault, const char* profileJson, uint32_t settleMs, uint32_t maxMs);
+
+  // Optional CSV trace (t_ms,target_bar,pressure_bar,sensor_bar,dim_level)
+  void setTrace(FILE* trace, const char* label) { trace_ = trace; traceLabel_ = label; }
+
+  PumpModel& pump() { return pump_; }
+  uint64_t nowUs() const { return nowUs_; }
+
+ private:
+  static void onPinWrite(uint8_t pin, bool high, void* ctx);
+  static void onIdle(uint64_t untilUs, void* ctx);
+  static void onTransport(HalChannel channel, const uint8_t* data, size_t len, void* ctx);
+
+  void runUntil(uint64_t untilUs);
+  void sample();
+
+  SimConfig config_;
+  MainsModel mains_;
+  PumpModel pump_;
+  uint64_t nowUs_;
+  uint64_t nextLoopUs_;
+  uint64_t nextSampleUs_;
+  bool inLoop_;
+
+  // Fault injection
+  bool detectorEnabled_;
+  bool loopStalled_;
+  uint64_t lastGateUs_;
+
+  // Metrics for the profile currently running
+  bool collecting_;
+  uint64_t runStartUs_;
+  double errorSquaredSum_;
+  uint32_t errorSamples_;
+  float maxOvershoot_;
+  float maxUndershoot_;
+  double flowErrorSquaredSum_;
+  uint32_t flowSamples_;
+  float flowWindowVolume_[SIM_FLOW_WINDOW];  // Pumped volume per sample (ring)
+  float flowWindowTarget_[SIM_FLOW_WINDOW];  // Target flow per sample (ring)
+  int flowWindowCount_;                      // Consecutive flow-segment samples
+  float rippleWindow_[SIM_RIPPLE_WINDOW];    // Model pressure per sample (ring)
+  int rippleCount_;
+  double rippleSquaredSum_;
+  uint32_t rippleSamples_;
+
+  FILE* trace_;
+  const char* traceLabel_;
+};
+
+#endif
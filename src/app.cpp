@@ -0,0 +1,163 @@
+#include "app.h"
+
+#include "calibration.h"
+#include "commands.h"
+#include "config.h"
+#include "flow_estimator.h"
+#include "hal.h"
+#include "messaging.h"
+#include "perf_stats.h"
+#include "pressure_control.h"
+#include "profile_engine.h"
+#include "profiles.h"
+#include "pump_dynamics.h"
+#include "shot_recorder.h"
+#include "status_publisher.h"
+#include "subscriptions.h"
+#include "supervisor.h"
+#include "triac.h"
+#include "ws_server.h"
+
+#define DEVICE_NAME "EspressoProfiler-ESP32"
+
+void appSetup() {
+  consolePrintf("Starting Espresso Profiler ESP32...");
+
+  // CRITICAL: Initialize triac drive FIRST
+  initTriacDrive();
+
+  // Initialize Preferences (NVS) for persistent storage
+  halStorageBegin("modspresso");
+  consolePrintf("NVS (Preferences) initialized");
+
+  // Load saved data from NVS
+  loadCalibrationData();
+  loadProfiles();
+  loadDefaultProfiles();
+  loadShotIndex();
+  loadPumpDynamics();
+  loadPressureControl();
+  loadFlowModel();
+  consolePrintf("Data loaded from NVS");
+  initSubscriptions();
+
+  // Independent limits on the drive from here on
+  initSupervisor();
+
+  // Initialize pins
+  halPinMode(LED_PIN, HAL_PIN_OUTPUT);
+  halDigitalWrite(LED_PIN, false);
+  initHardwareButtons();
+
+  // Initialize Bluetooth
+  halTransportBegin(DEVICE_NAME, handleCommand);
+
+  consolePrintf("Waiting for client connection to notify...");
+}
+
+void appHandleConsoleLine(const char* line) {
+  halConsolePrintln("");
+  logPrintf("debug", ">>> [SERIAL] Received: %s", line);
+  handleCommand(line);
+  sendLogMessage(">>> [SERIAL] Done", "debug");
+}
+
+void appLoop() {
+  perfLoopTick();
+  // Heartbeat, and stop + report a safety trip before anything drives the triac
+  supervisorLoopTick();
+
+  static bool oldDeviceConnected = false;
+  bool deviceConnected = halTransportConnected();
+
+  // Handle Bluetooth connection
+  if (!deviceConnected && oldDeviceConnected) {
+    halDelay(500); // Give the Bluetooth stack the chance to get things ready
+    halTransportRestartAdvertising(); // Restart advertising
+    consolePrintf("Start advertising");
+    resetSubscriptions(MESSAGE_CLIENT_BLE); // The next client starts with every stream
+    resetStatusClient(MESSAGE_CLIENT_BLE);
+    resetTransmitQueue();
+    oldDeviceConnected = deviceConnected;
+  }
+
+  // New connection detected - send initial messages after delay to ensure notifications are ready
+  if (deviceConnected && !oldDeviceConnected) {
+    oldDeviceConnected = deviceConnected;
+
+    // Wait a bit to ensure Web Bluetooth has fully set up notifications
+    halDelay(800); // Give Web Bluetooth time to complete startNotifications()
+
+    consolePrintf("Sending initial messages after connection...");
+    resetStatusClient(MESSAGE_CLIENT_BLE);
+    sendStatusUpdate(1 << MESSAGE_CLIENT_BLE);
+    halDelay(100);
+    sendLogMessage("ESP32 connected and ready", "info");
+    halDelay(100);
+    sendLogMessage("Serial Monitor ready - you can send commands via Serial or BLE", "info");
+
+    consolePrintf("Initial messages sent");
+  }
+
+  // PSM decision happens in ISR - nothing to do here
+
+  // Handle profile execution (or a calibration/identification/autotune run)
+  if (isRunning) {
+    if (calibrationRunning) {
+      stopCalibration("Profile started");
+    }
+    if (pumpIdentificationRunning) {
+      stopPumpIdentification("Profile started");
+    }
+    if (autotuneRunning) {
+      stopAutotune("Profile started");
+    }
+    if (sanityTestRunning) {
+      stopSanityTest("Profile started");
+    }
+    uint32_t perfStart = perfBegin();
+    executeProfile();
+    perfEnd(PERF_CONTROL_TICK, perfStart);
+  } else if (calibrationRunning) {
+    calibrationTick();
+  } else if (pumpIdentificationRunning) {
+    pumpIdentificationTick();
+  } else if (autotuneRunning) {
+    autotuneTick();
+  } else if (sanityTestRunning) {
+    sanityTestTick();
+  } else if (!swControlEnabled) {
+    // Ensure dimmer is in OFF mode when no profile is running
+    // (unless SW control is enabled for manual testing)
+    if (readTriacControl().mode != DIM_OFF) {
+      setDimLevel(0);
+    }
+  }
+
+#if USE_HARDWARE_BUTTONS
+  checkHardwareButtons();
+#endif
+
+  // Print triac stats periodically
+  printTriacStats();
+
+  // Send status updates every second (status topic)
+  static unsigned long lastStatusUpdate = 0;
+  if (clientConnected() && halMillis() - lastStatusUpdate > 1000) {
+    uint8_t statusClients = topicDue(TOPIC_STATUS);
+    if (statusClients) {
+      sendStatusUpdate(statusClients);
+    }
+    lastStatusUpdate = halMillis();
+  }
+
+  // Recorded blocks go to flash here, off the control tick
+  shotRecorderTick();
+
+  // One chunk of a shot download per pass, so it never holds up the loop
+  shotTransferTick();
+
+  // Queued telemetry and log notifications, after this pass's responses
+  pumpTransmitQueue();
+  wsServerTick();
+}
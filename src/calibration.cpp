@@ -0,0 +1,385 @@
+#include "calibration.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hal.h"
+#include "messaging.h"
+#include "pressure_control.h"
+#include "profile_engine.h"
+#include "triac.h"
+
+float dimLevelToPressure[CALIBRATION_POINTS] = {0}; // Pressure for each 5% step
+bool isCalibrated = false;
+CalibrationModel calibrationCurve;
+
+// Pressure sensor calibration: bar = (volts - pressureOffset) * pressureScale
+float pressureOffset = PRESSURE_SENSOR_OFFSET_V;
+float pressureScale = PRESSURE_SENSOR_BAR_PER_V;
+
+// Automatic sweep state
+bool calibrationRunning = false;
+static int calStep = 0;                      // Calibration index being held
+static unsigned long calStepStartTime = 0;
+static unsigned long calSweepStartTime = 0;
+static unsigned long calLastSampleTime = 0;
+static SettleDetector calSettle;
+
+// Refits the curve from the raw table; 0 bar above 0% marks a missing point
+void rebuildCalibrationCurve() {
+  float levels[CALIBRATION_POINTS];
+  bool valid[CALIBRATION_POINTS];
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    levels[i] = indexToDimLevel(i);
+    valid[i] = isCalibrated && (i == 0 || dimLevelToPressure[i] > 0);
+  }
+  if (!calibrationCurve.fit(levels, dimLevelToPressure, valid, CALIBRATION_POINTS)) {
+    return;
+  }
+
+  const CalibrationFitQuality& q = calibrationCurve.quality();
+  consolePrintf("Calibration fit: %d points, %d outliers, %d pooled, rms %.3f bar, max %.3f bar", q.usedPoints,
+                q.outliers, q.pooledPoints, q.rmsResidualBar, q.maxResidualBar);
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    if (q.outlierMask & (1UL << i)) {
+      logPrintf("warn", "Calibration point %d%% (%.2f bar) rejected as outlier", indexToDimLevel(i), dimLevelToPressure[i]);
+    }
+  }
+}
+
+// Save calibration data to NVS
+void saveCalibrationData() {
+  rebuildCalibrationCurve();
+  halStoragePutU8("calibrated", isCalibrated);
+  if (isCalibrated) {
+    // Save calibration data array (21 float values: 0-100% in steps of 5)
+    size_t dataSize = sizeof(float) * CALIBRATION_POINTS;
+    halStoragePutBytes("calib_v2", dimLevelToPressure, dataSize);
+    consolePrintf("Calibration data saved to NVS (v2 format)");
+  } else {
+    halStorageRemove("calib_v2");
+    consolePrintf("Calibration data cleared from NVS");
+  }
+}
+
+// Load calibration data from NVS
+void loadCalibrationData() {
+  isCalibrated = halStorageGetU8("calibrated", false);
+  if (isCalibrated) {
+    // Load calibration data array (new v2 format with floats)
+    size_t dataSize = sizeof(float) * CALIBRATION_POINTS;
+    if (halStorageBytesLength("calib_v2") == dataSize) {
+      halStorageGetBytes("calib_v2", dimLevelToPressure, dataSize);
+      consolePrintf("Calibration data loaded from NVS (v2):");
+      for (int i = 0; i < CALIBRATION_POINTS; i++) {
+        if (dimLevelToPressure[i] > 0) {
+          consolePrintf("  %d%% -> %.2f bar", indexToDimLevel(i), dimLevelToPressure[i]);
+        }
+      }
+    } else {
+      consolePrintf("WARNING: Calibration data size mismatch (old format?), clearing...");
+      isCalibrated = false;
+      halStorageRemove("calib_v2");
+      halStorageRemove("calib_data");  // Remove old format too
+    }
+  } else {
+    consolePrintf("No calibration data found in NVS");
+  }
+  rebuildCalibrationCurve();
+}
+
+float getCurrentPressure() {
+#if USE_PRESSURE_SENSOR
+  float volts = halAnalogReadMilliVolts(PRESSURE_SENSOR_PIN) / 1000.0f;
+  float pressure = (volts - pressureOffset) * pressureScale;
+  return pressure > 0.0f ? pressure : 0.0f;
+#else
+  // Manual pressure reading - user reads from manometer
+  // This function is called during calibration to get user input
+  // For now, return 0 as placeholder
+  return 0.0;
+#endif
+}
+
+int pressureToDimLevel(float pressure) {
+  // FULL POWER: If pressure is >= 10 bar, always return 100% (no PSM skipping)
+  if (pressure >= 10.0f) {
+    return 100;
+  }
+
+  if (!isCalibrated || !calibrationCurve.isValid()) {
+    // Fallback: linear mapping assuming 0-12 bar range
+    return (int)(pressure * 100) * 100 / 1200;
+  }
+
+  // Monotone curve: precomputed inverse, no bracket search
+  pressure = clampFloat(pressure, 0, 12);
+  return clampInt((int)roundf(calibrationCurve.levelFor(pressure)), 0, 100);
+}
+
+static void beginCalibrationStep(int step) {
+  calStep = step;
+  calStepStartTime = halMillis();
+  calLastSampleTime = 0;
+  calSettle.reset();
+  setDimLevel(indexToDimLevel(step));
+}
+
+void startCalibration(bool automatic) {
+  if (!automatic) {
+    consolePrintf("Starting manual calibration...");
+
+    MessageDocument response(256);
+    response["status"] = "calibration_started";
+    response["mode"] = "manual";
+    response["steps"] = CALIBRATION_POINTS;
+    sendResponse(response);
+    return;
+  }
+
+  const char* error = NULL;
+  if (!USE_PRESSURE_SENSOR) {
+    error = "No pressure sensor";
+  } else if (isRunning || autotuneRunning) {
+    error = "Profile or autotune running";
+  }
+  if (error) {
+    logPrintf("warn", "Automatic calibration refused: %s", error);
+    MessageDocument response(256);
+    response["status"] = "calibration_error";
+    response["error"] = error;
+    sendResponse(response);
+    return;
+  }
+
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    dimLevelToPressure[i] = 0;
+  }
+  calibrationRunning = true;
+  calSweepStartTime = halMillis();
+  // 0% is the baseline reading of the idle machine
+  beginCalibrationStep(0);
+
+  logPrintf("info", "Automatic calibration started (%d steps)", CALIBRATION_POINTS);
+  MessageDocument response(256);
+  response["status"] = "calibration_started";
+  response["mode"] = "auto";
+  response["steps"] = CALIBRATION_POINTS;
+  sendResponse(response);
+}
+
+void stopCalibration(const char* reason) {
+  if (!calibrationRunning) return;
+
+  calibrationRunning = false;
+  if (!isRunning) {
+    setDimLevel(0);
+  }
+  // The stored calibration is only replaced by a finished sweep
+  loadCalibrationData();
+
+  logPrintf("warn", "Calibration aborted at %d%%: %s", indexToDimLevel(calStep), reason);
+  MessageDocument response(256);
+  response["status"] = "calibration_aborted";
+  response["step"] = calStep;
+  response["reason"] = reason;
+  sendResponse(response);
+}
+
+bool SettleDetector::add(float pressure, float* mean) {
+  window_[head_] = pressure;
+  head_ = (head_ + 1) % CAL_WINDOW_SAMPLES;
+  if (count_ < CAL_WINDOW_SAMPLES) {
+    count_++;
+    if (count_ < CAL_WINDOW_SAMPLES) return false;
+  }
+
+  float sum = 0.0f;
+  float firstHalf = 0.0f;
+  for (int i = 0; i < CAL_WINDOW_SAMPLES; i++) {
+    // Oldest sample first
+    float value = window_[(head_ + i) % CAL_WINDOW_SAMPLES];
+    sum += value;
+    if (i < CAL_WINDOW_SAMPLES / 2) firstHalf += value;
+  }
+  *mean = sum / CAL_WINDOW_SAMPLES;
+
+  float variance = 0.0f;
+  for (int i = 0; i < CAL_WINDOW_SAMPLES; i++) {
+    float d = window_[i] - *mean;
+    variance += d * d;
+  }
+  variance /= CAL_WINDOW_SAMPLES - 1;
+
+  float secondHalf = sum - firstHalf;
+  float drift = fabsf(secondHalf - firstHalf) / (CAL_WINDOW_SAMPLES / 2);
+  return variance <= CAL_SETTLE_STDDEV_BAR * CAL_SETTLE_STDDEV_BAR && drift <= CAL_SETTLE_DRIFT_BAR;
+}
+
+void calibrationTick() {
+  if (!calibrationRunning) return;
+
+  unsigned long now = halMillis();
+  if (calLastSampleTime != 0 && now - calLastSampleTime < CAL_SAMPLE_INTERVAL_MS) return;
+  calLastSampleTime = now;
+
+  unsigned long held = now - calStepStartTime;
+  if (held < CAL_MIN_SETTLE_MS) return;
+
+  float mean;
+  bool settled = calSettle.add(getCurrentPressure(), &mean);
+  if (!calSettle.full() || (!settled && held < CAL_STEP_TIMEOUT_MS)) return;
+
+  dimLevelToPressure[calStep] = mean;
+  if (!settled) {
+    logPrintf("warn", "Calibration %d%%: not settled after %lums, using %.2f bar", indexToDimLevel(calStep), held, mean);
+  }
+
+  MessageDocument progress(256);
+  progress["type"] = "calibration_progress";
+  progress["step"] = calStep;
+  progress["steps"] = CALIBRATION_POINTS;
+  progress["level"] = indexToDimLevel(calStep);
+  progress["pressure"] = mean;
+  progress["settled"] = settled;
+  progress["held_ms"] = held;
+  sendResponse(progress);
+
+  if (calStep + 1 < CALIBRATION_POINTS) {
+    beginCalibrationStep(calStep + 1);
+    return;
+  }
+
+  calibrationRunning = false;
+  setDimLevel(0);
+  isCalibrated = true;
+  saveCalibrationData();
+  logPrintf("info", "Automatic calibration finished in %lus", (now - calSweepStartTime) / 1000);
+  sendCalibrationStatus();
+}
+
+void setCalibrationPoint(int step, float pressure) {
+  // step is the dim level (0-100), convert to index
+  int index = dimLevelToIndex(step);
+  if (index >= 0 && index < CALIBRATION_POINTS) {
+    dimLevelToPressure[index] = pressure;
+    consolePrintf("Calibration point %d%% (idx %d): %.2f bar", step, index, pressure);
+
+    if (step >= 100) {
+      isCalibrated = true;
+      saveCalibrationData();
+      consolePrintf("Calibration completed and saved");
+    }
+  }
+}
+
+void setCalibrationData(JsonObject calibration) {
+  // Validate input
+  if (calibration.size() == 0) {
+    consolePrintf("Error: No calibration data received");
+    MessageDocument response(256);
+    response["status"] = "calibration_error";
+    response["error"] = "No data received";
+    sendResponse(response);
+    return;
+  }
+
+  // Clear existing calibration data
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    dimLevelToPressure[i] = 0;
+  }
+
+  int validPoints = 0;
+  int totalPoints = calibration.size();
+
+  // Fill in calibration data from JSON
+  // Supports any dim level that's a multiple of 5 (0, 5, 10, 15, ..., 100)
+  for (JsonPair kv : calibration) {
+    int dimLevel = atoi(kv.key().c_str());
+    float pressure = kv.value().as<float>();
+
+    if (dimLevel >= 0 && dimLevel <= 100 && pressure >= 0 && pressure <= 12) {
+      // Round to nearest 5% and get index
+      int roundedLevel = ((dimLevel + 2) / 5) * 5;  // Round to nearest 5
+      int index = dimLevelToIndex(roundedLevel);
+      dimLevelToPressure[index] = pressure;
+      validPoints++;
+      consolePrintf("Calibration: %d%% (idx %d) -> %.2f bar", dimLevel, index, pressure);
+    } else {
+      consolePrintf("Invalid calibration point: %d%% -> %.2f bar", dimLevel, pressure);
+    }
+  }
+
+  if (validPoints > 0) {
+    isCalibrated = true;
+
+    // Save calibration data to NVS
+    saveCalibrationData();
+
+    logPrintf("info", "Calibration data saved: %d valid points (%d total)", validPoints, totalPoints);
+
+    // Send detailed confirmation
+    MessageDocument response(512);
+    response["status"] = "calibration_data_set";
+    response["total_points"] = totalPoints;
+    response["valid_points"] = validPoints;
+    response["is_calibrated"] = true;
+    response["timestamp"] = halMillis();
+
+    // Include the actual calibration data for verification
+    JsonObject calibData = response.createNestedObject("calibration_data");
+    for (int i = 0; i < CALIBRATION_POINTS; i++) {
+      if (dimLevelToPressure[i] > 0) {
+        char key[4];
+        snprintf(key, sizeof(key), "%d", indexToDimLevel(i));
+        calibData[key] = dimLevelToPressure[i];
+      }
+    }
+
+    sendResponse(response);
+  } else {
+    consolePrintf("Error: No valid calibration points received");
+    MessageDocument response(256);
+    response["status"] = "calibration_error";
+    response["error"] = "No valid points";
+    response["total_points"] = totalPoints;
+    response["valid_points"] = 0;
+    sendResponse(response);
+  }
+}
+
+// calibration_data is paged (keyed by dim level); the fit is on every page
+void sendCalibrationStatus() {
+  PagedResponse pages("calibration_data", true);
+  JsonObject header = pages.header();
+  header["type"] = "calibration_status";
+  header["is_calibrated"] = isCalibrated;
+
+  if (isCalibrated) {
+    if (calibrationCurve.isValid()) {
+      const CalibrationFitQuality& q = calibrationCurve.quality();
+      JsonObject fit = header.createNestedObject("fit");
+      fit["model"] = "isotonic_pchip";
+      fit["used"] = q.usedPoints;
+      fit["pooled"] = q.pooledPoints;
+      fit["rms_bar"] = roundf(q.rmsResidualBar * 1000.0f) / 1000.0f;
+      fit["max_bar"] = roundf(q.maxResidualBar * 1000.0f) / 1000.0f;
+      JsonArray outliers = fit.createNestedArray("outliers");
+      for (int i = 0; i < CALIBRATION_POINTS; i++) {
+        if (q.outlierMask & (1UL << i)) outliers.add(indexToDimLevel(i));
+      }
+    }
+
+    for (int i = 0; i < CALIBRATION_POINTS; i++) {
+      if (dimLevelToPressure[i] > 0) {
+        char key[4];
+        snprintf(key, sizeof(key), "%d", indexToDimLevel(i));
+        pages.item().set(dimLevelToPressure[i]);
+        pages.add(key);
+      }
+    }
+  }
+
+  pages.finish();
+}
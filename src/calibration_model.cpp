@@ -0,0 +1,172 @@
+#include "calibration_model.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+CalibrationModel::CalibrationModel() : knotCount_(0) {
+  memset(&quality_, 0, sizeof(quality_));
+}
+
+static int compareFloat(const void* a, const void* b) {
+  float fa = *(const float*)a;
+  float fb = *(const float*)b;
+  return (fa > fb) - (fa < fb);
+}
+
+bool CalibrationModel::fit(const float* levels, const float* pressures, const bool* valid, int count) {
+  memset(&quality_, 0, sizeof(quality_));
+  knotCount_ = 0;
+  if (count > CAL_MODEL_MAX_POINTS) count = CAL_MODEL_MAX_POINTS;
+
+  bool keep[CAL_MODEL_MAX_POINTS];
+  int kept = 0;
+  for (int i = 0; i < count; i++) {
+    keep[i] = valid[i];
+    if (keep[i]) kept++;
+  }
+  if (kept < 2) return false;
+
+  // 1. Outliers: residual against the line through the kept neighbours
+  for (int pass = 0; pass < CAL_MAX_OUTLIERS && kept > 3; pass++) {
+    float residual[CAL_MODEL_MAX_POINTS];
+    float absResidual[CAL_MODEL_MAX_POINTS];
+    int residualCount = 0;
+    int worst = -1;
+    int prev = -1;
+    for (int i = 0; i < count; i++) {
+      residual[i] = 0.0f;
+      if (!keep[i]) continue;
+      int next = i + 1;
+      while (next < count && !keep[next]) next++;
+      if (prev >= 0 && next < count) {
+        float t = (levels[i] - levels[prev]) / (levels[next] - levels[prev]);
+        float line = pressures[prev] + (pressures[next] - pressures[prev]) * t;
+        residual[i] = pressures[i] - line;
+        absResidual[residualCount++] = fabsf(residual[i]);
+        if (worst < 0 || fabsf(residual[i]) > fabsf(residual[worst])) worst = i;
+      }
+      prev = i;
+    }
+    if (worst < 0) break;
+
+    qsort(absResidual, residualCount, sizeof(float), compareFloat);
+    float sigma = 1.4826f * absResidual[residualCount / 2];
+    float limit = 3.0f * sigma > CAL_OUTLIER_MIN_BAR ? 3.0f * sigma : CAL_OUTLIER_MIN_BAR;
+    if (fabsf(residual[worst]) <= limit) break;
+
+    keep[worst] = false;
+    kept--;
+    quality_.outliers++;
+    quality_.outlierMask |= 1UL << worst;
+  }
+
+  // 2. Isotonic regression (pool adjacent violators, unit weights)
+  float blockSum[CAL_MODEL_MAX_POINTS];
+  int blockSize[CAL_MODEL_MAX_POINTS];
+  int blocks = 0;
+  for (int i = 0; i < count; i++) {
+    if (!keep[i]) continue;
+    x_[knotCount_] = levels[i];
+    y_[knotCount_] = pressures[i];
+    knotCount_++;
+
+    blockSum[blocks] = pressures[i];
+    blockSize[blocks] = 1;
+    blocks++;
+    while (blocks > 1 && blockSum[blocks - 2] / blockSize[blocks - 2] > blockSum[blocks - 1] / blockSize[blocks - 1]) {
+      blockSum[blocks - 2] += blockSum[blocks - 1];
+      blockSize[blocks - 2] += blockSize[blocks - 1];
+      blocks--;
+    }
+  }
+
+  float squaredSum = 0.0f;
+  int k = 0;
+  for (int b = 0; b < blocks; b++) {
+    float mean = blockSum[b] / blockSize[b];
+    for (int j = 0; j < blockSize[b]; j++, k++) {
+      float r = y_[k] - mean;
+      if (fabsf(r) > 1e-4f) quality_.pooledPoints++;
+      squaredSum += r * r;
+      if (fabsf(r) > quality_.maxResidualBar) quality_.maxResidualBar = fabsf(r);
+      y_[k] = mean;
+    }
+  }
+  quality_.usedPoints = knotCount_;
+  quality_.rmsResidualBar = sqrtf(squaredSum / knotCount_);
+
+  // 3. Fritsch-Carlson slopes: zero at flats and extrema, weighted harmonic
+  // mean of the secants elsewhere
+  float secant[CAL_MODEL_MAX_POINTS] = {0};
+  for (int i = 0; i < knotCount_ - 1; i++) {
+    secant[i] = (y_[i + 1] - y_[i]) / (x_[i + 1] - x_[i]);
+  }
+  m_[0] = secant[0];
+  m_[knotCount_ - 1] = secant[knotCount_ - 2];
+  for (int i = 1; i < knotCount_ - 1; i++) {
+    if (secant[i - 1] * secant[i] <= 0.0f) {
+      m_[i] = 0.0f;
+    } else {
+      float h0 = x_[i] - x_[i - 1];
+      float h1 = x_[i + 1] - x_[i];
+      float w1 = 2.0f * h1 + h0;
+      float w2 = h1 + 2.0f * h0;
+      m_[i] = (w1 + w2) / (w1 / secant[i - 1] + w2 / secant[i]);
+    }
+  }
+
+  for (int j = 0; j < CAL_INVERSE_POINTS; j++) {
+    inverse_[j] = solveLevel(j * CAL_INVERSE_STEP_BAR);
+  }
+  return true;
+}
+
+float CalibrationModel::pressureAt(float level) const {
+  if (knotCount_ < 2) return 0.0f;
+  if (level <= x_[0]) return y_[0];
+  if (level >= x_[knotCount_ - 1]) return y_[knotCount_ - 1];
+
+  int k = 0;
+  while (level > x_[k + 1]) k++;
+  float h = x_[k + 1] - x_[k];
+  float t = (level - x_[k]) / h;
+  float t2 = t * t;
+  float t3 = t2 * t;
+  return (2.0f * t3 - 3.0f * t2 + 1.0f) * y_[k] + (t3 - 2.0f * t2 + t) * h * m_[k] +
+         (-2.0f * t3 + 3.0f * t2) * y_[k + 1] + (t3 - t2) * h * m_[k + 1];
+}
+
+// Bisection on the segment that first reaches the pressure (the curve is
+// non-decreasing, so this is the smallest such level)
+float CalibrationModel::solveLevel(float pressure) const {
+  if (pressure <= y_[0]) return x_[0];
+  if (pressure > y_[knotCount_ - 1]) return x_[knotCount_ - 1];
+
+  int k = 0;
+  while (y_[k + 1] < pressure) k++;
+  float lo = x_[k];
+  float hi = x_[k + 1];
+  for (int i = 0; i < 20; i++) {
+    float mid = 0.5f * (lo + hi);
+    if (pressureAt(mid) < pressure) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return hi;
+}
+
+float CalibrationModel::levelFor(float pressure) const {
+  if (knotCount_ < 2) return 0.0f;
+  if (pressure <= 0.0f) return inverse_[0];
+
+  float position = pressure / CAL_INVERSE_STEP_BAR;
+  int index = (int)position;
+  if (index >= CAL_INVERSE_POINTS - 1) {
+    return pressure > maxPressure() ? x_[knotCount_ - 1] : inverse_[CAL_INVERSE_POINTS - 1];
+  }
+  float frac = position - index;
+  return inverse_[index] + (inverse_[index + 1] - inverse_[index]) * frac;
+}
@@ -0,0 +1,494 @@
+#include "commands.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ArduinoJson.h>
+
+#include "calibration.h"
+#include "config.h"
+#include "flow_estimator.h"
+#include "hal.h"
+#include "messaging.h"
+#include "network.h"
+#include "perf_stats.h"
+#include "pressure_control.h"
+#include "profile_clock.h"
+#include "profile_engine.h"
+#include "profile_upload.h"
+#include "profiles.h"
+#include "pump_dynamics.h"
+#include "shot_recorder.h"
+#include "status_publisher.h"
+#include "supervisor.h"
+#include "subscriptions.h"
+#include "triac.h"
+#include "ws_server.h"
+
+// Why the command being dispatched failed (NULL = it did not), for batches.
+// This and the batch buffers below are shared: handleClientCommand holds
+// the command lock while it runs (BLE task and loop() both send commands)
+static const char* commandError = NULL;
+
+// client (MESSAGE_CLIENT_*) sent it: subscriptions and status snapshots are its own
+static void dispatchCommand(JsonObject doc, int client) {
+  // Support both "command" and "cmd" (optimized format)
+  const char* cmd = doc["command"] | doc["cmd"] | "";
+
+  if (strcmp(cmd, "start_profile") == 0) {
+    startProfile(doc["profile"]);
+  } else if (strcmp(cmd, "start_profile_by_id") == 0) {
+    uint8_t profileId = doc["profile_id"] | doc["id"] | 255;
+    if (profileId != 255) {
+      startProfileById(profileId);
+    } else {
+      consolePrintf("ERROR: profile_id not provided");
+      MessageDocument response(256);
+      response["status"] = "error";
+      response["error"] = "profile_id not provided";
+      sendResponse(response);
+    }
+  } else if (strcmp(cmd, "stop_profile") == 0) {
+    stopCalibration("Stop requested");
+    stopPumpIdentification("Stop requested");
+    stopAutotune("Stop requested");
+    stopSanityTest("Stop requested");
+    stopProfile();
+  } else if (strcmp(cmd, "seek") == 0) {
+    // {"command":"seek","time":42.5}: seconds into the running profile
+    float seconds = doc["time"] | -1.0f;
+    MessageDocument response(256);
+    if (seconds < 0.0f) {
+      response["status"] = "seek_error";
+      response["error"] = "time not provided";
+    } else if (!seekProfile(seconds)) {
+      response["status"] = "seek_error";
+      response["error"] = "No profile running";
+    } else {
+      response["status"] = "profile_seek";
+      response["time"] = profileElapsedMs() / 1000.0f;
+      response["segment"] = currentSegment;
+    }
+    sendResponse(response);
+  } else if (strcmp(cmd, "dry_run") == 0) {
+    // {"command":"dry_run","speed":10,"profile_id":3} or with "profile":{...}
+    uint8_t speed = (uint8_t)clampInt(doc["speed"] | 10, 1, PROFILE_CLOCK_MAX_SPEED);
+    uint8_t profileId = doc["profile_id"] | doc["id"] | 255;
+    if (!doc.containsKey("profile") && profileId == 255) {
+      MessageDocument response(256);
+      response["status"] = "error";
+      response["error"] = "profile or profile_id not provided";
+      sendResponse(response);
+    } else {
+      stopCalibration("Dry run requested");
+      stopPumpIdentification("Dry run requested");
+      stopAutotune("Dry run requested");
+      stopSanityTest("Dry run requested");
+      beginDryRun(speed);
+      if (doc.containsKey("profile")) {
+        startProfile(doc["profile"]);
+      } else {
+        startProfileById(profileId);
+      }
+      if (!isRunning) {
+        endDryRun();  // Profile did not start (invalid ID or checksum)
+      }
+    }
+  } else if (strcmp(cmd, "resume_at") == 0) {
+    // {"command":"resume_at","time":42.5,"profile_id":3} or with "profile":{...}
+    float seconds = doc["time"] | 0.0f;
+    uint8_t profileId = doc["profile_id"] | doc["id"] | 255;
+    if (doc.containsKey("profile")) {
+      startProfile(doc["profile"], seconds);
+    } else if (profileId != 255) {
+      startProfileById(profileId, seconds);
+    } else {
+      MessageDocument response(256);
+      response["status"] = "error";
+      response["error"] = "profile or profile_id not provided";
+      sendResponse(response);
+    }
+  } else if (strcmp(cmd, "start_calibration") == 0) {
+    // Automatic sweep by default when the transducer is fitted
+    bool automatic = doc["auto"] | (USE_PRESSURE_SENSOR != 0);
+    startCalibration(automatic);
+  } else if (strcmp(cmd, "stop_calibration") == 0) {
+    stopCalibration("Stop requested");
+  } else if (strcmp(cmd, "identify_pump") == 0) {
+    int fromLevel = doc["from"] | PUMP_ID_FROM_LEVEL;
+    int toLevel = doc["to"] | PUMP_ID_TO_LEVEL;
+    startPumpIdentification(fromLevel, toLevel);
+  } else if (strcmp(cmd, "get_pump_dynamics") == 0) {
+    sendPumpDynamics();
+  } else if (strcmp(cmd, "get_safety") == 0) {
+    sendSafetyStatus();
+  } else if (strcmp(cmd, "set_feedforward") == 0) {
+    setFeedforwardEnabled(doc["enable"] | true);
+  } else if (strcmp(cmd, "autotune_pressure") == 0) {
+    // {"setpoints":[3,6,9],"amplitude":15}; setpoints in bar, ascending
+    float setpoints[PID_MAX_BANDS] = {3.0f, 6.0f, 9.0f};
+    int count = PID_DEFAULT_BANDS;
+    JsonArray requested = doc["setpoints"];
+    if (!requested.isNull()) {
+      count = requested.size();
+      for (int i = 0; i < count && i < PID_MAX_BANDS; i++) {
+        setpoints[i] = requested[i];
+      }
+    }
+    startAutotune(setpoints, count, doc["amplitude"] | PID_RELAY_AMPLITUDE);
+  } else if (strcmp(cmd, "stop_autotune") == 0) {
+    stopAutotune("Stop requested");
+  } else if (strcmp(cmd, "get_pressure_control") == 0) {
+    sendPressureControlStatus();
+  } else if (strcmp(cmd, "set_pressure_control") == 0) {
+    setPressureControlEnabled(doc["enable"] | true);
+  } else if (strcmp(cmd, "set_flow_model") == 0) {
+    setFlowModel(doc["stroke_ml"] | flowModel.strokeMl, doc["deadhead_bar"] | flowModel.deadheadBar);
+  } else if (strcmp(cmd, "get_flow_model") == 0) {
+    sendFlowModel();
+  } else if (strcmp(cmd, "set_calibration_point") == 0) {
+    int step = doc["step"];
+    float pressure = doc["pressure"];
+    setCalibrationPoint(step, pressure);
+  } else if (strcmp(cmd, "subscribe") == 0) {
+    // {"topics":{"telemetry":{"rate":10},"logs":{"level":"warn"},"triac_stats":false}}
+    if (doc["reset"] | false) {
+      resetSubscriptions(client);
+    }
+    applySubscriptions(client, doc["topics"]);
+    if ((doc["reset"] | false) || !doc["topics"]["status"].isNull()) {
+      resetStatusClient(client);
+    }
+  } else if (strcmp(cmd, "get_subscriptions") == 0) {
+    sendSubscriptions(client);
+  } else if (strcmp(cmd, "get_status") == 0) {
+    // Also how a client recovers from a gap in the status sequence
+    resetStatusClient(client);
+    sendStatusUpdate(1 << client);
+  } else if (strcmp(cmd, "set_default_profile") == 0) {
+    int button = doc["button"];
+    uint8_t profileId = doc["profileId"];
+    if (!setDefaultProfile(button, profileId)) {
+      commandError = "invalid profile id";
+    }
+  } else if (strcmp(cmd, "set_calibration_data") == 0) {
+    setCalibrationData(doc["calibration"]);
+  } else if (strcmp(cmd, "get_calibration_status") == 0) {
+    sendCalibrationStatus();
+  } else if (strcmp(cmd, "store_profile") == 0 || cmd[0] == '\0') {
+    // Handle both full and optimized (shortened) command format
+    uint8_t id;
+    JsonObject profile;
+
+    // Check for optimized format (cmd = "", id directly in root)
+    if (cmd[0] == '\0' && doc.containsKey("id") && doc.containsKey("p")) {
+      id = doc["id"];
+      profile = doc["p"];
+    } else {
+      // Standard format
+      id = doc["id"];
+      profile = doc["profile"];
+    }
+
+    if (!storeProfile(id, profile)) {
+      commandError = "invalid profile";
+    }
+  } else if (strcmp(cmd, "upload_begin") == 0) {
+    handleUploadBegin(doc);
+  } else if (strcmp(cmd, "upload_chunk") == 0) {
+    handleUploadChunk(doc);
+  } else if (strcmp(cmd, "upload_commit") == 0) {
+    handleUploadCommit();
+  } else if (strcmp(cmd, "upload_abort") == 0) {
+    handleUploadAbort();
+  } else if (strcmp(cmd, "get_profile_status") == 0) {
+    sendProfileStatus();
+  } else if (strcmp(cmd, "get_profile_hashes") == 0) {
+    sendProfileHashes();
+  } else if (strcmp(cmd, "set_wifi_credentials") == 0) {
+    const char* ssid = doc["ssid"];
+    const char* password = doc["password"];
+    setWiFiCredentials(ssid, password);
+  } else if (strcmp(cmd, "get_ws_server") == 0) {
+    sendWsServerStatus();
+  } else if (strcmp(cmd, "ota_update") == 0) {
+    const char* firmwareUrl = doc["firmware_url"];
+    if (firmwareUrl) {
+      performOTAUpdate(firmwareUrl);
+    } else {
+      consolePrintf("ERROR: firmware_url not provided");
+      MessageDocument response(256);
+      response["status"] = "ota_error";
+      response["error"] = "firmware_url not provided";
+      sendResponse(response);
+    }
+  } else if (strcmp(cmd, "clear_all_profiles") == 0) {
+    // Clear all stored profiles
+    clearAllProfiles();
+
+    MessageDocument response(256);
+    response["status"] = "profiles_cleared";
+    response["profile_count"] = 0;
+    sendResponse(response);
+  } else if (strcmp(cmd, "set_pwm_test_mode") == 0) {
+    bool enable = doc["enable"] | false;
+    setPwmTestMode(enable);
+
+    if (pwmTestMode) {
+      consolePrintf("========================================");
+      consolePrintf("[DIMMER] PWM TEST MODE ENABLED");
+      consolePrintf("  Zero-cross: DISABLED");
+      consolePrintf("  Direct PWM output on GPIO%d", DIMMER_PIN);
+      consolePrintf("  Use set_dim_level to control");
+      consolePrintf("========================================");
+      sendLogMessage("[DIMMER] PWM test mode ENABLED - ZC disabled", "warn");
+    } else {
+      consolePrintf("[DIMMER] PWM test mode DISABLED - TRIAC mode active");
+      sendLogMessage("[DIMMER] PWM test mode DISABLED - TRIAC mode active", "info");
+    }
+
+    MessageDocument response(256);
+    response["status"] = "pwm_test_mode_set";
+    response["enabled"] = pwmTestMode.load();
+    response["zc_enabled"] = zcEnabled.load();
+    sendResponse(response);
+  } else if (strcmp(cmd, "set_dim_level") == 0) {
+    int level = doc["level"] | 0;
+    setDimLevel(level);
+
+    TriacControl control = readTriacControl();
+    const char* modeStr = pwmTestMode ? "PWM_TEST" : (control.mode == DIM_OFF ? "OFF" : "TRIAC");
+    logPrintf("info", "[DIMMER] Level set to %d%% (%s)", dimmerLevel, modeStr);
+
+    MessageDocument response(256);
+    response["status"] = "dim_level_set";
+    response["level"] = dimmerLevel;
+    response["mode"] = modeStr;
+    response["psm_duty"] = control.duty;
+    sendResponse(response);
+  } else if (strcmp(cmd, "set_zc_enabled") == 0) {
+    bool enabled = doc["enabled"] | true;
+    setZeroCrossEnabled(enabled);
+
+    sendLogMessage(enabled ? "[ZC] Zero-cross detection ENABLED" : "[ZC] Zero-cross detection DISABLED", "info");
+
+    MessageDocument response(256);
+    response["status"] = "zc_enabled_set";
+    response["enabled"] = zcEnabled.load();
+    sendResponse(response);
+  } else if (strcmp(cmd, "sanity_test") == 0) {
+    if (isRunning || calibrationRunning || pumpIdentificationRunning || autotuneRunning || sanityTestRunning) {
+      MessageDocument response(256);
+      response["status"] = "sanity_test_error";
+      response["error"] = "Another run in progress";
+      sendResponse(response);
+    } else {
+      startSanityTest();  // Stepped by loop(), answers sanity_test_complete
+    }
+  } else if (strcmp(cmd, "get_dimmer_stats") == 0) {
+    TriacControl control = readTriacControl();
+    TriacStats triacStats;
+    readTriacStats(&triacStats);
+    MessageDocument response(512);
+    response["status"] = "dimmer_stats";
+    response["mode"] = (control.mode == DIM_OFF) ? "OFF" : "PSM";
+    response["level"] = dimmerLevel;
+    response["psm_duty"] = control.duty;
+    response["zc_count"] = triacStats.zcCount;
+    response["fired_count"] = triacStats.firedCount;
+    response["sw_control"] = swControlEnabled;
+    sendResponse(response);
+  } else if (strcmp(cmd, "set_sw_control") == 0) {
+    bool enable = doc["enable"] | false;
+    swControlEnabled = enable;
+
+    if (enable) {
+      sendLogMessage("[SAFETY] SW control ENABLED - hardware switch bypassed!", "warn");
+    } else {
+      setDimLevel(0);  // Force OFF when disabling SW control
+      sendLogMessage("[SAFETY] SW control DISABLED - hardware switch active", "info");
+    }
+
+    MessageDocument response(256);
+    response["status"] = "sw_control_set";
+    response["enabled"] = swControlEnabled;
+    sendResponse(response);
+  } else if (strcmp(cmd, "list_shots") == 0) {
+    sendShotList();
+  } else if (strcmp(cmd, "get_shot") == 0) {
+    uint32_t shotId = doc["id"] | 0;
+    uint32_t offset = doc["offset"] | 0;
+    sendShotData(shotId, offset);
+  } else if (strcmp(cmd, "get_perf_stats") == 0) {
+    perfSampleCommandStack();
+    sendPerfStats();
+    if (doc["reset"] | false) {
+      resetPerfStats();
+    }
+  } else if (strcmp(cmd, "relay_test") == 0) {
+#if USE_RELAYS
+    bool on = doc["on"] | false;
+    halDigitalWrite(RELAY_1_PIN, on);
+    halDigitalWrite(RELAY_2_PIN, on);
+    consolePrintf("[RELAY] Test: %s", on ? "ON" : "OFF");
+    MessageDocument response(256);
+    response["status"] = "relay_test";
+    response["on"] = on;
+    sendResponse(response);
+#else
+    sendLogMessage("[RELAY] Relays disabled in this build", "warn");
+#endif
+  } else {
+    commandError = "unknown command";
+  }
+}
+
+// ============================================================================
+// BATCHES
+// ============================================================================
+
+// Ack of the batched command being applied, from the response hook
+static char batchStatus[32];
+static char batchError[64];
+
+static void captureBatchAck(JsonDocument& response) {
+  snprintf(batchStatus, sizeof(batchStatus), "%s", response["status"] | "");
+  snprintf(batchError, sizeof(batchError), "%s", response["error"] | "");
+}
+
+// Commands a batch may hold: the profile and default writes a rollback
+// undoes, and reads. Anything else (runs, calibration and control settings,
+// subscriptions, uploads, triac/relay drive, network changes) would stay
+// applied in a batch answered applied:false, so a batch holding one is
+// refused up front.
+static const char* const BATCH_COMMANDS[] = {
+  "store_profile", "set_default_profile", "clear_all_profiles", "get_profile_status", "get_profile_hashes",
+  "get_status", "get_safety", "get_pump_dynamics", "get_pressure_control", "get_flow_model",
+  "get_calibration_status", "get_subscriptions", "get_ws_server", "get_dimmer_stats", "list_shots"
+};
+
+// Index of the first command a batch may not hold, -1 if none
+static int findNotBatchable(JsonArray commands) {
+  int index = 0;
+  for (JsonVariant command : commands) {
+    const char* cmd = command["command"] | command["cmd"] | "";
+    bool allowed = false;
+    for (size_t i = 0; i < sizeof(BATCH_COMMANDS) / sizeof(BATCH_COMMANDS[0]) && !allowed; i++) {
+      allowed = strcmp(cmd, BATCH_COMMANDS[i]) == 0;
+    }
+    if (!allowed) return index;
+    index++;
+  }
+  return -1;
+}
+
+static bool isErrorStatus(const char* status) {
+  size_t length = strlen(status);
+  return strcmp(status, "error") == 0 || (length > 6 && strcmp(status + length - 6, "_error") == 0);
+}
+
+static void applyBatch(JsonArray commands, uint32_t parseUs, int client) {
+  MessageDocument response(COMMAND_DOC_BYTES);
+  response["status"] = "batch_done";
+  response["count"] = commands.size();
+  if (commands.size() > BATCH_MAX_COMMANDS) {
+    response["status"] = "batch_error";
+    response["error"] = "too many commands";
+    sendResponse(response);
+    return;
+  }
+  int refused = findNotBatchable(commands);
+  if (refused >= 0) {
+    response["status"] = "batch_error";
+    response["error"] = "command not allowed in a batch";
+    response["failed"] = refused;
+    sendResponse(response);
+    return;
+  }
+
+  uint32_t applyStart = halMicros();
+  JsonArray results = response.createNestedArray("results");
+  int failedAt = -1;
+  beginProfileTransaction();
+  setResponseHook(captureBatchAck);
+  for (JsonVariant command : commands) {
+    batchStatus[0] = '\0';
+    batchError[0] = '\0';
+    commandError = NULL;
+    JsonObject object = command.as<JsonObject>();
+    if (!object.isNull()) {
+      dispatchCommand(object, client);
+    } else {
+      commandError = "not a command";
+    }
+
+    if (commandError == NULL && isErrorStatus(batchStatus)) {
+      commandError = batchError[0] != '\0' ? batchError : batchStatus;
+    }
+    if (commandError) {
+      failedAt = results.size();
+      results.add("error");
+      response["error"] = (char*)commandError;  // Copied: may be one of the buffers above
+      break;
+    }
+    if (batchStatus[0] != '\0') {
+      results.add((char*)batchStatus);
+    } else {
+      results.add("ok");
+    }
+  }
+  setResponseHook(NULL);
+
+  uint32_t saveStart = halMicros();
+  if (failedAt >= 0) {
+    rollbackProfileTransaction();
+  } else {
+    commitProfileTransaction();
+  }
+  uint32_t end = halMicros();
+
+  response["applied"] = failedAt < 0;
+  if (failedAt >= 0) {
+    response["failed"] = failedAt;
+  }
+  JsonObject timing = response.createNestedObject("us");
+  timing["parse"] = parseUs;
+  timing["apply"] = saveStart - applyStart;
+  timing["save"] = end - saveStart;
+  logPrintf(failedAt < 0 ? "info" : "error", "[BATCH] %u commands %s: parse %lu us, apply %lu us, save %lu us",
+            (unsigned)commands.size(), failedAt < 0 ? "applied" : "rolled back", (unsigned long)parseUs,
+            (unsigned long)(saveStart - applyStart), (unsigned long)(end - saveStart));
+  sendResponse(response);
+}
+
+void handleCommand(const char* command) {
+  handleClientCommand(MESSAGE_CLIENT_BLE, command);
+}
+
+void handleClientCommand(int client, const char* command) {
+  halCommandLock();
+  uint32_t perfStart = perfBegin();
+  uint32_t parseStart = halMicros();
+  // A batch holds several commands: size the document to the text
+  size_t docBytes = messageDocBytesFor(command, strlen(command));
+  MessageDocument doc(docBytes > COMMAND_DOC_BYTES ? docBytes : COMMAND_DOC_BYTES);
+  DeserializationError error = deserializeJson(doc, command);
+
+  if (error) {
+    consolePrintf("JSON parsing failed");
+  } else if (doc.is<JsonArray>()) {
+    applyBatch(doc.as<JsonArray>(), halMicros() - parseStart, client);
+  } else {
+    commandError = NULL;
+    dispatchCommand(doc.as<JsonObject>(), client);
+    if (commandError) {
+      // Batches report it in batch_done; a single command answers here
+      MessageDocument response(256);
+      response["status"] = "error";
+      response["error"] = commandError;
+      sendResponse(response);
+    }
+  }
+  perfEndShared(PERF_COMMAND, perfStart);
+  halCommandUnlock();
+}
@@ -0,0 +1,126 @@
+#include "flow_estimator.h"
+
+#include <math.h>
+
+#include <ArduinoJson.h>
+
+#include "calibration.h"
+#include "config.h"
+#include "hal.h"
+#include "messaging.h"
+#include "triac.h"
+
+FlowModel flowModel = {FLOW_STROKE_ML, FLOW_DEADHEAD_BAR};
+float estimatedFlow = 0.0f;
+float estimatedVolume = 0.0f;
+
+static unsigned long flowLastFired = 0;
+static unsigned long flowLastUpdate = 0;
+static bool flowHaveUpdate = false;
+static float flowTrim = 0.0f;
+static unsigned long flowLastTrim = 0;
+static bool flowHaveTrim = false;
+
+void loadFlowModel() {
+  if (halStorageBytesLength("flow_model") == sizeof(FlowModel)) {
+    halStorageGetBytes("flow_model", &flowModel, sizeof(FlowModel));
+    consolePrintf("Flow model loaded: %.3f ml/stroke, dead-head %.1f bar", flowModel.strokeMl, flowModel.deadheadBar);
+  }
+}
+
+void setFlowModel(float strokeMl, float deadheadBar) {
+  if (strokeMl <= 0.0f || deadheadBar <= 1.0f) {
+    logPrintf("error", "Invalid flow model: %.3f ml/stroke, dead-head %.1f bar", strokeMl, deadheadBar);
+    MessageDocument response(256);
+    response["status"] = "flow_model_error";
+    response["error"] = "Invalid flow model";
+    sendResponse(response);
+    return;
+  }
+  flowModel.strokeMl = strokeMl;
+  flowModel.deadheadBar = deadheadBar;
+  halStoragePutBytes("flow_model", &flowModel, sizeof(FlowModel));
+  logPrintf("info", "Flow model set: %.3f ml/stroke, dead-head %.1f bar", strokeMl, deadheadBar);
+  sendFlowModel();
+}
+
+void sendFlowModel() {
+  MessageDocument response(256);
+  response["type"] = "flow_model";
+  response["stroke_ml"] = flowModel.strokeMl;
+  response["deadhead_bar"] = flowModel.deadheadBar;
+  response["flow"] = estimatedFlow;
+  response["volume"] = estimatedVolume;
+  sendResponse(response);
+}
+
+float halfCycleDisplacementMl(float backPressureBar) {
+  float headroom = 1.0f - backPressureBar / flowModel.deadheadBar;
+  return headroom > 0.0f ? 0.5f * flowModel.strokeMl * headroom : 0.0f;
+}
+
+// Pressure the pump is working against right now
+static float backPressure() {
+#if USE_PRESSURE_SENSOR
+  return getCurrentPressure();
+#else
+  return calibrationCurve.isValid() ? calibrationCurve.pressureAt((float)dimmerLevel) : 0.0f;
+#endif
+}
+
+// Half-cycles per second from the measured ZC interval (nominal if implausible)
+static float halfCycleRate() {
+  unsigned long interval = triacZcIntervalUs();
+  if (interval >= 6000 && interval <= 12000) {
+    return 1000000.0f / interval;
+  }
+  return 2.0f * AC_FREQ_HZ;
+}
+
+void resetFlowEstimator() {
+  estimatedFlow = 0.0f;
+  estimatedVolume = 0.0f;
+  flowLastFired = triacFiredCount();
+  flowHaveUpdate = false;
+  flowTrim = 0.0f;
+  flowHaveTrim = false;
+}
+
+void updateFlowEstimator() {
+  unsigned long now = halMillis();
+  unsigned long fired = triacFiredCount();
+  float volume = (fired - flowLastFired) * halfCycleDisplacementMl(backPressure());
+  flowLastFired = fired;
+  estimatedVolume += volume;
+
+  if (flowHaveUpdate && now > flowLastUpdate) {
+    float dt = (now - flowLastUpdate) / 1000.0f;
+    estimatedFlow += (volume / dt - estimatedFlow) * dt / (FLOW_FILTER_TAU_S + dt);
+  }
+  flowLastUpdate = now;
+  flowHaveUpdate = true;
+}
+
+int flowToDimLevel(float targetFlow, bool closedLoop) {
+  unsigned long now = halMillis();
+  float pressure = backPressure();
+  float perSecondAtFull = halfCycleDisplacementMl(pressure) * halfCycleRate();
+  float level = perSecondAtFull > 0.0f ? 100.0f * targetFlow / perSecondAtFull : 100.0f;
+
+  // The fired count is what the estimate is built on, so the trim only
+  // takes up PSM rounding and model drift between the sensor and the count
+  if (closedLoop && flowHaveTrim && now > flowLastTrim) {
+    float dt = (now - flowLastTrim) / 1000.0f;
+    if (dt > 0.5f) dt = 0.5f;
+    flowTrim = clampFloat(flowTrim + FLOW_TRIM_KI * (targetFlow - estimatedFlow) * dt, -FLOW_TRIM_LIMIT, FLOW_TRIM_LIMIT);
+  }
+  flowLastTrim = now;
+  flowHaveTrim = true;
+  if (closedLoop) level += flowTrim;
+
+  if (pressure > FLOW_PRESSURE_LIMIT_BAR) {
+    float capped = (float)pressureToDimLevel(FLOW_PRESSURE_LIMIT_BAR);
+    if (level > capped) level = capped;
+  }
+  return clampInt((int)lroundf(level), 0, 100);
+}
@@ -0,0 +1,481 @@
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLEUtils.h>
+#include <BLE2902.h>
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <errno.h>
+#include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+#include <esp_task.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <fcntl.h>
+#include <lwip/sockets.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "hal.h"
+
+// Bluetooth service and characteristic UUIDs
+#define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define RESPONSE_UUID       "beb5483e-36e1-4688-b7f5-ea07361b26a8"  // Notify: JSON responses (the original characteristic)
+#define COMMAND_UUID        "beb5483e-36e1-4688-b7f5-ea07361b26a9"  // Write with response: JSON commands
+#define TELEMETRY_UUID      "beb5483e-36e1-4688-b7f5-ea07361b26aa"  // Notify: binary telemetry frames
+#define LOG_UUID            "beb5483e-36e1-4688-b7f5-ea07361b26ab"  // Notify: serial_log lines
+#define SERVICE_HANDLES     20                                       // 4 characteristics + 3 CCCDs
+
+#define PWM_CHANNEL 0
+
+// Preferences for non-volatile storage (NVS)
+static Preferences preferences;
+
+static BLEServer* pServer = NULL;
+static portMUX_TYPE transportMux = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t commandMutexBuffer;
+static SemaphoreHandle_t commandMutex = NULL;
+static BLECharacteristic* pCommandCharacteristic = NULL;
+static BLECharacteristic* pNotifyCharacteristics[HAL_CHANNEL_COUNT] = {NULL, NULL, NULL};
+static volatile bool deviceConnected = false;
+static HalReceiveFn receiveHandler = NULL;
+static bool consoleEnabled = true;
+
+// ============================================================================
+// CLOCK
+// ============================================================================
+uint32_t halMillis() {
+  return millis();
+}
+
+uint32_t IRAM_ATTR halMicros() {
+  return micros();
+}
+
+uint64_t IRAM_ATTR halMicros64() {
+  return (uint64_t)esp_timer_get_time();
+}
+
+void halDelay(uint32_t ms) {
+  delay(ms);
+}
+
+void IRAM_ATTR halDelayMicroseconds(uint32_t us) {
+  delayMicroseconds(us);
+}
+
+uint32_t IRAM_ATTR halCycleCount() {
+  return ESP.getCycleCount();
+}
+
+uint32_t halCpuFrequencyMhz() {
+  return getCpuFrequencyMhz();
+}
+
+// ============================================================================
+// GPIO
+// ============================================================================
+void halPinMode(uint8_t pin, HalPinMode mode) {
+  switch (mode) {
+    case HAL_PIN_INPUT: pinMode(pin, INPUT); break;
+    case HAL_PIN_OUTPUT: pinMode(pin, OUTPUT); break;
+    case HAL_PIN_INPUT_PULLUP: pinMode(pin, INPUT_PULLUP); break;
+  }
+}
+
+void IRAM_ATTR halDigitalWrite(uint8_t pin, bool high) {
+  digitalWrite(pin, high ? HIGH : LOW);
+}
+
+bool halDigitalRead(uint8_t pin) {
+  return digitalRead(pin) == HIGH;
+}
+
+void halAttachRisingInterrupt(uint8_t pin, HalIsrFn isr) {
+  attachInterrupt(digitalPinToInterrupt(pin), isr, RISING);
+}
+
+void halDetachInterrupt(uint8_t pin) {
+  detachInterrupt(digitalPinToInterrupt(pin));
+}
+
+uint32_t halAnalogReadMilliVolts(uint8_t pin) {
+  return analogReadMilliVolts(pin);
+}
+
+void halPwmBegin(uint8_t pin, uint32_t freqHz, uint8_t resolutionBits) {
+  ledcSetup(PWM_CHANNEL, freqHz, resolutionBits);
+  ledcAttachPin(pin, PWM_CHANNEL);
+  ledcWrite(PWM_CHANNEL, 0);
+}
+
+void halPwmWrite(uint32_t duty) {
+  ledcWrite(PWM_CHANNEL, duty);
+}
+
+void halPwmEnd(uint8_t pin) {
+  ledcDetachPin(pin);
+}
+
+// ============================================================================
+// TIMERS
+// ============================================================================
+HalTimerHandle halTimerCreate(const char* name, HalTimerFn callback, void* arg) {
+  esp_timer_create_args_t timerArgs = {
+    .callback = callback,
+    .arg = arg,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = name
+  };
+  esp_timer_handle_t handle = NULL;
+  if (esp_timer_create(&timerArgs, &handle) != ESP_OK) {
+    return NULL;
+  }
+  return (HalTimerHandle)handle;
+}
+
+void IRAM_ATTR halTimerStartOnce(HalTimerHandle timer, uint32_t delayUs) {
+  esp_timer_start_once((esp_timer_handle_t)timer, delayUs);
+}
+
+void IRAM_ATTR halTimerStop(HalTimerHandle timer) {
+  esp_timer_stop((esp_timer_handle_t)timer);
+}
+
+// ============================================================================
+// TASKS AND WATCHDOG
+// ============================================================================
+#define PERIODIC_TASK_MAX 2
+#define PERIODIC_TASK_STACK 3072
+#define PERIODIC_TASK_PRIORITY (ESP_TASK_TIMER_PRIO - 1)  // Above loopTask (1), below esp_timer (22)
+
+struct PeriodicTask {
+  HalTaskFn fn;
+  void* arg;
+  TickType_t period;
+};
+
+static PeriodicTask periodicTasks[PERIODIC_TASK_MAX];
+static int periodicTaskCount = 0;
+
+static void periodicTaskMain(void* param) {
+  PeriodicTask* task = (PeriodicTask*)param;
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    task->fn(task->arg);
+    vTaskDelayUntil(&wake, task->period);
+  }
+}
+
+bool halTaskCreatePeriodic(const char* name, HalTaskFn fn, void* arg, uint32_t periodMs) {
+  if (periodicTaskCount >= PERIODIC_TASK_MAX) return false;
+  PeriodicTask* task = &periodicTasks[periodicTaskCount];
+  task->fn = fn;
+  task->arg = arg;
+  task->period = pdMS_TO_TICKS(periodMs) > 0 ? pdMS_TO_TICKS(periodMs) : 1;
+  // Same core as loop(): a spinning loop is preempted, not starved
+  if (xTaskCreatePinnedToCore(periodicTaskMain, name, PERIODIC_TASK_STACK, task, PERIODIC_TASK_PRIORITY, NULL,
+                              ARDUINO_RUNNING_CORE) != pdPASS) {
+    return false;
+  }
+  periodicTaskCount++;
+  return true;
+}
+
+uintptr_t halCurrentTask() {
+  return (uintptr_t)xTaskGetCurrentTaskHandle();
+}
+
+void halWatchdogBegin(uint32_t timeoutMs) {
+  // The core usually started the task watchdog already (ESP_ERR_INVALID_STATE):
+  // its timeout then stays, the subscription below works either way
+  esp_task_wdt_init((timeoutMs + 999) / 1000, true);
+  esp_task_wdt_add(NULL);
+}
+
+void halWatchdogFeed() {
+  esp_task_wdt_reset();
+}
+
+bool halResetByWatchdog() {
+  esp_reset_reason_t reason = esp_reset_reason();
+  return reason == ESP_RST_TASK_WDT || reason == ESP_RST_INT_WDT || reason == ESP_RST_WDT;
+}
+
+// ============================================================================
+// STORAGE
+// ============================================================================
+bool halStorageBegin(const char* ns) {
+  return preferences.begin(ns, false);
+}
+
+uint8_t halStorageGetU8(const char* key, uint8_t defaultValue) {
+  return preferences.getUChar(key, defaultValue);
+}
+
+void halStoragePutU8(const char* key, uint8_t value) {
+  preferences.putUChar(key, value);
+}
+
+uint32_t halStorageGetU32(const char* key, uint32_t defaultValue) {
+  return preferences.getUInt(key, defaultValue);
+}
+
+void halStoragePutU32(const char* key, uint32_t value) {
+  preferences.putUInt(key, value);
+}
+
+size_t halStorageGetBytes(const char* key, void* data, size_t len) {
+  return preferences.getBytes(key, data, len);
+}
+
+void halStoragePutBytes(const char* key, const void* data, size_t len) {
+  preferences.putBytes(key, data, len);
+}
+
+size_t halStorageBytesLength(const char* key) {
+  return preferences.getBytesLength(key);
+}
+
+bool halStorageIsKey(const char* key) {
+  return preferences.isKey(key);
+}
+
+void halStorageRemove(const char* key) {
+  preferences.remove(key);
+}
+
+bool halFileBegin() {
+  // Format on first boot
+  return SPIFFS.begin(true);
+}
+
+bool halFileWrite(const char* path, const uint8_t* data, size_t len, bool append) {
+  File file = SPIFFS.open(path, append ? FILE_APPEND : FILE_WRITE);
+  if (!file) return false;
+  size_t n = len > 0 ? file.write(data, len) : 0;
+  file.close();
+  return n == len;
+}
+
+size_t halFileRead(const char* path, uint32_t offset, uint8_t* data, size_t len) {
+  File file = SPIFFS.open(path, FILE_READ);
+  if (!file) return 0;
+  size_t n = 0;
+  if (file.seek(offset)) {
+    n = file.read(data, len);
+  }
+  file.close();
+  return n;
+}
+
+int32_t halFileSize(const char* path) {
+  if (!SPIFFS.exists(path)) return -1;
+  File file = SPIFFS.open(path, FILE_READ);
+  if (!file) return -1;
+  int32_t size = file.size();
+  file.close();
+  return size;
+}
+
+// ============================================================================
+// TRANSPORT (BLE)
+// ============================================================================
+class MyServerCallbacks: public BLEServerCallbacks {
+    void onConnect(BLEServer* pServer) {
+      deviceConnected = true;
+      Serial.println("Device connected");
+      digitalWrite(LED_PIN, HIGH);
+      // Don't send messages here - wait for loop() to handle it after notifications are ready
+    };
+
+    void onDisconnect(BLEServer* pServer) {
+      deviceConnected = false;
+      Serial.println("Device disconnected");
+      digitalWrite(LED_PIN, LOW);
+    }
+};
+
+class MyCallbacks: public BLECharacteristicCallbacks {
+    void onWrite(BLECharacteristic *pCharacteristic) {
+      std::string rxValue = pCharacteristic->getValue();
+
+      if (rxValue.length() > 0) {
+        Serial.printf("Received Value: %s\n", rxValue.c_str());
+        if (receiveHandler) {
+          receiveHandler(rxValue.c_str());
+        }
+      }
+    }
+};
+
+void halTransportBegin(const char* deviceName, HalReceiveFn onReceive) {
+  receiveHandler = onReceive;
+  commandMutex = xSemaphoreCreateMutexStatic(&commandMutexBuffer);
+
+  BLEDevice::init(deviceName);
+  pServer = BLEDevice::createServer();
+  pServer->setCallbacks(new MyServerCallbacks());
+
+  // Create BLE service
+  BLEService *pService = pServer->createService(BLEUUID(SERVICE_UUID), SERVICE_HANDLES);
+
+  // Commands: write with response, so the client knows the write landed
+  pCommandCharacteristic = pService->createCharacteristic(COMMAND_UUID, BLECharacteristic::PROPERTY_WRITE);
+  pCommandCharacteristic->setCallbacks(new MyCallbacks());
+
+  // One notify characteristic per outgoing stream
+  static const char* const notifyUuids[HAL_CHANNEL_COUNT] = {RESPONSE_UUID, TELEMETRY_UUID, LOG_UUID};
+  for (int i = 0; i < HAL_CHANNEL_COUNT; i++) {
+    pNotifyCharacteristics[i] = pService->createCharacteristic(
+                                  notifyUuids[i],
+                                  BLECharacteristic::PROPERTY_READ |
+                                  BLECharacteristic::PROPERTY_NOTIFY
+                                );
+    pNotifyCharacteristics[i]->addDescriptor(new BLE2902());
+  }
+
+  // Start the service
+  pService->start();
+
+  // Start advertising
+  BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
+  pAdvertising->addServiceUUID(SERVICE_UUID);
+  pAdvertising->setScanResponse(true);
+  pAdvertising->setMinPreferred(0x06);  // Functions that help with iPhone connections issue
+  pAdvertising->setMaxPreferred(0x12);
+
+  // Set device name for advertising
+  BLEAdvertisementData advertisementData;
+  advertisementData.setName(deviceName);
+  advertisementData.setCompleteServices(BLEUUID(SERVICE_UUID));
+  pAdvertising->setAdvertisementData(advertisementData);
+
+  BLEDevice::startAdvertising();
+}
+
+bool halTransportConnected() {
+  return deviceConnected && pCommandCharacteristic;
+}
+
+void halTransportRestartAdvertising() {
+  pServer->startAdvertising();
+}
+
+void halTransportNotify(HalChannel channel, const uint8_t* data, size_t len) {
+  if (!halTransportConnected()) return;
+  BLECharacteristic* characteristic = pNotifyCharacteristics[channel];
+  characteristic->setValue((uint8_t*)data, len);
+  characteristic->notify();
+}
+
+void halTransportLock() {
+  portENTER_CRITICAL(&transportMux);
+}
+
+void halTransportUnlock() {
+  portEXIT_CRITICAL(&transportMux);
+}
+
+// Before halTransportBegin only loop() runs commands
+void halCommandLock() {
+  if (commandMutex) xSemaphoreTake(commandMutex, portMAX_DELAY);
+}
+
+void halCommandUnlock() {
+  if (commandMutex) xSemaphoreGive(commandMutex);
+}
+
+// ============================================================================
+// TCP
+// ============================================================================
+static bool tcpSetNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+int halTcpListen(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 2) != 0 || !tcpSetNonBlocking(fd)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int halTcpAccept(int listener) {
+  int fd = accept(listener, NULL, NULL);
+  if (fd < 0) return -1;
+  int noDelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  if (!tcpSetNonBlocking(fd)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int halTcpRead(int socket, uint8_t* buffer, size_t len) {
+  int n = recv(socket, buffer, len, MSG_DONTWAIT);
+  if (n > 0) return n;
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+  return -1;
+}
+
+int halTcpWrite(int socket, const uint8_t* data, size_t len) {
+  int n = send(socket, data, len, MSG_DONTWAIT);
+  if (n >= 0) return n;
+  if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+  return -1;
+}
+
+void halTcpClose(int socket) {
+  if (socket >= 0) close(socket);
+}
+
+// ============================================================================
+// MEMORY
+// ============================================================================
+uint32_t halFreeHeap() {
+  return ESP.getFreeHeap();
+}
+
+uint32_t halLargestFreeBlock() {
+  return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+uint32_t halStackHighWaterMark() {
+  // ESP-IDF reports the high-water mark in bytes
+  return uxTaskGetStackHighWaterMark(NULL);
+}
+
+uint32_t halCrc32(uint32_t crc, const uint8_t* data, size_t len) {
+  return esp_rom_crc32_le(crc, data, len);
+}
+
+// ============================================================================
+// CONSOLE
+// ============================================================================
+void halConsolePrintln(const char* line) {
+  if (consoleEnabled) {
+    Serial.println(line);
+  }
+}
+
+void halConsoleSetEnabled(bool enabled) {
+  consoleEnabled = enabled;
+}
+
+#endif
@@ -0,0 +1,520 @@
+#ifndef ARDUINO
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "hal.h"
+#include "hal_native.h"
+
+#define NATIVE_MAX_TIMERS 8
+#define NATIVE_MAX_TASKS 2
+#define NATIVE_MAX_PINS 40
+
+struct HalTimer {
+  const char* name;
+  HalTimerFn callback;
+  void* arg;
+  bool armed;
+  uint64_t deadlineUs;
+};
+
+static bool manualClock = false;
+static uint64_t manualTimeUs = 0;
+static std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+static HalTimer timers[NATIVE_MAX_TIMERS];
+static int timerCount = 0;
+
+struct NativeTask {
+  HalTaskFn fn;
+  void* arg;
+  uint32_t periodUs;
+  HalTimerHandle timer;
+};
+
+static NativeTask tasks[NATIVE_MAX_TASKS];
+static int taskCount = 0;
+static bool tasksSuspended = false;
+static uint32_t watchdogTimeoutMs = 0;  // 0 = not started
+static uint64_t watchdogFedUs = 0;
+
+static HalIsrFn pinIsr[NATIVE_MAX_PINS];
+static bool pinLevel[NATIVE_MAX_PINS];
+static uint32_t pinMilliVolts[NATIVE_MAX_PINS];
+static HalNativePinFn pinWriteFn = NULL;
+static void* pinWriteCtx = NULL;
+static HalNativeIdleFn idleFn = NULL;
+static void* idleCtx = NULL;
+
+static std::map<std::string, std::vector<uint8_t> > storage;
+static std::map<std::string, std::vector<uint8_t> > files;
+
+static bool transportConnected = true;
+static HalNativeTransportFn transportFn = NULL;
+static void* transportCtx = NULL;
+static bool consoleEnabled = true;
+
+// ============================================================================
+// CLOCK
+// ============================================================================
+uint64_t halNativeTimeUs() {
+  if (manualClock) return manualTimeUs;
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void halNativeUseManualClock(bool manual) {
+  manualTimeUs = halNativeTimeUs();
+  manualClock = manual;
+}
+
+void halNativeSetTimeUs(uint64_t us) {
+  manualTimeUs = us;
+}
+
+uint32_t halMillis() {
+  return (uint32_t)(halNativeTimeUs() / 1000);
+}
+
+uint32_t halMicros() {
+  return (uint32_t)halNativeTimeUs();
+}
+
+uint64_t halMicros64() {
+  return halNativeTimeUs();
+}
+
+void halNativeOnIdle(HalNativeIdleFn fn, void* ctx) {
+  idleFn = fn;
+  idleCtx = ctx;
+}
+
+void halDelay(uint32_t ms) {
+  if (manualClock) {
+    uint64_t untilUs = manualTimeUs + (uint64_t)ms * 1000;
+    if (idleFn) {
+      idleFn(untilUs, idleCtx);
+    }
+    manualTimeUs = untilUs;
+  } else {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+}
+
+void halDelayMicroseconds(uint32_t us) {
+  // Busy-waits (gate pulse width) take no simulated time
+  if (!manualClock) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  }
+}
+
+uint32_t halCycleCount() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t halCpuFrequencyMhz() {
+  return 1000;
+}
+
+// ============================================================================
+// GPIO
+// ============================================================================
+void halPinMode(uint8_t pin, HalPinMode mode) {
+  if (pin < NATIVE_MAX_PINS && mode == HAL_PIN_INPUT_PULLUP) {
+    pinLevel[pin] = true;
+  }
+}
+
+void halDigitalWrite(uint8_t pin, bool high) {
+  if (pin >= NATIVE_MAX_PINS) return;
+  pinLevel[pin] = high;
+  if (pinWriteFn) {
+    pinWriteFn(pin, high, pinWriteCtx);
+  }
+}
+
+bool halDigitalRead(uint8_t pin) {
+  return pin < NATIVE_MAX_PINS ? pinLevel[pin] : false;
+}
+
+void halAttachRisingInterrupt(uint8_t pin, HalIsrFn isr) {
+  if (pin < NATIVE_MAX_PINS) pinIsr[pin] = isr;
+}
+
+void halDetachInterrupt(uint8_t pin) {
+  if (pin < NATIVE_MAX_PINS) pinIsr[pin] = NULL;
+}
+
+uint32_t halAnalogReadMilliVolts(uint8_t pin) {
+  return pin < NATIVE_MAX_PINS ? pinMilliVolts[pin] : 0;
+}
+
+void halNativeSetAnalogMilliVolts(uint8_t pin, uint32_t mv) {
+  if (pin < NATIVE_MAX_PINS) pinMilliVolts[pin] = mv;
+}
+
+void halPwmBegin(uint8_t pin, uint32_t freqHz, uint8_t resolutionBits) {
+}
+
+void halPwmWrite(uint32_t duty) {
+}
+
+void halPwmEnd(uint8_t pin) {
+}
+
+void halNativeTriggerInterrupt(uint8_t pin) {
+  if (pin < NATIVE_MAX_PINS && pinIsr[pin]) {
+    pinIsr[pin]();
+  }
+}
+
+void halNativeSetPinInput(uint8_t pin, bool high) {
+  if (pin < NATIVE_MAX_PINS) pinLevel[pin] = high;
+}
+
+void halNativeOnPinWrite(HalNativePinFn fn, void* ctx) {
+  pinWriteFn = fn;
+  pinWriteCtx = ctx;
+}
+
+// ============================================================================
+// TIMERS
+// ============================================================================
+HalTimerHandle halTimerCreate(const char* name, HalTimerFn callback, void* arg) {
+  if (timerCount >= NATIVE_MAX_TIMERS) return NULL;
+  HalTimer* timer = &timers[timerCount++];
+  timer->name = name;
+  timer->callback = callback;
+  timer->arg = arg;
+  timer->armed = false;
+  timer->deadlineUs = 0;
+  return timer;
+}
+
+void halTimerStartOnce(HalTimerHandle timer, uint32_t delayUs) {
+  if (!timer) return;
+  timer->deadlineUs = halNativeTimeUs() + delayUs;
+  timer->armed = true;
+}
+
+void halTimerStop(HalTimerHandle timer) {
+  if (timer) timer->armed = false;
+}
+
+int halNativeRunDueTimers() {
+  int fired = 0;
+  uint64_t now = halNativeTimeUs();
+  for (int i = 0; i < timerCount; i++) {
+    HalTimer* timer = &timers[i];
+    if (timer->armed && timer->deadlineUs <= now) {
+      timer->armed = false;
+      timer->callback(timer->arg);
+      fired++;
+    }
+  }
+  return fired;
+}
+
+uint64_t halNativeNextTimerUs() {
+  uint64_t next = UINT64_MAX;
+  for (int i = 0; i < timerCount; i++) {
+    if (timers[i].armed && timers[i].deadlineUs < next) {
+      next = timers[i].deadlineUs;
+    }
+  }
+  return next;
+}
+
+// ============================================================================
+// TASKS AND WATCHDOG
+// ============================================================================
+static void runNativeTask(void* arg) {
+  NativeTask* task = (NativeTask*)arg;
+  if (!tasksSuspended) {
+    task->fn(task->arg);
+  }
+  halTimerStartOnce(task->timer, task->periodUs);
+}
+
+bool halTaskCreatePeriodic(const char* name, HalTaskFn fn, void* arg, uint32_t periodMs) {
+  if (taskCount >= NATIVE_MAX_TASKS) return false;
+  NativeTask* task = &tasks[taskCount];
+  task->fn = fn;
+  task->arg = arg;
+  task->periodUs = periodMs * 1000;
+  task->timer = halTimerCreate(name, runNativeTask, task);
+  if (!task->timer) return false;
+  taskCount++;
+  halTimerStartOnce(task->timer, task->periodUs);
+  return true;
+}
+
+uintptr_t halCurrentTask() {
+  return (uintptr_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+}
+
+void halWatchdogBegin(uint32_t timeoutMs) {
+  watchdogTimeoutMs = timeoutMs;
+  watchdogFedUs = halNativeTimeUs();
+}
+
+void halWatchdogFeed() {
+  watchdogFedUs = halNativeTimeUs();
+}
+
+bool halResetByWatchdog() {
+  return false;
+}
+
+void halNativeSuspendTasks(bool suspended) {
+  tasksSuspended = suspended;
+}
+
+bool halNativeWatchdogExpired() {
+  return watchdogTimeoutMs > 0 && halNativeTimeUs() - watchdogFedUs > (uint64_t)watchdogTimeoutMs * 1000;
+}
+
+// ============================================================================
+// STORAGE
+// ============================================================================
+bool halStorageBegin(const char* ns) {
+  return true;
+}
+
+uint8_t halStorageGetU8(const char* key, uint8_t defaultValue) {
+  uint8_t value = defaultValue;
+  halStorageGetBytes(key, &value, sizeof(value));
+  return value;
+}
+
+void halStoragePutU8(const char* key, uint8_t value) {
+  halStoragePutBytes(key, &value, sizeof(value));
+}
+
+uint32_t halStorageGetU32(const char* key, uint32_t defaultValue) {
+  uint32_t value = defaultValue;
+  halStorageGetBytes(key, &value, sizeof(value));
+  return value;
+}
+
+void halStoragePutU32(const char* key, uint32_t value) {
+  halStoragePutBytes(key, &value, sizeof(value));
+}
+
+size_t halStorageGetBytes(const char* key, void* data, size_t len) {
+  std::map<std::string, std::vector<uint8_t> >::iterator it = storage.find(key);
+  if (it == storage.end() || it->second.size() > len) return 0;
+  memcpy(data, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+void halStoragePutBytes(const char* key, const void* data, size_t len) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  storage[key] = std::vector<uint8_t>(bytes, bytes + len);
+}
+
+size_t halStorageBytesLength(const char* key) {
+  std::map<std::string, std::vector<uint8_t> >::iterator it = storage.find(key);
+  return it == storage.end() ? 0 : it->second.size();
+}
+
+bool halStorageIsKey(const char* key) {
+  return storage.count(key) > 0;
+}
+
+void halStorageRemove(const char* key) {
+  storage.erase(key);
+}
+
+bool halFileBegin() {
+  return true;
+}
+
+bool halFileWrite(const char* path, const uint8_t* data, size_t len, bool append) {
+  std::vector<uint8_t>& file = files[path];
+  if (!append) file.clear();
+  file.insert(file.end(), data, data + len);
+  return true;
+}
+
+size_t halFileRead(const char* path, uint32_t offset, uint8_t* data, size_t len) {
+  std::map<std::string, std::vector<uint8_t> >::iterator it = files.find(path);
+  if (it == files.end() || offset >= it->second.size()) return 0;
+  size_t n = it->second.size() - offset;
+  if (n > len) n = len;
+  memcpy(data, it->second.data() + offset, n);
+  return n;
+}
+
+int32_t halFileSize(const char* path) {
+  std::map<std::string, std::vector<uint8_t> >::iterator it = files.find(path);
+  return it == files.end() ? -1 : (int32_t)it->second.size();
+}
+
+void halNativeResetStorage() {
+  storage.clear();
+  files.clear();
+}
+
+// ============================================================================
+// TRANSPORT
+// ============================================================================
+void halTransportBegin(const char* deviceName, HalReceiveFn onReceive) {
+}
+
+bool halTransportConnected() {
+  return transportConnected;
+}
+
+void halTransportRestartAdvertising() {
+}
+
+void halTransportNotify(HalChannel channel, const uint8_t* data, size_t len) {
+  if (!transportConnected) return;
+  if (transportFn) {
+    transportFn(channel, data, len, transportCtx);
+    return;
+  }
+  if (channel == HAL_CHANNEL_TELEMETRY) {
+    // Binary frames as one hex line
+    fputs("telemetry ", stdout);
+    for (size_t i = 0; i < len; i++) {
+      fprintf(stdout, "%02x", data[i]);
+    }
+  } else {
+    fwrite(data, 1, len, stdout);
+  }
+  fputc('\n', stdout);
+  fflush(stdout);
+}
+
+// Commands and the loop share one thread on the host
+void halTransportLock() {
+}
+
+void halTransportUnlock() {
+}
+
+void halCommandLock() {
+}
+
+void halCommandUnlock() {
+}
+
+void halNativeSetConnected(bool connected) {
+  transportConnected = connected;
+}
+
+void halNativeOnTransport(HalNativeTransportFn fn, void* ctx) {
+  transportFn = fn;
+  transportCtx = ctx;
+}
+
+// ============================================================================
+// TCP
+// ============================================================================
+static bool tcpSetNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+int halTcpListen(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 2) != 0 || !tcpSetNonBlocking(fd)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int halTcpAccept(int listener) {
+  int fd = accept(listener, NULL, NULL);
+  if (fd < 0) return -1;
+  int noDelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  if (!tcpSetNonBlocking(fd)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int halTcpRead(int socket, uint8_t* buffer, size_t len) {
+  int n = recv(socket, buffer, len, MSG_DONTWAIT);
+  if (n > 0) return n;
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+  return -1;
+}
+
+int halTcpWrite(int socket, const uint8_t* data, size_t len) {
+  int n = send(socket, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (n >= 0) return n;
+  if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+  return -1;
+}
+
+void halTcpClose(int socket) {
+  if (socket >= 0) close(socket);
+}
+
+// ============================================================================
+// MEMORY
+// ============================================================================
+uint32_t halFreeHeap() {
+  return 0;
+}
+
+uint32_t halLargestFreeBlock() {
+  return 0;
+}
+
+uint32_t halStackHighWaterMark() {
+  return 0;
+}
+
+uint32_t halCrc32(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+// ============================================================================
+// CONSOLE
+// ============================================================================
+void halConsolePrintln(const char* line) {
+  if (consoleEnabled) {
+    fprintf(stderr, "%s\n", line);
+  }
+}
+
+void halConsoleSetEnabled(bool enabled) {
+  consoleEnabled = enabled;
+}
+
+#endif
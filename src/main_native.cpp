@@ -0,0 +1,77 @@
+#if !defined(ARDUINO) && !defined(PIO_UNIT_TESTING)
+
+// Host build entry point: JSON commands are read line by line from stdin,
+// notifications go to stdout and the debug console to stderr. --ws PORT
+// stands in for a WiFi connection: the WebSocket server listens on PORT and
+// the program keeps running after stdin closes.
+//
+//   pio run -e native && echo '{"command":"get_status"}' | .pio/build/native/program
+//   .pio/build/native/program --ws 8080 < /dev/null    (ws://localhost:8080/ws)
+//
+// Left out of `pio test` builds: each test provides its own main().
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app.h"
+#include "config.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "network.h"
+#include "ws_server.h"
+
+int main(int argc, char** argv) {
+  bool serveWebSocket = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--ws") == 0 && i + 1 < argc) {
+      wsServerPort = (uint16_t)atoi(argv[++i]);
+      serveWebSocket = true;
+    } else {
+      fprintf(stderr, "usage: %s [--ws PORT]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  appSetup();
+  wifiConnected = serveWebSocket;
+
+  char line[1024];
+  size_t length = 0;
+  bool inputOpen = true;
+
+  while (inputOpen || serveWebSocket) {
+    struct pollfd pfd;
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    while (inputOpen && poll(&pfd, 1, 0) > 0) {
+      char c;
+      if (read(STDIN_FILENO, &c, 1) != 1) {
+        inputOpen = false;
+        break;
+      }
+      if (c == '\n' || c == '\r') {
+        if (length > 0) {
+          line[length] = '\0';
+          appHandleConsoleLine(line);
+          length = 0;
+        }
+      } else if (length < sizeof(line) - 1) {
+        line[length++] = c;
+      }
+    }
+
+    // Stand-in for 50 Hz mains, one detector edge per 10 ms pass: the safety
+    // supervisor trips on a triac that is on without zero-crosses
+    halNativeTriggerInterrupt(ZERO_CROSS_PIN);
+    halNativeRunDueTimers();
+    appLoop();
+    halDelay(10);
+  }
+
+  return 0;
+}
+
+#endif
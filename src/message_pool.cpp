@@ -0,0 +1,108 @@
+#include "message_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal.h"
+
+struct PoolClass {
+  uint8_t* storage;
+  size_t blockBytes;
+  uint8_t count;
+  uint32_t usedMask;
+};
+
+static uint8_t smallBlocks[MESSAGE_POOL_SMALL_COUNT][MESSAGE_POOL_SMALL_BYTES] __attribute__((aligned(8)));
+static uint8_t mediumBlocks[MESSAGE_POOL_MEDIUM_COUNT][MESSAGE_POOL_MEDIUM_BYTES] __attribute__((aligned(8)));
+static uint8_t largeBlocks[MESSAGE_POOL_LARGE_COUNT][MESSAGE_POOL_LARGE_BYTES] __attribute__((aligned(8)));
+
+// Smallest first
+static PoolClass poolClasses[MESSAGE_POOL_CLASSES] = {
+  {&smallBlocks[0][0], MESSAGE_POOL_SMALL_BYTES, MESSAGE_POOL_SMALL_COUNT, 0},
+  {&mediumBlocks[0][0], MESSAGE_POOL_MEDIUM_BYTES, MESSAGE_POOL_MEDIUM_COUNT, 0},
+  {&largeBlocks[0][0], MESSAGE_POOL_LARGE_BYTES, MESSAGE_POOL_LARGE_COUNT, 0},
+};
+
+static const char* const POOL_CLASS_KEYS[MESSAGE_POOL_CLASSES] = {"small", "medium", "large"};
+
+MessagePoolStats messagePoolStats;
+
+// Class and block index of a pool pointer, false for a heap pointer
+static bool findBlock(const void* pointer, int* cls, int* block) {
+  const uint8_t* p = (const uint8_t*)pointer;
+  for (int c = 0; c < MESSAGE_POOL_CLASSES; c++) {
+    const PoolClass& pool = poolClasses[c];
+    if (p >= pool.storage && p < pool.storage + pool.blockBytes * pool.count) {
+      *cls = c;
+      *block = (int)((p - pool.storage) / pool.blockBytes);
+      return true;
+    }
+  }
+  return false;
+}
+
+void* MessagePoolAllocator::allocate(size_t size) {
+  halTransportLock();
+  for (int c = 0; c < MESSAGE_POOL_CLASSES; c++) {
+    PoolClass& pool = poolClasses[c];
+    if (size > pool.blockBytes) continue;
+    for (int b = 0; b < pool.count; b++) {
+      if (pool.usedMask & (1u << b)) continue;
+      pool.usedMask |= 1u << b;
+      uint8_t inUse = ++messagePoolStats.inUse[c];
+      if (inUse > messagePoolStats.highWater[c]) messagePoolStats.highWater[c] = inUse;
+      messagePoolStats.allocations++;
+      halTransportUnlock();
+      return pool.storage + b * pool.blockBytes;
+    }
+  }
+  messagePoolStats.fallbacks++;
+  halTransportUnlock();
+  return malloc(size);
+}
+
+void MessagePoolAllocator::deallocate(void* pointer) {
+  int cls, block;
+  if (!findBlock(pointer, &cls, &block)) {
+    free(pointer);
+    return;
+  }
+  halTransportLock();
+  poolClasses[cls].usedMask &= ~(1u << block);
+  messagePoolStats.inUse[cls]--;
+  halTransportUnlock();
+}
+
+void* MessagePoolAllocator::reallocate(void* pointer, size_t newSize) {
+  int cls, block;
+  if (!findBlock(pointer, &cls, &block)) {
+    return realloc(pointer, newSize);
+  }
+  if (newSize <= poolClasses[cls].blockBytes) {
+    return pointer;
+  }
+  void* moved = allocate(newSize);
+  if (moved == NULL) return NULL;
+  memcpy(moved, pointer, poolClasses[cls].blockBytes);
+  deallocate(pointer);
+  return moved;
+}
+
+size_t messageDocBytesFor(const char* json, size_t length) {
+  size_t values = 1;
+  for (size_t i = 0; i < length; i++) {
+    if (json[i] == ',' || json[i] == '{' || json[i] == '[') values++;
+  }
+  return JSON_OBJECT_SIZE(values) + length;
+}
+
+void addMessagePoolStats(JsonObject pool) {
+  for (int c = 0; c < MESSAGE_POOL_CLASSES; c++) {
+    JsonArray entry = pool.createNestedArray(POOL_CLASS_KEYS[c]);
+    entry.add(messagePoolStats.inUse[c]);
+    entry.add(messagePoolStats.highWater[c]);
+    entry.add(poolClasses[c].count);
+  }
+  pool["allocs"] = messagePoolStats.allocations;
+  pool["fallbacks"] = messagePoolStats.fallbacks;
+}
@@ -0,0 +1,362 @@
+#include "messaging.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hal.h"
+#include "perf_stats.h"
+#include "profile_clock.h"
+#include "telemetry.h"
+#include "ws_server.h"
+
+uint32_t txTelemetryDropped = 0;
+uint32_t txLogDropped = 0;
+
+// Latest telemetry frame (loop task only)
+static uint8_t txTelemetryFrame[TELEMETRY_FRAME_LENGTH];
+static size_t txTelemetryLength = 0;
+
+// Log FIFO, filled from both the loop and the transport task
+struct TxLogSlot {
+  uint16_t length;
+  char json[MAX_MESSAGE_LENGTH + 1];
+};
+static TxLogSlot txLogSlots[TX_LOG_SLOTS];
+static uint8_t txLogHead = 0;
+static uint8_t txLogCount = 0;
+
+static ResponseHook responseHook = NULL;
+static uintptr_t responseHookTask = 0;
+
+static void transportSend(HalChannel channel, const uint8_t* data, size_t len) {
+  uint32_t perfStart = perfBegin();
+  halTransportNotify(channel, data, len);
+  perfEndShared(PERF_TRANSPORT_SEND, perfStart);
+}
+
+void consolePrintf(const char* format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  halConsolePrintln(line);
+}
+
+void logPrintf(const char* level, const char* format, ...) {
+  char message[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  sendLogMessage(message, level);
+}
+
+bool clientConnected() {
+  return halTransportConnected() || wsServerClientCount() > 0;
+}
+
+bool messageClientConnected(int client) {
+  if (client == MESSAGE_CLIENT_BLE) return halTransportConnected();
+  return wsServerClientOpen(client - MESSAGE_CLIENT_WS);
+}
+
+bool sendJsonTo(int client, const char* json, size_t length) {
+  if (!messageClientConnected(client)) return false;
+  if (client == MESSAGE_CLIENT_BLE) {
+    transportSend(HAL_CHANNEL_RESPONSE, (const uint8_t*)json, length);
+    return true;
+  }
+  return wsServerSend(client - MESSAGE_CLIENT_WS, false, (const uint8_t*)json, length);
+}
+
+void setResponseHook(ResponseHook hook) {
+  responseHookTask = halCurrentTask();
+  responseHook = hook;
+}
+
+// serializeJson() target: fills the notification buffer and counts the whole
+// length, so one pass writes the message and tells whether it fit
+struct NotifyBufferWriter {
+  char* buffer;
+  size_t capacity;
+  size_t length;
+
+  size_t write(uint8_t c) {
+    if (length < capacity) buffer[length] = (char)c;
+    length++;
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t n) {
+    if (length < capacity) memcpy(buffer + length, data, n < capacity - length ? n : capacity - length);
+    length += n;
+    return n;
+  }
+};
+
+void sendResponse(JsonDocument& doc) {
+  if (responseHook && doc.containsKey("status") && halCurrentTask() == responseHookTask) {
+    responseHook(doc);
+    return;
+  }
+
+  if (!clientConnected()) {
+    consolePrintf("WARNING: Cannot send response - device not connected or characteristic not initialized");
+    return;
+  }
+
+  char json[MAX_MESSAGE_LENGTH + 1];
+  NotifyBufferWriter writer = {json, MAX_MESSAGE_LENGTH, 0};
+  serializeJson(doc, writer);
+  if (writer.length > MAX_MESSAGE_LENGTH) {
+    // The client still gets an answer, naming what did not fit
+    const char* name = doc["type"] | doc["status"] | "";
+    consolePrintf("WARNING: %s too long (%u bytes), not sent", name, (unsigned)writer.length);
+    StaticJsonDocument<128> error;
+    error["status"] = "error";
+    error["error"] = "response too long";
+    error["response"] = name;
+    writer.length = 0;
+    serializeJson(error, writer);
+  }
+  json[writer.length] = '\0';
+
+  if (halTransportConnected()) {
+    transportSend(HAL_CHANNEL_RESPONSE, (const uint8_t*)json, writer.length);
+  }
+  wsServerBroadcast(false, (const uint8_t*)json, writer.length);
+}
+
+// ============================================================================
+// PAGED RESPONSES
+// ============================================================================
+
+#define PAGE_FIELDS_BYTES 24            // ,"page":NNN,"done":true
+#define PAGE_FIELDS_MEMORY JSON_OBJECT_SIZE(2)
+
+PagedResponse::PagedResponse(const char* listKey, bool keyed, size_t itemBytes)
+    : listKey_(listKey),
+      keyed_(keyed),
+      header_(MESSAGE_POOL_MEDIUM_BYTES),  // Room for a nested object such as safety limits
+      item_(itemBytes),
+      page_(PAGE_DOC_BYTES),
+      pageStarted_(false),
+      pageIndex_(0),
+      pageItems_(0),
+      pageBytes_(0) {
+  header_.to<JsonObject>();
+}
+
+JsonVariant PagedResponse::item() {
+  item_.clear();
+  return item_.to<JsonArray>().add();
+}
+
+void PagedResponse::startPage() {
+  page_.clear();
+  for (JsonPair member : header_.as<JsonObject>()) {
+    page_[member.key()] = member.value();
+  }
+  if (keyed_) {
+    page_.createNestedObject(listKey_);
+  } else {
+    page_.createNestedArray(listKey_);
+  }
+  pageBytes_ = measureJson(page_);
+  pageItems_ = 0;
+  pageStarted_ = true;
+}
+
+void PagedResponse::flushPage(bool last) {
+  if (pageIndex_ > 0 || !last) {
+    page_["page"] = pageIndex_;
+  }
+  if (pageIndex_ > 0 && last) {
+    page_["done"] = true;
+  }
+  sendResponse(page_);
+  pageIndex_++;
+  pageStarted_ = false;
+}
+
+void PagedResponse::add(const char* key) {
+  if (!pageStarted_) {
+    startPage();
+  }
+
+  JsonVariant value = item_[0];
+  size_t itemBytes = measureJson(value) + (pageItems_ > 0 ? 1 : 0);
+  if (keyed_) {
+    itemBytes += strlen(key) + 3;       // "key":
+  }
+  // The page's pool can run out before its text budget (many small numbers):
+  // the copy takes what the item takes in item_, plus the key
+  size_t itemMemory = item_.memoryUsage() + (keyed_ ? strlen(key) + 1 : 0);
+  bool textFull = pageBytes_ + itemBytes + PAGE_FIELDS_BYTES > MAX_MESSAGE_LENGTH;
+  bool poolFull = page_.memoryUsage() + itemMemory + PAGE_FIELDS_MEMORY > page_.capacity();
+  if (pageItems_ > 0 && (textFull || poolFull)) {
+    flushPage(false);
+    startPage();
+    itemBytes -= 1;                     // First on the new page: no comma
+  }
+
+  bool added;
+  if (keyed_) {
+    added = page_[listKey_][(char*)key].set(value);  // Key copied: callers format it in a local buffer
+  } else {
+    added = page_[listKey_].add(value);
+  }
+  if (!added || page_.overflowed()) {
+    // Only an item too large for an empty page gets here
+    consolePrintf("WARNING: %s item does not fit a page", listKey_);
+  }
+  pageBytes_ += itemBytes;
+  pageItems_++;
+}
+
+void PagedResponse::finish() {
+  if (!pageStarted_) {
+    startPage();
+  }
+  flushPage(true);
+}
+
+// Appends text as a JSON string body; stops (false) before overrunning end
+static bool appendJsonEscaped(char*& out, const char* end, const char* text) {
+  for (; *text; text++) {
+    unsigned char c = (unsigned char)*text;
+    char escaped[7];
+    int n;
+    if (c == '"' || c == '\\') {
+      n = snprintf(escaped, sizeof(escaped), "\\%c", c);
+    } else if (c == '\n') {
+      n = snprintf(escaped, sizeof(escaped), "\\n");
+    } else if (c < 0x20) {
+      n = snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+    } else {
+      escaped[0] = (char)c;
+      n = 1;
+    }
+    if (out + n > end) return false;
+    memcpy(out, escaped, n);
+    out += n;
+  }
+  return true;
+}
+
+// serial_log is formatted directly: no document on the per-tick log path
+static size_t formatLogJson(char* json, size_t size, const char* message, const char* level) {
+  char suffix[96];
+  int suffixLength = snprintf(suffix, sizeof(suffix), "\",\"level\":\"%s\",\"timestamp\":%lu}", level,
+                              (unsigned long)profileMillis());
+  static const char prefix[] = "{\"type\":\"serial_log\",\"message\":\"";
+
+  char* out = json;
+  memcpy(out, prefix, sizeof(prefix) - 1);
+  out += sizeof(prefix) - 1;
+  if (!appendJsonEscaped(out, json + size - 1 - suffixLength, message)) {
+    consolePrintf("WARNING: Log message too long, truncating");
+  }
+  memcpy(out, suffix, suffixLength + 1);
+  return (size_t)(out - json) + suffixLength;
+}
+
+// serial_log to the clients in the mask: WebSocket slots directly, BLE
+// through the log queue
+static void notifyLog(const char* message, const char* level, uint8_t clients) {
+  char json[MAX_MESSAGE_LENGTH + 1];
+  size_t length = formatLogJson(json, sizeof(json), message, level);
+  for (int slot = 0; slot < WS_MAX_CLIENTS; slot++) {
+    if (clients & (1 << (MESSAGE_CLIENT_WS + slot))) {
+      wsServerSend(slot, false, (const uint8_t*)json, length);
+    }
+  }
+  if (!(clients & (1 << MESSAGE_CLIENT_BLE)) || !halTransportConnected()) return;
+
+  halTransportLock();
+  if (txLogCount == TX_LOG_SLOTS) {
+    txLogHead = (txLogHead + 1) % TX_LOG_SLOTS;
+    txLogCount--;
+    txLogDropped++;
+  }
+  TxLogSlot& slot = txLogSlots[(txLogHead + txLogCount) % TX_LOG_SLOTS];
+  memcpy(slot.json, json, length);
+  slot.length = (uint16_t)length;
+  txLogCount++;
+  halTransportUnlock();
+  consolePrintf("Log queued (%u bytes): %s", (unsigned)length, message);
+}
+
+// Send log message via BLE (for Serial Monitor in webapp)
+void sendLogMessage(const char* message, const char* level) {
+  // Always print to Serial as well
+  consolePrintf("[LOG] %s", message);
+
+  if (!clientConnected()) {
+    consolePrintf("DEBUG: Device not connected, skipping BLE log");
+    return;
+  }
+  uint8_t clients = logDue(level);
+  if (clients) {
+    notifyLog(message, level, clients);
+  }
+}
+
+void sendTopicLog(SubscriptionTopic topic, const char* message, const char* level) {
+  consolePrintf("[LOG] %s", message);
+  uint8_t clients = clientConnected() ? topicDue(topic) : 0;
+  if (clients) {
+    notifyLog(message, level, clients);
+  }
+}
+
+void sendTelemetryFrame(const uint8_t* frame, size_t len, uint8_t clients) {
+  // WebSocket clients take every frame, BLE the latest one
+  for (int slot = 0; slot < WS_MAX_CLIENTS; slot++) {
+    if (clients & (1 << (MESSAGE_CLIENT_WS + slot))) {
+      wsServerSend(slot, true, frame, len);
+    }
+  }
+  if (!(clients & (1 << MESSAGE_CLIENT_BLE)) || !halTransportConnected() || len > sizeof(txTelemetryFrame)) return;
+  if (txTelemetryLength > 0) {
+    txTelemetryDropped++;
+  }
+  memcpy(txTelemetryFrame, frame, len);
+  txTelemetryLength = len;
+}
+
+void pumpTransmitQueue() {
+  int budget = TX_NOTIFY_BUDGET;
+
+  if (txTelemetryLength > 0) {
+    transportSend(HAL_CHANNEL_TELEMETRY, txTelemetryFrame, txTelemetryLength);
+    txTelemetryLength = 0;
+    budget--;
+  }
+
+  while (budget-- > 0) {
+    char json[MAX_MESSAGE_LENGTH + 1];
+    size_t length = 0;
+    halTransportLock();
+    if (txLogCount > 0) {
+      const TxLogSlot& slot = txLogSlots[txLogHead];
+      length = slot.length;
+      memcpy(json, slot.json, length);
+      txLogHead = (txLogHead + 1) % TX_LOG_SLOTS;
+      txLogCount--;
+    }
+    halTransportUnlock();
+    if (length == 0) break;
+    transportSend(HAL_CHANNEL_LOG, (const uint8_t*)json, length);
+  }
+}
+
+void resetTransmitQueue() {
+  halTransportLock();
+  txLogHead = 0;
+  txLogCount = 0;
+  halTransportUnlock();
+  txTelemetryLength = 0;
+}
@@ -0,0 +1,182 @@
+#include "network.h"
+
+#include <string.h>
+
+#include <ArduinoJson.h>
+
+#include "messaging.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <WiFi.h>
+#include <HTTPUpdate.h>
+#include <WiFiClientSecure.h>
+
+#include "config.h"
+#endif
+
+// WiFi and OTA configuration
+char wifiSSID[64] = "";  // WiFi SSID (set via BLE command)
+char wifiPassword[64] = "";  // WiFi password (set via BLE command)
+bool wifiConfigured = false;
+bool wifiConnected = false;
+
+// WiFi and OTA functions
+void setWiFiCredentials(const char* ssid, const char* password) {
+  if (ssid && strlen(ssid) > 0) {
+    strncpy(wifiSSID, ssid, sizeof(wifiSSID) - 1);
+    wifiSSID[sizeof(wifiSSID) - 1] = '\0';
+
+    if (password) {
+      strncpy(wifiPassword, password, sizeof(wifiPassword) - 1);
+      wifiPassword[sizeof(wifiPassword) - 1] = '\0';
+    } else {
+      wifiPassword[0] = '\0';
+    }
+
+    wifiConfigured = true;
+    consolePrintf("WiFi credentials set: SSID=%s", wifiSSID);
+
+    // Send confirmation
+    MessageDocument response(256);
+    response["status"] = "wifi_credentials_set";
+    response["ssid"] = wifiSSID;
+    sendResponse(response);
+
+    // Try to connect
+    setupWiFi();
+  } else {
+    consolePrintf("ERROR: Invalid WiFi SSID");
+    MessageDocument response(256);
+    response["status"] = "wifi_error";
+    response["error"] = "Invalid SSID";
+    sendResponse(response);
+  }
+}
+
+#ifdef ARDUINO
+
+void setupWiFi() {
+  if (!wifiConfigured || strlen(wifiSSID) == 0) {
+    Serial.println("WiFi not configured");
+    return;
+  }
+
+  Serial.printf("Connecting to WiFi: %s\n", wifiSSID);
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(wifiSSID, strlen(wifiPassword) > 0 ? wifiPassword : NULL);
+
+  int attempts = 0;
+  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
+    delay(500);
+    Serial.print(".");
+    attempts++;
+  }
+
+  if (WiFi.status() == WL_CONNECTED) {
+    wifiConnected = true;
+    Serial.println("");
+    Serial.println("WiFi connected!");
+    IPAddress localIp = WiFi.localIP();
+    char ip[16];
+    snprintf(ip, sizeof(ip), "%u.%u.%u.%u", localIp[0], localIp[1], localIp[2], localIp[3]);
+    Serial.printf("IP address: %s\n", ip);
+
+    MessageDocument response(256);
+    response["status"] = "wifi_connected";
+    response["ip"] = ip;
+    sendResponse(response);
+  } else {
+    wifiConnected = false;
+    Serial.println("");
+    Serial.println("WiFi connection failed!");
+
+    MessageDocument response(256);
+    response["status"] = "wifi_error";
+    response["error"] = "Connection failed";
+    sendResponse(response);
+  }
+}
+
+void performOTAUpdate(const char* firmwareUrl) {
+  Serial.printf("Starting OTA update from: %s\n", firmwareUrl);
+
+  // Ensure WiFi is connected
+  if (!wifiConnected) {
+    if (wifiConfigured) {
+      setupWiFi();
+      if (!wifiConnected) {
+        Serial.println("ERROR: WiFi not connected. Cannot perform OTA update.");
+        MessageDocument response(256);
+        response["status"] = "ota_error";
+        response["error"] = "WiFi not connected";
+        sendResponse(response);
+        return;
+      }
+    } else {
+      Serial.println("ERROR: WiFi not configured. Cannot perform OTA update.");
+      MessageDocument response(256);
+      response["status"] = "ota_error";
+      response["error"] = "WiFi not configured";
+      sendResponse(response);
+      return;
+    }
+  }
+
+  // Send status update
+  MessageDocument response(256);
+  response["status"] = "ota_started";
+  response["url"] = firmwareUrl;
+  sendResponse(response);
+
+  // Perform OTA update
+  httpUpdate.setLedPin(LED_PIN, LOW);
+
+  // Check if URL is HTTPS
+  t_httpUpdate_return ret;
+
+  if (strncmp(firmwareUrl, "https://", 8) == 0) {
+    // For HTTPS, use WiFiClientSecure (disable certificate validation for simplicity)
+    WiFiClientSecure secureClient;
+    secureClient.setInsecure();  // Not recommended for production, but simpler for OTA
+    ret = httpUpdate.update(secureClient, firmwareUrl);
+  } else {
+    // For HTTP, use regular WiFiClient
+    WiFiClient client;
+    ret = httpUpdate.update(client, firmwareUrl);
+  }
+
+  switch (ret) {
+    case HTTP_UPDATE_FAILED:
+      Serial.printf("OTA update failed: error %d\n", httpUpdate.getLastError());
+      // Note: Can't send response here as device may have rebooted
+      break;
+    case HTTP_UPDATE_NO_UPDATES:
+      Serial.println("OTA update: No updates available");
+      break;
+    case HTTP_UPDATE_OK:
+      Serial.println("OTA update successful! Device will reboot.");
+      // Device will reboot automatically
+      break;
+  }
+}
+
+#else
+
+// No WiFi radio on the host build
+void setupWiFi() {
+  wifiConnected = false;
+  MessageDocument response(256);
+  response["status"] = "wifi_error";
+  response["error"] = "WiFi not available in native build";
+  sendResponse(response);
+}
+
+void performOTAUpdate(const char* firmwareUrl) {
+  MessageDocument response(256);
+  response["status"] = "ota_error";
+  response["error"] = "OTA not available in native build";
+  sendResponse(response);
+}
+
+#endif
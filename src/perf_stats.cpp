@@ -0,0 +1,121 @@
+#include "perf_stats.h"
+
+#include <string.h>
+
+#include <ArduinoJson.h>
+
+#include "messaging.h"
+
+PerfCounter perfCounters[PERF_SECTION_COUNT];
+PerfHistogram perfHistograms[PERF_HISTOGRAM_COUNT];
+
+static uint32_t lastLoopUs = 0;
+static uint32_t lastMemorySampleMs = 0;
+static uint32_t freeHeapBytes = 0;
+static uint32_t minFreeHeapBytes = 0;
+static uint32_t largestFreeBlockBytes = 0;
+static uint32_t loopStackFreeBytes = 0;
+static uint32_t commandStackFreeBytes = 0;
+static uint32_t perfResetMs = 0;
+
+static const char* const SECTION_KEYS[PERF_SECTION_COUNT] = {"isr", "timer", "tick", "cmd", "send"};
+static const char* const HISTOGRAM_KEYS[PERF_HISTOGRAM_COUNT] = {"loop_us", "isr_lat_us", "zc_gate_us"};
+
+static void sampleMemory() {
+  freeHeapBytes = halFreeHeap();
+  largestFreeBlockBytes = halLargestFreeBlock();
+  if (minFreeHeapBytes == 0 || freeHeapBytes < minFreeHeapBytes) {
+    minFreeHeapBytes = freeHeapBytes;
+  }
+  // Scans the unused part of the stack: keep it off the per-loop path
+  loopStackFreeBytes = halStackHighWaterMark();
+}
+
+void perfLoopTick() {
+#if PERF_STATS
+  uint32_t now = halMicros();
+  if (lastLoopUs != 0) {
+    perfRecordUs(PERF_HIST_LOOP_PERIOD, now - lastLoopUs);
+  }
+  lastLoopUs = now;
+
+  if (halMillis() - lastMemorySampleMs >= 1000) {
+    sampleMemory();
+    lastMemorySampleMs = halMillis();
+  }
+#endif
+}
+
+void perfSampleCommandStack() {
+  commandStackFreeBytes = halStackHighWaterMark();
+}
+
+void resetPerfStats() {
+  memset(perfCounters, 0, sizeof(perfCounters));
+  memset(perfHistograms, 0, sizeof(perfHistograms));
+  minFreeHeapBytes = 0;
+  lastLoopUs = 0;
+  perfResetMs = halMillis();
+}
+
+// Buckets as {"lo":first non-empty bucket,"n":[counts up to the last non-empty],"max":µs}
+static void addHistogram(JsonObject out, const PerfHistogram& h) {
+  int lo = 0;
+  int hi = PERF_HISTOGRAM_BUCKETS - 1;
+  while (lo < PERF_HISTOGRAM_BUCKETS && h.buckets[lo] == 0) lo++;
+  while (hi >= lo && h.buckets[hi] == 0) hi--;
+
+  out["lo"] = lo < PERF_HISTOGRAM_BUCKETS ? lo : 0;
+  JsonArray counts = out.createNestedArray("n");
+  for (int i = lo; i <= hi; i++) {
+    counts.add(h.buckets[i]);
+  }
+  out["max"] = h.maxUs;
+}
+
+// One perf_stats response, paged (PagedResponse) when it would not fit one
+// notification; the list is keyed, so the pages merge into one "stats" object
+// (test_perf_stats checks every page fits with each counter at its maximum).
+#define PERF_ITEM_DOC_BYTES (JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(PERF_HISTOGRAM_BUCKETS))
+
+void sendPerfStats() {
+  PagedResponse pages("stats", true, PERF_ITEM_DOC_BYTES);
+  JsonObject header = pages.header();
+  header["type"] = "perf_stats";
+  header["enabled"] = PERF_STATS ? true : false;
+  header["mhz"] = halCpuFrequencyMhz();
+  header["window_s"] = (halMillis() - perfResetMs) / 1000;
+
+  // Per section: [count, mean cycles, max cycles]
+  for (int i = 0; i < PERF_SECTION_COUNT; i++) {
+    halTransportLock();
+    PerfCounter c = perfCounters[i];
+    halTransportUnlock();
+    JsonArray entry = pages.item().to<JsonArray>();
+    entry.add(c.count);
+    entry.add(c.count > 0 ? (uint32_t)(c.totalCycles / c.count) : 0);
+    entry.add(c.maxCycles);
+    pages.add(SECTION_KEYS[i]);
+  }
+
+  for (int i = 0; i < PERF_HISTOGRAM_COUNT; i++) {
+    addHistogram(pages.item().to<JsonObject>(), perfHistograms[i]);
+    pages.add(HISTOGRAM_KEYS[i]);
+  }
+
+  JsonObject heap = pages.item().to<JsonObject>();
+  heap["free"] = freeHeapBytes;
+  heap["min_free"] = minFreeHeapBytes;
+  heap["largest"] = largestFreeBlockBytes;
+  pages.add("heap");
+
+  addMessagePoolStats(pages.item().to<JsonObject>());
+  pages.add("pool");
+
+  JsonObject stack = pages.item().to<JsonObject>();
+  stack["loop"] = loopStackFreeBytes;
+  stack["cmd"] = commandStackFreeBytes;
+  pages.add("stack_free");
+
+  pages.finish();
+}
@@ -0,0 +1,493 @@
+#include "pressure_control.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <ArduinoJson.h>
+
+#include "calibration.h"
+#include "config.h"
+#include "hal.h"
+#include "messaging.h"
+#include "profile_engine.h"
+#include "pump_dynamics.h"
+#include "triac.h"
+
+PidSchedule pidSchedule;
+bool pidScheduleValid = false;
+bool pressureControlEnabled = true;
+bool autotuneRunning = false;
+StepMetrics lastStepMetrics = {0.0f, 0.0f, -1.0f, 0.0f, -1.0f};
+static bool stepMetricsValid = false;
+
+// Closed-loop state
+static float integralTerm = 0.0f;
+static float filteredSlope = 0.0f;      // d(pressure)/dt, bar/s
+static float lastMeasured = 0.0f;
+static unsigned long lastUpdateTime = 0;
+static bool haveLastUpdate = false;
+
+enum AutotunePhase {
+  AUTOTUNE_RELAY = 0,  // Relay limit cycle around the current band setpoint
+  AUTOTUNE_STEP_HOLD,  // Closed loop at the lowest setpoint
+  AUTOTUNE_STEP_RECORD // Closed-loop step to the highest setpoint
+};
+
+#define AUTOTUNE_SAMPLE_MS 20
+#define AUTOTUNE_STEP_SAMPLES (PID_STEP_RECORD_MS / AUTOTUNE_SAMPLE_MS)
+
+static AutotunePhase atPhase = AUTOTUNE_RELAY;
+static PidSchedule atSchedule;          // Filled band by band, committed at the end
+static int atBand = 0;
+static int atAmplitude = PID_RELAY_AMPLITUDE;
+static int atBias = 0;
+static bool atRelayHigh = true;
+static unsigned long atPhaseStartTime = 0;
+static unsigned long atLastSwitch = 0;
+static unsigned long atHighDwell = 0;   // Last completed dwell on each side, 0 until seen
+static unsigned long atLowDwell = 0;
+static unsigned long atLastSample = 0;
+static unsigned long atLastRise = 0;
+static bool atHaveRise = false;
+static int atCycles = 0;
+static float atCycleMax = 0.0f;
+static float atCycleMin = 0.0f;
+static float atPeriodSum = 0.0f;
+static float atAmplitudeSum = 0.0f;
+static uint16_t atTrace[AUTOTUNE_STEP_SAMPLES];  // Step response, 0.01 bar
+static int atTraceCount = 0;
+
+void loadPressureControl() {
+  if (halStorageBytesLength("pid_sched") == sizeof(PidSchedule)) {
+    halStorageGetBytes("pid_sched", &pidSchedule, sizeof(PidSchedule));
+    pidScheduleValid = pidSchedule.bandCount > 0 && pidSchedule.bandCount <= PID_MAX_BANDS;
+    if (pidScheduleValid) {
+      consolePrintf("PID gain schedule loaded: %d bands", pidSchedule.bandCount);
+    }
+  }
+  pressureControlEnabled = halStorageGetU8("pid_on", 1) != 0;
+}
+
+void setPressureControlEnabled(bool enabled) {
+  pressureControlEnabled = enabled;
+  halStoragePutU8("pid_on", enabled ? 1 : 0);
+  logPrintf("info", "Pressure feedback %s", enabled ? "enabled" : "disabled");
+  sendPressureControlStatus();
+}
+
+static float round2(float value) {
+  return roundf(value * 100.0f) / 100.0f;
+}
+
+void sendPressureControlStatus() {
+  MessageDocument response(1024);
+  response["type"] = "pressure_control";
+  response["enabled"] = pressureControlEnabled;
+  response["valid"] = pidScheduleValid;
+  if (pidScheduleValid) {
+    JsonArray bands = response.createNestedArray("bands");
+    for (int i = 0; i < pidSchedule.bandCount; i++) {
+      const PidBand& band = pidSchedule.bands[i];
+      JsonObject entry = bands.createNestedObject();
+      entry["sp"] = round2(band.setpointBar);
+      entry["ku"] = round2(band.ultimateGain);
+      entry["tu_ms"] = (int)band.ultimatePeriodMs;
+      entry["kp"] = round2(band.kp);
+      entry["ki"] = round2(band.ki);
+      entry["kd"] = round2(band.kd);
+    }
+  }
+  if (stepMetricsValid) {
+    JsonObject step = response.createNestedObject("step");
+    step["from"] = round2(lastStepMetrics.fromBar);
+    step["to"] = round2(lastStepMetrics.toBar);
+    step["rise_ms"] = (int)lastStepMetrics.riseTimeMs;
+    step["overshoot_pct"] = round2(lastStepMetrics.overshootPct);
+    step["settling_ms"] = (int)lastStepMetrics.settlingTimeMs;  // -1: never settled
+  }
+  sendResponse(response);
+}
+
+// Gains at a target pressure: linear between band setpoints, held outside
+static void gainsAt(const PidSchedule& schedule, float pressure, float* kp, float* ki, float* kd) {
+  const PidBand* bands = schedule.bands;
+  int last = schedule.bandCount - 1;
+  if (pressure <= bands[0].setpointBar || last == 0) {
+    *kp = bands[0].kp;
+    *ki = bands[0].ki;
+    *kd = bands[0].kd;
+    return;
+  }
+  if (pressure >= bands[last].setpointBar) {
+    *kp = bands[last].kp;
+    *ki = bands[last].ki;
+    *kd = bands[last].kd;
+    return;
+  }
+  int k = 0;
+  while (pressure > bands[k + 1].setpointBar) k++;
+  float t = (pressure - bands[k].setpointBar) / (bands[k + 1].setpointBar - bands[k].setpointBar);
+  *kp = bands[k].kp + (bands[k + 1].kp - bands[k].kp) * t;
+  *ki = bands[k].ki + (bands[k + 1].ki - bands[k].ki) * t;
+  *kd = bands[k].kd + (bands[k + 1].kd - bands[k].kd) * t;
+}
+
+void resetPressureControl() {
+  integralTerm = 0.0f;
+  filteredSlope = 0.0f;
+  haveLastUpdate = false;
+}
+
+// PID with derivative on the measurement and conditional integration
+// (frozen while saturated in the direction of the error, or far from target)
+static int pidUpdate(const PidSchedule& schedule, float targetBar, float measuredBar, float feedforwardLevel) {
+  unsigned long now = halMillis();
+  float dt = haveLastUpdate ? (now - lastUpdateTime) / 1000.0f : 0.0f;
+  if (dt > 0.5f) dt = 0.5f;  // A stalled loop must not dump a huge integral step
+
+  if (dt > 0.0f) {
+    float slope = (measuredBar - lastMeasured) / dt;
+    filteredSlope += (slope - filteredSlope) * dt / (PID_DERIVATIVE_TAU_S + dt);
+  }
+  lastMeasured = measuredBar;
+  lastUpdateTime = now;
+  haveLastUpdate = true;
+
+  float kp, ki, kd;
+  gainsAt(schedule, targetBar, &kp, &ki, &kd);
+
+  float error = targetBar - measuredBar;
+  float unsaturated = feedforwardLevel + kp * error + integralTerm - kd * filteredSlope;
+  bool pushingHigh = unsaturated >= 100.0f && error > 0.0f;
+  bool pushingLow = unsaturated <= 0.0f && error < 0.0f;
+  if (!pushingHigh && !pushingLow && fabsf(error) < PID_INTEGRAL_ZONE_BAR) {
+    integralTerm = clampFloat(integralTerm + ki * error * dt, -PID_INTEGRAL_LIMIT, PID_INTEGRAL_LIMIT);
+  }
+
+  float output = feedforwardLevel + kp * error + integralTerm - kd * filteredSlope;
+  return clampInt((int)lroundf(output), 0, 100);
+}
+
+int pressureControlUpdate(float targetBar, float measuredBar, float feedforwardLevel) {
+  if (!USE_PRESSURE_SENSOR || !pressureControlEnabled || !pidScheduleValid || targetBar < PID_MIN_TARGET_BAR) {
+    resetPressureControl();
+    return clampInt((int)lroundf(feedforwardLevel), 0, 100);
+  }
+  return pidUpdate(pidSchedule, targetBar, measuredBar, feedforwardLevel);
+}
+
+// ---------------------------------------------------------------------------
+// Relay autotune
+// ---------------------------------------------------------------------------
+
+static void beginRelayBand(int band) {
+  atPhase = AUTOTUNE_RELAY;
+  atBand = band;
+  atPhaseStartTime = halMillis();
+  atLastSample = 0;
+  atHaveRise = false;
+  atCycles = 0;
+  atPeriodSum = 0.0f;
+  atAmplitudeSum = 0.0f;
+  atCycleMax = 0.0f;
+  atCycleMin = 1000.0f;
+  atBias = pressureToDimLevel(atSchedule.bands[band].setpointBar);
+  atRelayHigh = true;
+  atLastSwitch = atPhaseStartTime;
+  atHighDwell = 0;
+  atLowDwell = 0;
+  setDimLevel(clampInt(atBias + atAmplitude, 0, 100));
+}
+
+static int relayLevel(bool high) {
+  return clampInt(high ? atBias + atAmplitude : atBias - atAmplitude, 0, 100);
+}
+
+// Biased relay: the calibration curve only estimates the level that holds
+// the setpoint, and a relay centred on the wrong level either never leaves
+// one side or cycles lopsided. The bias moves to the cycle's mean output
+// (which is where the plant balances) and the cycle count starts over.
+// Returns false when the bias is already pinned at 0 or 100% and cannot
+// move any further; the caller aborts the run.
+static bool rebiasRelay(int bias, unsigned long now) {
+  bias = clampInt(bias, 0, 100);
+  if (bias == atBias) return false;
+  consolePrintf("Autotune band %d: relay bias %d%% -> %d%% (dwell high %lu ms, low %lu ms)", atBand, atBias, bias,
+                atHighDwell, atLowDwell);
+  atBias = bias;
+  atHaveRise = false;
+  atCycles = 0;
+  atPeriodSum = 0.0f;
+  atAmplitudeSum = 0.0f;
+  atLastSwitch = now;
+  atHighDwell = 0;
+  atLowDwell = 0;
+  setDimLevel(relayLevel(atRelayHigh));
+  return true;
+}
+
+void startAutotune(const float* setpoints, int count, int amplitude) {
+  const char* error = NULL;
+  if (!USE_PRESSURE_SENSOR) {
+    error = "No pressure sensor";
+  } else if (isRunning || calibrationRunning || pumpIdentificationRunning) {
+    error = "Profile, calibration or identification running";
+  } else if (count < 1 || count > PID_MAX_BANDS) {
+    error = "Invalid band count";
+  } else if (amplitude < 2 || amplitude > 50) {
+    error = "Invalid relay amplitude";
+  }
+  for (int i = 0; !error && i < count; i++) {
+    if (setpoints[i] < PID_MIN_TARGET_BAR || setpoints[i] > PID_AUTOTUNE_MAX_SETPOINT_BAR) {
+      error = "Setpoint outside the safe range";
+    } else if (i > 0 && setpoints[i] <= setpoints[i - 1]) {
+      error = "Setpoints must ascend";
+    }
+  }
+  if (error) {
+    logPrintf("warn", "Autotune refused: %s", error);
+    MessageDocument response(256);
+    response["status"] = "autotune_error";
+    response["error"] = error;
+    sendResponse(response);
+    return;
+  }
+
+  memset(&atSchedule, 0, sizeof(atSchedule));
+  atSchedule.bandCount = count;
+  for (int i = 0; i < count; i++) {
+    atSchedule.bands[i].setpointBar = setpoints[i];
+  }
+  atAmplitude = amplitude;
+  stepMetricsValid = false;
+  autotuneRunning = true;
+  beginRelayBand(0);
+
+  logPrintf("info", "Autotune started: %d bands, relay +/-%d%%", count, amplitude);
+  MessageDocument response(256);
+  response["status"] = "autotune_started";
+  response["bands"] = count;
+  response["amplitude"] = amplitude;
+  sendResponse(response);
+}
+
+void stopAutotune(const char* reason) {
+  if (!autotuneRunning) return;
+
+  autotuneRunning = false;
+  currentTargetPressure = 0.0f;
+  if (!isRunning) {
+    setDimLevel(0);
+  }
+  logPrintf("warn", "Autotune aborted: %s", reason);
+  MessageDocument response(256);
+  response["status"] = "autotune_aborted";
+  response["reason"] = reason;
+  response["band"] = atBand;
+  sendResponse(response);
+}
+
+// Tyreus-Luyben PID: less aggressive than Ziegler-Nichols, which rings on
+// the pump's long dead time
+static void finishRelayBand() {
+  PidBand& band = atSchedule.bands[atBand];
+  float a = atAmplitudeSum / PID_RELAY_CYCLES;
+  float eps = PID_RELAY_HYSTERESIS_BAR;
+  float effective = a > eps * 1.05f ? sqrtf(a * a - eps * eps) : a;
+  float d = 0.5f * (relayLevel(true) - relayLevel(false));  // Less than the amplitude when clamped
+  band.ultimatePeriodMs = atPeriodSum / PID_RELAY_CYCLES;
+  band.ultimateGain = 4.0f * d / ((float)M_PI * effective);
+
+  float tuS = band.ultimatePeriodMs / 1000.0f;
+  band.kp = band.ultimateGain / 2.2f;
+  band.ki = band.kp / (2.2f * tuS);
+  band.kd = band.kp * tuS / 6.3f;
+
+  logPrintf("info", "Autotune band %d (%.1f bar): a=%.2f bar, Ku=%.2f %%/bar, Tu=%.0f ms -> Kp=%.2f Ki=%.2f Kd=%.2f",
+            atBand, band.setpointBar, a, band.ultimateGain, band.ultimatePeriodMs, band.kp, band.ki, band.kd);
+  MessageDocument progress(256);
+  progress["type"] = "autotune_progress";
+  progress["band"] = atBand;
+  progress["sp"] = round2(band.setpointBar);
+  progress["ku"] = round2(band.ultimateGain);
+  progress["tu_ms"] = (int)band.ultimatePeriodMs;
+  sendResponse(progress);
+
+  if (atBand + 1 < atSchedule.bandCount) {
+    beginRelayBand(atBand + 1);
+    return;
+  }
+
+  // All bands tuned: verify with a closed-loop step across the schedule
+  // (skipped with a single band)
+  if (atSchedule.bandCount < 2) {
+    pidSchedule = atSchedule;
+    pidScheduleValid = true;
+    halStoragePutBytes("pid_sched", &pidSchedule, sizeof(PidSchedule));
+    autotuneRunning = false;
+    setDimLevel(0);
+    sendPressureControlStatus();
+    return;
+  }
+  atPhase = AUTOTUNE_STEP_HOLD;
+  atPhaseStartTime = halMillis();
+  atLastSample = atPhaseStartTime - AUTOTUNE_SAMPLE_MS;
+  atTraceCount = 0;
+  resetPressureControl();
+}
+
+// Rise, overshoot and settling time of the recorded step
+static void computeStepMetrics(float fromBar, float toBar) {
+  float delta = toBar - fromBar;
+  float rise10 = -1.0f;
+  float rise90 = -1.0f;
+  float peak = fromBar;
+  int lastOutside = -1;
+  for (int i = 0; i < atTraceCount; i++) {
+    float p = atTrace[i] / 100.0f;
+    float t = (float)(i * AUTOTUNE_SAMPLE_MS);
+    if (rise10 < 0.0f && p >= fromBar + 0.1f * delta) rise10 = t;
+    if (rise90 < 0.0f && p >= fromBar + 0.9f * delta) rise90 = t;
+    if (p > peak) peak = p;
+    if (fabsf(p - toBar) > PID_SETTLE_BAND_BAR) lastOutside = i;
+  }
+
+  lastStepMetrics.fromBar = fromBar;
+  lastStepMetrics.toBar = toBar;
+  lastStepMetrics.riseTimeMs = rise10 >= 0.0f && rise90 >= 0.0f ? rise90 - rise10 : -1.0f;
+  lastStepMetrics.overshootPct = peak > toBar ? 100.0f * (peak - toBar) / delta : 0.0f;
+  if (lastOutside == atTraceCount - 1) {
+    lastStepMetrics.settlingTimeMs = -1.0f;
+  } else {
+    lastStepMetrics.settlingTimeMs = (float)((lastOutside + 1) * AUTOTUNE_SAMPLE_MS);
+  }
+  stepMetricsValid = true;
+}
+
+static void finishAutotune() {
+  const PidBand& low = atSchedule.bands[0];
+  const PidBand& high = atSchedule.bands[atSchedule.bandCount - 1];
+  computeStepMetrics(low.setpointBar, high.setpointBar);
+
+  pidSchedule = atSchedule;
+  pidScheduleValid = true;
+  halStoragePutBytes("pid_sched", &pidSchedule, sizeof(PidSchedule));
+  autotuneRunning = false;
+  currentTargetPressure = 0.0f;
+  setDimLevel(0);
+
+  logPrintf("info", "Autotune finished: step %.1f -> %.1f bar, rise %.0f ms, overshoot %.1f%%, settling %.0f ms",
+            lastStepMetrics.fromBar, lastStepMetrics.toBar, lastStepMetrics.riseTimeMs, lastStepMetrics.overshootPct,
+            lastStepMetrics.settlingTimeMs);
+  sendPressureControlStatus();
+}
+
+static void relayTick(unsigned long now, float pressure) {
+  const float setpoint = atSchedule.bands[atBand].setpointBar;
+  if (pressure > setpoint + PID_RELAY_MAX_OVER_BAR) {
+    stopAutotune("Pressure limit exceeded");
+    return;
+  }
+  if (now - atPhaseStartTime > PID_RELAY_TIMEOUT_MS) {
+    stopAutotune("No limit cycle");
+    return;
+  }
+
+  // Stuck on one side: the bias is far off, move it half a swing towards
+  // the switch that never comes
+  if (now - atLastSwitch > PID_RELAY_DWELL_MAX_MS) {
+    if (!rebiasRelay(atRelayHigh ? atBias + atAmplitude / 2 : atBias - atAmplitude / 2, now)) {
+      stopAutotune("Relay bias saturated");
+    }
+    return;
+  }
+
+  if (pressure > atCycleMax) atCycleMax = pressure;
+  if (pressure < atCycleMin) atCycleMin = pressure;
+
+  if (atRelayHigh && pressure > setpoint + PID_RELAY_HYSTERESIS_BAR) {
+    atRelayHigh = false;
+    atHighDwell = atHaveRise ? now - atLastSwitch : 0;  // The first climb is the fill, not a dwell
+    atLastSwitch = now;
+    setDimLevel(relayLevel(false));
+  } else if (!atRelayHigh && pressure < setpoint - PID_RELAY_HYSTERESIS_BAR) {
+    // A rising switch closes one limit cycle
+    atRelayHigh = true;
+    atLowDwell = now - atLastSwitch;
+    atLastSwitch = now;
+    setDimLevel(relayLevel(true));
+
+    if (atHighDwell > 0) {
+      float dwellSum = (float)(atHighDwell + atLowDwell);
+      float asymmetry = ((float)atHighDwell - (float)atLowDwell) / dwellSum;
+      if (fabsf(asymmetry) > PID_RELAY_MAX_ASYMMETRY) {
+        // Mean output of the cycle just closed
+        float mean = (relayLevel(true) * (float)atHighDwell + relayLevel(false) * (float)atLowDwell) / dwellSum;
+        if (!rebiasRelay((int)lroundf(mean), now)) {
+          stopAutotune("Relay bias saturated");
+          return;
+        }
+        atHaveRise = true;
+        atLastRise = now;
+        atCycleMax = pressure;
+        atCycleMin = pressure;
+        return;
+      }
+    }
+
+    if (atHaveRise) {
+      atCycles++;
+      if (atCycles > PID_RELAY_WARMUP_CYCLES) {
+        atPeriodSum += (float)(now - atLastRise);
+        atAmplitudeSum += 0.5f * (atCycleMax - atCycleMin);
+      }
+    }
+    atHaveRise = true;
+    atLastRise = now;
+    atCycleMax = pressure;
+    atCycleMin = pressure;
+    if (atCycles >= PID_RELAY_WARMUP_CYCLES + PID_RELAY_CYCLES) {
+      finishRelayBand();
+    }
+  }
+}
+
+void autotuneTick() {
+  if (!autotuneRunning) return;
+
+  unsigned long now = halMillis();
+  float pressure = getCurrentPressure();
+
+  if (atPhase == AUTOTUNE_RELAY) {
+    relayTick(now, pressure);
+    return;
+  }
+
+  // Step test under closed loop with the new schedule
+  const float low = atSchedule.bands[0].setpointBar;
+  const float high = atSchedule.bands[atSchedule.bandCount - 1].setpointBar;
+  float target = atPhase == AUTOTUNE_STEP_HOLD ? low : high;
+  if (pressure > high + PID_RELAY_MAX_OVER_BAR) {
+    stopAutotune("Pressure limit exceeded");
+    return;
+  }
+  currentTargetPressure = target;
+  setDimLevel(pidUpdate(atSchedule, target, pressure, (float)pressureToDimLevel(target)));
+
+  if (atPhase == AUTOTUNE_STEP_HOLD) {
+    if (now - atPhaseStartTime >= PID_STEP_HOLD_MS) {
+      atPhase = AUTOTUNE_STEP_RECORD;
+      atPhaseStartTime = now;
+      atLastSample = now - AUTOTUNE_SAMPLE_MS;
+    }
+    return;
+  }
+
+  if (now - atLastSample >= AUTOTUNE_SAMPLE_MS) {
+    atLastSample += AUTOTUNE_SAMPLE_MS;
+    atTrace[atTraceCount++] = (uint16_t)(clampFloat(pressure, 0.0f, 600.0f) * 100.0f);
+    if (atTraceCount >= AUTOTUNE_STEP_SAMPLES) {
+      finishAutotune();
+    }
+  }
+}
@@ -0,0 +1,29 @@
+#include "profile_clock.h"
+
+#include "hal.h"
+
+static uint64_t clockBaseReal = 0;      // halMicros64() at the last speed change
+static uint64_t clockBaseVirtual = 0;   // profileMicros() at the same moment
+static uint8_t clockSpeed = 1;
+
+uint64_t profileMicros() {
+  uint64_t now = halMicros64();
+  if (clockSpeed == 1) return now;
+  return clockBaseVirtual + (now - clockBaseReal) * clockSpeed;
+}
+
+uint32_t profileMillis() {
+  return (uint32_t)(profileMicros() / 1000);
+}
+
+uint8_t profileClockSpeed() {
+  return clockSpeed;
+}
+
+void setProfileClockSpeed(uint8_t speed) {
+  if (speed < 1) speed = 1;
+  if (speed > PROFILE_CLOCK_MAX_SPEED) speed = PROFILE_CLOCK_MAX_SPEED;
+  clockBaseVirtual = profileMicros();
+  clockBaseReal = halMicros64();
+  clockSpeed = speed;
+}
@@ -0,0 +1,745 @@
+#include "profile_engine.h"
+
+#include <math.h>
+
+#include "calibration.h"
+#include "config.h"
+#include "flow_estimator.h"
+#include "hal.h"
+#include "messaging.h"
+#include "pressure_control.h"
+#include "profile_clock.h"
+#include "profiles.h"
+#include "pump_dynamics.h"
+#include "shot_recorder.h"
+#include "subscriptions.h"
+#include "supervisor.h"
+#include "telemetry.h"
+#include "triac.h"
+
+// Profile execution variables
+bool isRunning = false;
+int64_t startTimeUs = 0;
+int currentSegment = 0;
+static RuntimeSegment profileSegments[PROFILE_MAX_SEGMENTS];
+int totalSegments = 0;
+static uint32_t timelineEndMs = 0;  // Latest segment end
+
+// The timeline resolved into non-overlapping pieces: from startMs until the
+// next piece, segment is the one that sets the target (in a gap, the one
+// whose end value holds). Two boundaries per segment at most.
+struct TimelinePiece {
+  uint32_t startMs;
+  int segment;
+};
+static TimelinePiece timelinePieces[2 * PROFILE_MAX_SEGMENTS];
+static int timelinePieceCount = 0;
+static int loggedSegment = -1;   // Segment whose entry was last logged
+float currentTargetPressure = 0.0f;
+float currentTargetFlow = 0.0f;
+bool dryRunActive = false;
+
+// Button state tracking
+bool lastButton1State = true;
+bool lastButton2State = true;
+unsigned long lastButton1Time = 0;
+unsigned long lastButton2Time = 0;
+const unsigned long DEBOUNCE_DELAY = 50; // 50ms debounce
+
+// Emergency stop initialization flags (reset when profile stops)
+bool button1StateInitialized = false;
+bool button2StateInitialized = false;
+
+// Power-up safety: Prevents auto-start if switch is ON at boot
+bool powerUpSafetyActive = false;  // True = switch was ON at boot, waiting for OFF
+
+// Buttons are active-low (INPUT_PULLUP): true = released
+#define BUTTON_PRESSED false
+
+// Seconds (fractions allowed) to ms; negative times count as 0
+static uint32_t secondsToMs(float seconds) {
+  return seconds > 0.0f ? (uint32_t)lroundf(seconds * 1000.0f) : 0;
+}
+
+static int32_t toScaledValue(float value) {
+  return (int32_t)lroundf(value * PROFILE_VALUE_SCALE);
+}
+
+// Reads one segment, full or shortened field names. Flow segments
+// (startFlow/endFlow) carry their targets in ml/s.
+static void readSegment(JsonObject segment, RuntimeSegment* out) {
+  out->startMs = secondsToMs(segment.containsKey("startTime") ? segment["startTime"].as<float>() : segment["st"] | 0.0f);
+  out->endMs = secondsToMs(segment.containsKey("endTime") ? segment["endTime"].as<float>() : segment["et"] | 0.0f);
+  out->flow = segment.containsKey("startFlow") || segment.containsKey("sf");
+  float startValue, endValue;
+  if (out->flow) {
+    startValue = segment.containsKey("startFlow") ? segment["startFlow"].as<float>() : segment["sf"].as<float>();
+    endValue = segment.containsKey("endFlow") ? segment["endFlow"].as<float>()
+                                              : (segment.containsKey("ef") ? segment["ef"].as<float>() : startValue);
+  } else {
+    startValue = segment.containsKey("startPressure") ? segment["startPressure"].as<float>()
+                                                      : (segment.containsKey("sp") ? segment["sp"].as<float>() : 0.0f);
+    endValue = segment.containsKey("endPressure") ? segment["endPressure"].as<float>()
+                                                  : (segment.containsKey("ep") ? segment["ep"].as<float>() : 0.0f);
+  }
+  out->startValue = toScaledValue(startValue);
+  out->endValue = toScaledValue(endValue);
+}
+
+// Segment in charge from a boundary on: of those running there, the one that
+// started last (profile order breaks ties), else the previous piece's
+static int pieceSegmentAt(uint32_t ms, int previous) {
+  for (int i = totalSegments - 1; i >= 0; i--) {
+    const RuntimeSegment& segment = profileSegments[i];
+    if (segment.startMs <= ms && ms < segment.endMs) return i;
+  }
+  return previous;
+}
+
+// Cuts the sorted segments at every start and end into pieces with one
+// segment each
+static void compilePieces() {
+  timelinePieceCount = 0;
+  uint32_t boundary = totalSegments > 0 ? profileSegments[0].startMs : 0;
+  int segment = -1;
+  while (timelinePieceCount < totalSegments * 2) {
+    segment = pieceSegmentAt(boundary, segment);
+    if (timelinePieceCount == 0 || timelinePieces[timelinePieceCount - 1].segment != segment) {
+      timelinePieces[timelinePieceCount].startMs = boundary;
+      timelinePieces[timelinePieceCount].segment = segment;
+      timelinePieceCount++;
+    }
+
+    // Next start or end after this boundary
+    bool found = false;
+    uint32_t next = 0;
+    for (int i = 0; i < totalSegments; i++) {
+      const RuntimeSegment& candidate = profileSegments[i];
+      if (candidate.startMs > boundary && (!found || candidate.startMs < next)) {
+        next = candidate.startMs;
+        found = true;
+      }
+      if (candidate.endMs > boundary && (!found || candidate.endMs < next)) {
+        next = candidate.endMs;
+        found = true;
+      }
+    }
+    if (!found) break;
+    boundary = next;
+  }
+}
+
+// Compiles the decoded segments into the timeline: zero-length segments are
+// dropped and the rest ordered by start time, then cut into pieces so the
+// segment in charge at any time is a binary search over the piece starts.
+// Where segments overlap, the one that started last wins while it runs and
+// an earlier one still running takes over again after it; between segments
+// the previous end value holds.
+static void compileTimeline() {
+  int kept = 0;
+  timelineEndMs = 0;
+  for (int i = 0; i < totalSegments; i++) {
+    RuntimeSegment segment = profileSegments[i];
+    if (segment.endMs <= segment.startMs) {
+      logPrintf("warn", "Profile segment %d (%ums-%ums) has no duration, skipped", i + 1, (unsigned)segment.startMs,
+                (unsigned)segment.endMs);
+      continue;
+    }
+    int j = kept;
+    while (j > 0 && profileSegments[j - 1].startMs > segment.startMs) {
+      profileSegments[j] = profileSegments[j - 1];
+      j--;
+    }
+    profileSegments[j] = segment;
+    kept++;
+    if (segment.endMs > timelineEndMs) timelineEndMs = segment.endMs;
+  }
+  totalSegments = kept;
+  compilePieces();
+}
+
+// Segment in charge at the time (see compileTimeline()), -1 before the first
+static int findSegment(uint32_t ms) {
+  int low = 0;
+  int high = timelinePieceCount;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (timelinePieces[mid].startMs <= ms) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low > 0 ? timelinePieces[low - 1].segment : -1;
+}
+
+// Segment value at a time within or after it, integer-only: the product
+// fits 64 bits and the division rounds to nearest
+static int32_t segmentValueAt(const RuntimeSegment& segment, uint32_t ms) {
+  if (ms >= segment.endMs) return segment.endValue;
+  if (ms <= segment.startMs) return segment.startValue;
+  int64_t span = segment.endMs - segment.startMs;
+  int64_t scaled = (int64_t)(segment.endValue - segment.startValue) * (int64_t)(ms - segment.startMs);
+  int64_t step = scaled >= 0 ? (scaled + span / 2) / span : (scaled - span / 2) / span;
+  return segment.startValue + (int32_t)step;
+}
+
+// Puts the profile clock origin atMs before now (clamped to the timeline)
+static void setTimelinePosition(uint32_t atMs) {
+  if (atMs > timelineEndMs) atMs = timelineEndMs;
+  startTimeUs = (int64_t)profileMicros() - (int64_t)atMs * 1000;
+  int segmentIndex = findSegment(atMs);
+  currentSegment = segmentIndex < 0 ? 0 : segmentIndex;
+}
+
+// Compiles the loaded segments and sets the clock so the profile is atSeconds in
+static void beginTimeline(float atSeconds) {
+  compileTimeline();
+  loggedSegment = -1;
+  setTimelinePosition(secondsToMs(atSeconds));
+}
+
+uint32_t profileElapsedMs() {
+  int64_t elapsedUs = (int64_t)profileMicros() - startTimeUs;
+  return elapsedUs > 0 ? (uint32_t)(elapsedUs / 1000) : 0;
+}
+
+// Shot recording, controller state and relays for a starting run; a dry run
+// records nothing and leaves the relays off
+static void beginRun() {
+  if (!dryRunActive) {
+    beginShotRecording();
+    supervisorBrewStarted(timelineEndMs - profileElapsedMs());
+  }
+  resetPressureControl();
+  resetFlowEstimator();
+#if USE_RELAYS
+  if (!dryRunActive) {
+    halDigitalWrite(RELAY_1_PIN, true);
+    halDigitalWrite(RELAY_2_PIN, true);
+  }
+#endif
+  isRunning = true;
+}
+
+void beginDryRun(uint8_t speed) {
+  if (isRunning) {
+    stopProfile();
+  }
+  dryRunActive = true;
+  setDimLevel(0);
+  setProfileClockSpeed(speed);
+  logPrintf("info", "Dry run at %ux: triac inhibited", (unsigned)profileClockSpeed());
+}
+
+void endDryRun() {
+  if (!dryRunActive) return;
+  dryRunActive = false;
+  setProfileClockSpeed(1);
+}
+
+void startProfile(JsonObject profile, float atSeconds) {
+  if (isRunning) {
+    stopProfile();
+  }
+
+  // Decode the segments once (full or shortened field names)
+  JsonArray sourceSegments = profile["segments"];
+  totalSegments = sourceSegments.size();
+  if (totalSegments > PROFILE_MAX_SEGMENTS) {
+    logPrintf("warn", "Profile has %d segments, running the first %d", totalSegments, PROFILE_MAX_SEGMENTS);
+    totalSegments = PROFILE_MAX_SEGMENTS;
+  }
+  for (int i = 0; i < totalSegments; i++) {
+    readSegment(sourceSegments[i], &profileSegments[i]);
+  }
+
+  beginTimeline(atSeconds);
+  beginRun();
+#if USE_HARDWARE_BUTTONS
+  lastButton1State = halDigitalRead(BUTTON_1_PIN);
+  lastButton2State = halDigitalRead(BUTTON_2_PIN);
+  lastButton1Time = halMillis();
+  lastButton2Time = halMillis();
+  if (lastButton1State == BUTTON_PRESSED) {
+    button1StateInitialized = true;  // Button is pressed - ready for emergency stop check
+    consolePrintf("DEBUG: Button1 initialized as LOW (pressed) for BLE-started profile");
+  } else {
+    button1StateInitialized = false;  // Button not pressed - don't check for emergency stop
+    consolePrintf("DEBUG: Button1 initialized as HIGH (not pressed) - emergency stop disabled");
+  }
+
+  if (lastButton2State == BUTTON_PRESSED) {
+    button2StateInitialized = true;
+    consolePrintf("DEBUG: Button2 initialized as LOW (pressed) for BLE-started profile");
+  } else {
+    button2StateInitialized = false;
+    consolePrintf("DEBUG: Button2 initialized as HIGH (not pressed) - emergency stop disabled");
+  }
+#endif
+  const char* profileName = profile["name"] | "Unnamed";
+  logPrintf("info", "Brew profile started: \"%s\" (%d segments)", profileName, totalSegments);
+
+  // Debug: Log segment data
+  consolePrintf("DEBUG startProfile: totalSegments=%d, startTime=%ldms", totalSegments, (long)(startTimeUs / 1000));
+  for (int i = 0; i < totalSegments && i < 5; i++) {
+    const RuntimeSegment& seg = profileSegments[i];
+    consolePrintf("  Segment %d: %.1fs-%.1fs, %.1f→%.1f %s", i, seg.startMs / 1000.0f, seg.endMs / 1000.0f,
+                  (float)seg.startValue / PROFILE_VALUE_SCALE, (float)seg.endValue / PROFILE_VALUE_SCALE, seg.flow ? "ml/s" : "bar");
+  }
+
+  // Send confirmation
+  MessageDocument response(256);
+  response["status"] = "profile_started";
+  response["profile_id"] = 255; // Unknown for ad-hoc BLE profile
+  response["profile_name"] = profileName;
+  response["segments"] = totalSegments;
+  response["start_time"] = (long)(startTimeUs / 1000); // millis since boot
+  if (atSeconds > 0.0f) response["at"] = profileElapsedMs() / 1000.0f;
+  if (dryRunActive) response["dry_run"] = profileClockSpeed();
+  sendResponse(response);
+}
+
+void stopProfile() {
+#if USE_RELAYS
+  halDigitalWrite(RELAY_1_PIN, false);
+  halDigitalWrite(RELAY_2_PIN, false);
+#endif
+  if (!isRunning) {
+    // Already stopped, nothing to do
+    return;
+  }
+
+  isRunning = false;
+  supervisorBrewStopped();
+  currentTargetPressure = 0.0f;
+  currentTargetFlow = 0.0f;
+  setDimLevel(0);
+  consolePrintf("[DIMMER] Force OFF executed");
+  finishShotRecording();
+
+  unsigned long duration = profileElapsedMs() / 1000; // Duration in seconds
+  bool dryRun = dryRunActive;
+  endDryRun();
+
+  logPrintf("info", "Brew profile finished (duration: %lus)", duration);
+
+#if USE_HARDWARE_BUTTONS
+  button1StateInitialized = false;
+  button2StateInitialized = false;
+  consolePrintf("DEBUG: Reset button state initialization flags");
+#endif
+
+  // Reset the start to prevent reuse
+  startTimeUs = 0;
+  currentSegment = 0;
+  totalSegments = 0;
+
+  MessageDocument response(256);
+  response["status"] = "profile_stopped";
+  response["duration"] = duration;
+  if (dryRun) response["dry_run"] = true;
+  sendResponse(response);
+}
+
+// Profile target at any time (feedforward look-ahead); holds the last
+// pressure in gaps, flow segments and after the end
+static int32_t targetPressureAtMs(uint32_t ms) {
+  int active = findSegment(ms);
+  for (int i = active; i >= 0; i--) {
+    const RuntimeSegment& seg = profileSegments[i];
+    if (seg.flow) continue;
+    return segmentValueAt(seg, ms);
+  }
+  return 0;
+}
+
+static float targetPressureAt(float seconds) {
+  return (float)targetPressureAtMs(secondsToMs(seconds)) / PROFILE_VALUE_SCALE;
+}
+
+void executeProfile() {
+  if (totalSegments <= 0) {
+    consolePrintf("ERROR: Profile has no segments to run");
+    stopProfile();
+    return;
+  }
+
+  uint32_t elapsedMs = profileElapsedMs();
+  if (elapsedMs > timelineEndMs) {
+    stopProfile();
+    return;
+  }
+
+  int segmentIndex = findSegment(elapsedMs);
+  if (segmentIndex < 0) {
+    // Not yet time for the first segment
+    setDimLevel(0);
+    return;
+  }
+  currentSegment = segmentIndex;
+
+  const RuntimeSegment& segment = profileSegments[currentSegment];
+  bool flowSegment = segment.flow;
+  // Past this segment's end (a gap before the next one) the end value holds
+  bool inGap = elapsedMs > segment.endMs;
+  int32_t targetValue = segmentValueAt(segment, elapsedMs);
+  // Floats from here on: logs and the controllers
+  float currentTime = elapsedMs / 1000.0f;
+  float startPressure = (float)segment.startValue / PROFILE_VALUE_SCALE;  // ml/s for flow segments
+  float endPressure = (float)segment.endValue / PROFILE_VALUE_SCALE;
+  float segmentStartTime = segment.startMs / 1000.0f;
+  float segmentEndTime = segment.endMs / 1000.0f;
+
+  // Log when entering a new segment
+  if (currentSegment != loggedSegment) {
+    logPrintf("info", "[%.1fs] Profile segment %d/%d: %.1fs-%.1fs, %.1f→%.1f %s", currentTime, currentSegment + 1, totalSegments,
+              segmentStartTime, segmentEndTime, startPressure, endPressure, flowSegment ? "ml/s" : "bar");
+    loggedSegment = currentSegment;
+  }
+
+  // Debug: Log current time and segment info every 5 seconds
+  static unsigned long lastDebugTime = 0;
+  if (halMillis() - lastDebugTime >= 5000) {
+    consolePrintf("[%.1fs] DEBUG: currentTime=%.1fs, segment=%d, startTime=%.1fs, endTime=%.1fs, gap=%d, totalSegments=%d",
+                  currentTime, currentTime, currentSegment, segmentStartTime, segmentEndTime, inGap, totalSegments);
+    lastDebugTime = halMillis();
+  }
+
+  float targetPressure = (float)targetValue / PROFILE_VALUE_SCALE;
+
+  updateFlowEstimator();
+  int dimLevel;
+  if (flowSegment) {
+    // Flow target (ml/s): the pump model gives the level at the current back pressure
+    float targetFlow = targetPressure;
+    targetPressure = 0.0f;
+    currentTargetFlow = targetFlow;
+    dimLevel = flowToDimLevel(targetFlow, !dryRunActive);
+    resetPressureControl();
+  } else {
+    // Convert pressure to dim level and set (ahead of time to cover the pump
+    // lag), trimmed by the scheduled PID on the transducer reading
+    currentTargetFlow = 0.0f;
+    float commandPressure = feedforwardPressure(currentTime, targetPressureAt);
+    if (dryRunActive) {
+      // No pump running: the feedforward level alone, without the PID
+      dimLevel = pressureToDimLevel(commandPressure);
+    } else {
+      dimLevel = pressureControlUpdate(targetPressure, getCurrentPressure(), (float)pressureToDimLevel(commandPressure));
+    }
+  }
+
+  // Debug: Log pressure to dim level conversion
+  static float lastTargetPressure = -1.0f;
+  if (fabsf(targetPressure - lastTargetPressure) > 0.1f) {
+    consolePrintf("DEBUG: pressureToDimLevel(%.2f bar) = %d%%, isCalibrated=%d", targetPressure, dimLevel, isCalibrated);
+    lastTargetPressure = targetPressure;
+  }
+
+  // Log dim level changes (every second or when level changes significantly)
+  static int lastLoggedDimLevel = -1;
+  static unsigned long lastLogTime = 0;
+  bool shouldLog = false;
+
+  if (dimLevel != lastLoggedDimLevel) {
+    shouldLog = true; // Always log when dim level changes
+  } else if (halMillis() - lastLogTime >= 1000) {
+    shouldLog = true; // Log at least once per second
+  }
+
+  if (shouldLog) {
+    if (flowSegment) {
+      logPrintf("info", "[%.1fs] Brew: Target: %.1f ml/s | Flow: %.1f ml/s | Dim: %d%%", currentTime, currentTargetFlow,
+                estimatedFlow, dimLevel);
+    } else {
+      logPrintf("info", "[%.1fs] Brew: Target: %.1f bar | Dim: %d%%", currentTime, targetPressure, dimLevel);
+    }
+    lastLoggedDimLevel = dimLevel;
+    lastLogTime = halMillis();
+  }
+
+  if (!dryRunActive) {
+    setDimLevel(dimLevel);
+  }
+  currentTargetPressure = targetPressure;
+  recordShotSample(targetPressure);
+
+  // Telemetry frame (telemetry topic; not even built when no client wants it)
+  uint8_t telemetryClients = topicDue(TOPIC_TELEMETRY);
+  if (telemetryClients) {
+    TelemetrySample sample;
+    sample.timeMs = elapsedMs;
+    sample.pressure = getCurrentPressure();
+    sample.target = flowSegment ? currentTargetFlow : targetPressure;
+    sample.flow = estimatedFlow;
+    sample.dimLevel = (uint8_t)dimLevel;
+    sample.segment = (uint8_t)currentSegment;
+    sample.flowSegment = flowSegment;
+    sample.dryRun = dryRunActive;
+    uint8_t frame[TELEMETRY_FRAME_LENGTH];
+    sendTelemetryFrame(frame, encodeTelemetryFrame(sample, frame), telemetryClients);
+  }
+}
+
+bool seekProfile(float seconds) {
+  if (!isRunning) {
+    logPrintf("warn", "Seek ignored: no profile running");
+    return false;
+  }
+  setTimelinePosition(secondsToMs(seconds));
+  if (!dryRunActive) {
+    // The brew limit runs from the new position, so a seek back is not cut short
+    supervisorBrewStarted(timelineEndMs - profileElapsedMs());
+  }
+  resetPressureControl();
+  logPrintf("info", "Profile seek to %.1fs (segment %d/%d)", profileElapsedMs() / 1000.0f, currentSegment + 1,
+            totalSegments);
+  return true;
+}
+
+// Fills the runtime segment table from a stored compact profile
+static void loadCompactSegments(CompactProfile& profile, bool verbose) {
+  totalSegments = profile.segmentCount < PROFILE_MAX_SEGMENTS ? profile.segmentCount : PROFILE_MAX_SEGMENTS;
+
+  for (int i = 0; i < totalSegments; i++) {
+    RuntimeSegment& segment = profileSegments[i];
+    segment.startMs = profile.segments[i].startTime * 1000u;
+    segment.endMs = profile.segments[i].endTime * 1000u;
+    // Stored in 0.1 units: exact in thousandths
+    bool flow = (profile.segments[i].startPressure & COMPACT_FLOW_FLAG) != 0;
+    segment.flow = flow;
+    segment.startValue = (profile.segments[i].startPressure & ~COMPACT_FLOW_FLAG) * (PROFILE_VALUE_SCALE / 10);
+    segment.endValue = profile.segments[i].endPressure * (PROFILE_VALUE_SCALE / 10);
+
+    if (verbose) {
+      consolePrintf("  Segment %d: %ds-%ds, %.1f→%.1f %s", i, profile.segments[i].startTime, profile.segments[i].endTime,
+                    (float)segment.startValue / PROFILE_VALUE_SCALE, (float)segment.endValue / PROFILE_VALUE_SCALE,
+                    flow ? "ml/s" : "bar");
+    }
+  }
+}
+
+void startDefaultProfile(int button) {
+  uint8_t profileId = (button == 1) ? defaultProfile1 : defaultProfile2;
+  const char* buttonName = (button == 1) ? "SW1" : "SW2";
+
+  if (profileId == 255) {
+    logPrintf("warn", "No default profile set for %s", buttonName);
+    return;
+  }
+
+  if (profileId >= profileCount) {
+    logPrintf("error", "Invalid profile ID: %d for %s", profileId, buttonName);
+    return;
+  }
+
+  // Validate checksum
+  CompactProfile& profile = storedProfiles[profileId];
+  if (calculateChecksum(profile) != profile.checksum) {
+    logPrintf("error", "Profile checksum validation failed for ID: %d (triggered by %s)", profileId, buttonName);
+    return;
+  }
+
+  // Start the stored profile
+  logPrintf("info", "%s triggered: Starting profile \"%s\" (ID: %d)", buttonName, profile.name, profileId);
+
+  consolePrintf("DEBUG startDefaultProfile: Converting profile ID %d with %d segments", profileId, profile.segmentCount);
+  loadCompactSegments(profile, true);
+
+  // Verify segments were created
+  consolePrintf("DEBUG startDefaultProfile: totalSegments=%d", totalSegments);
+
+  // Start profile execution
+  beginTimeline(0.0f);
+  beginRun();
+#if USE_HARDWARE_BUTTONS
+  if (button == 1) {
+    lastButton1State = halDigitalRead(BUTTON_1_PIN);  // Read actual state
+    lastButton1Time = halMillis();
+    // Initialize flag based on actual button state
+    if (lastButton1State == BUTTON_PRESSED) {
+      button1StateInitialized = true;  // Button is pressed - ready for emergency stop check
+      consolePrintf("DEBUG: Button1 initialized as LOW (pressed) for this profile");
+    } else {
+      button1StateInitialized = false;  // Button not pressed - don't check for emergency stop
+      consolePrintf("DEBUG: Button1 initialized as HIGH (not pressed) - emergency stop disabled");
+    }
+  } else if (button == 2) {
+    lastButton2State = halDigitalRead(BUTTON_2_PIN);  // Read actual state
+    lastButton2Time = halMillis();
+    // Initialize flag based on actual button state
+    if (lastButton2State == BUTTON_PRESSED) {
+      button2StateInitialized = true;  // Button is pressed - ready for emergency stop check
+      consolePrintf("DEBUG: Button2 initialized as LOW (pressed) for this profile");
+    } else {
+      button2StateInitialized = false;  // Button not pressed - don't check for emergency stop
+      consolePrintf("DEBUG: Button2 initialized as HIGH (not pressed) - emergency stop disabled");
+    }
+  }
+#endif
+  consolePrintf("DEBUG startDefaultProfile: startTime=%ldms, totalSegments=%d, isRunning=%d", (long)(startTimeUs / 1000),
+                totalSegments, isRunning);
+
+  // Send confirmation
+  MessageDocument response(256);
+  response["status"] = "profile_started";
+  response["profile_id"] = profileId;
+  response["profile_name"] = profile.name;
+  response["segments"] = profile.segmentCount;
+  response["start_time"] = (long)(startTimeUs / 1000); // millis since boot
+  sendResponse(response);
+}
+
+void startProfileById(uint8_t profileId, float atSeconds) {
+  if (profileId >= profileCount) {
+    logPrintf("error", "Invalid profile ID: %d", profileId);
+    return;
+  }
+
+  CompactProfile& profile = storedProfiles[profileId];
+  if (calculateChecksum(profile) != profile.checksum) {
+    logPrintf("error", "Profile checksum validation failed for ID: %d", profileId);
+    return;
+  }
+
+  logPrintf("info", "Starting profile \"%s\" (ID: %d)", profile.name, profileId);
+
+  loadCompactSegments(profile, false);
+  beginTimeline(atSeconds);
+  beginRun();
+
+  MessageDocument response(256);
+  response["status"] = "profile_started";
+  response["profile_id"] = profileId;
+  response["profile_name"] = profile.name;
+  response["segments"] = profile.segmentCount;
+  if (atSeconds > 0.0f) response["at"] = profileElapsedMs() / 1000.0f;
+  if (dryRunActive) response["dry_run"] = profileClockSpeed();
+  sendResponse(response);
+}
+
+void initHardwareButtons() {
+#if USE_HARDWARE_BUTTONS
+  halPinMode(BUTTON_1_PIN, HAL_PIN_INPUT_PULLUP);
+  halPinMode(BUTTON_2_PIN, HAL_PIN_INPUT_PULLUP);
+  halDelay(10);
+  lastButton1State = halDigitalRead(BUTTON_1_PIN);
+  lastButton2State = halDigitalRead(BUTTON_2_PIN);
+  lastButton1Time = halMillis();
+  lastButton2Time = halMillis();
+  button1StateInitialized = false;
+  button2StateInitialized = false;
+  if (lastButton1State == BUTTON_PRESSED || lastButton2State == BUTTON_PRESSED) {
+    powerUpSafetyActive = true;
+    consolePrintf("[SWITCH] WARNING: Switch is ON at boot - waiting for OFF position");
+    consolePrintf("[SWITCH] Move switch to OFF position, then ON to start program");
+    consolePrintf("[SWITCH] Power-up safety ACTIVE");
+  } else {
+    powerUpSafetyActive = false;
+    consolePrintf("[SWITCH] Switch is OFF at boot - normal operation");
+  }
+#else
+  powerUpSafetyActive = false;
+#endif
+#if USE_RELAYS
+  halPinMode(RELAY_1_PIN, HAL_PIN_OUTPUT);
+  halPinMode(RELAY_2_PIN, HAL_PIN_OUTPUT);
+  halDigitalWrite(RELAY_1_PIN, false);
+  halDigitalWrite(RELAY_2_PIN, false);
+#endif
+}
+
+void checkHardwareButtons() {
+#if USE_HARDWARE_BUTTONS
+  bool button1State = halDigitalRead(BUTTON_1_PIN);
+  bool button2State = halDigitalRead(BUTTON_2_PIN);
+
+  unsigned long currentTime = halMillis();
+
+  // Power-up safety: Clear when switch goes to OFF
+  if (powerUpSafetyActive) {
+    if (button1State != BUTTON_PRESSED && button2State != BUTTON_PRESSED) {
+      powerUpSafetyActive = false;
+      consolePrintf("[SWITCH] Power-up safety cleared - switch moved to OFF");
+      consolePrintf("[SWITCH] You can now toggle ON to start program");
+    }
+    // Don't process button presses while power-up safety is active
+    lastButton1State = button1State;
+    lastButton2State = button2State;
+    return;
+  }
+
+  // Check button 1 (Profile 1)
+  if (button1State != lastButton1State) {
+    if (currentTime - lastButton1Time > DEBOUNCE_DELAY) {
+      if (button1State == BUTTON_PRESSED) {
+        consolePrintf("[SWITCH] Transition: OFF -> ON1 (Program 1)");
+        sendLogMessage("[SWITCH] OFF -> ON1: Starting Program 1", "info");
+
+        if (isRunning) {
+          consolePrintf("[SWITCH] -> OFF: Stopping program");
+          sendLogMessage("[SAFETY] Stopping profile - setting dimmer to OFF", "warn");
+          stopProfile();
+          lastButton1Time = currentTime;
+          lastButton1State = button1State;
+          return;
+        }
+
+        if (defaultProfile1 != 255) {
+          consolePrintf("Starting default profile 1 (ID: %d)", defaultProfile1);
+          startDefaultProfile(1);
+        } else {
+          consolePrintf("[SWITCH] SW1: No default profile set");
+          sendLogMessage("[SWITCH] SW1: No default profile set", "warn");
+        }
+      } else {
+        consolePrintf("[SWITCH] Transition: ON1 (Program 1) -> OFF");
+        if (isRunning) {
+          consolePrintf("[SWITCH] -> OFF: Stopping program");
+          sendLogMessage("[SAFETY] Stopping profile - setting dimmer to OFF", "warn");
+          stopProfile();
+        }
+      }
+      lastButton1Time = currentTime;
+    }
+    lastButton1State = button1State;
+  }
+
+  // Check button 2 (Profile 2)
+  if (button2State != lastButton2State) {
+    if (currentTime - lastButton2Time > DEBOUNCE_DELAY) {
+      if (button2State == BUTTON_PRESSED) {
+        consolePrintf("[SWITCH] Transition: OFF -> ON2 (Program 2)");
+        sendLogMessage("[SWITCH] OFF -> ON2: Starting Program 2", "info");
+
+        if (isRunning) {
+          consolePrintf("[SWITCH] -> OFF: Stopping program");
+          sendLogMessage("[SAFETY] Stopping profile - setting dimmer to OFF", "warn");
+          stopProfile();
+          lastButton2Time = currentTime;
+          lastButton2State = button2State;
+          return;
+        }
+
+        if (defaultProfile2 != 255) {
+          consolePrintf("Starting default profile 2 (ID: %d)", defaultProfile2);
+          startDefaultProfile(2);
+        } else {
+          consolePrintf("[SWITCH] SW2: No default profile set");
+          sendLogMessage("[SWITCH] SW2: No default profile set", "warn");
+        }
+      } else {
+        consolePrintf("[SWITCH] Transition: ON2 (Program 2) -> OFF");
+        if (isRunning) {
+          consolePrintf("[SWITCH] -> OFF: Stopping program");
+          sendLogMessage("[SAFETY] Stopping profile - setting dimmer to OFF", "warn");
+          stopProfile();
+        }
+      }
+      lastButton2Time = currentTime;
+    }
+    lastButton2State = button2State;
+  }
+#endif
+}
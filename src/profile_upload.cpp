@@ -0,0 +1,227 @@
+#include "profile_upload.h"
+
+#include <string.h>
+
+#include "config.h"
+#include "hal.h"
+#include "messaging.h"
+#include "profiles.h"
+
+// Staged object (the transfer lives until commit, abort or the next begin)
+static uint8_t uploadBuffer[UPLOAD_MAX_BYTES];
+static bool uploadActive = false;
+static uint32_t uploadSize = 0;
+static uint32_t uploadCrc = 0;
+static uint32_t uploadOffset = 0;
+
+// Decodes into dst (room for maxLen bytes); -1 on a bad character or overflow
+static int base64Decode(const char* src, uint8_t* dst, size_t maxLen) {
+  size_t out = 0;
+  uint32_t bits = 0;
+  int bitCount = 0;
+  for (; *src && *src != '='; src++) {
+    char c = *src;
+    int value;
+    if (c >= 'A' && c <= 'Z') value = c - 'A';
+    else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+    else if (c >= '0' && c <= '9') value = c - '0' + 52;
+    else if (c == '+') value = 62;
+    else if (c == '/') value = 63;
+    else return -1;
+
+    bits = (bits << 6) | (uint32_t)value;
+    bitCount += 6;
+    if (bitCount >= 8) {
+      bitCount -= 8;
+      if (out == maxLen) return -1;
+      dst[out++] = (uint8_t)(bits >> bitCount);
+    }
+  }
+  return (int)out;
+}
+
+static void sendUploadError(const char* error) {
+  MessageDocument response(256);
+  response["status"] = "upload_error";
+  response["error"] = error;
+  response["offset"] = uploadOffset;
+  sendResponse(response);
+}
+
+static void sendUploadOffset(const char* status) {
+  MessageDocument response(256);
+  response["status"] = status;
+  response["offset"] = uploadOffset;
+  response["size"] = uploadSize;
+  sendResponse(response);
+}
+
+void handleUploadBegin(JsonObject doc) {
+  uint32_t size = doc["size"] | 0;
+  uint32_t crc = doc["crc"].as<uint32_t>();
+
+  if (size == 0 || size > UPLOAD_MAX_BYTES) {
+    uploadActive = false;
+    uploadOffset = 0;
+    sendUploadError("size out of range");
+    return;
+  }
+
+  if (uploadActive && size == uploadSize && crc == uploadCrc) {
+    // Same object again (reconnected): carry on where it stopped
+    consolePrintf("[UPLOAD] Resuming at %u of %u bytes", (unsigned)uploadOffset, (unsigned)size);
+  } else {
+    uploadActive = true;
+    uploadSize = size;
+    uploadCrc = crc;
+    uploadOffset = 0;
+    consolePrintf("[UPLOAD] Started: %u bytes, crc %08x", (unsigned)size, (unsigned)crc);
+  }
+  sendUploadOffset("upload_ready");
+}
+
+void handleUploadChunk(JsonObject doc) {
+  if (!uploadActive) {
+    sendUploadError("no upload in progress");
+    return;
+  }
+
+  uint32_t offset = doc["offset"] | 0;
+  const char* data = doc["data"] | "";
+  uint8_t chunk[UPLOAD_CHUNK_MAX_BYTES];
+  int length = base64Decode(data, chunk, sizeof(chunk));
+  if (length <= 0) {
+    sendUploadError("bad chunk data");
+    return;
+  }
+  if (doc["crc"].as<uint32_t>() != halCrc32(0, chunk, length)) {
+    sendUploadError("chunk crc mismatch");
+    return;
+  }
+
+  if (offset + length <= uploadOffset) {
+    // Repeat of a chunk whose ack was lost
+    sendUploadOffset("upload_ack");
+    return;
+  }
+  if (offset != uploadOffset) {
+    sendUploadError("unexpected offset");
+    return;
+  }
+  if (offset + length > uploadSize) {
+    sendUploadError("chunk past the end");
+    return;
+  }
+
+  memcpy(uploadBuffer + offset, chunk, length);
+  uploadOffset += length;
+  sendUploadOffset("upload_ack");
+}
+
+// Next record of the staged object; false when there are none left
+static bool nextRecord(uint32_t& pos, const char*& record, size_t& length) {
+  const char* text = (const char*)uploadBuffer;
+  while (pos < uploadSize && (text[pos] == '\n' || text[pos] == '\r')) pos++;
+  if (pos >= uploadSize) return false;
+
+  const char* newline = (const char*)memchr(text + pos, '\n', uploadSize - pos);
+  uint32_t end = newline ? (uint32_t)(newline - text) : uploadSize;
+  record = text + pos;
+  length = end - pos;
+  pos = end;
+  return true;
+}
+
+// Parses one record into doc; the profile object, or null when it is unusable
+static JsonObject parseRecord(JsonDocument& doc, const char* record, size_t length, uint8_t& id) {
+  if (deserializeJson(doc, record, length)) return JsonObject();
+  id = doc["id"] | 255;
+  JsonObject profile = doc.containsKey("profile") ? doc["profile"] : doc["p"];
+  if (id >= MAX_PROFILES || profile.isNull()) return JsonObject();
+  if (!profile.containsKey("segments") && !profile.containsKey("s")) return JsonObject();
+  return profile;
+}
+
+void handleUploadCommit() {
+  if (!uploadActive) {
+    sendUploadError("no upload in progress");
+    return;
+  }
+  if (uploadOffset != uploadSize) {
+    sendUploadError("upload incomplete");
+    return;
+  }
+  uint32_t crc = halCrc32(0, uploadBuffer, uploadSize);
+  if (crc != uploadCrc) {
+    // Nothing worth resuming: start over
+    uploadActive = false;
+    uploadOffset = 0;
+    logPrintf("error", "[UPLOAD] CRC mismatch: got %08x, expected %08x", (unsigned)crc, (unsigned)uploadCrc);
+    sendUploadError("crc mismatch");
+    return;
+  }
+
+  // All records must be valid before any is stored
+  int records = 0;
+  uint32_t pos = 0;
+  const char* record;
+  size_t length;
+  while (nextRecord(pos, record, length)) {
+    MessageDocument doc(messageDocBytesFor(record, length));
+    uint8_t id;
+    if (parseRecord(doc, record, length, id).isNull()) {
+      uploadActive = false;
+      uploadOffset = 0;
+      logPrintf("error", "[UPLOAD] Record %d is not a valid profile", records + 1);
+      sendUploadError("invalid record");
+      return;
+    }
+    records++;
+  }
+
+  // One transaction, so a record that fails to store undoes the others (in a
+  // batch the batch's transaction does, on the upload_error)
+  bool ownTransaction = !profileTransactionOpen();
+  if (ownTransaction) {
+    beginProfileTransaction();
+  }
+  int stored = 0;
+  pos = 0;
+  while (nextRecord(pos, record, length)) {
+    MessageDocument doc(messageDocBytesFor(record, length));
+    uint8_t id;
+    JsonObject profile = parseRecord(doc, record, length, id);
+    if (!storeProfile(id, profile, false)) {
+      if (ownTransaction) {
+        rollbackProfileTransaction();
+      }
+      uploadActive = false;
+      uploadOffset = 0;
+      logPrintf("error", "[UPLOAD] Record %d (profile %d) could not be stored", stored + 1, id);
+      sendUploadError("store failed");
+      return;
+    }
+    stored++;
+  }
+  saveProfiles();
+  if (ownTransaction) {
+    commitProfileTransaction();
+  }
+  uploadActive = false;
+
+  logPrintf("info", "[UPLOAD] Stored %d profiles (%u bytes)", stored, (unsigned)uploadSize);
+  MessageDocument response(256);
+  response["status"] = "upload_done";
+  response["stored"] = stored;
+  response["size"] = uploadSize;
+  response["crc"] = uploadCrc;
+  sendResponse(response);
+}
+
+void handleUploadAbort() {
+  uploadActive = false;
+  uploadOffset = 0;
+  MessageDocument response(256);
+  response["status"] = "upload_aborted";
+  sendResponse(response);
+}
@@ -0,0 +1,348 @@
+#include "profiles.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "flow_estimator.h"
+#include "hal.h"
+#include "messaging.h"
+
+// Profile storage (10 profiles)
+CompactProfile storedProfiles[MAX_PROFILES];
+uint8_t profileCount = 0;
+
+// Default profiles for hardware buttons (0-9, 255 = none)
+uint8_t defaultProfile1 = 255;  // Profile ID for button 1
+uint8_t defaultProfile2 = 255;  // Profile ID for button 2
+
+// Open transaction: what it changed, and the state to roll back to
+static bool transactionOpen = false;
+static bool profilesDirty = false;
+static bool defaultsDirty = false;
+static CompactProfile savedProfiles[MAX_PROFILES];
+static uint8_t savedProfileCount = 0;
+static uint8_t savedDefault1 = 255;
+static uint8_t savedDefault2 = 255;
+
+// Save all profiles to NVS
+void saveProfiles() {
+  if (transactionOpen) {
+    profilesDirty = true;
+    return;
+  }
+
+  halStoragePutU8("profile_count", profileCount);
+
+  // Save each profile (up to 10 profiles)
+  for (uint8_t i = 0; i < MAX_PROFILES; i++) {
+    char key[12];
+    snprintf(key, sizeof(key), "prof_%d", i);
+    CompactProfile& profile = storedProfiles[i];
+
+    if (profile.id != 255 && profile.segmentCount > 0) {
+      // Profile exists - save it
+      halStoragePutBytes(key, &profile, sizeof(CompactProfile));
+    } else {
+      // Profile slot empty - remove it
+      halStorageRemove(key);
+    }
+  }
+
+  consolePrintf("Profiles saved to NVS (count: %d)", profileCount);
+}
+
+// Load all profiles from NVS
+void loadProfiles() {
+  profileCount = halStorageGetU8("profile_count", 0);
+
+  int loadedCount = 0;
+  for (uint8_t i = 0; i < MAX_PROFILES; i++) {
+    char key[12];
+    snprintf(key, sizeof(key), "prof_%d", i);
+
+    if (halStorageIsKey(key)) {
+      // Profile exists in NVS - load it
+      size_t profileSize = sizeof(CompactProfile);
+      if (halStorageBytesLength(key) == profileSize) {
+        halStorageGetBytes(key, &storedProfiles[i], profileSize);
+
+        // Validate checksum
+        uint8_t calculatedChecksum = calculateChecksum(storedProfiles[i]);
+        if (calculatedChecksum == storedProfiles[i].checksum && storedProfiles[i].id != 255) {
+          loadedCount++;
+          consolePrintf("Profile %d loaded: \"%s\" (%d segments)", i, storedProfiles[i].name, storedProfiles[i].segmentCount);
+        } else {
+          consolePrintf("WARNING: Profile %d checksum mismatch, skipping...", i);
+          storedProfiles[i].id = 255;  // Mark as empty
+          storedProfiles[i].segmentCount = 0;
+        }
+      } else {
+        consolePrintf("WARNING: Profile %d size mismatch, skipping...", i);
+        storedProfiles[i].id = 255;  // Mark as empty
+        storedProfiles[i].segmentCount = 0;
+      }
+    } else {
+      // Profile slot empty
+      storedProfiles[i].id = 255;
+      storedProfiles[i].segmentCount = 0;
+    }
+  }
+
+  // Update profileCount to match actual loaded profiles
+  profileCount = loadedCount;
+  consolePrintf("Profiles loaded from NVS (count: %d)", profileCount);
+}
+
+// Save default profiles (button assignments) to NVS
+void saveDefaultProfiles() {
+  if (transactionOpen) {
+    defaultsDirty = true;
+    return;
+  }
+  halStoragePutU8("default_prof1", defaultProfile1);
+  halStoragePutU8("default_prof2", defaultProfile2);
+  consolePrintf("Default profiles saved to NVS: Button1=%d, Button2=%d", defaultProfile1, defaultProfile2);
+}
+
+// Load default profiles (button assignments) from NVS
+void loadDefaultProfiles() {
+  defaultProfile1 = halStorageGetU8("default_prof1", 255);
+  defaultProfile2 = halStorageGetU8("default_prof2", 255);
+
+  // Validate default profile IDs
+  if (defaultProfile1 != 255 && defaultProfile1 >= MAX_PROFILES) {
+    consolePrintf("WARNING: Invalid default profile 1 ID (%d), clearing...", defaultProfile1);
+    defaultProfile1 = 255;
+  }
+  if (defaultProfile2 != 255 && defaultProfile2 >= MAX_PROFILES) {
+    consolePrintf("WARNING: Invalid default profile 2 ID (%d), clearing...", defaultProfile2);
+    defaultProfile2 = 255;
+  }
+
+  consolePrintf("Default profiles loaded from NVS: Button1=%d, Button2=%d", defaultProfile1, defaultProfile2);
+}
+
+void beginProfileTransaction() {
+  memcpy(savedProfiles, storedProfiles, sizeof(savedProfiles));
+  savedProfileCount = profileCount;
+  savedDefault1 = defaultProfile1;
+  savedDefault2 = defaultProfile2;
+  profilesDirty = false;
+  defaultsDirty = false;
+  transactionOpen = true;
+}
+
+void commitProfileTransaction() {
+  transactionOpen = false;
+  if (profilesDirty) {
+    saveProfiles();
+  }
+  if (defaultsDirty) {
+    saveDefaultProfiles();
+  }
+}
+
+void rollbackProfileTransaction() {
+  memcpy(storedProfiles, savedProfiles, sizeof(storedProfiles));
+  profileCount = savedProfileCount;
+  defaultProfile1 = savedDefault1;
+  defaultProfile2 = savedDefault2;
+  transactionOpen = false;
+  consolePrintf("Profile changes rolled back");
+}
+
+bool profileTransactionOpen() {
+  return transactionOpen;
+}
+
+// Calculate checksum for profile validation
+uint8_t calculateChecksum(CompactProfile& profile) {
+  uint8_t sum = 0;
+  uint8_t* data = (uint8_t*)&profile;
+  for (size_t i = 0; i < sizeof(CompactProfile) - 1; i++) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+// Byte layout clients reproduce: see profiles.h. Changing it invalidates
+// every client's cached hashes
+uint32_t profileHash(const CompactProfile& profile) {
+  uint32_t crc = halCrc32(0, &profile.id, 1);
+  crc = halCrc32(crc, (const uint8_t*)profile.name, sizeof(profile.name));
+  crc = halCrc32(crc, &profile.segmentCount, 1);
+  crc = halCrc32(crc, (const uint8_t*)profile.segments, profile.segmentCount * sizeof(CompactSegment));
+  return halCrc32(crc, &profile.totalDuration, 1);
+}
+
+bool profileSlotUsed(uint8_t id) {
+  return id < MAX_PROFILES && storedProfiles[id].id != 255 && storedProfiles[id].segmentCount > 0;
+}
+
+// Store profile in compact format
+bool storeProfile(uint8_t id, JsonObject profileData, bool persist) {
+  if (id >= MAX_PROFILES) return false;
+
+  // Built aside first: the stored one only changes if the content does
+  CompactProfile profile;
+  memset(&profile, 0, sizeof(profile));
+  profile.id = id;
+
+  // Copy name (truncate if too long) - support both "name" and "n" (optimized)
+  const char* name = profileData["name"] | profileData["n"] | "";
+  strncpy(profile.name, name, 15);
+  profile.name[15] = '\0';
+
+  // Process segments - support both "segments" and "s" (optimized)
+  JsonArray segments;
+  if (profileData.containsKey("segments")) {
+    segments = profileData["segments"];
+  } else if (profileData.containsKey("s")) {
+    segments = profileData["s"];
+  } else {
+    return false; // No segments found
+  }
+
+  profile.segmentCount = segments.size() < MAX_SEGMENTS ? segments.size() : MAX_SEGMENTS;
+  profile.totalDuration = 0;
+
+  for (int i = 0; i < profile.segmentCount; i++) {
+    JsonObject segment = segments[i];
+
+    // Convert to compact format - support both full and shortened field names
+    profile.segments[i].startTime = segment.containsKey("startTime") ? segment["startTime"] : segment["st"] | 0;
+    profile.segments[i].endTime = segment.containsKey("endTime") ? segment["endTime"] : segment["et"] | 0;
+
+    if (segment.containsKey("startFlow") || segment.containsKey("sf")) {
+      // Flow segment: ml/s in 0.1 steps, flagged in startPressure
+      float startFlow = segment.containsKey("startFlow") ? segment["startFlow"].as<float>() : segment["sf"].as<float>();
+      float endFlow = segment.containsKey("endFlow") ? segment["endFlow"].as<float>() : (segment.containsKey("ef") ? segment["ef"].as<float>() : startFlow);
+      profile.segments[i].startPressure = COMPACT_FLOW_FLAG | (uint8_t)(clampFloat(startFlow, 0.0f, FLOW_MAX_ML_S) * 10 + 0.5f);
+      profile.segments[i].endPressure = (uint8_t)(clampFloat(endFlow, 0.0f, FLOW_MAX_ML_S) * 10 + 0.5f);
+    } else {
+      float startPress = segment.containsKey("startPressure") ? segment["startPressure"].as<float>() : (segment.containsKey("sp") ? segment["sp"].as<float>() : 0.0f);
+      float endPress = segment.containsKey("endPressure") ? segment["endPressure"].as<float>() : (segment.containsKey("ep") ? segment["ep"].as<float>() : 0.0f);
+
+      profile.segments[i].startPressure = (uint8_t)(startPress * 10); // Convert to 0-120
+      profile.segments[i].endPressure = (uint8_t)(endPress * 10);
+    }
+
+    if (profile.segments[i].endTime > profile.totalDuration) {
+      profile.totalDuration = profile.segments[i].endTime;
+    }
+  }
+
+  // Calculate checksum
+  profile.checksum = calculateChecksum(profile);
+
+  CompactProfile& stored = storedProfiles[id];
+  if (profileSlotUsed(id) && calculateChecksum(stored) == stored.checksum &&
+      profileHash(stored) == profileHash(profile)) {
+    consolePrintf("Profile %d unchanged (%08x), not saved", id, (unsigned)profileHash(profile));
+    return true;
+  }
+  stored = profile;
+
+  // Update profile count
+  if (id >= profileCount) {
+    profileCount = id + 1;
+  }
+
+  logPrintf("info", "Profile synced: ID %d - \"%s\" (%d segments, %ds)", id, profile.name, profile.segmentCount, profile.totalDuration);
+
+  // Save profiles to NVS
+  if (persist) {
+    saveProfiles();
+  }
+
+  return true;
+}
+
+void clearAllProfiles() {
+  for (int i = 0; i < MAX_PROFILES; i++) {
+    storedProfiles[i].id = 255; // Mark as empty
+    storedProfiles[i].name[0] = '\0';
+    storedProfiles[i].segmentCount = 0;
+    storedProfiles[i].totalDuration = 0;
+    storedProfiles[i].checksum = 0;
+  }
+  profileCount = 0;
+
+  sendLogMessage("All profiles cleared on ESP32", "info");
+}
+
+bool setDefaultProfile(int button, uint8_t profileId) {
+  const char* buttonName = (button == 1) ? "SW1" : "SW2";
+
+  // Allow profileId 255 (no profile) or 0-9
+  if (profileId != 255 && profileId >= MAX_PROFILES) {
+    logPrintf("error", "Invalid profile ID: %d", profileId);
+    return false;
+  }
+
+  if (button == 1) {
+    defaultProfile1 = profileId;
+    if (profileId == 255) {
+      logPrintf("info", "Cleared: %s (Button 1) - no profile assigned", buttonName);
+    } else {
+      logPrintf("info", "Synced: %s (Button 1) -> Profile ID %d", buttonName, profileId);
+    }
+  } else if (button == 2) {
+    defaultProfile2 = profileId;
+    if (profileId == 255) {
+      logPrintf("info", "Cleared: %s (Button 2) - no profile assigned", buttonName);
+    } else {
+      logPrintf("info", "Synced: %s (Button 2) -> Profile ID %d", buttonName, profileId);
+    }
+  }
+
+  // Save default profiles to NVS
+  saveDefaultProfiles();
+
+  // Send confirmation
+  MessageDocument response(256);
+  response["status"] = "default_profile_set";
+  response["button"] = button;
+  response["profileId"] = profileId;
+  sendResponse(response);
+  return true;
+}
+
+// {"type":"profile_hashes","hashes":[h0,...,h9]}: index = id, null = empty
+void sendProfileHashes() {
+  MessageDocument response(512);
+  response["type"] = "profile_hashes";
+
+  JsonArray hashes = response.createNestedArray("hashes");
+  for (uint8_t i = 0; i < MAX_PROFILES; i++) {
+    if (profileSlotUsed(i) && calculateChecksum(storedProfiles[i]) == storedProfiles[i].checksum) {
+      hashes.add(profileHash(storedProfiles[i]));
+    } else {
+      hashes.add();
+    }
+  }
+
+  sendResponse(response);
+}
+
+// Ten profiles take about 1 KB: paged
+void sendProfileStatus() {
+  PagedResponse pages("profiles");
+  JsonObject header = pages.header();
+  header["type"] = "profile_status";
+  header["profile_count"] = profileCount;
+  header["default_profile1"] = defaultProfile1;
+  header["default_profile2"] = defaultProfile2;
+
+  for (int i = 0; i < profileCount; i++) {
+    JsonObject profile = pages.item().to<JsonObject>();
+    profile["id"] = storedProfiles[i].id;
+    profile["name"] = storedProfiles[i].name;
+    profile["segment_count"] = storedProfiles[i].segmentCount;
+    profile["total_duration"] = storedProfiles[i].totalDuration;
+    profile["checksum_valid"] = (calculateChecksum(storedProfiles[i]) == storedProfiles[i].checksum);
+    pages.add();
+  }
+
+  pages.finish();
+}
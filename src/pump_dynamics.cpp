@@ -0,0 +1,224 @@
+#include "pump_dynamics.h"
+
+#include <math.h>
+
+#include <ArduinoJson.h>
+
+#include "calibration.h"
+#include "config.h"
+#include "hal.h"
+#include "messaging.h"
+#include "pressure_control.h"
+#include "profile_engine.h"
+#include "triac.h"
+
+PumpDynamics pumpDynamics = {0.0f, 0.0f, 0.0f};
+bool pumpDynamicsValid = false;
+bool feedforwardEnabled = true;
+bool pumpIdentificationRunning = false;
+
+enum PumpIdPhase {
+  PUMP_ID_PRESTEP = 0,  // Holding the start level until the pressure settles
+  PUMP_ID_STEP          // Recording the response to the step
+};
+
+static PumpIdPhase idPhase = PUMP_ID_PRESTEP;
+static int idFromLevel = PUMP_ID_FROM_LEVEL;
+static int idToLevel = PUMP_ID_TO_LEVEL;
+static unsigned long idPhaseStartTime = 0;
+static unsigned long idLastSettleSample = 0;
+static unsigned long idLastTraceSample = 0;
+static float idBasePressure = 0.0f;
+static SettleDetector idSettle;
+static uint16_t idTrace[PUMP_ID_MAX_SAMPLES];  // Step response, 0.01 bar
+static int idTraceCount = 0;
+
+void loadPumpDynamics() {
+  if (halStorageBytesLength("pump_dyn") == sizeof(PumpDynamics)) {
+    halStorageGetBytes("pump_dyn", &pumpDynamics, sizeof(PumpDynamics));
+    pumpDynamicsValid = true;
+    consolePrintf("Pump dynamics loaded: tau %.0f ms, dead time %.0f ms, gain %.3f bar/%%", pumpDynamics.tauMs,
+                  pumpDynamics.deadTimeMs, pumpDynamics.gainBarPerPct);
+  }
+  feedforwardEnabled = halStorageGetU8("pump_ff", 1) != 0;
+}
+
+void setFeedforwardEnabled(bool enabled) {
+  feedforwardEnabled = enabled;
+  halStoragePutU8("pump_ff", enabled ? 1 : 0);
+  logPrintf("info", "Feedforward %s", enabled ? "enabled" : "disabled");
+  sendPumpDynamics();
+}
+
+void sendPumpDynamics() {
+  MessageDocument response(256);
+  response["type"] = "pump_dynamics";
+  response["valid"] = pumpDynamicsValid;
+  response["feedforward"] = feedforwardEnabled;
+  if (pumpDynamicsValid) {
+    response["tau_ms"] = (int)pumpDynamics.tauMs;
+    response["dead_time_ms"] = (int)pumpDynamics.deadTimeMs;
+    response["gain_bar_per_pct"] = pumpDynamics.gainBarPerPct;
+  }
+  sendResponse(response);
+}
+
+static void beginIdPhase(PumpIdPhase phase, int level) {
+  idPhase = phase;
+  idPhaseStartTime = halMillis();
+  idLastSettleSample = 0;
+  idLastTraceSample = idPhaseStartTime - PUMP_ID_SAMPLE_MS;  // Sample 0 = step time
+  idTraceCount = 0;
+  idSettle.reset();
+  setDimLevel(level);
+}
+
+void startPumpIdentification(int fromLevel, int toLevel) {
+  const char* error = NULL;
+  fromLevel = clampInt(fromLevel, 0, 100);
+  toLevel = clampInt(toLevel, 0, 100);
+  if (!USE_PRESSURE_SENSOR) {
+    error = "No pressure sensor";
+  } else if (isRunning || calibrationRunning || autotuneRunning) {
+    error = "Profile, calibration or autotune running";
+  } else if (fromLevel == toLevel) {
+    error = "Step levels are equal";
+  }
+  if (error) {
+    logPrintf("warn", "Pump identification refused: %s", error);
+    MessageDocument response(256);
+    response["status"] = "pump_id_error";
+    response["error"] = error;
+    sendResponse(response);
+    return;
+  }
+
+  idFromLevel = fromLevel;
+  idToLevel = toLevel;
+  pumpIdentificationRunning = true;
+  beginIdPhase(PUMP_ID_PRESTEP, fromLevel);
+
+  logPrintf("info", "Pump identification started: step %d%% -> %d%%", fromLevel, toLevel);
+  MessageDocument response(256);
+  response["status"] = "pump_id_started";
+  response["from"] = fromLevel;
+  response["to"] = toLevel;
+  sendResponse(response);
+}
+
+void stopPumpIdentification(const char* reason) {
+  if (!pumpIdentificationRunning) return;
+
+  pumpIdentificationRunning = false;
+  if (!isRunning) {
+    setDimLevel(0);
+  }
+  logPrintf("warn", "Pump identification aborted: %s", reason);
+  MessageDocument response(256);
+  response["status"] = "pump_id_aborted";
+  response["reason"] = reason;
+  sendResponse(response);
+}
+
+// First time (ms after the step) the smoothed response crosses the level
+static float crossingTimeMs(float level, bool rising) {
+  float previous = idTrace[0] / 100.0f;
+  for (int i = 1; i < idTraceCount - 1; i++) {
+    float value = (idTrace[i - 1] + idTrace[i] + idTrace[i + 1]) / 300.0f;
+    bool crossed = rising ? value >= level : value <= level;
+    if (crossed) {
+      float t = value != previous ? (level - previous) / (value - previous) : 1.0f;
+      return (i - 1 + clampFloat(t, 0.0f, 1.0f)) * PUMP_ID_SAMPLE_MS;
+    }
+    previous = value;
+  }
+  return -1.0f;
+}
+
+static void finishPumpIdentification(float finalPressure) {
+  pumpIdentificationRunning = false;
+  setDimLevel(0);
+
+  float delta = finalPressure - idBasePressure;
+  bool rising = delta > 0.0f;
+  float t28 = crossingTimeMs(idBasePressure + 0.283f * delta, rising);
+  float t63 = crossingTimeMs(idBasePressure + 0.632f * delta, rising);
+
+  const char* error = NULL;
+  if (fabsf(delta) < PUMP_ID_MIN_STEP_BAR) {
+    error = "Step response too small";
+  } else if (t28 < 0.0f || t63 <= t28) {
+    error = "No clean step response";
+  }
+  if (error) {
+    logPrintf("error", "Pump identification failed: %s (%.2f -> %.2f bar)", error, idBasePressure, finalPressure);
+    MessageDocument response(256);
+    response["status"] = "pump_id_error";
+    response["error"] = error;
+    sendResponse(response);
+    return;
+  }
+
+  // Smith's method
+  float tau = 1.5f * (t63 - t28);
+  float deadTime = t63 - tau;
+  pumpDynamics.tauMs = tau;
+  pumpDynamics.deadTimeMs = deadTime > 0.0f ? deadTime : 0.0f;
+  pumpDynamics.gainBarPerPct = delta / (idToLevel - idFromLevel);
+  pumpDynamicsValid = true;
+  halStoragePutBytes("pump_dyn", &pumpDynamics, sizeof(PumpDynamics));
+
+  logPrintf("info", "Pump identified: tau %.0f ms, dead time %.0f ms, %.2f -> %.2f bar", pumpDynamics.tauMs,
+            pumpDynamics.deadTimeMs, idBasePressure, finalPressure);
+  sendPumpDynamics();
+}
+
+void pumpIdentificationTick() {
+  if (!pumpIdentificationRunning) return;
+
+  unsigned long now = halMillis();
+  unsigned long held = now - idPhaseStartTime;
+
+  if (idPhase == PUMP_ID_STEP && now - idLastTraceSample >= PUMP_ID_SAMPLE_MS) {
+    // Timestamps on the sample grid keep the trace uniform despite loop jitter
+    idLastTraceSample += PUMP_ID_SAMPLE_MS;
+    float pressure = getCurrentPressure();
+    idTrace[idTraceCount++] = (uint16_t)(clampFloat(pressure, 0.0f, 600.0f) * 100.0f);
+    if (idTraceCount >= PUMP_ID_MAX_SAMPLES) {
+      // Out of trace: take the last second as the final value
+      float sum = 0.0f;
+      int n = 1000 / PUMP_ID_SAMPLE_MS;
+      for (int i = idTraceCount - n; i < idTraceCount; i++) sum += idTrace[i] / 100.0f;
+      finishPumpIdentification(sum / n);
+      return;
+    }
+  }
+
+  if (held < CAL_MIN_SETTLE_MS || now - idLastSettleSample < CAL_SAMPLE_INTERVAL_MS) return;
+  idLastSettleSample = now;
+
+  float mean;
+  bool settled = idSettle.add(getCurrentPressure(), &mean);
+  if (!idSettle.full() || (!settled && held < CAL_STEP_TIMEOUT_MS)) return;
+
+  if (idPhase == PUMP_ID_PRESTEP) {
+    idBasePressure = mean;
+    beginIdPhase(PUMP_ID_STEP, idToLevel);
+  } else {
+    finishPumpIdentification(mean);
+  }
+}
+
+float feedforwardPressure(float seconds, float (*targetAt)(float seconds)) {
+  if (!feedforwardEnabled || !pumpDynamicsValid) {
+    return targetAt(seconds);
+  }
+
+  float deadTimeS = clampFloat(pumpDynamics.deadTimeMs, 0.0f, PUMP_FF_MAX_LOOKAHEAD_MS) / 1000.0f;
+  float tauS = clampFloat(pumpDynamics.tauMs, 0.0f, PUMP_FF_MAX_LOOKAHEAD_MS) / 1000.0f;
+
+  float ahead = seconds + deadTimeS;
+  float target = targetAt(ahead);
+  float slope = (targetAt(ahead + PUMP_FF_SLOPE_WINDOW_S) - target) / PUMP_FF_SLOPE_WINDOW_S;
+  return clampFloat(target + tauS * slope, 0.0f, 12.0f);
+}
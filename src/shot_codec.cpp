@@ -0,0 +1,185 @@
+#include "shot_codec.h"
+
+#include <string.h>
+
+// Channels coded as second differences (bit set) vs first differences
+static const uint8_t SHOT_ORDER_MASK = (1 << SHOT_CH_TIME) | (1 << SHOT_CH_TARGET) | (1 << SHOT_CH_FIRED);
+
+static inline uint32_t zigzagEncode(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t zigzagDecode(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline int32_t quantizePressure(float bar) {
+  float scaled = bar * SHOT_PRESSURE_QUANT;
+  return (int32_t)(scaled >= 0 ? scaled + 0.5f : scaled - 0.5f);
+}
+
+static void quantizeSample(const ShotSample& sample, int32_t* q) {
+  q[SHOT_CH_TIME] = (int32_t)sample.timeMs;
+  q[SHOT_CH_TARGET] = quantizePressure(sample.targetPressure);
+  q[SHOT_CH_PRESSURE] = quantizePressure(sample.pressure);
+  q[SHOT_CH_DIM] = sample.dimLevel;
+  q[SHOT_CH_FIRED] = (int32_t)sample.firedCount;
+}
+
+// ============================================================================
+// ENCODER
+// ============================================================================
+void ShotEncoder::begin(ShotSinkFn sink, void* ctx) {
+  sinkFn = sink;
+  sinkCtx = ctx;
+  bufferLen = 0;
+  written = 0;
+  samples = 0;
+  zeroRun = 0;
+  memset(prev, 0, sizeof(prev));
+  memset(prevDelta, 0, sizeof(prevDelta));
+
+  putByte('S');
+  putByte('H');
+  putByte(SHOT_CODEC_VERSION);
+  putByte(SHOT_CHANNELS);
+  putByte(SHOT_ORDER_MASK);
+  putByte(SHOT_PRESSURE_QUANT & 0xFF);
+  putByte(SHOT_PRESSURE_QUANT >> 8);
+  putByte(0);
+}
+
+void ShotEncoder::add(const ShotSample& sample) {
+  int32_t q[SHOT_CHANNELS];
+  int32_t residual[SHOT_CHANNELS];
+  quantizeSample(sample, q);
+
+  uint8_t tag = 0;
+  for (int ch = 0; ch < SHOT_CHANNELS; ch++) {
+    int32_t delta = q[ch] - prev[ch];
+    residual[ch] = (SHOT_ORDER_MASK & (1 << ch)) ? delta - prevDelta[ch] : delta;
+    prev[ch] = q[ch];
+    prevDelta[ch] = delta;
+    if (residual[ch] != 0) {
+      tag |= (1 << ch);
+    }
+  }
+  samples++;
+
+  if (tag == 0) {
+    // Steady state - extend the current run instead of emitting a record
+    zeroRun++;
+    if (zeroRun == SHOT_MAX_RUN) {
+      flushRun();
+    }
+    return;
+  }
+
+  flushRun();
+  putByte(tag);
+  for (int ch = 0; ch < SHOT_CHANNELS; ch++) {
+    if (tag & (1 << ch)) {
+      putVarint(zigzagEncode(residual[ch]));
+    }
+  }
+}
+
+void ShotEncoder::finish() {
+  flushRun();
+  flush();
+}
+
+void ShotEncoder::flushRun() {
+  if (zeroRun > 0) {
+    putByte(0x80 | (uint8_t)(zeroRun - 1));
+    zeroRun = 0;
+  }
+}
+
+void ShotEncoder::putByte(uint8_t b) {
+  if (bufferLen == SHOT_ENCODER_BUFFER) {
+    flush();
+  }
+  buffer[bufferLen++] = b;
+}
+
+void ShotEncoder::putVarint(uint32_t v) {
+  while (v >= 0x80) {
+    putByte((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  putByte((uint8_t)v);
+}
+
+void ShotEncoder::flush() {
+  if (bufferLen == 0) return;
+  if (sinkFn) {
+    sinkFn(buffer, bufferLen, sinkCtx);
+  }
+  written += bufferLen;
+  bufferLen = 0;
+}
+
+// ============================================================================
+// DECODER
+// ============================================================================
+bool ShotDecoder::begin(const uint8_t* buf, size_t length) {
+  data = buf;
+  len = length;
+  pos = SHOT_HEADER_SIZE;
+  pendingRun = 0;
+  memset(prev, 0, sizeof(prev));
+  memset(prevDelta, 0, sizeof(prevDelta));
+
+  if (length < SHOT_HEADER_SIZE || buf[0] != 'S' || buf[1] != 'H') return false;
+  if (buf[2] != SHOT_CODEC_VERSION || buf[3] != SHOT_CHANNELS) return false;
+  orderMask = buf[4];
+  pressureQuant = buf[5] | (buf[6] << 8);
+  return pressureQuant != 0;
+}
+
+bool ShotDecoder::next(ShotSample& out) {
+  int32_t residual[SHOT_CHANNELS] = {0};
+
+  if (pendingRun > 0) {
+    pendingRun--;
+  } else {
+    if (pos >= len) return false;
+    uint8_t tag = data[pos++];
+    if (tag & 0x80) {
+      pendingRun = tag & 0x7F;  // This sample plus the remaining run
+    } else {
+      for (int ch = 0; ch < SHOT_CHANNELS; ch++) {
+        if (tag & (1 << ch)) {
+          uint32_t v;
+          if (!getVarint(v)) return false;
+          residual[ch] = zigzagDecode(v);
+        }
+      }
+    }
+  }
+
+  for (int ch = 0; ch < SHOT_CHANNELS; ch++) {
+    int32_t delta = (orderMask & (1 << ch)) ? prevDelta[ch] + residual[ch] : residual[ch];
+    prev[ch] += delta;
+    prevDelta[ch] = delta;
+  }
+
+  out.timeMs = (uint32_t)prev[SHOT_CH_TIME];
+  out.targetPressure = (float)prev[SHOT_CH_TARGET] / pressureQuant;
+  out.pressure = (float)prev[SHOT_CH_PRESSURE] / pressureQuant;
+  out.dimLevel = (uint8_t)prev[SHOT_CH_DIM];
+  out.firedCount = (uint32_t)prev[SHOT_CH_FIRED];
+  return true;
+}
+
+bool ShotDecoder::getVarint(uint32_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (pos >= len) return false;
+    uint8_t b = data[pos++];
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
@@ -0,0 +1,300 @@
+#include "shot_recorder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ArduinoJson.h>
+
+#include "calibration.h"
+#include "hal.h"
+#include "messaging.h"
+#include "profile_engine.h"
+#include "shot_codec.h"
+#include "triac.h"
+
+ShotEncoder shotEncoder;
+bool shotRecording = false;
+uint32_t shotSeq = 0;
+static char shotFilePath[24];
+static unsigned long shotLastSampleTime = 0;
+static unsigned long shotFiredBase = 0;
+static uint32_t shotEncodeCycles = 0;
+static uint32_t shotSinkCycles = 0;
+
+// Encoded blocks wait in RAM for shotRecorderTick(): a flash write can stall
+// for milliseconds, too long for the control tick. The loop writes one buffer
+// while the encoder fills the other; each holds bytes of a single shot.
+struct ShotWriteBuffer {
+  uint32_t shotId;
+  size_t len;
+  uint8_t data[SHOT_WRITE_BUFFER];
+};
+static ShotWriteBuffer shotWrites[2];
+static uint8_t shotWriteActive = 0;
+static uint32_t shotDroppedBytes = 0;   // Current shot, once set the rest is dropped too
+
+// Shot being streamed to the client, one chunk per loop pass
+static bool shotTxActive = false;
+static uint32_t shotTxId = 0;
+static uint32_t shotTxOffset = 0;
+static uint32_t shotTxTotal = 0;
+
+static void shotPath(uint32_t shotId, char* path, size_t size) {
+  snprintf(path, size, "/shot_%u.bin", (unsigned)(shotId % SHOT_SLOTS));
+}
+
+// Oldest shot still in flash (the slot being recorded is not readable)
+static uint32_t oldestShotId() {
+  uint32_t kept = shotRecording ? SHOT_SLOTS - 1 : SHOT_SLOTS;
+  return shotSeq > kept ? shotSeq - kept : 0;
+}
+
+// A shot with bytes still in RAM is not complete in flash yet
+static bool shotWritePending(uint32_t shotId) {
+  halTransportLock();
+  bool pending = (shotWrites[0].len > 0 && shotWrites[0].shotId == shotId) ||
+                 (shotWrites[1].len > 0 && shotWrites[1].shotId == shotId);
+  halTransportUnlock();
+  return pending;
+}
+
+// Encoder sink: queue compressed blocks for shotRecorderTick(). Runs on the
+// control tick, or wherever the shot is stopped from.
+static void shotFileSink(const uint8_t* data, size_t len, void* ctx) {
+  uint32_t cycles = halCycleCount();
+  halTransportLock();
+  ShotWriteBuffer* buffer = &shotWrites[shotWriteActive];
+  if (buffer->len > 0 && buffer->shotId != shotSeq && shotWrites[shotWriteActive ^ 1].len == 0) {
+    // Previous shot not written yet: start this one in the other buffer
+    shotWriteActive ^= 1;
+    buffer = &shotWrites[shotWriteActive];
+  }
+  if (shotDroppedBytes == 0 && (buffer->len == 0 || buffer->shotId == shotSeq) &&
+      buffer->len + len <= SHOT_WRITE_BUFFER) {
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->shotId = shotSeq;
+    buffer->len += len;
+  } else {
+    shotDroppedBytes += len;
+  }
+  halTransportUnlock();
+  shotSinkCycles += halCycleCount() - cycles;
+}
+
+static size_t base64Encode(const uint8_t* src, size_t len, char* dst) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t out = 0;
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t n = (uint32_t)src[i] << 16;
+    if (i + 1 < len) n |= (uint32_t)src[i + 1] << 8;
+    if (i + 2 < len) n |= src[i + 2];
+    dst[out++] = alphabet[(n >> 18) & 0x3F];
+    dst[out++] = alphabet[(n >> 12) & 0x3F];
+    dst[out++] = i + 1 < len ? alphabet[(n >> 6) & 0x3F] : '=';
+    dst[out++] = i + 2 < len ? alphabet[n & 0x3F] : '=';
+  }
+  dst[out] = '\0';
+  return out;
+}
+
+void loadShotIndex() {
+  shotSeq = halStorageGetU32("shot_seq", 0);
+  if (!halFileBegin()) {
+    consolePrintf("WARNING: SPIFFS mount failed - shot recording disabled");
+  }
+}
+
+void beginShotRecording() {
+  if (shotRecording) {
+    finishShotRecording();
+  }
+
+  // The new shot reuses the oldest slot; a transfer of that shot cannot go on
+  if (shotTxActive && shotTxId % SHOT_SLOTS == shotSeq % SHOT_SLOTS) {
+    shotTxActive = false;
+    MessageDocument response(256);
+    response["status"] = "error";
+    response["error"] = "shot overwritten";
+    response["id"] = shotTxId;
+    sendResponse(response);
+  }
+
+  shotPath(shotSeq, shotFilePath, sizeof(shotFilePath));
+  if (!halFileWrite(shotFilePath, NULL, 0, false)) {
+    consolePrintf("WARNING: Could not open %s - shot not recorded", shotFilePath);
+    return;
+  }
+
+  shotDroppedBytes = 0;
+  shotEncoder.begin(shotFileSink, NULL);
+  shotRecording = true;
+  shotLastSampleTime = 0;
+  shotFiredBase = triacFiredCount();
+  shotEncodeCycles = 0;
+  consolePrintf("[SHOT] Recording shot #%u to %s", (unsigned)shotSeq, shotFilePath);
+}
+
+void recordShotSample(float targetPressure) {
+  if (!shotRecording) return;
+
+  unsigned long elapsed = profileElapsedMs();
+  if (shotEncoder.sampleCount() > 0 && elapsed - shotLastSampleTime < SHOT_SAMPLE_INTERVAL_MS) {
+    return;
+  }
+  shotLastSampleTime = elapsed;
+
+  ShotSample sample;
+  sample.timeMs = elapsed;
+  sample.targetPressure = targetPressure;
+  sample.pressure = getCurrentPressure();
+  sample.dimLevel = (uint8_t)dimmerLevel;
+  sample.firedCount = triacFiredCount() - shotFiredBase;
+
+  // Encoder only: a block it hands to the sink is not part of the sample cost
+  uint32_t sinkCycles = shotSinkCycles;
+  uint32_t cycles = halCycleCount();
+  shotEncoder.add(sample);
+  shotEncodeCycles += halCycleCount() - cycles - (shotSinkCycles - sinkCycles);
+}
+
+void finishShotRecording() {
+  if (!shotRecording) return;
+
+  shotEncoder.finish();
+  shotRecording = false;
+
+  uint32_t samples = shotEncoder.sampleCount();
+  uint32_t bytes = shotEncoder.bytesWritten();
+  float ratio = bytes > 0 ? (float)(samples * SHOT_RAW_SAMPLE_SIZE) / bytes : 0.0f;
+  uint32_t cyclesPerSample = samples > 0 ? shotEncodeCycles / samples : 0;
+
+  logPrintf("info", "[SHOT] #%u saved: %u samples, %u bytes (%.1fx), %u cycles/sample",
+            (unsigned)shotSeq, (unsigned)samples, (unsigned)bytes, ratio, (unsigned)cyclesPerSample);
+  if (shotDroppedBytes > 0) {
+    logPrintf("warning", "[SHOT] #%u truncated: flash writes fell behind, %u bytes dropped",
+              (unsigned)shotSeq, (unsigned)shotDroppedBytes);
+  }
+
+  shotSeq++;
+  halStoragePutU32("shot_seq", shotSeq);
+}
+
+void sendShotList() {
+  MessageDocument response(1024);
+  response["type"] = "shot_list";
+  response["next_id"] = shotSeq;
+
+  JsonArray shots = response.createNestedArray("shots");
+  for (uint32_t id = oldestShotId(); id < shotSeq; id++) {
+    char path[24];
+    shotPath(id, path, sizeof(path));
+    int32_t size = halFileSize(path);
+    if (size < 0 || shotWritePending(id)) continue;
+    JsonObject shot = shots.createNestedObject();
+    shot["id"] = id;
+    shot["bytes"] = size;
+  }
+
+  sendResponse(response);
+}
+
+// Next chunk of the active transfer; the last one (or an empty shot) carries
+// "done":true
+static void sendShotChunk() {
+  char path[24];
+  shotPath(shotTxId, path, sizeof(path));
+
+  uint8_t raw[SHOT_CHUNK_BYTES];
+  char encoded[((SHOT_CHUNK_BYTES + 2) / 3) * 4 + 1];
+  size_t n = 0;
+  if (shotTxOffset < shotTxTotal) {
+    n = halFileRead(path, shotTxOffset, raw, sizeof(raw));
+    if (n == 0) {
+      shotTxActive = false;
+      MessageDocument response(256);
+      response["status"] = "error";
+      response["error"] = "shot read failed";
+      response["id"] = shotTxId;
+      response["offset"] = shotTxOffset;
+      sendResponse(response);
+      return;
+    }
+  }
+  base64Encode(raw, n, encoded);
+
+  MessageDocument chunk(512);
+  chunk["type"] = "shot_data";
+  chunk["id"] = shotTxId;
+  chunk["offset"] = shotTxOffset;
+  chunk["total"] = shotTxTotal;
+  chunk["data"] = (const char*)encoded;
+  shotTxOffset += n;
+  if (shotTxOffset >= shotTxTotal) {
+    chunk["done"] = true;
+    shotTxActive = false;
+  }
+  sendResponse(chunk);
+}
+
+// Streams a stored shot from offset to end as base64 chunks: the first one
+// now, the rest from shotTransferTick(). A client that misses a chunk
+// re-requests from that chunk's offset (which restarts the transfer there).
+void sendShotData(uint32_t shotId, uint32_t offset) {
+  bool inRange = shotId < shotSeq && shotId >= oldestShotId() && !shotWritePending(shotId);
+
+  char path[24];
+  shotPath(shotId, path, sizeof(path));
+  int32_t total = inRange ? halFileSize(path) : -1;
+  if (total < 0 || offset > (uint32_t)total) {
+    MessageDocument response(256);
+    response["status"] = "error";
+    response["error"] = total < 0 ? "shot not found" : "offset out of range";
+    response["id"] = shotId;
+    if (total >= 0) {
+      response["offset"] = offset;
+      response["total"] = total;
+    }
+    sendResponse(response);
+    return;
+  }
+
+  shotTxActive = true;
+  shotTxId = shotId;
+  shotTxOffset = offset;
+  shotTxTotal = (uint32_t)total;
+  sendShotChunk();
+}
+
+void shotTransferTick() {
+  if (!shotTxActive) return;
+  if (!clientConnected()) {
+    shotTxActive = false;
+    return;
+  }
+  sendShotChunk();
+}
+
+void shotRecorderTick() {
+  halTransportLock();
+  uint8_t pending = shotWriteActive ^ 1;
+  if (shotWrites[pending].len == 0) {
+    if (shotWrites[shotWriteActive].len == 0) {
+      halTransportUnlock();
+      return;
+    }
+    // Encoder continues in the empty buffer while this one goes to flash
+    shotWriteActive = pending;
+    pending ^= 1;
+  }
+  halTransportUnlock();
+
+  ShotWriteBuffer* buffer = &shotWrites[pending];
+  char path[24];
+  shotPath(buffer->shotId, path, sizeof(path));
+  if (!halFileWrite(path, buffer->data, buffer->len, true)) {
+    consolePrintf("WARNING: Could not write %s - shot truncated", path);
+  }
+  halTransportLock();
+  buffer->len = 0;
+  halTransportUnlock();
+}
@@ -0,0 +1,135 @@
+#include "status_publisher.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <ArduinoJson.h>
+
+#include "calibration.h"
+#include "hal.h"
+#include "messaging.h"
+#include "pressure_control.h"
+#include "profile_engine.h"
+#include "profiles.h"
+
+struct StatusSnapshot {
+  float pressure;
+  int currentSegment;
+  int totalSegments;
+  int profileCount;
+  uint8_t defaultProfile1;
+  uint8_t defaultProfile2;
+  bool isRunning;
+  bool isDryRun;
+  bool isCalibrated;
+  bool isCalibrating;
+  bool isAutotuning;
+  char profile1Name[sizeof(storedProfiles[0].name) + 1];
+  char profile2Name[sizeof(storedProfiles[0].name) + 1];
+};
+
+struct StatusClient {
+  bool valid;          // sent holds what the client has
+  uint32_t sequence;
+  StatusSnapshot sent;
+};
+
+static StatusClient statusClients[MESSAGE_CLIENT_COUNT];
+
+static void copyProfileName(char* name, size_t size, uint8_t profileId) {
+  name[0] = '\0';
+  if (profileId != 255 && profileId < profileCount) {
+    strncpy(name, storedProfiles[profileId].name, size - 1);
+    name[size - 1] = '\0';
+  }
+}
+
+static void captureStatus(StatusSnapshot& status) {
+  status.pressure = getCurrentPressure();
+  status.currentSegment = currentSegment;
+  status.totalSegments = totalSegments;
+  status.profileCount = profileCount;
+  status.defaultProfile1 = defaultProfile1;
+  status.defaultProfile2 = defaultProfile2;
+  status.isRunning = isRunning;
+  status.isDryRun = dryRunActive;
+  status.isCalibrated = isCalibrated;
+  status.isCalibrating = calibrationRunning;
+  status.isAutotuning = autotuneRunning;
+  copyProfileName(status.profile1Name, sizeof(status.profile1Name), defaultProfile1);
+  copyProfileName(status.profile2Name, sizeof(status.profile2Name), defaultProfile2);
+}
+
+// Fields of current that differ from what the client has; false if none
+static bool buildStatus(JsonDocument& doc, StatusClient& client, const StatusSnapshot& current) {
+  bool full = !client.valid;
+  const StatusSnapshot& sent = client.sent;
+
+  doc["type"] = "status_update";
+  doc["seq"] = client.sequence + 1;
+  if (full) {
+    doc["full"] = true;
+    doc["uptime"] = halMillis() / 1000;
+  }
+  size_t base = doc.size();
+
+  if (full || fabsf(current.pressure - sent.pressure) >= STATUS_PRESSURE_DEADBAND_BAR) {
+    doc["current_pressure"] = current.pressure;
+  }
+  if (full || current.isRunning != sent.isRunning) doc["is_running"] = current.isRunning;
+  if (full || current.isDryRun != sent.isDryRun) doc["dry_run"] = current.isDryRun;
+  if (full || current.currentSegment != sent.currentSegment) doc["current_segment"] = current.currentSegment;
+  if (full || current.totalSegments != sent.totalSegments) doc["total_segments"] = current.totalSegments;
+  if (full || current.isCalibrated != sent.isCalibrated) doc["is_calibrated"] = current.isCalibrated;
+  if (full || current.isCalibrating != sent.isCalibrating) doc["is_calibrating"] = current.isCalibrating;
+  if (full || current.isAutotuning != sent.isAutotuning) doc["is_autotuning"] = current.isAutotuning;
+  if (full || current.profileCount != sent.profileCount) doc["profile_count"] = current.profileCount;
+  if (full || current.defaultProfile1 != sent.defaultProfile1) doc["default_profile1"] = current.defaultProfile1;
+  if (full || current.defaultProfile2 != sent.defaultProfile2) doc["default_profile2"] = current.defaultProfile2;
+  if (full || strcmp(current.profile1Name, sent.profile1Name) != 0) {
+    doc["default_profile1_name"] = current.profile1Name;
+  }
+  if (full || strcmp(current.profile2Name, sent.profile2Name) != 0) {
+    doc["default_profile2_name"] = current.profile2Name;
+  }
+  return full || doc.size() > base;
+}
+
+void sendStatusUpdate(uint8_t clients) {
+  StatusSnapshot current;
+  captureStatus(current);
+
+  for (int i = 0; i < MESSAGE_CLIENT_COUNT; i++) {
+    StatusClient& client = statusClients[i];
+    if (!messageClientConnected(i)) {
+      client.valid = false;
+      continue;
+    }
+    if (!(clients & (1 << i))) continue;
+
+    StaticJsonDocument<STATUS_DOC_SIZE> doc;
+    if (!buildStatus(doc, client, current)) continue;
+
+    char json[MAX_MESSAGE_LENGTH + 1];
+    size_t length = serializeJson(doc, json, sizeof(json));
+    if (!sendJsonTo(i, json, length)) {
+      // Dropped on the way: restart this client from a snapshot
+      client.valid = false;
+      continue;
+    }
+
+    // Pressure stays at the last value sent until it leaves the deadband
+    float sentPressure = client.sent.pressure;
+    bool pressureSent = doc.containsKey("current_pressure");
+    client.sent = current;
+    if (!pressureSent) client.sent.pressure = sentPressure;
+    client.sequence++;
+    client.valid = true;
+  }
+}
+
+void resetStatusClient(int client) {
+  if (client >= 0 && client < MESSAGE_CLIENT_COUNT) {
+    statusClients[client].valid = false;
+  }
+}
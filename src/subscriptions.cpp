@@ -0,0 +1,156 @@
+#include "subscriptions.h"
+
+#include <string.h>
+
+#include "config.h"
+#include "hal.h"
+#include "messaging.h"
+
+// Per client (MESSAGE_CLIENT_*) and topic; defaults set by initSubscriptions()
+static TopicSubscription subscriptions[MESSAGE_CLIENT_COUNT][TOPIC_COUNT];
+
+static const char* const TOPIC_NAMES[TOPIC_COUNT] = {"telemetry", "logs", "status", "triac_stats"};
+static const char* const LEVEL_NAMES[] = {"debug", "info", "warn", "error"};
+
+static bool validClient(int client) {
+  return client >= 0 && client < MESSAGE_CLIENT_COUNT;
+}
+
+// Defaults: every stream, as sent before subscriptions existed
+static void setTopicDefaults(TopicSubscription& sub) {
+  uint32_t sent = sub.sent;
+  uint32_t suppressed = sub.suppressed;
+  memset(&sub, 0, sizeof(sub));
+  sub.enabled = true;
+  sub.decimation = 1;
+  sub.minLevel = LOG_DEBUG;
+  sub.sent = sent;
+  sub.suppressed = suppressed;
+}
+
+void initSubscriptions() {
+  memset(subscriptions, 0, sizeof(subscriptions));
+  for (int client = 0; client < MESSAGE_CLIENT_COUNT; client++) {
+    resetSubscriptions(client);
+  }
+}
+
+void resetSubscriptions(int client) {
+  if (!validClient(client)) return;
+  for (int i = 0; i < TOPIC_COUNT; i++) {
+    setTopicDefaults(subscriptions[client][i]);
+  }
+}
+
+static int parseLevel(const char* level) {
+  for (int i = 0; i < (int)(sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0])); i++) {
+    if (strcmp(level, LEVEL_NAMES[i]) == 0) return i;
+  }
+  return -1;
+}
+
+static bool clientTopicDue(TopicSubscription& sub, unsigned long now) {
+  if (!sub.enabled) {
+    sub.suppressed++;
+    return false;
+  }
+  if (sub.decimation > 1 && ++sub.skipCount < sub.decimation) {
+    sub.suppressed++;
+    return false;
+  }
+  sub.skipCount = 0;
+
+  if (sub.minIntervalMs > 0 && sub.sent > 0 && now - sub.lastSent < sub.minIntervalMs) {
+    sub.suppressed++;
+    return false;
+  }
+  sub.lastSent = now;
+  sub.sent++;
+  return true;
+}
+
+uint8_t topicDue(SubscriptionTopic topic) {
+  unsigned long now = halMillis();
+  uint8_t clients = 0;
+  for (int client = 0; client < MESSAGE_CLIENT_COUNT; client++) {
+    if (messageClientConnected(client) && clientTopicDue(subscriptions[client][topic], now)) {
+      clients |= 1 << client;
+    }
+  }
+  return clients;
+}
+
+uint8_t logDue(const char* level) {
+  int value = parseLevel(level);
+  unsigned long now = halMillis();
+  uint8_t clients = 0;
+  for (int client = 0; client < MESSAGE_CLIENT_COUNT; client++) {
+    if (!messageClientConnected(client)) continue;
+    TopicSubscription& sub = subscriptions[client][TOPIC_LOGS];
+    if (value >= 0 && value < sub.minLevel) {
+      sub.suppressed++;
+    } else if (clientTopicDue(sub, now)) {
+      clients |= 1 << client;
+    }
+  }
+  return clients;
+}
+
+void applySubscriptions(int client, JsonObject topics) {
+  if (!validClient(client)) return;
+  for (int i = 0; i < TOPIC_COUNT; i++) {
+    JsonVariant value = topics[TOPIC_NAMES[i]];
+    if (value.isNull()) continue;
+
+    TopicSubscription& sub = subscriptions[client][i];
+    if (value.is<bool>()) {
+      if (value.as<bool>()) {
+        setTopicDefaults(sub);
+      } else {
+        sub.enabled = false;
+      }
+      continue;
+    }
+
+    JsonObject options = value.as<JsonObject>();
+    sub.enabled = options["enabled"] | true;
+    if (options.containsKey("rate")) {
+      // Messages per second; 0 = unlimited
+      float rate = options["rate"].as<float>();
+      sub.minIntervalMs = rate > 0.0f ? (uint16_t)clampFloat(1000.0f / rate, 1.0f, 60000.0f) : 0;
+    }
+    if (options.containsKey("decimate")) {
+      sub.decimation = (uint8_t)clampInt(options["decimate"].as<int>(), 1, 255);
+      sub.skipCount = 0;
+    }
+    if (options.containsKey("level")) {
+      int level = parseLevel(options["level"] | "");
+      if (level >= 0) sub.minLevel = (uint8_t)level;
+    }
+  }
+  sendSubscriptions(client);
+}
+
+void sendSubscriptions(int client) {
+  if (!validClient(client)) return;
+  MessageDocument response(768);
+  response["type"] = "subscriptions";
+  response["client"] = client;
+  JsonObject topics = response.createNestedObject("topics");
+  for (int i = 0; i < TOPIC_COUNT; i++) {
+    const TopicSubscription& sub = subscriptions[client][i];
+    JsonObject entry = topics.createNestedObject(TOPIC_NAMES[i]);
+    entry["on"] = sub.enabled;
+    entry["rate"] = sub.minIntervalMs > 0 ? 1000.0f / sub.minIntervalMs : 0.0f;
+    entry["decimate"] = sub.decimation;
+    if (i == TOPIC_LOGS) {
+      entry["level"] = LEVEL_NAMES[sub.minLevel];
+    }
+    entry["sent"] = sub.sent;
+    entry["suppressed"] = sub.suppressed;
+  }
+  // Generated but lost in the transmit queue (see messaging.h)
+  response["telemetry_dropped"] = txTelemetryDropped;
+  response["logs_dropped"] = txLogDropped;
+  sendResponse(response);
+}
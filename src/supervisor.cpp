@@ -0,0 +1,275 @@
+#include "supervisor.h"
+
+#include <atomic>
+
+#include <ArduinoJson.h>
+
+#include "calibration.h"
+#include "config.h"
+#include "hal.h"
+#include "messaging.h"
+#include "pressure_control.h"
+#include "profile_engine.h"
+#include "pump_dynamics.h"
+#include "triac.h"
+
+SafetyTrip safetyTrips[SUPERVISOR_TRIP_LOG];
+uint32_t safetyTripCount = 0;
+
+static const char* const TRIP_NAMES[TRIP_REASON_COUNT] = {
+  "none", "watchdog", "loop_stall", "brew_duration", "zc_timeout", "fired_without_zc", "over_pressure"
+};
+
+// Shared between the supervisor task and loop()
+static std::atomic<uint32_t> loopHeartbeatMs(0);
+static std::atomic<uint32_t> brewStartMs(0);
+static std::atomic<uint32_t> brewLimitMs(0);      // 0 = no run to time
+static std::atomic<uint8_t> pendingReason(TRIP_NONE);
+static std::atomic<uint32_t> pendingAtMs(0);
+static std::atomic<float> pendingValue(0.0f);
+
+// Supervisor task only
+static bool watchdogStarted = false;
+static bool triacWasOn = false;
+static uint32_t onSinceMs = 0;
+static uint32_t lastZcCount = 0;
+static uint32_t lastZcSeenMs = 0;
+static uint32_t lastFiredCount = 0;
+static uint32_t lastPulseCount = 0;
+static int32_t armedPulses = 0;                   // Fired by the ISR, gate pulse not yet seen
+#if USE_PRESSURE_SENSOR
+static bool pressureHigh = false;
+static uint32_t pressureHighSinceMs = 0;
+#endif
+
+const char* safetyTripName(uint8_t reason) {
+  return reason < TRIP_REASON_COUNT ? TRIP_NAMES[reason] : "unknown";
+}
+
+static void recordTrip(const SafetyTrip& trip) {
+  safetyTrips[safetyTripCount % SUPERVISOR_TRIP_LOG] = trip;
+  safetyTripCount++;
+  halStoragePutU32("safety_n", safetyTripCount);
+  halStoragePutBytes("safety_last", &trip, sizeof(trip));
+}
+
+static void addTrip(JsonObject entry, const SafetyTrip& trip) {
+  entry["reason"] = safetyTripName(trip.reason);
+  entry["at_ms"] = trip.atMs;
+  entry["value"] = trip.value;
+}
+
+static void supervisorTask(void* arg) {
+  supervisorCheck();
+}
+
+void initSupervisor() {
+  safetyTripCount = halStorageGetU32("safety_n", 0);
+  if (safetyTripCount > 0 && halStorageBytesLength("safety_last") == sizeof(SafetyTrip)) {
+    halStorageGetBytes("safety_last", &safetyTrips[(safetyTripCount - 1) % SUPERVISOR_TRIP_LOG], sizeof(SafetyTrip));
+  }
+  if (halResetByWatchdog()) {
+    SafetyTrip trip = {TRIP_WATCHDOG, 0, (float)SUPERVISOR_WATCHDOG_MS};
+    recordTrip(trip);
+    consolePrintf("[SAFETY] Previous boot ended in a watchdog reset");
+  }
+
+  loopHeartbeatMs.store(halMillis(), std::memory_order_relaxed);
+  if (!halTaskCreatePeriodic("supervisor", supervisorTask, NULL, SUPERVISOR_PERIOD_MS)) {
+    consolePrintf("[SAFETY] ERROR: supervisor task not started");
+    return;
+  }
+  consolePrintf("[SAFETY] Supervisor running every %d ms, watchdog %d ms", SUPERVISOR_PERIOD_MS,
+                SUPERVISOR_WATCHDOG_MS);
+}
+
+// ============================================================================
+// SUPERVISOR TASK
+// ============================================================================
+
+// Off first, then publish the trip for loop(); the first reason wins
+static void trip(SafetyTripReason reason, float value) {
+  forceTriacOff();
+  pendingAtMs.store(halMillis(), std::memory_order_relaxed);
+  pendingValue.store(value, std::memory_order_relaxed);
+  pendingReason.store(reason, std::memory_order_release);
+}
+
+void supervisorCheck() {
+  if (!watchdogStarted) {
+    halWatchdogBegin(SUPERVISOR_WATCHDOG_MS);
+    watchdogStarted = true;
+  }
+  halWatchdogFeed();
+
+  uint32_t now = halMillis();
+  TriacControl control = readTriacControl();
+  // Pulses first: a pulse counted here has its fire in the stats read after
+  uint32_t pulses = pulseCount.load(std::memory_order_acquire);
+  TriacStats stats;
+  readTriacStats(&stats);
+
+  // Every gate pulse needs a fire the ISR decided on at a crossing; a glitch
+  // re-arming the timer fires once for two decisions, so at most one stays owed
+  armedPulses += (int32_t)(stats.firedCount - lastFiredCount) - (int32_t)(pulses - lastPulseCount);
+  lastFiredCount = stats.firedCount;
+  lastPulseCount = pulses;
+  int32_t unarmed = armedPulses < 0 ? -armedPulses : 0;
+  armedPulses = armedPulses < 0 ? 0 : (armedPulses > 1 ? 1 : armedPulses);
+
+  if (stats.zcCount != lastZcCount) {
+    lastZcCount = stats.zcCount;
+    lastZcSeenMs = now;
+  }
+
+  if (pendingReason.load(std::memory_order_acquire) != TRIP_NONE) {
+    // Tripped, loop() has not caught up: keep it off
+    if (control.mode == DIM_ON) forceTriacOff();
+    return;
+  }
+
+  uint32_t limit = brewLimitMs.load(std::memory_order_relaxed);
+  if (limit > 0) {
+    uint32_t brewMs = now - brewStartMs.load(std::memory_order_relaxed);
+    if (brewMs > limit) {
+      trip(TRIP_BREW_DURATION, (float)brewMs);
+      return;
+    }
+  }
+
+  if (control.mode != DIM_ON) {
+    triacWasOn = false;
+#if USE_PRESSURE_SENSOR
+    pressureHigh = false;
+#endif
+    return;
+  }
+  if (!triacWasOn) {
+    triacWasOn = true;
+    onSinceMs = now;
+  }
+
+  if (unarmed > 0) {
+    trip(TRIP_FIRED_WITHOUT_ZC, (float)unarmed);
+    return;
+  }
+
+  uint32_t loopAge = now - loopHeartbeatMs.load(std::memory_order_relaxed);
+  if (loopAge > SUPERVISOR_LOOP_STALL_MS) {
+    trip(TRIP_LOOP_STALL, (float)loopAge);
+    return;
+  }
+
+  if (zcEnabled && !pwmTestMode) {
+    // Measured from switch-on when the last crossing is older than that
+    uint32_t reference = (int32_t)(lastZcSeenMs - onSinceMs) > 0 ? lastZcSeenMs : onSinceMs;
+    if (now - reference > SUPERVISOR_ZC_TIMEOUT_MS) {
+      trip(TRIP_ZC_TIMEOUT, (float)(now - reference));
+      return;
+    }
+  }
+
+#if USE_PRESSURE_SENSOR
+  float pressure = getCurrentPressure();
+  if (pressure <= SUPERVISOR_MAX_PRESSURE_BAR) {
+    pressureHigh = false;
+  } else if (!pressureHigh) {
+    pressureHigh = true;
+    pressureHighSinceMs = now;
+  } else if (now - pressureHighSinceMs >= SUPERVISOR_PRESSURE_HOLD_MS) {
+    trip(TRIP_OVER_PRESSURE, pressure);
+  }
+#endif
+}
+
+void supervisorBrewStarted(uint32_t expectedMs) {
+  uint32_t limit = expectedMs + SUPERVISOR_BREW_GRACE_MS;
+  if (limit > SUPERVISOR_MAX_BREW_MS) limit = SUPERVISOR_MAX_BREW_MS;
+  brewStartMs.store(halMillis(), std::memory_order_relaxed);
+  brewLimitMs.store(limit, std::memory_order_relaxed);
+}
+
+void supervisorBrewStopped() {
+  brewLimitMs.store(0, std::memory_order_relaxed);
+}
+
+bool supervisorTripped() {
+  return pendingReason.load(std::memory_order_acquire) != TRIP_NONE;
+}
+
+SafetyTripReason supervisorPendingTrip() {
+  return (SafetyTripReason)pendingReason.load(std::memory_order_acquire);
+}
+
+// ============================================================================
+// LOOP SIDE
+// ============================================================================
+void supervisorLoopTick() {
+  loopHeartbeatMs.store(halMillis(), std::memory_order_relaxed);
+
+  uint8_t reason = pendingReason.load(std::memory_order_acquire);
+  if (reason == TRIP_NONE) return;
+
+  SafetyTrip record = {reason, pendingAtMs.load(std::memory_order_relaxed),
+                       pendingValue.load(std::memory_order_relaxed)};
+
+  // Whatever was driving the triac stops before the latch is released
+  if (isRunning) {
+    stopProfile();
+  }
+  if (calibrationRunning) {
+    stopCalibration("Safety trip");
+  }
+  if (pumpIdentificationRunning) {
+    stopPumpIdentification("Safety trip");
+  }
+  if (autotuneRunning) {
+    stopAutotune("Safety trip");
+  }
+  if (sanityTestRunning) {
+    stopSanityTest("Safety trip");
+  }
+  setDimLevel(0);
+  recordTrip(record);
+
+  logPrintf("error", "[SAFETY] %s tripped (%.1f) at %lums: triac forced off", safetyTripName(reason), record.value,
+            (unsigned long)record.atMs);
+  MessageDocument message(256);
+  message["type"] = "safety_trip";
+  addTrip(message.as<JsonObject>(), record);
+  message["trip_count"] = safetyTripCount;
+  sendResponse(message);
+
+  // setTriacLevel() holds the level at 0 until the pending trip is cleared
+  releaseTriacForcedOff();
+  pendingReason.store(TRIP_NONE, std::memory_order_release);
+}
+
+// Trips paged: the full log with the limits is longer than one notification
+void sendSafetyStatus() {
+  PagedResponse pages("trips");
+  JsonObject response = pages.header();
+  response["type"] = "safety";
+  response["tripped"] = supervisorTripped();
+  response["trip_count"] = safetyTripCount;
+
+  JsonObject limits = response.createNestedObject("limits");
+  limits["max_brew_s"] = SUPERVISOR_MAX_BREW_MS / 1000;
+  limits["brew_grace_ms"] = SUPERVISOR_BREW_GRACE_MS;
+  limits["zc_timeout_ms"] = SUPERVISOR_ZC_TIMEOUT_MS;
+  limits["loop_stall_ms"] = SUPERVISOR_LOOP_STALL_MS;
+  limits["watchdog_ms"] = SUPERVISOR_WATCHDOG_MS;
+#if USE_PRESSURE_SENSOR
+  limits["max_pressure"] = SUPERVISOR_MAX_PRESSURE_BAR;
+#endif
+
+  // Oldest first
+  uint32_t kept = safetyTripCount < SUPERVISOR_TRIP_LOG ? safetyTripCount : SUPERVISOR_TRIP_LOG;
+  for (uint32_t i = safetyTripCount - kept; i < safetyTripCount; i++) {
+    const SafetyTrip& logged = safetyTrips[i % SUPERVISOR_TRIP_LOG];
+    if (logged.reason == TRIP_NONE) continue;  // Before this boot, not loaded
+    addTrip(pages.item().to<JsonObject>(), logged);
+    pages.add();
+  }
+  pages.finish();
+}
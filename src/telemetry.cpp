@@ -0,0 +1,35 @@
+#include "telemetry.h"
+
+#include <math.h>
+
+static uint16_t telemetrySequence = 0;
+
+// 0.01 units, clamped to the u16 field
+static uint16_t centi(float value) {
+  if (!(value > 0.0f)) return 0;
+  if (value >= 655.35f) return 65535;
+  return (uint16_t)lroundf(value * 100.0f);
+}
+
+static void putU16(uint8_t* out, uint16_t value) {
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+}
+
+static void putU32(uint8_t* out, uint32_t value) {
+  putU16(out, (uint16_t)value);
+  putU16(out + 2, (uint16_t)(value >> 16));
+}
+
+size_t encodeTelemetryFrame(const TelemetrySample& sample, uint8_t* frame) {
+  frame[0] = TELEMETRY_FRAME_TYPE;
+  frame[1] = (sample.flowSegment ? TELEMETRY_FLAG_FLOW : 0) | (sample.dryRun ? TELEMETRY_FLAG_DRY_RUN : 0);
+  putU16(frame + 2, telemetrySequence++);
+  putU32(frame + 4, sample.timeMs);
+  putU16(frame + 8, centi(sample.pressure));
+  putU16(frame + 10, centi(sample.target));
+  putU16(frame + 12, centi(sample.flow));
+  frame[14] = sample.dimLevel;
+  frame[15] = sample.segment;
+  return TELEMETRY_FRAME_LENGTH;
+}
@@ -0,0 +1,430 @@
+#include "triac.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "hal.h"
+#include "messaging.h"
+#include "perf_stats.h"
+#include "subscriptions.h"
+#include "supervisor.h"
+
+// Control word: written by setTriacLevel(), read by the ISR (see triac.h)
+static std::atomic<uint32_t> triacControlWord(0);
+
+// Firing pattern per duty level (see triac.h); data RAM so the ISR can read
+// it while the flash cache is off
+static DRAM_ATTR uint32_t firingPatterns[101][FIRING_PATTERN_WORDS];
+
+// Position in the pattern window, advanced by the ISR on every edge
+static uint32_t isrHalfCycle = 0;
+
+// ISR counters behind a seqlock (odd sequence = update in progress)
+struct SharedTriacStats {
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint32_t> zcCount;
+  std::atomic<uint32_t> firedCount;
+  std::atomic<uint32_t> zcIntervalUs;
+  std::atomic<uint32_t> lastZcUs;
+};
+static SharedTriacStats sharedStats;
+
+static volatile uint32_t zcTimestamp = 0;    // Last edge, for the gate timer's latency histogram
+int dimmerLevel = 0;
+
+// Loop-side rate bookkeeping for printTriacStats()
+unsigned long psmLastZcCount = 0;
+unsigned long psmLastFiredCount = 0;
+
+// PWM test mode (bypasses zero-cross, direct LEDC PWM)
+std::atomic<bool> pwmTestMode(false);
+
+std::atomic<uint32_t> pulseCount(0);
+unsigned long offModeStartTime = 0;
+std::atomic<bool> zcEnabled(true);
+
+// Software control mode (bypasses hardware switch safety)
+bool swControlEnabled = false;
+
+// Timer handle
+HalTimerHandle pulseTimerHandle = NULL;
+static volatile unsigned long gateDeadlineUs = 0;  // When the armed gate pulse is due
+
+// ============================================================================
+// ZERO-CROSS ISR (Keep minimal!)
+// ============================================================================
+static inline uint32_t packControl(DimmerMode mode, int duty, uint16_t generation) {
+  return ((uint32_t)generation << TRIAC_CONTROL_GENERATION_SHIFT) | (mode == DIM_ON ? TRIAC_CONTROL_ON : 0) |
+         ((uint32_t)duty & TRIAC_CONTROL_DUTY_MASK);
+}
+
+static TriacControl unpackControl(uint32_t word) {
+  TriacControl control;
+  control.mode = (word & TRIAC_CONTROL_ON) ? DIM_ON : DIM_OFF;
+  control.duty = (uint8_t)(word & TRIAC_CONTROL_DUTY_MASK);
+  control.forcedOff = (word & TRIAC_CONTROL_FORCED_OFF) != 0;
+  control.generation = (uint16_t)(word >> TRIAC_CONTROL_GENERATION_SHIFT);
+  return control;
+}
+
+static inline uint16_t nextGeneration(uint32_t word) {
+  return (uint16_t)((word >> TRIAC_CONTROL_GENERATION_SHIFT) + 1);
+}
+
+// One store per control change; CAS so concurrent writers never lose a
+// generation. The forced-off bit is carried over.
+static void publishControl(DimmerMode mode, int duty) {
+  uint32_t current = triacControlWord.load(std::memory_order_relaxed);
+  uint32_t next;
+  do {
+    next = packControl(mode, duty, nextGeneration(current)) | (current & TRIAC_CONTROL_FORCED_OFF);
+  } while (!triacControlWord.compare_exchange_weak(current, next, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void initFiringPatterns() {
+  memset(firingPatterns, 0, sizeof(firingPatterns));
+  for (int duty = 0; duty <= 100; duty++) {
+    for (int cycle = 0; cycle < FIRING_PATTERN_HALF_CYCLES / 2; cycle++) {
+      // Each polarity fires `duty` of the 100 cycles, evenly spread; the
+      // second half-cycle's sequence runs half a step behind the first
+      int first = 2 * cycle;
+      int second = first + 1;
+      if (((cycle + 1) * duty) / 100 != (cycle * duty) / 100) {
+        firingPatterns[duty][first >> 5] |= 1u << (first & 31);
+      }
+      if (((cycle + 1) * duty + 50) / 100 != (cycle * duty + 50) / 100) {
+        firingPatterns[duty][second >> 5] |= 1u << (second & 31);
+      }
+    }
+  }
+}
+
+void IRAM_ATTR zeroCrossISR() {
+  uint32_t perfStart = perfBegin();
+  uint32_t now = halMicros();
+
+  // The window position runs on across duty changes and while off
+  uint32_t halfCycle = isrHalfCycle;
+  isrHalfCycle = halfCycle + 1 < FIRING_PATTERN_HALF_CYCLES ? halfCycle + 1 : 0;
+
+  uint32_t control = triacControlWord.load(std::memory_order_acquire);
+  uint32_t duty = control & TRIAC_CONTROL_DUTY_MASK;
+
+  // PSM decision + firing entirely in ISR (no loop dependency)
+  bool shouldFire = false;
+  if ((control & TRIAC_CONTROL_ON) && pulseTimerHandle != NULL) {
+    if (duty >= 100) {
+      shouldFire = true;
+    } else if (duty > 0) {
+      shouldFire = (firingPatterns[duty][halfCycle >> 5] >> (halfCycle & 31)) & 1u;
+    }
+
+    if (shouldFire) {
+      halTimerStop(pulseTimerHandle);
+      halTimerStartOnce(pulseTimerHandle, PHASE_DELAY_FULL_US);
+      gateDeadlineUs = now + PHASE_DELAY_FULL_US;
+    }
+  }
+
+  // Stats: sequence odd while the block changes
+  uint32_t sequence = sharedStats.sequence.load(std::memory_order_relaxed);
+  sharedStats.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  uint32_t lastZc = sharedStats.lastZcUs.load(std::memory_order_relaxed);
+  if (lastZc > 0) {
+    sharedStats.zcIntervalUs.store(now - lastZc, std::memory_order_relaxed);
+  }
+  sharedStats.lastZcUs.store(now, std::memory_order_relaxed);
+  sharedStats.zcCount.store(sharedStats.zcCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  if (shouldFire) {
+    sharedStats.firedCount.store(sharedStats.firedCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+  sharedStats.sequence.store(sequence + 2, std::memory_order_release);
+
+  zcTimestamp = now;
+  perfEnd(PERF_ZC_ISR, perfStart);
+}
+
+TriacControl readTriacControl() {
+  return unpackControl(triacControlWord.load(std::memory_order_acquire));
+}
+
+void readTriacStats(TriacStats* stats) {
+  uint32_t before, after;
+  do {
+    before = sharedStats.sequence.load(std::memory_order_acquire);
+    stats->zcCount = sharedStats.zcCount.load(std::memory_order_relaxed);
+    stats->firedCount = sharedStats.firedCount.load(std::memory_order_relaxed);
+    stats->zcIntervalUs = sharedStats.zcIntervalUs.load(std::memory_order_relaxed);
+    stats->lastZcUs = sharedStats.lastZcUs.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = sharedStats.sequence.load(std::memory_order_relaxed);
+  } while ((before & 1) != 0 || before != after);
+}
+
+uint32_t triacFiredCount() {
+  return sharedStats.firedCount.load(std::memory_order_relaxed);
+}
+
+uint32_t triacZcIntervalUs() {
+  return sharedStats.zcIntervalUs.load(std::memory_order_relaxed);
+}
+
+// ============================================================================
+// PULSE TIMER CALLBACK
+// ============================================================================
+void IRAM_ATTR pulseTimerCallback(void* arg) {
+  uint32_t perfStart = perfBegin();
+  if (triacControlWord.load(std::memory_order_relaxed) & TRIAC_CONTROL_ON) {
+    uint32_t now = halMicros();
+    long late = (long)(now - gateDeadlineUs);
+    perfRecordUs(PERF_HIST_ISR_LATENCY, late > 0 ? (uint32_t)late : 0);
+    perfRecordUs(PERF_HIST_ZC_TO_GATE, now - zcTimestamp);
+
+    halDigitalWrite(DIMMER_PIN, true);
+    halDelayMicroseconds(PULSE_WIDTH_US);
+    halDigitalWrite(DIMMER_PIN, false);
+    pulseCount.fetch_add(1, std::memory_order_release);
+  }
+  perfEnd(PERF_PULSE_TIMER, perfStart);
+}
+
+// ============================================================================
+// TRIAC DRIVE INITIALIZATION
+// ============================================================================
+void initTriacDrive() {
+  halPinMode(DIMMER_PIN, HAL_PIN_OUTPUT);
+  halDigitalWrite(DIMMER_PIN, false);
+
+  dimmerLevel = 0;
+  initFiringPatterns();
+  publishControl(DIM_OFF, 0);
+  // Before the interrupt, so the ISR never sees a missing timer
+  pulseTimerHandle = halTimerCreate("triac_pulse", pulseTimerCallback, NULL);
+
+  halPinMode(ZERO_CROSS_PIN, HAL_PIN_INPUT_PULLUP);
+  // NOTE: Using RISING edge - if 100% gives low power, try FALLING
+  halAttachRisingInterrupt(ZERO_CROSS_PIN, zeroCrossISR);
+
+  consolePrintf("[TRIAC] Drive initialized: DIM pin LOW, ZC interrupt attached");
+  consolePrintf("[DIMMER] System initialized - OFF mode, ZC enabled");
+}
+
+// ============================================================================
+// SET TRIAC LEVEL
+// ============================================================================
+void setTriacLevel(int level) {
+  level = clampInt(level, 0, 100);
+  if (level > 0 && supervisorTripped()) {
+    // Held off until loop() has handled the trip
+    level = 0;
+  }
+  dimmerLevel = level;
+
+  if (pwmTestMode) {
+    // Direct PWM output (bypasses ZC)
+    int pwmValue = level * 255 / 100;
+    halPwmWrite(pwmValue);
+
+    consolePrintf("[DIMMER] PWM test mode - Level: %d%%, PWM value: %d", level, pwmValue);
+    return;
+  }
+
+  // PSM mode (Pulse-Skip Modulation)
+  if (level == 0) {
+    publishControl(DIM_OFF, 0);
+    if (pulseTimerHandle != NULL) {
+      halTimerStop(pulseTimerHandle);
+    }
+    halDigitalWrite(DIMMER_PIN, false);
+    offModeStartTime = halMillis();
+
+    consolePrintf("[PSM] Level 0%% - OFF mode (no pulses)");
+  } else if (publishTriacDuty(level)) {
+    consolePrintf("[PSM] Level %d%% - PSM mode (%d of 100 half-cycles)", level, level);
+  }
+}
+
+// PSM: duty percent selects the firing pattern; the ISR switches tables at
+// its current window position, so the pattern stays phase-continuous
+bool publishTriacDuty(int duty) {
+  uint32_t current = triacControlWord.load(std::memory_order_relaxed);
+  uint32_t next;
+  do {
+    // Checked on every retry: a trip that lands between load and CAS wins
+    if (current & TRIAC_CONTROL_FORCED_OFF) {
+      return false;
+    }
+    if ((current & TRIAC_CONTROL_ON) && (uint32_t)duty == (current & TRIAC_CONTROL_DUTY_MASK)) {
+      // Unchanged level (profile ticks every loop): nothing to publish or log
+      return false;
+    }
+    next = packControl(DIM_ON, duty, nextGeneration(current));
+  } while (!triacControlWord.compare_exchange_weak(current, next, std::memory_order_release, std::memory_order_relaxed));
+  return true;
+}
+
+// No timer stop needed: an armed gate pulse checks the word and is dropped,
+// and the next crossing fires nothing
+void forceTriacOff() {
+  uint32_t current = triacControlWord.load(std::memory_order_relaxed);
+  uint32_t next;
+  do {
+    next = packControl(DIM_OFF, 0, nextGeneration(current)) | TRIAC_CONTROL_FORCED_OFF;
+  } while (!triacControlWord.compare_exchange_weak(current, next, std::memory_order_release, std::memory_order_relaxed));
+  if (pwmTestMode) {
+    halPwmWrite(0);
+  }
+  halDigitalWrite(DIMMER_PIN, false);
+}
+
+void releaseTriacForcedOff() {
+  uint32_t current = triacControlWord.load(std::memory_order_relaxed);
+  uint32_t next;
+  do {
+    if (!(current & TRIAC_CONTROL_FORCED_OFF)) {
+      return;
+    }
+    next = packControl(DIM_OFF, 0, nextGeneration(current));
+  } while (!triacControlWord.compare_exchange_weak(current, next, std::memory_order_release, std::memory_order_relaxed));
+}
+
+// PSM decision now happens entirely in ISR - no loop dependency
+
+// Wrapper for compatibility
+void setDimLevel(int level) {
+  setTriacLevel(level);
+}
+
+// Switches between direct PWM output (ZC detached) and normal PSM drive
+void setPwmTestMode(bool enable) {
+  // First, turn off dimmer
+  setDimLevel(0);
+
+  pwmTestMode = enable;
+
+  if (pwmTestMode) {
+    // Disable ZC interrupt, use direct PWM
+    halDetachInterrupt(ZERO_CROSS_PIN);
+    zcEnabled = false;
+
+    // Setup LEDC PWM channel (1kHz, 8-bit)
+    halPwmBegin(DIMMER_PIN, 1000, 8);
+  } else {
+    // Disable PWM, re-enable ZC
+    halPwmEnd(DIMMER_PIN);
+    halPinMode(DIMMER_PIN, HAL_PIN_OUTPUT);
+    halDigitalWrite(DIMMER_PIN, false);
+
+    halAttachRisingInterrupt(ZERO_CROSS_PIN, zeroCrossISR);
+    zcEnabled = true;
+  }
+}
+
+void setZeroCrossEnabled(bool enabled) {
+  zcEnabled = enabled;
+  if (enabled) {
+    halAttachRisingInterrupt(ZERO_CROSS_PIN, zeroCrossISR);
+  } else {
+    halDetachInterrupt(ZERO_CROSS_PIN);
+  }
+}
+
+// ============================================================================
+// SANITY TEST
+// ============================================================================
+static const int SANITY_LEVELS[] = {0, 50, 100};
+#define SANITY_PHASES ((int)(sizeof(SANITY_LEVELS) / sizeof(SANITY_LEVELS[0])))
+
+bool sanityTestRunning = false;
+static int sanityPhase = 0;
+static unsigned long sanityPhaseStartTime = 0;
+
+static void beginSanityPhase(int phase) {
+  sanityPhase = phase;
+  sanityPhaseStartTime = halMillis();
+  setDimLevel(SANITY_LEVELS[phase]);
+  logPrintf("debug", "[SANITY TEST] Phase %d: %d%%", phase + 1, SANITY_LEVELS[phase]);
+}
+
+void startSanityTest() {
+  sendLogMessage("[SANITY TEST] Starting: OFF→50%→100%→OFF", "info");
+  sanityTestRunning = true;
+  beginSanityPhase(0);
+
+  MessageDocument response(256);
+  response["status"] = "sanity_test_started";
+  response["phase_ms"] = SANITY_PHASE_MS;
+  sendResponse(response);
+}
+
+void sanityTestTick() {
+  if (!sanityTestRunning) return;
+  if (halMillis() - sanityPhaseStartTime < SANITY_PHASE_MS) return;
+  if (sanityPhase + 1 < SANITY_PHASES) {
+    beginSanityPhase(sanityPhase + 1);
+    return;
+  }
+
+  sanityTestRunning = false;
+  setDimLevel(0);
+  sendLogMessage("[SANITY TEST] Complete - dimmer OFF", "info");
+
+  MessageDocument response(256);
+  response["status"] = "sanity_test_complete";
+  sendResponse(response);
+}
+
+void stopSanityTest(const char* reason) {
+  if (!sanityTestRunning) return;
+
+  sanityTestRunning = false;
+  setDimLevel(0);
+  logPrintf("warn", "[SANITY TEST] Aborted in phase %d: %s", sanityPhase + 1, reason);
+  MessageDocument response(256);
+  response["status"] = "sanity_test_aborted";
+  response["phase"] = sanityPhase + 1;
+  response["reason"] = reason;
+  sendResponse(response);
+}
+
+// ============================================================================
+// PRINT TRIAC STATS
+// ============================================================================
+void printTriacStats() {
+  static unsigned long lastPrint = 0;
+
+  if (halMillis() - lastPrint < 1000) return;  // Every 1 second
+
+  // Calculate rates
+  TriacStats triacStats;
+  readTriacStats(&triacStats);
+  unsigned long currentZc = triacStats.zcCount;
+  unsigned long currentFired = triacStats.firedCount;
+  float zcPerSec = (currentZc - psmLastZcCount) / 1.0f;
+  float firedPerSec = (currentFired - psmLastFiredCount) / 1.0f;
+  psmLastZcCount = currentZc;
+  psmLastFiredCount = currentFired;
+  lastPrint = halMillis();
+
+  // Calculate actual duty
+  float actualDuty = (zcPerSec > 0) ? (firedPerSec / zcPerSec * 100.0f) : 0.0f;
+
+  TriacControl control = readTriacControl();
+  const char* modeStr = pwmTestMode ? "PWM_TEST" : (control.mode == DIM_OFF ? "OFF" : "PSM");
+
+  // Build stats string
+  char stats[160];
+  int len = snprintf(stats, sizeof(stats), "[PSM STATS] Mode: %s, Duty: %d%%, ZC/s: %.0f, Fired/s: %.0f, Actual: %.1f%%",
+                     modeStr, control.duty, zcPerSec, firedPerSec, actualDuty);
+
+  if (zcEnabled && triacStats.zcIntervalUs > 0 && len > 0 && len < (int)sizeof(stats)) {
+    snprintf(stats + len, sizeof(stats) - len, ", ZC int: %luµs", (unsigned long)triacStats.zcIntervalUs);
+  }
+
+  // Print to Serial AND send via BLE (if subscribed)
+  sendTopicLog(TOPIC_TRIAC_STATS, stats, "debug");
+}
@@ -0,0 +1,530 @@
+#include "ws_server.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <ArduinoJson.h>
+
+#include "commands.h"
+#include "hal.h"
+#include "messaging.h"
+#include "network.h"
+#include "status_publisher.h"
+
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+
+#define WS_CLOSE_PROTOCOL_ERROR 1002
+#define WS_CLOSE_TOO_BIG 1009
+
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+enum WsClientState {
+  WS_FREE = 0,
+  WS_HTTP,      // Waiting for the request
+  WS_OPEN,      // Upgraded
+  WS_CLOSING    // Sending what is queued, then closing
+};
+
+struct WsClient {
+  int socket;
+  uint8_t state;
+  unsigned long stateSince;
+  uint8_t rx[WS_RX_BUFFER + 1];   // +1: a text frame is terminated in place
+  size_t rxLength;
+  uint8_t tx[WS_TX_QUEUE_BYTES];  // Ring; appended under the transport lock
+  size_t txHead;
+  size_t txCount;
+  uint32_t sent;
+  uint32_t dropped;
+};
+
+uint16_t wsServerPort = WS_SERVER_PORT;
+
+static int wsListener = -1;
+static unsigned long wsLastListenAttempt = 0;
+static bool wsListenAttempted = false;
+static WsClient wsClients[WS_MAX_CLIENTS];
+
+// ============================================================================
+// HANDSHAKE (SHA-1 + base64 of the client key)
+// ============================================================================
+static uint32_t rol(uint32_t value, int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1Block(uint32_t* h, const uint8_t* block) {
+  uint32_t w[80];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) |
+           ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+  }
+  for (int i = 16; i < 80; i++) {
+    w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+  for (int i = 0; i < 80; i++) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    uint32_t t = rol(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = rol(b, 30);
+    b = a;
+    a = t;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+}
+
+static void sha1(const uint8_t* data, size_t len, uint8_t* digest) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  size_t done = 0;
+  for (; done + 64 <= len; done += 64) {
+    sha1Block(h, data + done);
+  }
+
+  // Padding: 0x80, zeros, bit length (big-endian) in the last 8 bytes
+  uint8_t tail[128];
+  size_t rest = len - done;
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, data + done, rest);
+  tail[rest] = 0x80;
+  size_t tailLength = rest + 9 <= 64 ? 64 : 128;
+  uint64_t bits = (uint64_t)len * 8;
+  for (int i = 0; i < 8; i++) {
+    tail[tailLength - 1 - i] = (uint8_t)(bits >> (8 * i));
+  }
+  for (size_t i = 0; i < tailLength; i += 64) {
+    sha1Block(h, tail + i);
+  }
+
+  for (int i = 0; i < 5; i++) {
+    digest[4 * i] = (uint8_t)(h[i] >> 24);
+    digest[4 * i + 1] = (uint8_t)(h[i] >> 16);
+    digest[4 * i + 2] = (uint8_t)(h[i] >> 8);
+    digest[4 * i + 3] = (uint8_t)h[i];
+  }
+}
+
+static void base64(const uint8_t* data, size_t len, char* out) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t o = 0;
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t chunk = (uint32_t)data[i] << 16;
+    if (i + 1 < len) chunk |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < len) chunk |= data[i + 2];
+    out[o++] = alphabet[(chunk >> 18) & 0x3F];
+    out[o++] = alphabet[(chunk >> 12) & 0x3F];
+    out[o++] = i + 1 < len ? alphabet[(chunk >> 6) & 0x3F] : '=';
+    out[o++] = i + 2 < len ? alphabet[chunk & 0x3F] : '=';
+  }
+  out[o] = '\0';
+}
+
+// Value of a request header (case-insensitive name), false if missing
+static bool findHeader(const char* request, const char* name, char* value, size_t valueSize) {
+  size_t nameLength = strlen(name);
+  const char* line = strstr(request, "\r\n");
+  while (line != NULL) {
+    line += 2;
+    if (strncasecmp(line, name, nameLength) == 0 && line[nameLength] == ':') {
+      const char* start = line + nameLength + 1;
+      while (*start == ' ') start++;
+      const char* end = strstr(start, "\r\n");
+      size_t length = end ? (size_t)(end - start) : strlen(start);
+      if (length >= valueSize) return false;
+      memcpy(value, start, length);
+      value[length] = '\0';
+      return true;
+    }
+    line = strstr(line, "\r\n");
+  }
+  return false;
+}
+
+// ============================================================================
+// SEND QUEUE
+// ============================================================================
+static void closeClient(WsClient& client) {
+  halTransportLock();
+  client.state = WS_FREE;
+  halTransportUnlock();
+  halTcpClose(client.socket);
+  client.socket = -1;
+}
+
+// Caller holds the transport lock and has checked the space
+static void queueBytes(WsClient& client, const uint8_t* data, size_t len) {
+  size_t tail = (client.txHead + client.txCount) % WS_TX_QUEUE_BYTES;
+  size_t first = WS_TX_QUEUE_BYTES - tail;
+  if (first > len) first = len;
+  memcpy(client.tx + tail, data, first);
+  memcpy(client.tx, data + first, len - first);
+  client.txCount += len;
+}
+
+// Whole message or nothing; never waits for the socket
+static bool queueMessage(WsClient& client, const uint8_t* data, size_t len) {
+  bool queued = false;
+  halTransportLock();
+  if (len <= WS_TX_QUEUE_BYTES - client.txCount) {
+    queueBytes(client, data, len);
+    client.sent++;
+    queued = true;
+  } else {
+    client.dropped++;
+  }
+  halTransportUnlock();
+  return queued;
+}
+
+static bool queueFrame(WsClient& client, uint8_t opcode, const uint8_t* data, size_t len) {
+  uint8_t header[4];
+  size_t headerLength = 2;
+  header[0] = 0x80 | opcode;
+  if (len < 126) {
+    header[1] = (uint8_t)len;
+  } else if (len <= 0xFFFF) {
+    header[1] = 126;
+    header[2] = (uint8_t)(len >> 8);
+    header[3] = (uint8_t)len;
+    headerLength = 4;
+  } else {
+    client.dropped++;
+    return false;
+  }
+
+  bool queued = false;
+  halTransportLock();
+  if (headerLength + len <= WS_TX_QUEUE_BYTES - client.txCount) {
+    queueBytes(client, header, headerLength);
+    queueBytes(client, data, len);
+    client.sent++;
+    queued = true;
+  } else {
+    client.dropped++;
+  }
+  halTransportUnlock();
+  return queued;
+}
+
+static void closeWithStatus(WsClient& client, uint16_t code) {
+  uint8_t payload[2] = {(uint8_t)(code >> 8), (uint8_t)code};
+  queueFrame(client, WS_OPCODE_CLOSE, payload, sizeof(payload));
+  client.state = WS_CLOSING;
+  client.stateSince = halMillis();
+}
+
+static void flushClient(WsClient& client) {
+  for (;;) {
+    halTransportLock();
+    size_t head = client.txHead;
+    size_t count = client.txCount;
+    halTransportUnlock();
+    if (count == 0) break;
+
+    // Producers only append, so [head, head + chunk) is stable here
+    size_t chunk = WS_TX_QUEUE_BYTES - head;
+    if (chunk > count) chunk = count;
+    int written = halTcpWrite(client.socket, client.tx + head, chunk);
+    if (written < 0) {
+      closeClient(client);
+      return;
+    }
+    if (written == 0) return;
+
+    halTransportLock();
+    client.txHead = (client.txHead + written) % WS_TX_QUEUE_BYTES;
+    client.txCount -= written;
+    halTransportUnlock();
+  }
+  if (client.state == WS_CLOSING) {
+    closeClient(client);
+  }
+}
+
+// ============================================================================
+// RECEIVE
+// ============================================================================
+static void consumeRx(WsClient& client, size_t len) {
+  memmove(client.rx, client.rx + len, client.rxLength - len);
+  client.rxLength -= len;
+}
+
+static void sendHttp(WsClient& client, const char* status, const char* body) {
+  char response[256];
+  int length = snprintf(response, sizeof(response),
+                        "HTTP/1.1 %s\r\nContent-Type: application/json\r\nContent-Length: %u\r\n"
+                        "Connection: close\r\n\r\n%s",
+                        status, (unsigned)strlen(body), body);
+  queueMessage(client, (const uint8_t*)response, (size_t)length);
+  client.state = WS_CLOSING;
+  client.stateSince = halMillis();
+}
+
+static void handleHttpRequest(WsClient& client) {
+  client.rx[client.rxLength] = '\0';
+  char* request = (char*)client.rx;
+  char* end = strstr(request, "\r\n\r\n");
+  if (end == NULL) {
+    if (client.rxLength == WS_RX_BUFFER) {
+      sendHttp(client, "431 Request Header Fields Too Large", "{\"error\":\"Request too large\"}");
+    }
+    return;
+  }
+  end[2] = '\0';  // Headers only; frames may follow the blank line
+
+  if (strncmp(request, "GET ", 4) != 0) {
+    sendHttp(client, "405 Method Not Allowed", "{\"error\":\"GET only\"}");
+    return;
+  }
+
+  char key[64 + sizeof(WS_GUID)];
+  if (!findHeader(request, "Sec-WebSocket-Key", key, 64)) {
+    if (strncmp(request + 4, "/ ", 2) == 0) {
+      sendHttp(client, "200 OK", "{\"device\":\"modspresso\",\"websocket\":\"/ws\"}");
+    } else {
+      sendHttp(client, "404 Not Found", "{\"error\":\"Not found\"}");
+    }
+    return;
+  }
+
+  uint8_t digest[20];
+  char accept[32];
+  strcat(key, WS_GUID);
+  sha1((const uint8_t*)key, strlen(key), digest);
+  base64(digest, sizeof(digest), accept);
+
+  char response[160];
+  int length = snprintf(response, sizeof(response),
+                        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: %s\r\n\r\n",
+                        accept);
+  consumeRx(client, (size_t)(end + 4 - request));
+  queueMessage(client, (const uint8_t*)response, (size_t)length);
+
+  halTransportLock();
+  client.state = WS_OPEN;
+  halTransportUnlock();
+  client.stateSince = halMillis();
+  logPrintf("info", "WebSocket client connected (%d open)", wsServerClientCount());
+  int messageClient = MESSAGE_CLIENT_WS + (int)(&client - wsClients);
+  resetSubscriptions(messageClient);  // Full rate on every stream until it subscribes
+  resetStatusClient(messageClient);
+  sendStatusUpdate(1 << messageClient);
+}
+
+// One complete client frame; false when more bytes are needed or it closed
+static bool handleFrame(WsClient& client) {
+  if (client.rxLength < 2) return false;
+
+  uint8_t* rx = client.rx;
+  uint8_t opcode = rx[0] & 0x0F;
+  bool final = (rx[0] & 0x80) != 0;
+  bool masked = (rx[1] & 0x80) != 0;
+  size_t length = rx[1] & 0x7F;
+  size_t offset = 2;
+  if (length == 126) {
+    if (client.rxLength < 4) return false;
+    length = ((size_t)rx[2] << 8) | rx[3];
+    offset = 4;
+  } else if (length == 127) {
+    closeWithStatus(client, WS_CLOSE_TOO_BIG);
+    return false;
+  }
+
+  // Clients must mask; commands are small enough not to need fragments
+  if (!masked || !final) {
+    closeWithStatus(client, WS_CLOSE_PROTOCOL_ERROR);
+    return false;
+  }
+  size_t frameLength = offset + 4 + length;
+  if (frameLength > WS_RX_BUFFER) {
+    closeWithStatus(client, WS_CLOSE_TOO_BIG);
+    return false;
+  }
+  if (client.rxLength < frameLength) return false;
+
+  const uint8_t* mask = rx + offset;
+  uint8_t* payload = rx + offset + 4;
+  for (size_t i = 0; i < length; i++) {
+    payload[i] ^= mask[i & 3];
+  }
+
+  switch (opcode) {
+    case WS_OPCODE_TEXT: {
+      uint8_t next = payload[length];
+      payload[length] = '\0';
+      handleClientCommand(MESSAGE_CLIENT_WS + (int)(&client - wsClients), (const char*)payload);
+      payload[length] = next;
+      break;
+    }
+    case WS_OPCODE_PING:
+      queueFrame(client, WS_OPCODE_PONG, payload, length);
+      break;
+    case WS_OPCODE_CLOSE:
+      queueFrame(client, WS_OPCODE_CLOSE, payload, length < 2 ? length : 2);
+      client.state = WS_CLOSING;
+      client.stateSince = halMillis();
+      break;
+    default:
+      // Binary and pong frames carry nothing for us
+      break;
+  }
+  consumeRx(client, frameLength);
+  return client.state == WS_OPEN;
+}
+
+static void readClient(WsClient& client) {
+  int received = halTcpRead(client.socket, client.rx + client.rxLength, WS_RX_BUFFER - client.rxLength);
+  if (received < 0) {
+    closeClient(client);
+    return;
+  }
+  client.rxLength += received;
+
+  if (client.state == WS_HTTP) {
+    handleHttpRequest(client);
+  }
+  while (client.state == WS_OPEN && handleFrame(client)) {
+  }
+}
+
+// ============================================================================
+// SERVER
+// ============================================================================
+static void stopServer() {
+  for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+    if (wsClients[i].state != WS_FREE) {
+      closeClient(wsClients[i]);
+    }
+  }
+  halTcpClose(wsListener);
+  wsListener = -1;
+  wsListenAttempted = false;
+  consolePrintf("WebSocket server stopped");
+}
+
+static void acceptClients() {
+  int socket;
+  while ((socket = halTcpAccept(wsListener)) >= 0) {
+    WsClient* client = NULL;
+    for (int i = 0; i < WS_MAX_CLIENTS && client == NULL; i++) {
+      if (wsClients[i].state == WS_FREE) client = &wsClients[i];
+    }
+    if (client == NULL) {
+      consolePrintf("WebSocket server full, connection refused");
+      halTcpClose(socket);
+      continue;
+    }
+    client->socket = socket;
+    client->stateSince = halMillis();
+    client->rxLength = 0;
+    halTransportLock();
+    client->txHead = 0;
+    client->txCount = 0;
+    client->sent = 0;
+    client->dropped = 0;
+    client->state = WS_HTTP;
+    halTransportUnlock();
+  }
+}
+
+void wsServerTick() {
+  if (!wifiConnected) {
+    if (wsListener >= 0) stopServer();
+    return;
+  }
+
+  unsigned long now = halMillis();
+  if (wsListener < 0) {
+    if (wsListenAttempted && now - wsLastListenAttempt < WS_LISTEN_RETRY_MS) return;
+    wsListenAttempted = true;
+    wsLastListenAttempt = now;
+    wsListener = halTcpListen(wsServerPort);
+    if (wsListener < 0) {
+      logPrintf("warn", "WebSocket server could not listen on port %u", (unsigned)wsServerPort);
+      return;
+    }
+    logPrintf("info", "WebSocket server listening on port %u", (unsigned)wsServerPort);
+  }
+
+  acceptClients();
+  for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+    WsClient& client = wsClients[i];
+    if (client.state == WS_FREE) continue;
+    if (client.state != WS_OPEN && now - client.stateSince > WS_HANDSHAKE_TIMEOUT_MS) {
+      closeClient(client);
+      continue;
+    }
+    if (client.state != WS_CLOSING) {
+      readClient(client);
+    }
+    if (client.state != WS_FREE) {
+      flushClient(client);
+    }
+  }
+}
+
+int wsServerClientCount() {
+  int count = 0;
+  for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+    if (wsClients[i].state == WS_OPEN) count++;
+  }
+  return count;
+}
+
+bool wsServerClientOpen(int slot) {
+  return slot >= 0 && slot < WS_MAX_CLIENTS && wsClients[slot].state == WS_OPEN;
+}
+
+bool wsServerSend(int slot, bool binary, const uint8_t* data, size_t len) {
+  if (!wsServerClientOpen(slot)) return false;
+  return queueFrame(wsClients[slot], binary ? WS_OPCODE_BINARY : WS_OPCODE_TEXT, data, len);
+}
+
+void wsServerBroadcast(bool binary, const uint8_t* data, size_t len) {
+  for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+    if (wsClients[i].state == WS_OPEN) {
+      queueFrame(wsClients[i], binary ? WS_OPCODE_BINARY : WS_OPCODE_TEXT, data, len);
+    }
+  }
+}
+
+void sendWsServerStatus() {
+  MessageDocument response(512);
+  response["type"] = "ws_server";
+  response["listening"] = wsListener >= 0;
+  response["port"] = wsServerPort;
+  JsonArray clients = response.createNestedArray("clients");
+  for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+    const WsClient& client = wsClients[i];
+    if (client.state != WS_OPEN) continue;
+    JsonObject entry = clients.createNestedObject();
+    entry["queued"] = client.txCount;
+    entry["sent"] = client.sent;
+    entry["dropped"] = client.dropped;
+  }
+  sendResponse(response);
+}
@@ -0,0 +1,114 @@
+// Calibration model: monotone fit, outlier rejection and the inverse
+//   pio test -e native -f test_calibration_model
+
+#include <unity.h>
+
+#include "calibration_model.h"
+
+#define GRID_POINTS 21                  // 0, 5, ..., 100 %
+
+static float levels[GRID_POINTS];
+static float pressures[GRID_POINTS];
+static bool valid[GRID_POINTS];
+
+// Pump curve shape: nothing below 20 %, then rising and flattening out
+static float pumpCurve(float level) {
+  if (level <= 20.0f) return 0.0f;
+  float x = (level - 20.0f) / 80.0f;
+  return 11.0f * x * (2.0f - x);
+}
+
+void setUp() {
+  for (int i = 0; i < GRID_POINTS; i++) {
+    levels[i] = i * 5.0f;
+    pressures[i] = pumpCurve(levels[i]);
+    valid[i] = true;
+  }
+}
+
+void tearDown() {
+}
+
+void test_fit_passes_through_clean_points() {
+  CalibrationModel model;
+  TEST_ASSERT_TRUE(model.fit(levels, pressures, valid, GRID_POINTS));
+  TEST_ASSERT_TRUE(model.isValid());
+  TEST_ASSERT_EQUAL_UINT8(GRID_POINTS, model.quality().usedPoints);
+  TEST_ASSERT_EQUAL_UINT8(0, model.quality().outliers);
+  for (int i = 0; i < GRID_POINTS; i++) {
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, pressures[i], model.pressureAt(levels[i]));
+  }
+}
+
+void test_fit_is_monotone() {
+  // Sensor noise that makes the raw grid dip in two places
+  pressures[10] -= 0.9f;
+  pressures[15] += 0.6f;
+  CalibrationModel model;
+  TEST_ASSERT_TRUE(model.fit(levels, pressures, valid, GRID_POINTS));
+  TEST_ASSERT_TRUE(model.quality().pooledPoints > 0);
+
+  float previous = model.pressureAt(0.0f);
+  for (float level = 0.5f; level <= 100.0f; level += 0.5f) {
+    float pressure = model.pressureAt(level);
+    TEST_ASSERT_TRUE(pressure >= previous - 1e-5f);
+    previous = pressure;
+  }
+}
+
+void test_rejects_outlier() {
+  pressures[12] += 4.0f;
+  CalibrationModel model;
+  TEST_ASSERT_TRUE(model.fit(levels, pressures, valid, GRID_POINTS));
+  TEST_ASSERT_EQUAL_UINT8(1, model.quality().outliers);
+  TEST_ASSERT_EQUAL_UINT32(1UL << 12, model.quality().outlierMask);
+  TEST_ASSERT_FLOAT_WITHIN(0.3f, pumpCurve(60.0f), model.pressureAt(60.0f));
+}
+
+void test_ignores_invalid_points() {
+  pressures[8] = 50.0f;
+  valid[8] = false;
+  CalibrationModel model;
+  TEST_ASSERT_TRUE(model.fit(levels, pressures, valid, GRID_POINTS));
+  TEST_ASSERT_EQUAL_UINT8(GRID_POINTS - 1, model.quality().usedPoints);
+  TEST_ASSERT_TRUE(model.pressureAt(40.0f) < 5.0f);
+}
+
+void test_needs_two_points() {
+  for (int i = 1; i < GRID_POINTS; i++) valid[i] = false;
+  CalibrationModel model;
+  TEST_ASSERT_FALSE(model.fit(levels, pressures, valid, GRID_POINTS));
+  TEST_ASSERT_FALSE(model.isValid());
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, model.levelFor(5.0f));
+}
+
+void test_inverse_round_trip() {
+  CalibrationModel model;
+  TEST_ASSERT_TRUE(model.fit(levels, pressures, valid, GRID_POINTS));
+  for (float bar = 0.5f; bar < model.maxPressure(); bar += 0.25f) {
+    float level = model.levelFor(bar);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, bar, model.pressureAt(level));
+  }
+}
+
+void test_inverse_is_smallest_level() {
+  CalibrationModel model;
+  TEST_ASSERT_TRUE(model.fit(levels, pressures, valid, GRID_POINTS));
+  // Flat at 0 bar up to 20 %: the inverse of 0 bar is the bottom of the flat
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, model.levelFor(0.0f));
+  TEST_ASSERT_TRUE(model.levelFor(0.1f) > 20.0f);
+  // Beyond the curve: full level
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 100.0f, model.levelFor(model.maxPressure() + 1.0f));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fit_passes_through_clean_points);
+  RUN_TEST(test_fit_is_monotone);
+  RUN_TEST(test_rejects_outlier);
+  RUN_TEST(test_ignores_invalid_points);
+  RUN_TEST(test_needs_two_points);
+  RUN_TEST(test_inverse_round_trip);
+  RUN_TEST(test_inverse_is_smallest_level);
+  return UNITY_END();
+}
@@ -0,0 +1,204 @@
+// Command dispatch: single commands, short names and batches, checked on the
+// responses the transport receives
+//   pio test -e native -f test_commands
+
+#include <string.h>
+
+#include <unity.h>
+
+#include "app.h"
+#include "commands.h"
+#include "flow_estimator.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "message_pool.h"
+#include "messaging.h"
+#include "profiles.h"
+#include "triac.h"
+
+#define TEST_PROFILE "{\"name\":\"flat\",\"segments\":[{\"startTime\":0,\"endTime\":20,\"startPressure\":9,\"endPressure\":9}]}"
+
+static char lastResponse[1024];
+static int responseCount = 0;
+
+static void captureResponse(HalChannel channel, const uint8_t* data, size_t len, void* ctx) {
+  if (channel != HAL_CHANNEL_RESPONSE || len >= sizeof(lastResponse)) return;
+  memcpy(lastResponse, data, len);
+  lastResponse[len] = '\0';
+  responseCount++;
+}
+
+static void command(const char* json) {
+  responseCount = 0;
+  lastResponse[0] = '\0';
+  handleCommand(json);
+}
+
+// Last response of the command into doc
+static void parseReply(JsonDocument& doc) {
+  TEST_ASSERT_TRUE(responseCount > 0);
+  TEST_ASSERT_TRUE(deserializeJson(doc, lastResponse) == DeserializationError::Ok);
+}
+
+void setUp() {
+  command("{\"command\":\"clear_all_profiles\"}");
+}
+
+void tearDown() {
+}
+
+void test_full_and_short_names() {
+  MessageDocument reply(1024);
+  command("{\"command\":\"seek\"}");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("seek_error", reply["status"] | "");
+  TEST_ASSERT_EQUAL_STRING("time not provided", reply["error"] | "");
+
+  command("{\"cmd\":\"seek\",\"time\":3}");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("seek_error", reply["status"] | "");
+  TEST_ASSERT_EQUAL_STRING("No profile running", reply["error"] | "");
+}
+
+void test_store_and_set_default() {
+  command("{\"command\":\"store_profile\",\"id\":0,\"profile\":" TEST_PROFILE "}");
+  TEST_ASSERT_TRUE(profileSlotUsed(0));
+  TEST_ASSERT_EQUAL_STRING("flat", storedProfiles[0].name);
+  TEST_ASSERT_EQUAL_UINT8(20, storedProfiles[0].totalDuration);
+
+  MessageDocument reply(1024);
+  command("{\"command\":\"set_default_profile\",\"button\":1,\"profileId\":0}");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("default_profile_set", reply["status"] | "");
+  TEST_ASSERT_EQUAL_UINT8(0, defaultProfile1);
+}
+
+void test_unknown_command_answers_error() {
+  MessageDocument reply(1024);
+  command("{\"command\":\"no_such_command\"}");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("error", reply["status"] | "");
+  TEST_ASSERT_EQUAL_STRING("unknown command", reply["error"] | "");
+}
+
+void test_oversized_response_answers_error() {
+  char text[MAX_MESSAGE_LENGTH];
+  memset(text, 'x', sizeof(text) - 1);
+  text[sizeof(text) - 1] = '\0';
+  MessageDocument response(1024);
+  response["type"] = "oversized";
+  response["text"] = text;
+  responseCount = 0;
+  sendResponse(response);
+
+  MessageDocument reply(1024);
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("error", reply["status"] | "");
+  TEST_ASSERT_EQUAL_STRING("response too long", reply["error"] | "");
+  TEST_ASSERT_EQUAL_STRING("oversized", reply["response"] | "");
+}
+
+void test_invalid_json_is_ignored() {
+  command("{\"command\":");
+  TEST_ASSERT_EQUAL_INT(0, responseCount);
+}
+
+void test_batch_applies_all() {
+  MessageDocument reply(1024);
+  command("[{\"command\":\"store_profile\",\"id\":0,\"profile\":" TEST_PROFILE "},"
+          "{\"command\":\"set_default_profile\",\"button\":2,\"profileId\":0}]");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("batch_done", reply["status"] | "");
+  TEST_ASSERT_TRUE(reply["applied"] | false);
+  TEST_ASSERT_EQUAL_STRING("ok", reply["results"][0] | "");
+  TEST_ASSERT_EQUAL_STRING("default_profile_set", reply["results"][1] | "");
+  TEST_ASSERT_TRUE(profileSlotUsed(0));
+  TEST_ASSERT_EQUAL_UINT8(0, defaultProfile2);
+}
+
+void test_batch_rolls_back_on_failure() {
+  MessageDocument reply(1024);
+  command("[{\"command\":\"store_profile\",\"id\":1,\"profile\":" TEST_PROFILE "},"
+          "{\"command\":\"set_default_profile\",\"button\":1,\"profileId\":12}]");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("batch_done", reply["status"] | "");
+  TEST_ASSERT_FALSE(reply["applied"] | true);
+  TEST_ASSERT_EQUAL_INT(1, reply["failed"] | -1);
+  TEST_ASSERT_FALSE(profileSlotUsed(1));
+}
+
+void test_batch_refuses_non_transactional() {
+  MessageDocument reply(1024);
+  command("[{\"command\":\"store_profile\",\"id\":2,\"profile\":" TEST_PROFILE "},"
+          "{\"command\":\"set_dim_level\",\"level\":50}]");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("batch_error", reply["status"] | "");
+  TEST_ASSERT_EQUAL_INT(1, reply["failed"] | -1);
+  TEST_ASSERT_FALSE(profileSlotUsed(2));
+  TEST_ASSERT_EQUAL_UINT8(0, readTriacControl().duty);
+}
+
+void test_batch_refuses_settings() {
+  MessageDocument reply(1024);
+  float strokeMl = flowModel.strokeMl;
+  command("[{\"command\":\"get_profile_status\"},"
+          "{\"command\":\"set_flow_model\",\"stroke_ml\":0.5}]");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("batch_error", reply["status"] | "");
+  TEST_ASSERT_EQUAL_INT(1, reply["failed"] | -1);
+  TEST_ASSERT_EQUAL_INT(1, responseCount);
+  TEST_ASSERT_EQUAL_FLOAT(strokeMl, flowModel.strokeMl);
+}
+
+// A phase changes on the first tick SANITY_PHASE_MS after the last, never
+// in a blocking wait
+static void sanityPhaseAt(uint64_t startUs, int phase, int before, int after) {
+  halNativeSetTimeUs(startUs + (uint64_t)phase * SANITY_PHASE_MS * 1000 - 1000);
+  sanityTestTick();
+  TEST_ASSERT_EQUAL_UINT8(before, readTriacControl().duty);
+  halNativeSetTimeUs(startUs + (uint64_t)phase * SANITY_PHASE_MS * 1000);
+  sanityTestTick();
+  TEST_ASSERT_EQUAL_UINT8(after, readTriacControl().duty);
+}
+
+void test_sanity_test_steps_from_loop() {
+  MessageDocument reply(1024);
+  uint64_t startUs = halNativeTimeUs();
+  command("{\"command\":\"sanity_test\"}");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("sanity_test_started", reply["status"] | "");
+  TEST_ASSERT_TRUE(sanityTestRunning);
+
+  command("{\"command\":\"sanity_test\"}");
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("sanity_test_error", reply["status"] | "");
+
+  sanityPhaseAt(startUs, 1, 0, 50);
+  sanityPhaseAt(startUs, 2, 50, 100);
+  responseCount = 0;
+  sanityPhaseAt(startUs, 3, 100, 0);
+  parseReply(reply);
+  TEST_ASSERT_EQUAL_STRING("sanity_test_complete", reply["status"] | "");
+  TEST_ASSERT_FALSE(sanityTestRunning);
+}
+
+int main(int argc, char** argv) {
+  halNativeUseManualClock(true);
+  halNativeSetTimeUs(0);
+  halNativeOnTransport(captureResponse, NULL);
+  halConsoleSetEnabled(false);
+  appSetup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_full_and_short_names);
+  RUN_TEST(test_store_and_set_default);
+  RUN_TEST(test_unknown_command_answers_error);
+  RUN_TEST(test_oversized_response_answers_error);
+  RUN_TEST(test_invalid_json_is_ignored);
+  RUN_TEST(test_batch_applies_all);
+  RUN_TEST(test_batch_rolls_back_on_failure);
+  RUN_TEST(test_batch_refuses_non_transactional);
+  RUN_TEST(test_batch_refuses_settings);
+  RUN_TEST(test_sanity_test_steps_from_loop);
+  return UNITY_END();
+}
@@ -0,0 +1,90 @@
+// get_perf_stats: one perf_stats response whose pages each fit one
+// notification, even with each counter and histogram bucket at its 32-bit
+// maximum
+//   pio test -e native -f test_perf_stats
+
+#include <string.h>
+
+#include <unity.h>
+
+#include "app.h"
+#include "commands.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "message_pool.h"
+#include "messaging.h"
+#include "perf_stats.h"
+
+static int perfMessages = 0;
+static bool sawDone = false;
+static size_t longestMessage = 0;
+static int statsKeys = 0;               // Members of "stats" over all pages
+
+static void captureResponse(HalChannel channel, const uint8_t* data, size_t len, void* ctx) {
+  if (channel != HAL_CHANNEL_RESPONSE) return;
+  if (len > longestMessage) longestMessage = len;
+
+  MessageDocument doc(2048);
+  if (deserializeJson(doc, (const char*)data, len) != DeserializationError::Ok) return;
+  if (strcmp(doc["type"] | "", "perf_stats") != 0) return;
+  perfMessages++;
+  // A single page has no "done"; the last of several has
+  if (doc["done"] | !doc.containsKey("page")) sawDone = true;
+  statsKeys += doc["stats"].size();
+}
+
+static void saturateCounters() {
+  for (int i = 0; i < PERF_SECTION_COUNT; i++) {
+    perfCounters[i].count = 0xFFFFFFFFu;
+    perfCounters[i].maxCycles = 0xFFFFFFFFu;
+    perfCounters[i].totalCycles = 0xFFFFFFFFFFFFFFFFull;
+  }
+  for (int i = 0; i < PERF_HISTOGRAM_COUNT; i++) {
+    for (int b = 0; b < PERF_HISTOGRAM_BUCKETS; b++) {
+      perfHistograms[i].buckets[b] = 0xFFFFFFFFu;
+    }
+    perfHistograms[i].maxUs = 0xFFFFFFFFu;
+  }
+}
+
+void setUp() {
+  perfMessages = 0;
+  sawDone = false;
+  longestMessage = 0;
+  statsKeys = 0;
+}
+
+void tearDown() {
+}
+
+// Sections, histograms, heap, pool and stack_free
+#define PERF_STATS_KEYS (PERF_SECTION_COUNT + PERF_HISTOGRAM_COUNT + 3)
+
+void test_pages_fit_one_notification() {
+  saturateCounters();
+  handleCommand("{\"command\":\"get_perf_stats\"}");
+  TEST_ASSERT_TRUE(perfMessages > 1);
+  TEST_ASSERT_TRUE(sawDone);
+  TEST_ASSERT_EQUAL_INT(PERF_STATS_KEYS, statsKeys);
+  TEST_ASSERT_TRUE(longestMessage <= MAX_MESSAGE_LENGTH);
+}
+
+void test_reset_clears_counters() {
+  saturateCounters();
+  handleCommand("{\"command\":\"get_perf_stats\",\"reset\":true}");
+  TEST_ASSERT_TRUE(sawDone);
+  TEST_ASSERT_EQUAL_UINT32(0, perfHistograms[PERF_HIST_LOOP_PERIOD].maxUs);
+}
+
+int main(int argc, char** argv) {
+  halNativeUseManualClock(true);
+  halNativeSetTimeUs(0);
+  halNativeOnTransport(captureResponse, NULL);
+  halConsoleSetEnabled(false);
+  appSetup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_pages_fit_one_notification);
+  RUN_TEST(test_reset_clears_counters);
+  return UNITY_END();
+}
@@ -0,0 +1,120 @@
+// Profile timeline: segment lookup, interpolation, gaps and seeking on the
+// manual clock
+//   pio test -e native -f test_profile_timeline
+
+#include <unity.h>
+
+#include "app.h"
+#include "hal.h"
+#include "hal_native.h"
+#include "message_pool.h"
+#include "profile_engine.h"
+
+static uint64_t profileStartUs = 0;
+
+static void discardNotification(HalChannel channel, const uint8_t* data, size_t len, void* ctx) {
+}
+
+static void startJsonProfile(const char* json) {
+  MessageDocument doc(1024);
+  TEST_ASSERT_TRUE(deserializeJson(doc, json) == DeserializationError::Ok);
+  profileStartUs = halNativeTimeUs();
+  startProfile(doc.as<JsonObject>());
+  TEST_ASSERT_TRUE(isRunning);
+}
+
+// Runs one control tick ms into the profile and returns its pressure target
+static float targetAt(uint32_t ms) {
+  halNativeSetTimeUs(profileStartUs + (uint64_t)ms * 1000);
+  executeProfile();
+  return currentTargetPressure;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+  stopProfile();
+  halNativeSetTimeUs(halNativeTimeUs() + 1000000);
+}
+
+void test_ramp_interpolates() {
+  startJsonProfile("{\"name\":\"ramp\",\"segments\":[{\"startTime\":0,\"endTime\":10,\"startPressure\":2,\"endPressure\":9}]}");
+  TEST_ASSERT_EQUAL_INT(1, totalSegments);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 2.0f, targetAt(0));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 5.5f, targetAt(5000));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 8.3f, targetAt(9000));
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 9.0f, targetAt(10000));
+}
+
+void test_gap_holds_previous_end() {
+  startJsonProfile(
+      "{\"segments\":[{\"st\":0,\"et\":5,\"sp\":3,\"ep\":3},"
+      "{\"st\":8,\"et\":12,\"sp\":6,\"ep\":6}]}");
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 3.0f, targetAt(6500));
+  TEST_ASSERT_EQUAL_INT(0, currentSegment);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 6.0f, targetAt(9000));
+  TEST_ASSERT_EQUAL_INT(1, currentSegment);
+}
+
+void test_segments_sorted_and_empty_dropped() {
+  startJsonProfile(
+      "{\"segments\":[{\"st\":20,\"et\":30,\"sp\":9,\"ep\":6},"
+      "{\"st\":4,\"et\":4,\"sp\":1,\"ep\":1},"
+      "{\"st\":0,\"et\":20,\"sp\":2,\"ep\":9}]}");
+  TEST_ASSERT_EQUAL_INT(2, totalSegments);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 5.5f, targetAt(10000));
+  TEST_ASSERT_EQUAL_INT(0, currentSegment);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 7.5f, targetAt(25000));
+  TEST_ASSERT_EQUAL_INT(1, currentSegment);
+}
+
+void test_overlap_returns_to_running_segment() {
+  // A long hold with a short bump on top: after the bump the hold is back
+  startJsonProfile(
+      "{\"segments\":[{\"st\":0,\"et\":30,\"sp\":3,\"ep\":9},"
+      "{\"st\":5,\"et\":10,\"sp\":1,\"ep\":1}]}");
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.0f, targetAt(7000));
+  TEST_ASSERT_EQUAL_INT(1, currentSegment);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 6.0f, targetAt(15000));
+  TEST_ASSERT_EQUAL_INT(0, currentSegment);
+}
+
+void test_stops_after_timeline_end() {
+  startJsonProfile("{\"segments\":[{\"st\":0,\"et\":3,\"sp\":4,\"ep\":4}]}");
+  targetAt(3000);
+  TEST_ASSERT_TRUE(isRunning);
+  targetAt(3001);
+  TEST_ASSERT_FALSE(isRunning);
+}
+
+void test_seek_moves_clock_and_segment() {
+  startJsonProfile(
+      "{\"segments\":[{\"st\":0,\"et\":10,\"sp\":2,\"ep\":2},"
+      "{\"st\":10,\"et\":20,\"sp\":8,\"ep\":8}]}");
+  targetAt(2000);
+  TEST_ASSERT_TRUE(seekProfile(15.0f));
+  TEST_ASSERT_EQUAL_UINT32(15000, profileElapsedMs());
+  TEST_ASSERT_EQUAL_INT(1, currentSegment);
+
+  // Past the end clamps to the end of the timeline
+  TEST_ASSERT_TRUE(seekProfile(60.0f));
+  TEST_ASSERT_EQUAL_UINT32(20000, profileElapsedMs());
+}
+
+int main(int argc, char** argv) {
+  halNativeUseManualClock(true);
+  halNativeSetTimeUs(0);
+  halNativeOnTransport(discardNotification, NULL);
+  halConsoleSetEnabled(false);
+  appSetup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_ramp_interpolates);
+  RUN_TEST(test_gap_holds_previous_end);
+  RUN_TEST(test_segments_sorted_and_empty_dropped);
+  RUN_TEST(test_overlap_returns_to_running_segment);
+  RUN_TEST(test_stops_after_timeline_end);
+  RUN_TEST(test_seek_moves_clock_and_segment);
+  return UNITY_END();
+}
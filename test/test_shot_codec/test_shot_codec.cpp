@@ -0,0 +1,114 @@
+// Shot codec: encode/decode round trip and malformed streams
+//   pio test -e native -f test_shot_codec
+
+#include <string.h>
+
+#include <unity.h>
+
+#include "shot_codec.h"
+
+#define SHOT_TEST_SAMPLES 3000          // 30 s at 100 Hz
+#define SHOT_TEST_CAPACITY 16384
+
+static uint8_t stream[SHOT_TEST_CAPACITY];
+static size_t streamLength = 0;
+
+static void memorySink(const uint8_t* data, size_t len, void* ctx) {
+  TEST_ASSERT_TRUE(streamLength + len <= sizeof(stream));
+  memcpy(stream + streamLength, data, len);
+  streamLength += len;
+}
+
+// Preinfusion, ramp and hold with a jittery sensor, a dim level that steps
+// and a constant-rate fire counter: every channel and a long steady run
+static ShotSample syntheticSample(int i) {
+  ShotSample sample;
+  sample.timeMs = i * 10 + (i % 97 == 0 ? 1 : 0);  // Occasional late tick
+  float t = i / 100.0f;
+  sample.targetPressure = t < 5.0f ? 2.0f : (t < 10.0f ? 2.0f + (t - 5.0f) * 1.4f : 9.0f);
+  sample.pressure = sample.targetPressure - 0.3f + ((i * 7919) % 13) * 0.01f;
+  sample.dimLevel = (uint8_t)(t < 5.0f ? 25 : (t < 10.0f ? 25 + (i / 50) % 60 : 80));
+  sample.firedCount = (uint32_t)i;
+  return sample;
+}
+
+static void encodeSynthetic(int count) {
+  streamLength = 0;
+  ShotEncoder encoder;
+  encoder.begin(memorySink, NULL);
+  for (int i = 0; i < count; i++) {
+    encoder.add(syntheticSample(i));
+  }
+  encoder.finish();
+  TEST_ASSERT_EQUAL_UINT32(count, encoder.sampleCount());
+  TEST_ASSERT_EQUAL_UINT32(streamLength, encoder.bytesWritten());
+}
+
+void setUp() {
+  streamLength = 0;
+}
+
+void tearDown() {
+}
+
+void test_round_trip() {
+  encodeSynthetic(SHOT_TEST_SAMPLES);
+
+  ShotDecoder decoder;
+  TEST_ASSERT_TRUE(decoder.begin(stream, streamLength));
+  ShotSample decoded;
+  for (int i = 0; i < SHOT_TEST_SAMPLES; i++) {
+    ShotSample expected = syntheticSample(i);
+    TEST_ASSERT_TRUE(decoder.next(decoded));
+    TEST_ASSERT_EQUAL_UINT32(expected.timeMs, decoded.timeMs);
+    TEST_ASSERT_FLOAT_WITHIN(0.0051f, expected.targetPressure, decoded.targetPressure);
+    TEST_ASSERT_FLOAT_WITHIN(0.0051f, expected.pressure, decoded.pressure);
+    TEST_ASSERT_EQUAL_UINT8(expected.dimLevel, decoded.dimLevel);
+    TEST_ASSERT_EQUAL_UINT32(expected.firedCount, decoded.firedCount);
+  }
+  TEST_ASSERT_FALSE(decoder.next(decoded));
+}
+
+void test_compresses() {
+  encodeSynthetic(SHOT_TEST_SAMPLES);
+  TEST_ASSERT_TRUE(streamLength * 4 < (size_t)SHOT_TEST_SAMPLES * SHOT_RAW_SAMPLE_SIZE);
+}
+
+void test_empty_shot() {
+  encodeSynthetic(0);
+  TEST_ASSERT_EQUAL_UINT32(SHOT_HEADER_SIZE, streamLength);
+
+  ShotDecoder decoder;
+  ShotSample decoded;
+  TEST_ASSERT_TRUE(decoder.begin(stream, streamLength));
+  TEST_ASSERT_FALSE(decoder.next(decoded));
+}
+
+void test_rejects_bad_header() {
+  encodeSynthetic(10);
+  ShotDecoder decoder;
+  TEST_ASSERT_FALSE(decoder.begin(stream, SHOT_HEADER_SIZE - 1));
+
+  stream[2] = SHOT_CODEC_VERSION + 1;
+  TEST_ASSERT_FALSE(decoder.begin(stream, streamLength));
+}
+
+void test_truncated_record() {
+  encodeSynthetic(10);  // Every sample after the first has residuals
+  ShotDecoder decoder;
+  TEST_ASSERT_TRUE(decoder.begin(stream, streamLength - 1));
+  ShotSample decoded;
+  int decodedCount = 0;
+  while (decoder.next(decoded)) decodedCount++;
+  TEST_ASSERT_TRUE(decodedCount < 10);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_compresses);
+  RUN_TEST(test_empty_shot);
+  RUN_TEST(test_rejects_bad_header);
+  RUN_TEST(test_truncated_record);
+  return UNITY_END();
+}